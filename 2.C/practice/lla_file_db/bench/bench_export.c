@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "export.h"
+#include "ingest.h"
+#include "store.h"
+
+// Listing a synthetic table (default 1M rows, or argv[2]; every 1000th row
+// deleted, every 50th address quoted in CSV), file cached. First the way
+// list_employees used to, four printf calls a record into a buffered
+// stream as stdout is when redirected, then through the exporter in each
+// format. Both write to /dev/null, so only formatting and write calls are
+// timed. Best of BENCH_RUNS each. The human output must match the printf
+// output byte for byte, and the CSV must load back through ingest_csv to
+// the same listing.
+#define BENCH_ROWS 1000000ULL
+#define BENCH_RUNS 3
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void remove_db(char *path) {
+    size_t len = strlen(path);
+    unlink(path);
+    snprintf(path + len, 8, ".wal");
+    unlink(path);
+    snprintf(path + len, 8, ".idx");
+    unlink(path);
+    path[len] = '\0';
+}
+
+static int build(char *path, unsigned long long rows) {
+    static const char *first[] = {"Alice", "Bartholomew", "Chen", "Dmitri", "Eve", "Fatima", "Gustavo", "Hiro"};
+    struct dbstore_t *store = NULL;
+    struct dbbatch_t *batch = NULL;
+    char name[64], address[64];
+    int failed = store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS ||
+                 store_batch_begin(store, &batch) != STATUS_SUCCESS;
+    for (unsigned long long i = 0; i < rows && !failed; i++) {
+        int namelen = i % 1000 == 999 ? 0 : snprintf(name, sizeof(name), "%s Employee%llu", first[i % 8], i);
+        int addresslen = snprintf(address, sizeof(address), i % 50 ? "%llu Main Street" : "%llu Main St, \"Rear\"",
+                                  i % 997 + 1);
+        unsigned int hours = (unsigned int)((i * 0x9e3779b97f4a7c15ULL) >> 40) % 100000;
+        failed = store_batch_add(batch, name, namelen, address, addresslen, hours) != STATUS_SUCCESS;
+    }
+    failed = failed || store_batch_commit(batch) != STATUS_SUCCESS;
+    store_close(store);
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+// list_employees before the exporter
+static void printf_employees(struct dbstore_t *store, FILE *out) {
+    for (unsigned int i = 0; i < store->header.count; i++) {
+        struct record_t employee;
+        if (store_record(store, i, &employee) != STATUS_SUCCESS) {
+            return;
+        }
+        if (!RECORD_DELETED(&employee)) {
+            fprintf(out, "Employee %u\n", i);
+            fprintf(out, "\tName: %.*s\n", (int)employee.namelen, employee.name);
+            fprintf(out, "\tAddress: %.*s\n", (int)employee.addresslen, employee.address);
+            fprintf(out, "\tHours: %u\n", employee.hours);
+        }
+    }
+}
+
+static double best_printf(struct dbstore_t *store) {
+    double best = 1e9;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        FILE *out = fopen("/dev/null", "w");
+        if (out == NULL) {
+            return -1;
+        }
+        double start = now_seconds();
+        printf_employees(store, out);
+        fclose(out);
+        double elapsed = now_seconds() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+static double best_export(struct dbstore_t *store, int format) {
+    double best = 1e9;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        int fd = open("/dev/null", O_WRONLY);
+        double start = now_seconds();
+        int status = fd == -1 ? STATUS_ERROR : export_employees(store, fd, format);
+        double elapsed = now_seconds() - start;
+        if (fd != -1) {
+            close(fd);
+        }
+        if (status != STATUS_SUCCESS) {
+            return -1;
+        }
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+// Exports store to path (or printf-lists it) and returns the file's size,
+// or -1
+static long long export_to(struct dbstore_t *store, const char *path, int format, int use_printf) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    int status = STATUS_SUCCESS;
+    if (use_printf) {
+        FILE *out = fdopen(dup(fd), "w");
+        if (out == NULL) {
+            status = STATUS_ERROR;
+        } else {
+            printf_employees(store, out);
+            status = fclose(out) == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+        }
+    } else {
+        status = export_employees(store, fd, format);
+    }
+    struct stat st;
+    long long size = status == STATUS_SUCCESS && fstat(fd, &st) == 0 ? st.st_size : -1;
+    close(fd);
+    return size;
+}
+
+static int same_files(const char *a, const char *b) {
+    FILE *fa = fopen(a, "r");
+    FILE *fb = fopen(b, "r");
+    int same = fa != NULL && fb != NULL;
+    static char bufa[1 << 16], bufb[1 << 16];
+    while (same) {
+        size_t na = fread(bufa, 1, sizeof(bufa), fa);
+        size_t nb = fread(bufb, 1, sizeof(bufb), fb);
+        same = na == nb && memcmp(bufa, bufb, na) == 0;
+        if (na == 0) {
+            break;
+        }
+    }
+    if (fa != NULL) {
+        fclose(fa);
+    }
+    if (fb != NULL) {
+        fclose(fb);
+    }
+    return same;
+}
+
+// Loads the CSV at csvpath into a new database at path and exports that
+// as CSV again to outpath
+static int reload_csv(char *path, const char *csvpath, const char *outpath) {
+    struct dbstore_t *store = NULL;
+    struct ingest_stats_t stats = {0};
+    int fd = open(csvpath, O_RDONLY);
+    int failed = fd == -1 || store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS ||
+                 ingest_csv(store, fd, &stats) != STATUS_SUCCESS || stats.skipped != 0 ||
+                 export_to(store, outpath, EXPORT_CSV, 0) < 0;
+    if (fd != -1) {
+        close(fd);
+    }
+    store_close(store);
+    remove_db(path);
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    unsigned long long rows = argc > 2 ? strtoull(argv[2], NULL, 10) : BENCH_ROWS;
+    char path[512], copy[512], first[512], second[512];
+    snprintf(path, sizeof(path), "%s/bench_export_%d.db", dir, (int)getpid());
+    snprintf(copy, sizeof(copy), "%s/bench_export_%d_copy.db", dir, (int)getpid());
+    snprintf(first, sizeof(first), "%s/bench_export_%d.1", dir, (int)getpid());
+    snprintf(second, sizeof(second), "%s/bench_export_%d.2", dir, (int)getpid());
+    struct dbstore_t *store = NULL;
+    int failed = build(path, rows) != STATUS_SUCCESS || store_open(path, &store) != STATUS_SUCCESS;
+
+    long long sizes[4] = {0};
+    long long printf_size = failed ? -1 : export_to(store, first, 0, 1);
+    sizes[EXPORT_HUMAN] = failed ? -1 : export_to(store, second, EXPORT_HUMAN, 0);
+    failed = failed || printf_size < 0 || sizes[EXPORT_HUMAN] != printf_size || !same_files(first, second);
+    if (!failed) {
+        sizes[EXPORT_CSV] = export_to(store, first, EXPORT_CSV, 0);
+        failed = sizes[EXPORT_CSV] < 0 || reload_csv(copy, first, second) != STATUS_SUCCESS ||
+                 !same_files(first, second);
+    }
+    for (int format = EXPORT_NDJSON; format <= EXPORT_BINARY && !failed; format++) {
+        sizes[format] = export_to(store, first, format, 0);
+        failed = sizes[format] < 0;
+    }
+    unlink(first);
+    unlink(second);
+
+    double printf_time = failed ? -1 : best_printf(store);
+    failed = failed || printf_time < 0;
+    if (!failed) {
+        printf("%llu rows (%s), checked: human matches printf, CSV loads back the same\n", rows, dir);
+        printf("%-24s %8.1f ms  %7.2f Mrow/s  %7.1f MB/s\n", "printf, 4 calls a record", printf_time * 1e3,
+               rows / printf_time / 1e6, printf_size / printf_time / 1e6);
+    }
+    static const char *names[] = {"human", "csv", "ndjson", "binary"};
+    for (int format = EXPORT_HUMAN; format <= EXPORT_BINARY && !failed; format++) {
+        double seconds = best_export(store, format);
+        failed = seconds < 0;
+        if (!failed) {
+            char label[64];
+            snprintf(label, sizeof(label), "export %s", names[format]);
+            printf("%-24s %8.1f ms  %7.2f Mrow/s  %7.1f MB/s  (%.1fx)\n", label, seconds * 1e3, rows / seconds / 1e6,
+                   sizes[format] / seconds / 1e6, printf_time / seconds);
+        }
+    }
+    store_close(store);
+    remove_db(path);
+    if (failed) {
+        printf("bench_export failed\n");
+    }
+    return failed;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "parse.h"
+#include "store.h"
+
+// The same 65k employees with typical names and addresses in a version 1
+// file and after migrating it to the current version: file size, then
+// scans touching only hours (the sum) and whole rows (name lengths plus
+// hours). Cold runs drop the file from the page cache first, so they pay
+// for every byte read.
+#define BENCH_RECORDS 65000
+#define BENCH_ROUNDS  50
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_cache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static unsigned long long scan_hours(struct dbstore_t *store) {
+    unsigned long long sum = 0;
+    unsigned int rows;
+    if (store->header.version != DB_VERSION_FIXED) {
+        for (unsigned int i = 0; i < store->header.count; i += rows) {
+            const unsigned int *column = store_hours_column(store, i, &rows);
+            for (unsigned int r = 0; r < rows; r++) {
+                sum += ntohl(column[r]);
+            }
+        }
+        return sum;
+    }
+    // Version 1: one 4-byte field every 516 bytes
+    const struct employee_t *employees = (const struct employee_t *)(store->map + sizeof(struct dbheader_t));
+    for (unsigned int i = 0; i < store->header.count; i++) {
+        sum += EMPLOYEE_HOURS(&employees[i]);
+    }
+    return sum;
+}
+
+static unsigned long long scan_rows(struct dbstore_t *store) {
+    unsigned long long sum = 0;
+    struct record_t record;
+    for (unsigned int i = 0; store_record(store, i, &record) == STATUS_SUCCESS; i++) {
+        sum += record.namelen + record.hours;
+    }
+    return sum;
+}
+
+struct timings_t {
+    double hours, rows, cold_hours, cold_rows;
+    unsigned long long check;
+};
+
+static int time_scans(char *path, struct timings_t *t) {
+    struct dbstore_t *store = NULL;
+    if (store_open(path, &store) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    double start = now_seconds();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        t->check += scan_hours(store);
+    }
+    t->hours = (now_seconds() - start) / BENCH_ROUNDS;
+    start = now_seconds();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        t->check += scan_rows(store);
+    }
+    t->rows = (now_seconds() - start) / BENCH_ROUNDS;
+    store_close(store);
+
+    // Cold: open and scan once, straight after dropping the cache
+    for (int which = 0; which < 2; which++) {
+        drop_cache(path);
+        start = now_seconds();
+        store = NULL;
+        if (store_open(path, &store) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        t->check += which ? scan_rows(store) : scan_hours(store);
+        *(which ? &t->cold_rows : &t->cold_hours) = now_seconds() - start;
+        store_close(store);
+    }
+    return STATUS_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_format_%d.db", dir, (int)getpid());
+
+    static const char *first[] = {"Alice", "Bartholomew", "Chen", "Dmitri", "Eve", "Fatima", "Gustavo", "Hiro"};
+    static const char *streets[] = {"Main Street", "Elm Avenue", "Harbour Road", "Old Mill Lane"};
+    struct dbstore_t *store = NULL;
+    if (store_create(path, DB_VERSION_FIXED, &store) != STATUS_SUCCESS) {
+        return 1;
+    }
+    struct employee_t employee;
+    int failed = 0;
+    for (int i = 0; i < BENCH_RECORDS && !failed; i++) {
+        memset(&employee, 0, sizeof(employee));
+        snprintf(employee.name, sizeof(employee.name), "%s Employee%d", first[i % 8], i);
+        snprintf(employee.address, sizeof(employee.address), "%d %s, Springfield", i % 997 + 1, streets[i % 4]);
+        employee.hours = htonl(i % 2000);
+        failed = write_all(store->fd, &employee, sizeof(employee), RECORD_OFFSET(i)) != STATUS_SUCCESS;
+    }
+    // Fix the header through one last append; the index is rebuilt if used
+    store->header.count = BENCH_RECORDS - 1;
+    employee.hours = ntohl(employee.hours);
+    failed = failed || store_append_employee(store, &employee) != STATUS_SUCCESS;
+    size_t v1_size = store->header.filesize;
+    store_close(store);
+    snprintf(path + strlen(path), 8, ".idx");
+    unlink(path);
+    path[strlen(path) - 4] = '\0';
+
+    struct timings_t v1 = {0}, migrated = {0};
+    unsigned int version = 0;
+    failed = failed || time_scans(path, &v1) != STATUS_SUCCESS;
+
+    store = NULL;
+    double start = now_seconds();
+    failed = failed || store_open(path, &store) != STATUS_SUCCESS ||
+             store_rewrite(store, store->header.count) != STATUS_SUCCESS;
+    double migrate = now_seconds() - start;
+    size_t new_size = store ? store->header.filesize : 0;
+    version = store ? store->header.version : 0;
+    store_close(store);
+    failed = failed || time_scans(path, &migrated) != STATUS_SUCCESS;
+
+    if (!failed && v1.check == migrated.check) {
+        printf("%d records (%s), migrated in %.1f ms\n", BENCH_RECORDS, dir, migrate * 1e3);
+        printf("           size      hours scan        row scan   cold hours   cold rows\n");
+        printf("v1   %7.2f MB  %8.1f Mrow/s  %8.1f Mrow/s  %8.2f ms  %8.2f ms\n", v1_size / 1e6,
+               BENCH_RECORDS / v1.hours / 1e6, BENCH_RECORDS / v1.rows / 1e6, v1.cold_hours * 1e3,
+               v1.cold_rows * 1e3);
+        printf("v%u   %7.2f MB  %8.1f Mrow/s  %8.1f Mrow/s  %8.2f ms  %8.2f ms\n", version, new_size / 1e6,
+               BENCH_RECORDS / migrated.hours / 1e6, BENCH_RECORDS / migrated.rows / 1e6,
+               migrated.cold_hours * 1e3, migrated.cold_rows * 1e3);
+        printf("v%u is %.1fx smaller\n", version, (double)v1_size / new_size);
+    } else {
+        printf("bench_format failed\n");
+        failed = 1;
+    }
+    unlink(path);
+    size_t len = strlen(path);
+    snprintf(path + len, sizeof(path) - len, ".wal");
+    unlink(path);
+    snprintf(path + len, sizeof(path) - len, ".idx");
+    unlink(path);
+    return failed;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "index.h"
+#include "parse.h"
+#include "store.h"
+
+// Lookups on a 60k-record database: by hours, by name and a 100-wide hours
+// range, each through the sidecar index and by walking the mapping. Then a
+// bare index with 2M keys to show how insert and lookup hold up as it grows.
+#define BENCH_RECORDS 60000
+#define BENCH_LOOKUPS 2000
+#define BENCH_SCANS   50
+#define BENCH_KEYS    2000000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int count_record(unsigned int record, void *arg) {
+    (void)record;
+    (*(long *)arg)++;
+    return 0;
+}
+
+static void remove_db(char *path) {
+    size_t len = strlen(path);
+    unlink(path);
+    snprintf(path + len, 8, ".wal");
+    unlink(path);
+    snprintf(path + len, 8, ".idx");
+    unlink(path);
+    path[len] = '\0';
+}
+
+// A permutation of 0..n-1, so the tree isn't just filled left to right
+static unsigned int scatter(unsigned int i, unsigned int n) {
+    return (unsigned int)(i * 2654435761ull % n);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_index_%d.db", dir, (int)getpid());
+
+    struct dbstore_t *store = NULL;
+    if (store_create(path, DB_VERSION_FIXED, &store) != STATUS_SUCCESS) {
+        return 1;
+    }
+    struct employee_t employee = {0};
+    for (int i = 0; i < BENCH_RECORDS - 1; i++) {
+        snprintf(employee.name, sizeof(employee.name), "Employee %d", i);
+        snprintf(employee.address, sizeof(employee.address), "%d Main Street", i);
+        employee.hours = htonl(scatter(i, BENCH_RECORDS));
+        write_all(store->fd, &employee, sizeof(employee), RECORD_OFFSET(i));
+    }
+    store->header.count = BENCH_RECORDS - 1;
+    employee.hours = scatter(BENCH_RECORDS - 1, BENCH_RECORDS);
+    int failed = store_append_employee(store, &employee) != STATUS_SUCCESS;
+    store_close(store);
+
+    // The bulk fill went around the index; without a sidecar first use rebuilds it
+    snprintf(path + strlen(path), 8, ".idx");
+    unlink(path);
+    path[strlen(path) - 4] = '\0';
+    store = NULL;
+    failed = failed || store_open(path, &store) != STATUS_SUCCESS;
+    double start = now_seconds();
+    failed = failed || store_index(store) == NULL;
+    double build = now_seconds() - start;
+
+    long found = 0;
+    double hours_index = 0, hours_scan = 0, name_index = 0, name_scan = 0, range_index = 0, range_scan = 0;
+    char name[256];
+    for (int i = 0; i < BENCH_LOOKUPS && !failed; i++) {
+        unsigned int record = (unsigned int)(i * 7919) % BENCH_RECORDS;
+        unsigned int hours = scatter(record, BENCH_RECORDS);
+        double t0 = now_seconds();
+        index_range_hours(store->index, hours, hours, count_record, &found);
+        hours_index += now_seconds() - t0;
+
+        memset(name, 0, sizeof(name));
+        snprintf(name, sizeof(name), "Employee %u", record);
+        t0 = now_seconds();
+        index_find_name(store->index, name, count_record, &found);
+        name_index += now_seconds() - t0;
+
+        t0 = now_seconds();
+        index_range_hours(store->index, hours, hours + 99, count_record, &found);
+        range_index += now_seconds() - t0;
+    }
+    for (int i = 0; i < BENCH_SCANS && !failed; i++) {
+        unsigned int record = (unsigned int)(i * 7919) % BENCH_RECORDS;
+        unsigned int hours = scatter(record, BENCH_RECORDS);
+        memset(name, 0, sizeof(name));
+        snprintf(name, sizeof(name), "Employee %u", record);
+
+        struct record_t row;
+        double t0 = now_seconds();
+        for (unsigned int r = 0; store_record(store, r, &row) == STATUS_SUCCESS; r++) {
+            found += row.hours == hours;
+        }
+        double t1 = now_seconds();
+        for (unsigned int r = 0; store_record(store, r, &row) == STATUS_SUCCESS; r++) {
+            found += strncmp(row.name, name, row.namelen) == 0 && name[row.namelen] == '\0';
+        }
+        double t2 = now_seconds();
+        for (unsigned int r = 0; store_record(store, r, &row) == STATUS_SUCCESS; r++) {
+            found += row.hours >= hours && row.hours <= hours + 99;
+        }
+        double t3 = now_seconds();
+        hours_scan += t1 - t0;
+        name_scan += t2 - t1;
+        range_scan += t3 - t2;
+    }
+    store_close(store);
+    remove_db(path);
+
+    // A bare index, grown one key at a time
+    snprintf(path, sizeof(path), "%s/bench_index_%d.idx", dir, (int)getpid());
+    struct dbindex_t *index = NULL;
+    int rebuild = 0;
+    failed = failed || index_open(path, 0, &index, &rebuild) != STATUS_SUCCESS;
+    start = now_seconds();
+    for (unsigned int i = 0; i < BENCH_KEYS && !failed; i++) {
+        memset(name, 0, 16);
+        snprintf(name, 16, "E%u", i);
+        failed = index_insert(index, i, name, scatter(i, BENCH_KEYS)) != STATUS_SUCCESS;
+    }
+    double insert = now_seconds() - start;
+    long big_found = 0;
+    start = now_seconds();
+    for (unsigned int i = 0; i < BENCH_LOOKUPS && !failed; i++) {
+        unsigned int key = (i * 7919) % BENCH_KEYS;
+        memset(name, 0, 16);
+        snprintf(name, 16, "E%u", key);
+        index_find_name(index, name, count_record, &big_found);
+        index_range_hours(index, key, key, count_record, &big_found);
+    }
+    double big_lookup = (now_seconds() - start) / BENCH_LOOKUPS;
+    size_t big_size = index ? (size_t)INDEX_HEADER(index)->page_count * INDEX_PAGE_SIZE : 0;
+    index_close(index);
+    unlink(path);
+
+    if (!failed && found >= 2L * BENCH_LOOKUPS && big_found == 2 * BENCH_LOOKUPS) {
+        printf("%d records (%s), index built on first use in %.1f ms\n", BENCH_RECORDS, dir, build * 1e3);
+        printf("                 index          scan\n");
+        printf("by hours     %9.2f us  %9.1f us\n", hours_index / BENCH_LOOKUPS * 1e6, hours_scan / BENCH_SCANS * 1e6);
+        printf("by name      %9.2f us  %9.1f us\n", name_index / BENCH_LOOKUPS * 1e6, name_scan / BENCH_SCANS * 1e6);
+        printf("hours range  %9.2f us  %9.1f us  (100 wide)\n", range_index / BENCH_LOOKUPS * 1e6,
+               range_scan / BENCH_SCANS * 1e6);
+        printf("%d keys: %.0f ns/insert, %.2f us per name + hours lookup, %.1f MB\n", BENCH_KEYS,
+               insert / BENCH_KEYS * 1e9, big_lookup * 1e6, big_size / 1e6);
+    } else {
+        printf("bench_index failed\n");
+        failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ingest.h"
+#include "parse.h"
+#include "store.h"
+
+// Loading employees from CSV (default 1M rows, or argv[2]) through one
+// batch, against the tokenizer on its own and against one transaction per
+// row, which is what a process per -a amounts to before its own startup.
+// Then the first lookup, which rebuilds the index in one pass.
+#define BENCH_ROWS    1000000ULL
+#define BENCH_APPENDS 1000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void remove_db(char *path) {
+    size_t len = strlen(path);
+    unlink(path);
+    snprintf(path + len, 8, ".wal");
+    unlink(path);
+    snprintf(path + len, 8, ".idx");
+    unlink(path);
+    path[len] = '\0';
+}
+
+static const char *streets[] = {"Main Street", "Elm Avenue", "Harbour Road", "Old Mill Lane"};
+
+static int write_csv(const char *path, unsigned long long rows) {
+    static const char *first[] = {"Alice", "Bartholomew", "Chen", "Dmitri", "Eve", "Fatima", "Gustavo", "Hiro"};
+    FILE *csv = fopen(path, "w");
+    if (csv == NULL) {
+        return STATUS_ERROR;
+    }
+    fprintf(csv, "name,address,hours\n");
+    for (unsigned long long i = 0; i < rows; i++) {
+        // Every other address has a comma, so it is quoted
+        if (i % 2) {
+            fprintf(csv, "%s Employee%llu,\"%llu %s, Springfield\",%llu\n", first[i % 8], i, i % 997 + 1,
+                    streets[i % 4], i % 2000);
+        } else {
+            fprintf(csv, "%s Employee%llu,%llu %s,%llu\n", first[i % 8], i, i % 997 + 1, streets[i % 4], i % 2000);
+        }
+    }
+    return fclose(csv) == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+// The tokenizer alone over the whole file in memory
+static double time_split(const char *path, unsigned long long *rowsOut) {
+    int fd = open(path, O_RDONLY);
+    off_t size = fd == -1 ? 0 : lseek(fd, 0, SEEK_END);
+    char *text = malloc(size > 0 ? size : 1);
+    if (fd == -1 || text == NULL || read_all(fd, text, size, 0) != STATUS_SUCCESS) {
+        free(text);
+        if (fd != -1) {
+            close(fd);
+        }
+        return 0;
+    }
+    close(fd);
+    double start = now_seconds();
+    struct csvfield_t fields[3];
+    unsigned long long rows = 0;
+    for (char *p = text, *end = text + size; p < end;) {
+        char *newline = memchr(p, '\n', end - p);
+        rows += csv_split(p, newline - p, fields, 3) == 3;
+        p = newline + 1;
+    }
+    double elapsed = now_seconds() - start;
+    free(text);
+    *rowsOut = rows;
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    unsigned long long rows = argc > 2 ? strtoull(argv[2], NULL, 10) : BENCH_ROWS;
+    char csvpath[512], path[512];
+    snprintf(csvpath, sizeof(csvpath), "%s/bench_ingest_%d.csv", dir, (int)getpid());
+    snprintf(path, sizeof(path), "%s/bench_ingest_%d.db", dir, (int)getpid());
+    int failed = write_csv(csvpath, rows) != STATUS_SUCCESS;
+
+    unsigned long long split_rows = 0;
+    double split = failed ? 0 : time_split(csvpath, &split_rows);
+    failed = failed || split_rows != rows + 1;
+
+    // Cached input, as a pipe from another process would be
+    struct dbstore_t *store = NULL;
+    struct ingest_stats_t stats = {0};
+    int fd = open(csvpath, O_RDONLY);
+    failed = failed || fd == -1 || store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS;
+    double start = now_seconds();
+    failed = failed || ingest_csv(store, fd, &stats) != STATUS_SUCCESS;
+    double load = now_seconds() - start;
+    if (fd != -1) {
+        close(fd);
+    }
+    failed = failed || stats.rows != rows || stats.skipped != 0 || store->header.count != rows;
+
+    // Spot checks, quoted and not
+    char want[128];
+    for (unsigned long long i = rows / 2; i < rows / 2 + 2 && !failed; i++) {
+        struct record_t record;
+        snprintf(want, sizeof(want), i % 2 ? "%llu %s, Springfield" : "%llu %s", i % 997 + 1, streets[i % 4]);
+        failed = store_record(store, i, &record) != STATUS_SUCCESS || record.addresslen != strlen(want) ||
+                 memcmp(record.address, want, record.addresslen) != 0 || record.hours != i % 2000;
+    }
+    start = now_seconds();
+    failed = failed || store_index(store) == NULL;
+    double reindex = now_seconds() - start;
+    unsigned long long filesize = store ? store->header.filesize : 0;
+    store_close(store);
+    remove_db(path);
+
+    // One WAL transaction per row
+    store = NULL;
+    failed = failed || store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS;
+    struct employee_t employee = {.hours = 40};
+    start = now_seconds();
+    for (int i = 0; i < BENCH_APPENDS && !failed; i++) {
+        snprintf(employee.name, sizeof(employee.name), "Employee %d", i);
+        snprintf(employee.address, sizeof(employee.address), "%d Main Street", i);
+        failed = store_append_employee(store, &employee) != STATUS_SUCCESS;
+    }
+    double appends = now_seconds() - start;
+    store_close(store);
+    remove_db(path);
+    unlink(csvpath);
+
+    if (!failed) {
+        printf("%llu rows, %.1f MB of CSV (%s), database %.1f MB\n", rows, stats.bytes / 1e6, dir, filesize / 1e6);
+        printf("csv_split only       %7.2f Mrow/s  %7.1f MB/s\n", rows / split / 1e6, stats.bytes / split / 1e6);
+        printf("ingest_csv batch     %7.2f Mrow/s  %7.1f MB/s  (%.2f s, one commit)\n", rows / load / 1e6,
+               stats.bytes / load / 1e6, load);
+        printf("append per row       %7.4f Mrow/s  (%.0f rows/s, 1 fdatasync each)\n", BENCH_APPENDS / appends / 1e6,
+               BENCH_APPENDS / appends);
+        printf("batch is %.0fx faster; index rebuilt on first lookup in %.2f s\n",
+               (rows / load) / (BENCH_APPENDS / appends), reindex);
+    } else {
+        printf("bench_ingest failed\n");
+        failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "pagecrc.h"
+#include "parse.h"
+#include "store.h"
+
+// A synthetic version 3 database far past the old 65,535-row and 4 GB
+// limits: rows (default 10M, pass 100000000 for the big run) with short
+// names and addresses, written straight into the segment layout with its
+// page checksums. Then the store opens it, which checks every page, scans
+// the hours of every row, reads random records and appends at the end. The index stays off: building it for every row is
+// a separate cost (see bench_index).
+#define BENCH_ROWS    10000000ULL
+#define BENCH_READS   1000000
+#define BENCH_APPENDS 100
+#define CHUNK_ROWS    65536
+#define STRING_BUF    (4 << 20)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int bench_hours(unsigned long long i) {
+    return (unsigned int)(i * 2654435761ULL % 4000);
+}
+
+// Decimal digits of n at p, no terminator; returns the length
+static unsigned int put_digits(char *p, unsigned long long n) {
+    char tmp[20];
+    unsigned int len = 0;
+    do {
+        tmp[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    for (unsigned int i = 0; i < len; i++) {
+        p[i] = tmp[len - 1 - i];
+    }
+    return len;
+}
+
+// "E<i>\0<i % 9973> Main St\0"
+static unsigned int put_strings(char *p, unsigned long long i, unsigned int *namelen, unsigned int *addresslen) {
+    p[0] = 'E';
+    *namelen = 1 + put_digits(p + 1, i);
+    p[*namelen] = '\0';
+    char *address = p + *namelen + 1;
+    *addresslen = put_digits(address, i % 9973 + 1);
+    memcpy(address + *addresslen, " Main St", 8);
+    *addresslen += 8;
+    address[*addresslen] = '\0';
+    return *namelen + *addresslen + 2;
+}
+
+static int generate(const char *path, unsigned long long rows) {
+    struct dbheader64_t header = {.magic = HEADER_MAGIC, .version = DB_VERSION_LARGE, .count = rows};
+    unsigned long long end = DB_PAGE_SIZE;
+    while (SEGMENT_FIRST(header.segment_count) < rows) {
+        header.segments[header.segment_count] = end;
+        end += SEGMENT_SIZE(header.segment_count);
+        header.segment_count++;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    unsigned long long *names = malloc(CHUNK_ROWS * sizeof(unsigned long long));
+    unsigned long long *addresses = malloc(CHUNK_ROWS * sizeof(unsigned long long));
+    unsigned int *hours = malloc(CHUNK_ROWS * sizeof(unsigned int));
+    char *strings = malloc(STRING_BUF);
+    int status = fd != -1 && names && addresses && hours && strings ? STATUS_SUCCESS : STATUS_ERROR;
+    unsigned long long strings_at = end;
+    size_t used = 0;
+    for (unsigned long long i = 0; status == STATUS_SUCCESS && i < rows;) {
+        int k = SEGMENT_OF(i);
+        unsigned long long row = i - SEGMENT_FIRST(k);
+        unsigned long long n = SEGMENT_ROWS(k) - row;
+        if (n > CHUNK_ROWS) {
+            n = CHUNK_ROWS;
+        }
+        if (n > rows - i) {
+            n = rows - i;
+        }
+        for (unsigned long long r = 0; r < n; r++) {
+            if (used + 64 > STRING_BUF) {
+                status = write_all(fd, strings, used, strings_at);
+                strings_at += used;
+                used = 0;
+            }
+            unsigned int namelen, addresslen;
+            unsigned int len = put_strings(strings + used, i + r, &namelen, &addresslen);
+            names[r] = htobe64(STRREF64(strings_at + used, namelen));
+            addresses[r] = htobe64(STRREF64(strings_at + used + namelen + 1, addresslen));
+            hours[r] = htonl(bench_hours(i + r));
+            used += len;
+        }
+        unsigned long long base = header.segments[k];
+        unsigned long long refs = SEGMENT_ROWS(k) * sizeof(unsigned long long);
+        if (status == STATUS_SUCCESS) {
+            status = write_all(fd, names, n * 8, base + row * 8);
+        }
+        if (status == STATUS_SUCCESS) {
+            status = write_all(fd, addresses, n * 8, base + refs + row * 8);
+        }
+        if (status == STATUS_SUCCESS) {
+            status = write_all(fd, hours, n * 4, base + 2 * refs + row * 4);
+        }
+        i += n;
+    }
+    if (status == STATUS_SUCCESS) {
+        status = write_all(fd, strings, used, strings_at);
+    }
+    header.filesize = strings_at + used;
+    if (status == STATUS_SUCCESS) {
+        status = pagecrc_build(fd, &header);
+    }
+    struct dbheader64_t disk;
+    size_t disklen = header_to_disk(&header, &disk);
+    if (status == STATUS_SUCCESS) {
+        status = write_all(fd, &disk, disklen, 0);
+    }
+    if (status == STATUS_SUCCESS && (ftruncate(fd, header.filesize) == -1 || fdatasync(fd) == -1)) {
+        status = STATUS_ERROR;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    free(names);
+    free(addresses);
+    free(hours);
+    free(strings);
+    return status;
+}
+
+static double scan_hours(struct dbstore_t *store, unsigned long long *sumOut) {
+    double start = now_seconds();
+    unsigned long long sum = 0;
+    unsigned int rows;
+    for (unsigned long long i = 0; i < store->header.count; i += rows) {
+        const unsigned int *column = store_hours_column(store, i, &rows);
+        for (unsigned int r = 0; r < rows; r++) {
+            sum += ntohl(column[r]);
+        }
+    }
+    *sumOut = sum;
+    return now_seconds() - start;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    unsigned long long rows = argc > 2 ? strtoull(argv[2], NULL, 10) : BENCH_ROWS;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_large_%d.db", dir, (int)getpid());
+
+    double start = now_seconds();
+    int failed = rows == 0 || rows > STORE_MAX_ROWS_LARGE || generate(path, rows) != STATUS_SUCCESS;
+    double build = now_seconds() - start;
+
+    struct dbstore_t *store = NULL;
+    start = now_seconds();
+    failed = failed || store_open(path, &store) != STATUS_SUCCESS;
+    double open_time = now_seconds() - start;
+
+    unsigned long long expected = 0, first_sum = 0, second_sum = 0;
+    for (unsigned long long i = 0; i < rows; i++) {
+        expected += bench_hours(i);
+    }
+    double first = 0, second = 0;
+    if (!failed) {
+        first = scan_hours(store, &first_sum);
+        second = scan_hours(store, &second_sum);
+        failed = first_sum != expected || second_sum != expected;
+    }
+
+    // Random rows, checked against what the generator wrote
+    char want[64];
+    unsigned long long seed = 88172645463325252ULL;
+    start = now_seconds();
+    for (int n = 0; n < BENCH_READS && !failed; n++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        unsigned long long i = seed % rows;
+        struct record_t record;
+        unsigned int namelen, addresslen;
+        put_strings(want, i, &namelen, &addresslen);
+        failed = store_record(store, i, &record) != STATUS_SUCCESS || record.namelen != namelen ||
+                 memcmp(record.name, want, namelen) != 0 || record.hours != bench_hours(i);
+    }
+    double reads = (now_seconds() - start) / BENCH_READS;
+
+    // Skip the index, as after an index error
+    if (store) {
+        store->index_failed = 1;
+    }
+    struct employee_t employee = {.hours = 7};
+    start = now_seconds();
+    for (int n = 0; n < BENCH_APPENDS && !failed; n++) {
+        snprintf(employee.name, sizeof(employee.name), "Appended %d", n);
+        snprintf(employee.address, sizeof(employee.address), "%d Late Street", n);
+        failed = store_append_employee(store, &employee) != STATUS_SUCCESS;
+    }
+    double appends = (now_seconds() - start) / BENCH_APPENDS;
+    struct record_t last;
+    failed = failed || store_record(store, rows + BENCH_APPENDS - 1, &last) != STATUS_SUCCESS ||
+             strncmp(last.name, "Appended 99", last.namelen) != 0;
+    unsigned long long filesize = store ? store->header.filesize : 0;
+    unsigned int segments = store ? store->header.segment_count : 0;
+    store_close(store);
+
+    if (!failed) {
+        printf("%llu rows (%s): %.2f GB in %u segments, %.1f bytes/row\n", rows, dir, filesize / 1e9, segments,
+               (double)filesize / rows);
+        printf("generate         %8.1f s    %6.2f Mrow/s\n", build, rows / build / 1e6);
+        printf("store_open       %8.2f ms   (%.2f GB/s checked)\n", open_time * 1e3, filesize / open_time / 1e9);
+        printf("hours scan       %8.2f s    %6.1f Mrow/s first pass, %.1f Mrow/s again\n", first, rows / first / 1e6,
+               rows / second / 1e6);
+        printf("random record    %8.2f us\n", reads * 1e6);
+        printf("append           %8.1f us   (WAL, 1 fdatasync each)\n", appends * 1e6);
+    } else {
+        printf("bench_large failed\n");
+        failed = 1;
+    }
+    unlink(path);
+    size_t len = strlen(path);
+    snprintf(path + len, sizeof(path) - len, ".wal");
+    unlink(path);
+    return failed;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "parse.h"
+#include "store.h"
+
+// Scanning a full 60k-record (31 MB) database for a missing hours value:
+// read_employees (heap copy, byte-swap every record) against walking the
+// mapping and converting hours as they are compared.
+#define BENCH_RECORDS 60000
+#define BENCH_ROUNDS  20
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_mmap_%d.db", dir, (int)getpid());
+
+    struct dbstore_t *store = NULL;
+    if (store_create(path, DB_VERSION_FIXED, &store) != STATUS_SUCCESS) {
+        return 1;
+    }
+    struct employee_t employee = {0};
+    for (int i = 0; i < BENCH_RECORDS - 1; i++) {
+        snprintf(employee.name, sizeof(employee.name), "Employee %d", i);
+        snprintf(employee.address, sizeof(employee.address), "%d Main Street", i);
+        employee.hours = htonl(i);
+        write_all(store->fd, &employee, sizeof(employee), RECORD_OFFSET(i));
+        if (index_insert(store->index, i, employee.name, i) != STATUS_SUCCESS) {
+            return 1;
+        }
+    }
+    store->header.count = BENCH_RECORDS - 1;
+    employee.hours = BENCH_RECORDS - 1;
+    int failed = store_append_employee(store, &employee) != STATUS_SUCCESS;
+
+    store_close(store);
+
+    // Each round opens the database like a CLI run would
+    unsigned int missing = BENCH_RECORDS * 2;
+    long found = 0;
+    double first_heap = 0, first_map = 0;
+    double start = now_seconds();
+    for (int round = 0; round < BENCH_ROUNDS && !failed; round++) {
+        struct employee_t *employees = NULL;
+        store = NULL;
+        double t0 = now_seconds();
+        failed = store_open(path, &store) != STATUS_SUCCESS ||
+                 read_employees(store->fd, &store->header, &employees) != STATUS_SUCCESS;
+        first_heap += now_seconds() - t0;
+        for (unsigned int i = 0; !failed && i < store->header.count; i++) {
+            found += employees[i].hours == missing;
+        }
+        free(employees);
+        store_close(store);
+    }
+    double heap = (now_seconds() - start) / BENCH_ROUNDS;
+
+    start = now_seconds();
+    for (int round = 0; round < BENCH_ROUNDS && !failed; round++) {
+        store = NULL;
+        double t0 = now_seconds();
+        struct record_t record;
+        failed = store_open(path, &store) != STATUS_SUCCESS || store_record(store, 0, &record) != STATUS_SUCCESS;
+        first_map += now_seconds() - t0;
+        for (unsigned int i = 0; !failed && store_record(store, i, &record) == STATUS_SUCCESS; i++) {
+            found += record.hours == missing;
+        }
+        if (round < BENCH_ROUNDS - 1) {
+            store_close(store);
+        }
+    }
+    double map = (now_seconds() - start) / BENCH_ROUNDS;
+
+    if (!failed && found == 0) {
+        printf("%d records, %.1f MB (%s)\n", BENCH_RECORDS, store->header.filesize / 1e6, dir);
+        printf("read_employees   first record %8.2f ms   full scan %8.2f ms   heap %.1f MB\n",
+               first_heap / BENCH_ROUNDS * 1e3, heap * 1e3, BENCH_RECORDS * sizeof(employee) / 1e6);
+        printf("mmap             first record %8.2f ms   full scan %8.2f ms   heap 0 MB\n",
+               first_map / BENCH_ROUNDS * 1e3, map * 1e3);
+    } else {
+        printf("bench_mmap failed\n");
+        failed = 1;
+    }
+    store_close(store);
+    unlink(path);
+    size_t len = strlen(path);
+    snprintf(path + len, sizeof(path) - len, ".wal");
+    unlink(path);
+    snprintf(path + len, sizeof(path) - len, ".idx");
+    unlink(path);
+    return failed;
+}
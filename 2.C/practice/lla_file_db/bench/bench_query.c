@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "query.h"
+#include "store.h"
+
+// Queries over a synthetic table (default 5M rows, or argv[2]; every 1000th
+// row deleted), file cached. An hours range count/sum done a row at a time
+// through store_record, then as a plain loop over the hours column, then
+// by query_run on 1, 2 and 4 threads and one per CPU. Then the other kinds
+// of query on the default thread count. Best of BENCH_RUNS each.
+#define BENCH_ROWS 5000000ULL
+#define BENCH_RUNS 3
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void remove_db(char *path) {
+    size_t len = strlen(path);
+    unlink(path);
+    snprintf(path + len, 8, ".wal");
+    unlink(path);
+    snprintf(path + len, 8, ".idx");
+    unlink(path);
+    path[len] = '\0';
+}
+
+static unsigned int row_hours(unsigned long long i) {
+    return (unsigned int)((i * 0x9e3779b97f4a7c15ULL) >> 40) % 2000;
+}
+
+static int build(char *path, unsigned long long rows) {
+    static const char *first[] = {"Alice", "Bartholomew", "Chen", "Dmitri", "Eve", "Fatima", "Gustavo", "Hiro"};
+    struct dbstore_t *store = NULL;
+    struct dbbatch_t *batch = NULL;
+    char name[64], address[64];
+    int failed = store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS ||
+                 store_batch_begin(store, &batch) != STATUS_SUCCESS;
+    for (unsigned long long i = 0; i < rows && !failed; i++) {
+        int namelen = i % 1000 == 999 ? 0 : snprintf(name, sizeof(name), "%s Employee%llu", first[i % 8], i);
+        int addresslen = snprintf(address, sizeof(address), "%llu Main Street", i % 997 + 1);
+        failed = store_batch_add(batch, name, namelen, address, addresslen, row_hours(i)) != STATUS_SUCCESS;
+    }
+    failed = failed || store_batch_commit(batch) != STATUS_SUCCESS;
+    store_close(store);
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+// A row at a time, as list_employees_by_hours would without the index
+static void naive_range(struct dbstore_t *store, unsigned int lo, unsigned int hi, struct query_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    for (unsigned long long i = 0; i < store->header.count; i++) {
+        struct record_t record;
+        if (store_record(store, i, &record) == STATUS_SUCCESS && !RECORD_DELETED(&record) && record.hours >= lo &&
+            record.hours <= hi) {
+            result->count++;
+            result->sum += record.hours;
+        }
+    }
+}
+
+// The column without SSE2 or threads, and without looking at tombstones,
+// so it isn't checked against the others
+static void column_range(struct dbstore_t *store, unsigned int lo, unsigned int hi, struct query_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    unsigned int rows;
+    for (unsigned long long i = 0; i < store->header.count; i += rows) {
+        const unsigned int *column = store_hours_column(store, i, &rows);
+        for (unsigned int j = 0; j < rows; j++) {
+            unsigned int h = ntohl(column[j]);
+            if (h >= lo && h <= hi) {
+                result->count++;
+                result->sum += h;
+            }
+        }
+    }
+}
+
+static double best_query(struct dbstore_t *store, const char *text, unsigned int threads,
+                         struct query_result_t *result) {
+    char buf[256];
+    struct query_t query;
+    double best = 1e9;
+    snprintf(buf, sizeof(buf), "%s", text);
+    if (query_parse(buf, &query) != STATUS_SUCCESS) {
+        return -1;
+    }
+    query.threads = threads;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        query_free(result);
+        double start = now_seconds();
+        if (query_run(store, &query, result) != STATUS_SUCCESS) {
+            return -1;
+        }
+        double elapsed = now_seconds() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+static void report(const char *label, unsigned long long rows, double seconds, const struct query_result_t *result) {
+    printf("%-34s %8.1f ms  %7.0f Mrow/s  count %llu\n", label, seconds * 1e3, rows / seconds / 1e6, result->count);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    unsigned long long rows = argc > 2 ? strtoull(argv[2], NULL, 10) : BENCH_ROWS;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_query_%d.db", dir, (int)getpid());
+    struct dbstore_t *store = NULL;
+    int failed = build(path, rows) != STATUS_SUCCESS || store_open(path, &store) != STATUS_SUCCESS;
+
+    struct query_result_t naive = {0}, column = {0}, result = {0};
+    double start = now_seconds();
+    if (!failed) {
+        naive_range(store, 100, 199, &naive);
+    }
+    double naive_time = now_seconds() - start;
+    start = now_seconds();
+    if (!failed) {
+        column_range(store, 100, 199, &column);
+    }
+    double column_time = now_seconds() - start;
+    if (!failed) {
+        printf("%llu rows (%s), %.1f MB, %ld CPUs\n", rows, dir, store->header.filesize / 1e6,
+               sysconf(_SC_NPROCESSORS_ONLN));
+        report("hours=100-199;count;sum naive", rows, naive_time, &naive);
+        report("  plain column loop", rows, column_time, &column);
+    }
+    static const unsigned int threads[] = {1, 2, 4, 0};
+    for (int t = 0; t < 4 && !failed; t++) {
+        char label[64];
+        snprintf(label, sizeof(label), threads[t] ? "  query_run, %u threads" : "  query_run, one per CPU",
+                 threads[t]);
+        double seconds = best_query(store, "hours=100-199;count;sum", threads[t], &result);
+        failed = seconds < 0 || result.count != naive.count || result.sum != naive.sum;
+        if (!failed) {
+            report(label, rows, seconds, &result);
+        }
+    }
+
+    // Each checked against a row at a time where that is cheap to write
+    static const char *queries[] = {
+        "count;sum;avg",
+        "hours=0-0;count",
+        "name=Chen;hours=0-499;count",
+        "top=10;select=name,hours",
+        "hours=1000-1000;select=name",
+    };
+    for (int q = 0; q < 5 && !failed; q++) {
+        double seconds = best_query(store, queries[q], 0, &result);
+        failed = seconds < 0;
+        if (q == 0 && !failed) {
+            naive_range(store, 0, 0xffffffff, &naive);
+            failed = result.count != naive.count || result.sum != naive.sum;
+        }
+        if (q == 3 && !failed) {
+            // Highest hours first, then lowest record
+            for (unsigned long long i = 1; i < result.nrecords && !failed; i++) {
+                unsigned int a = result.records[i - 1], b = result.records[i];
+                failed = row_hours(a) < row_hours(b) || (row_hours(a) == row_hours(b) && a > b);
+            }
+            failed = failed || result.nrecords != 10 || row_hours(result.records[0]) != 1999;
+        }
+        if (q == 4 && !failed) {
+            failed = result.nrecords != result.count;
+            for (unsigned long long i = 0; i < result.nrecords && !failed; i++) {
+                failed = row_hours(result.records[i]) != 1000 || (i > 0 && result.records[i] <= result.records[i - 1]);
+            }
+        }
+        if (!failed) {
+            report(queries[q], rows, seconds, &result);
+        }
+    }
+    query_free(&result);
+    store_close(store);
+    remove_db(path);
+    if (failed) {
+        printf("bench_query failed\n");
+    }
+    return failed;
+}
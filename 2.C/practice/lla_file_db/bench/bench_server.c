@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "index.h"
+#include "parse.h"
+#include "server.h"
+#include "store.h"
+
+// A server on a 100k-record database with clients (default 8, argv[2])
+// each sending ops requests (default 2000, argv[3]) one at a time, first
+// reads only, then 90% reads and 10% adds and updates. p50/p99 per kind
+// against what a cold CLI run pays to open the file and look up one name.
+#define BENCH_RECORDS 100000
+#define BENCH_CLIENTS 8
+#define BENCH_OPS     2000
+#define BENCH_COLD    200
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int count_record(unsigned int record, void *arg) {
+    (void)record;
+    (*(long *)arg)++;
+    return 0;
+}
+
+struct client_t {
+    const char *socket;
+    int ops;
+    int writes;                 // percent of requests that change something
+    unsigned int id;
+    double *reads;              // latencies
+    double *changes;
+    int nreads;
+    int nchanges;
+    int failed;
+};
+
+// Sends one request and reads up to its OK or ERR line
+static int request(int fd, char *line, size_t len) {
+    static __thread char buf[65536];
+    if (send(fd, line, len, MSG_NOSIGNAL) != (ssize_t)len) {
+        return STATUS_ERROR;
+    }
+    size_t have = 0;
+    size_t start = 0;   // of the line being read
+    for (;;) {
+        ssize_t n = read(fd, buf + have, sizeof(buf) - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return STATUS_ERROR;
+        }
+        have += n;
+        char *newline;
+        while ((newline = memchr(buf + start, '\n', have - start)) != NULL) {
+            if (strncmp(buf + start, "OK", 2) == 0) {
+                return STATUS_SUCCESS;
+            }
+            if (strncmp(buf + start, "ERR", 3) == 0) {
+                return STATUS_ERROR;
+            }
+            start = newline + 1 - buf;
+        }
+        // Only the unfinished line is kept
+        memmove(buf, buf + start, have - start);
+        have -= start;
+        start = 0;
+        if (have == sizeof(buf)) {
+            return STATUS_ERROR;
+        }
+    }
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd != -1 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *run_client(void *arg) {
+    struct client_t *client = arg;
+    int fd = connect_to(client->socket);
+    client->failed = fd == -1;
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL * (client->id + 1);
+    char line[512];
+    for (int op = 0; op < client->ops && !client->failed; op++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        unsigned int record = seed % BENCH_RECORDS;
+        unsigned int pick = (seed >> 32) % 100;
+        int change = pick < (unsigned int)client->writes;
+        int len;
+        if (change && pick % 2) {
+            len = snprintf(line, sizeof(line), "a Client%u Op%d,%d Load Street,%u\n", client->id, op, op,
+                           BENCH_RECORDS + client->id * client->ops + op);
+        } else if (change) {
+            // Same hours, so the record can be found again
+            len = snprintf(line, sizeof(line), "u %u,Employee %u,%d Moved Street,%u\n", record, record, op, record);
+        } else if (pick < 60) {
+            len = snprintf(line, sizeof(line), "g %u\n", record);
+        } else if (pick < 85) {
+            len = snprintf(line, sizeof(line), "s Employee %u\n", record);
+        } else {
+            len = snprintf(line, sizeof(line), "r %u,%u\n", record, record + 9);
+        }
+        double start = now_seconds();
+        client->failed = request(fd, line, len) != STATUS_SUCCESS;
+        double elapsed = now_seconds() - start;
+        if (change) {
+            client->changes[client->nchanges++] = elapsed;
+        } else {
+            client->reads[client->nreads++] = elapsed;
+        }
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, double *latencies, int n) {
+    if (n == 0) {
+        return;
+    }
+    qsort(latencies, n, sizeof(double), compare_double);
+    printf("  %-8s %6d   p50 %8.1f us   p99 %8.1f us   max %8.1f us\n", label, n, latencies[n / 2] * 1e6,
+           latencies[(int)(n * 0.99)] * 1e6, latencies[n - 1] * 1e6);
+}
+
+// All clients at once; returns nonzero on a failed request
+static int run_phase(const char *label, const char *socket, int clients, int ops, int writes) {
+    struct client_t *all = calloc(clients, sizeof(struct client_t));
+    pthread_t *threads = calloc(clients, sizeof(pthread_t));
+    double *reads = malloc((size_t)clients * ops * sizeof(double));
+    double *changes = malloc((size_t)clients * ops * sizeof(double));
+    if (all == NULL || threads == NULL || reads == NULL || changes == NULL) {
+        return 1;
+    }
+    double start = now_seconds();
+    for (int c = 0; c < clients; c++) {
+        all[c] = (struct client_t){.socket = socket, .ops = ops, .writes = writes, .id = c + (writes ? clients : 0)};
+        all[c].reads = reads + (size_t)c * ops;
+        all[c].changes = changes + (size_t)c * ops;
+        pthread_create(&threads[c], NULL, run_client, &all[c]);
+    }
+    int failed = 0, nreads = 0, nchanges = 0;
+    for (int c = 0; c < clients; c++) {
+        pthread_join(threads[c], NULL);
+        failed |= all[c].failed;
+    }
+    double elapsed = now_seconds() - start;
+    // Pack each client's latencies together
+    for (int c = 0; c < clients; c++) {
+        memmove(reads + nreads, all[c].reads, all[c].nreads * sizeof(double));
+        nreads += all[c].nreads;
+        memmove(changes + nchanges, all[c].changes, all[c].nchanges * sizeof(double));
+        nchanges += all[c].nchanges;
+    }
+    if (!failed) {
+        printf("%s: %d clients, %.0f requests/s\n", label, clients, (nreads + nchanges) / elapsed);
+        report("reads", reads, nreads);
+        report("changes", changes, nchanges);
+    }
+    free(all);
+    free(threads);
+    free(reads);
+    free(changes);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    int clients = argc > 2 ? atoi(argv[2]) : BENCH_CLIENTS;
+    int ops = argc > 3 ? atoi(argv[3]) : BENCH_OPS;
+    char path[512], socket[108];
+    snprintf(path, sizeof(path), "%s/bench_server_%d.db", dir, (int)getpid());
+    snprintf(socket, sizeof(socket), "/tmp/bench_server_%d.sock", (int)getpid());
+
+    struct dbstore_t *store = NULL;
+    struct dbbatch_t *batch = NULL;
+    char name[64], address[64];
+    int failed = store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS ||
+                 store_batch_begin(store, &batch) != STATUS_SUCCESS;
+    for (unsigned int i = 0; i < BENCH_RECORDS && !failed; i++) {
+        int namelen = snprintf(name, sizeof(name), "Employee %u", i);
+        int addresslen = snprintf(address, sizeof(address), "%u Main Street", i);
+        failed = store_batch_add(batch, name, namelen, address, addresslen, i) != STATUS_SUCCESS;
+    }
+    failed = failed || store_batch_commit(batch) != STATUS_SUCCESS || store_index(store) == NULL;
+    store_close(store);
+
+    // What each CLI run pays before and after its one lookup
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_COLD && !failed; i++) {
+        store = NULL;
+        long found = 0;
+        failed = store_open(path, &store) != STATUS_SUCCESS || store_index(store) == NULL;
+        snprintf(name, sizeof(name), "Employee %d", i * 397 % BENCH_RECORDS);
+        failed = failed || index_find_name(store->index, name, count_record, &found) != STATUS_SUCCESS || found != 1;
+        store_close(store);
+    }
+    double cold = (now_seconds() - start) / BENCH_COLD;
+
+    pid_t server = failed ? -1 : fork();
+    if (server == 0) {
+        store = NULL;
+        if (freopen("/dev/null", "w", stdout) == NULL || store_open(path, &store) != STATUS_SUCCESS) {
+            _exit(1);
+        }
+        int status = server_run(store, socket);
+        store_close(store);
+        _exit(status == STATUS_SUCCESS ? 0 : 1);
+    }
+    int fd = -1;
+    for (int tries = 0; server > 0 && fd == -1 && tries < 500; tries++) {
+        if ((fd = connect_to(socket)) == -1) {
+            usleep(10000);
+        }
+    }
+    failed = failed || fd == -1;
+    if (fd != -1) {
+        close(fd);
+    }
+    if (!failed) {
+        printf("%d records (%s); a cold open, index lookup and close takes %.1f us\n", BENCH_RECORDS, dir,
+               cold * 1e6);
+    }
+    failed = failed || run_phase("reads only", socket, clients, ops, 0);
+    failed = failed || run_phase("10% changes", socket, clients, ops, 10);
+
+    int status = 1;
+    if (server > 0) {
+        kill(server, SIGTERM);
+        waitpid(server, &status, 0);
+    }
+    failed = failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    if (failed) {
+        printf("bench_server failed\n");
+    }
+    unlink(path);
+    size_t len = strlen(path);
+    snprintf(path + len, sizeof(path) - len, ".wal");
+    unlink(path);
+    snprintf(path + len, sizeof(path) - len, ".idx");
+    unlink(path);
+    return failed;
+}
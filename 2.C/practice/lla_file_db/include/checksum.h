@@ -0,0 +1,12 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+
+// CRC-32C (Castagnoli). Pass 0 to start, or a previous result to continue.
+// Uses the SSE4.2 CRC32 instruction when the CPU has it, else tables.
+unsigned int crc32c(unsigned int crc, const void *data, size_t len);
+// Three buffers of len bytes each, from 0, interleaved
+void crc32c_3(const void *a, const void *b, const void *c, size_t len, unsigned int crcs[3]);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stddef.h>
+
+#include "store.h"
+
+// Output is gathered this much at a time before a write
+#define EXPORT_BUFFER (1 << 20)
+
+// Output formats
+//   human   the -l listing: "Employee N", then tab-indented name, address
+//           and hours lines
+//   csv     a name,address,hours header line, then one line per record,
+//           quoted where needed; -b loads it back
+//   ndjson  {"record":N,"name":"...","address":"...","hours":N} per line
+//   binary  per record, in network order: record u32, hours u32, name
+//           length u32, address length u32, then the name and address bytes
+#define EXPORT_HUMAN  0
+#define EXPORT_CSV    1
+#define EXPORT_NDJSON 2
+#define EXPORT_BINARY 3
+
+// Records formatted into one large buffer, with integers converted by
+// hand, and written out with write() as it fills. Strings are copied as
+// they are; NDJSON escapes quotes, backslashes and control characters but
+// leaves other bytes alone.
+struct exporter_t {
+    int fd;
+    int format;
+    char *buf;
+    size_t size;
+    size_t used;
+    unsigned long long written; // bytes, so far
+};
+
+// "human", "csv", "ndjson" or "binary"; STATUS_ERROR for anything else
+int export_format(const char *name);
+int export_begin(struct exporter_t *exporter, int fd, int format);
+int export_record(struct exporter_t *exporter, unsigned int index, const struct record_t *record);
+int export_flush(struct exporter_t *exporter);
+// Flushes and frees the buffer, even after an error
+int export_end(struct exporter_t *exporter);
+// Every live record, in record order
+int export_employees(struct dbstore_t *store, int fd, int format);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+
+#include "parse.h"
+
+#define INDEX_MAGIC     0x4c4c4149
+#define INDEX_VERSION   3
+#define INDEX_PAGE_SIZE 4096
+
+// Secondary indexes kept in a sidecar file, <file>.idx, made of 4 KB
+// pages and mapped read-write:
+//   - an open-addressing hash table from name to record number
+//   - a B+-tree keyed on (hours, record number), leaves chained for ranges
+// Page 0 is the idxheader_t. Pages given up by the tree or an outgrown
+// hash table go on a free list and are handed out again one at a time. The sidecar isn't covered by the WAL; it is
+// marked dirty while open and rebuilt from the database after a crash.
+struct idxheader_t {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int clean;         // set on close, cleared on open
+    unsigned int page_count;
+    unsigned long long db_count; // records covered, must match the header count
+    unsigned int btree_root;
+    unsigned int btree_height;  // 1 = the root is a leaf
+    unsigned int hash_page;     // first page of the slot array
+    unsigned int hash_slots;    // power of two
+    unsigned int hash_used;     // live slots + tombstones
+    unsigned int hash_tombstones;
+    unsigned int free_page;     // first of the free list, 0 for none
+};
+
+struct hashslot_t {
+    unsigned long long hash;
+    unsigned int record;
+    unsigned int pad;
+};
+
+struct btkey_t {
+    unsigned int hours;
+    unsigned int record;
+};
+
+#define BT_LEAF_MAX  511
+#define BT_INNER_MAX 340
+
+struct btleaf_t {
+    unsigned short leaf;
+    unsigned short nkeys;
+    unsigned int next;          // right sibling, 0 for the last leaf
+    struct btkey_t keys[BT_LEAF_MAX];
+};
+
+// children[i] holds keys below keys[i], children[nkeys] the rest
+struct btinner_t {
+    unsigned short leaf;
+    unsigned short nkeys;
+    unsigned int pad;
+    struct btkey_t keys[BT_INNER_MAX];
+    unsigned int children[BT_INNER_MAX + 1];
+};
+
+struct dbindex_t {
+    int fd;
+    char *map;
+    size_t maplen;
+};
+
+#define INDEX_HEADER(idx) ((struct idxheader_t *)(idx)->map)
+
+// Called with each matching record number; return nonzero to stop.
+typedef int (*index_visit_t)(unsigned int record, void *arg);
+
+// Opens or creates path. *rebuildOut is set when the contents can't be
+// trusted (new file, unclean close, or db_count differs from count) and
+// the caller must index_reset and re-insert every record.
+int index_open(char *path, unsigned long long count, struct dbindex_t **indexOut, int *rebuildOut);
+void index_close(struct dbindex_t *index);
+int index_reset(struct dbindex_t *index);
+
+// name is an employee_t name field, which may fill all 256 bytes unterminated
+unsigned long long index_name_hash(const char *name);
+int index_insert(struct dbindex_t *index, unsigned int record, const char *name, unsigned int hours);
+int index_remove(struct dbindex_t *index, unsigned int record, const char *name, unsigned int hours);
+
+// Name matches are by hash; the caller compares the stored name.
+int index_find_name(struct dbindex_t *index, const char *name, index_visit_t visit, void *arg);
+// Every record with lo <= hours <= hi, in hours order.
+int index_range_hours(struct dbindex_t *index, unsigned int lo, unsigned int hi, index_visit_t visit, void *arg);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "store.h"
+
+// Input is read this much at a time; no line may be longer
+#define INGEST_BUFFER (1 << 20)
+
+// Bulk load from CSV, one "name,address,hours" employee per line. A field
+// may be quoted ("9 Elm St, Springfield"), with "" for a quote inside it.
+// A first line whose hours aren't a number is taken as a header. Other bad
+// lines are reported and skipped; the rest go in through one store batch.
+struct csvfield_t {
+    char *data;
+    unsigned int length;
+};
+
+struct ingest_stats_t {
+    unsigned long long lines;
+    unsigned long long rows;        // appended
+    unsigned long long skipped;     // bad lines
+    unsigned long long bytes;
+};
+
+// Splits line (without its newline) at commas into at most max fields,
+// unquoting in place. Returns how many fields the line has, which may be
+// more than max, or -1 for a quote that isn't closed or isn't followed by
+// a comma.
+int csv_split(char *line, size_t length, struct csvfield_t *fields, int max);
+int ingest_csv(struct dbstore_t *store, int fd, struct ingest_stats_t *stats);
+// path "-" reads stdin
+int bulk_add_employees(struct dbstore_t *store, char *path);
+
+#endif
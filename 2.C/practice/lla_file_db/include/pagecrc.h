@@ -0,0 +1,44 @@
+#ifndef PAGECRC_H
+#define PAGECRC_H
+
+#include "parse.h"
+#include "store.h"
+
+// Smallest table, in pages covered: 4 KB of checksums for 4 MB of file
+#define PAGECRC_MIN_PAGES    1024
+// Pages checksummed per step, and the fewest handed to a verify thread
+#define PAGECRC_CHUNK        1024
+#define PAGECRC_THREAD_PAGES 16384
+#define PAGECRC_MAX_THREADS  64
+
+// Page checksums for version 3 files. Every 4 KB page of the file has a
+// CRC-32C entry, big-endian, in a table the header points at; the header
+// has a checksum of its own, and neither the header page nor the table's
+// pages have an entry. A checksum covers only a page's live bytes: in a
+// column, the entries of rows below count, elsewhere the bytes below
+// filesize. So rows and strings written past those, by a batch or before
+// a crash, change no checksum until the header that makes them live is
+// committed, with their new checksums in the same transaction.
+//
+// A file that outgrows its table gets a new one twice the size past its
+// end, written and synced before the header that points at it is logged.
+// Until then the old one stays in force; after, its pages are ordinary
+// data, garbage for a rewrite to drop.
+
+// Live bytes of the page under header
+unsigned int pagecrc_live(const struct dbheader64_t *header, unsigned long long page);
+// Places a table covering twice the file at its end and fills it from the
+// file as it stands. For a new file or a rewrite; the caller then writes
+// the header and syncs.
+int pagecrc_build(int fd, struct dbheader64_t *header);
+// Adds to the open transaction the checksums of the pages a change from
+// the store's header to header touches: the entries of rows first..end-1
+// in each column, and the file past the old end outside the segments. The
+// change's own writes must be in the transaction or the file already. May
+// move the table, which changes header.
+int pagecrc_log(struct dbstore_t *store, struct dbheader64_t *header, unsigned long long first,
+                unsigned long long end);
+// Checks every page with an entry, on up to one thread per CPU
+int pagecrc_verify(struct dbstore_t *store);
+
+#endif
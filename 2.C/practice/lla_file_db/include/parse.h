@@ -1,8 +1,16 @@
 #ifndef PARSE_H
 #define PARSE_H
 
+#include <arpa/inet.h>
+
 #define HEADER_MAGIC 0x4c4c4144
 
+#define DB_VERSION_FIXED    1   // dbheader_t, then employee_t records
+#define DB_VERSION_COLUMNAR 2   // dbheader_t, dbsegments_t, columns, string heap
+#define DB_VERSION_LARGE    3   // dbheader64_t page, row segments and strings
+#define DB_VERSION_CURRENT  DB_VERSION_LARGE
+
+// Versions 1 and 2
 struct dbheader_t {
 	unsigned int magic;
 	unsigned short version;
@@ -10,19 +18,91 @@ struct dbheader_t {
 	unsigned int filesize;
 };
 
+#define DB_PAGE_SIZE     4096
+#define DB_SEGMENT_BASE  1024ULL    // rows in segment 0, doubling with each segment
+#define DB_MAX_SEGMENTS  32
+
+// Version 3 header, alone in the first page. Rows live in page-aligned
+// segments, segment k holding DB_SEGMENT_BASE << k of them, so the file
+// grows by adding a segment at the end and nothing already written moves.
+// A segment is three columns: name and address refs (STRREF64), then
+// hours. Strings are appended wherever the end of the file is at the time.
+// Files written since page checksums were added also carry a table of
+// them (see pagecrc.h) and a checksum of the header itself. Also the
+// host-order header for every version.
+struct dbheader64_t {
+	unsigned int magic;
+	unsigned short version;
+	unsigned short pad;
+	unsigned long long count;
+	unsigned long long filesize;
+	unsigned int segment_count;
+	unsigned int pad2;
+	unsigned long long segments[DB_MAX_SEGMENTS];   // file offset of each
+	unsigned long long checksums;       // file offset of the page checksum table, 0 for none
+	unsigned long long checksum_pages;  // pages of the file it has room for
+	unsigned int crc;                   // crc32c of the header as stored, taken with this 0
+	unsigned int pad3;
+};
+
+// Bytes taken by a page checksum table, a whole number of pages
+#define CHECKSUM_TABLE_SIZE(pages) (((pages) * 4 + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE * DB_PAGE_SIZE)
+
+// Version 3 string ref: file offset in the low 48 bits, length above
+#define STRREF64(offset, length)  (((unsigned long long)(length) << 48) | (offset))
+#define STRREF64_OFFSET(ref)      ((ref) & 0xffffffffffffULL)
+#define STRREF64_LENGTH(ref)      ((unsigned int)((ref) >> 48))
+
+#define SEGMENT_ROWS(k)   (DB_SEGMENT_BASE << (k))
+#define SEGMENT_FIRST(k)  (DB_SEGMENT_BASE * ((1ULL << (k)) - 1))
+#define SEGMENT_SIZE(k)   (SEGMENT_ROWS(k) * (2 * sizeof(unsigned long long) + sizeof(unsigned int)))
+// Segment holding row i
+#define SEGMENT_OF(i)     (63 - __builtin_clzll((unsigned long long)(i) / DB_SEGMENT_BASE + 1))
+
+// Version 2 layout, after the header. Each column has room for capacity
+// rows; the heap runs from its offset to the end of the file and holds
+// NUL-terminated strings appended as records are written.
+struct dbsegments_t {
+	unsigned int capacity;
+	unsigned int names;         // strref_t per row
+	unsigned int addresses;     // strref_t per row
+	unsigned int hours;         // unsigned int per row
+	unsigned int heap;
+};
+
+// A string in the heap: offset from the start of the heap, length without
+// the NUL. A name of length 0 marks a deleted row.
+struct strref_t {
+	unsigned int offset;
+	unsigned int length;
+};
+
 struct employee_t {
 	char name[256];
 	char address[256];
 	unsigned int hours;
 };
 
-int create_db_header(int fd, struct dbheader_t **headerOut);
-int validate_db_header(int fd, struct dbheader_t **headerOut);
-int read_employees(int fd, struct dbheader_t *, struct employee_t **employeesOut);
-int output_file(int fd, struct dbheader_t *, struct employee_t *employees);
-void list_employees(struct dbheader_t *dbhdr, struct employee_t *employees);
-int add_employee(struct dbheader_t *dbhdr, struct employee_t *employees, char *addstring);
-int update_employee(struct dbheader_t *dbhdr, struct employee_t *employee, char *updatestring);
-int remove_employee(struct dbheader_t *dbhdr, struct employee_t **employeesOut, char *deletestring);
+// Deleted records keep their slot with an empty name and 0 hours, so a
+// scan of hours alone can only mistake rows with 0 hours for live ones
+#define EMPLOYEE_DELETED(e) ((e)->name[0] == '\0')
+
+// Records read straight from the file keep hours in network order
+#define EMPLOYEE_HOURS(e) ntohl((e)->hours)
+
+struct dbstore_t;
+
+int create_db_header(struct dbheader64_t **headerOut);
+int validate_db_header(int fd, struct dbheader64_t **headerOut);
+int read_employees(int fd, struct dbheader64_t *, struct employee_t **employeesOut);
+// format is one of EXPORT_HUMAN... in export.h
+int list_employees(struct dbstore_t *store, int format);
+int find_employees_by_name(struct dbstore_t *store, char *name);
+int list_employees_by_hours(struct dbstore_t *store, char *rangestring);
+int parse_employee(char *addstring, struct employee_t *employee);
+long find_employee_by_hours(struct dbstore_t *store, unsigned int hours);
+int add_employee(struct dbstore_t *store, char *addstring);
+int update_employee(struct dbstore_t *store, char *updatestring);
+int remove_employee(struct dbstore_t *store, char *deletestring);
 
 #endif
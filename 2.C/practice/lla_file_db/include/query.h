@@ -0,0 +1,52 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "store.h"
+
+#define QUERY_MAX_TOP     1000000
+#define QUERY_MAX_THREADS 64
+// Tables smaller than this are scanned on one thread
+#define QUERY_MIN_SPLIT   65536
+
+// Projection
+#define QUERY_NAME    1
+#define QUERY_ADDRESS 2
+#define QUERY_HOURS   4
+
+// Aggregates, over the hours of the matching rows
+#define QUERY_COUNT 1
+#define QUERY_SUM   2
+#define QUERY_AVG   4
+
+// A filter on name prefix and hours range, then either aggregates or the
+// matching rows (in record order, or the top K by hours). Written as
+// terms separated by ';', for example
+//   name=Tim;hours=100-200;select=name,hours;top=10
+//   hours=-40;count;avg
+struct query_t {
+    char prefix[256];
+    unsigned int prefixlen;     // 0: any name
+    unsigned int lo;            // hours, both inclusive
+    unsigned int hi;
+    unsigned int fields;        // QUERY_NAME | ...
+    unsigned int aggregates;    // QUERY_COUNT | ...; none lists rows
+    unsigned int top;           // 0: every match
+    unsigned int threads;       // 0: one per CPU
+};
+
+struct query_result_t {
+    unsigned long long count;   // matching rows (with top, those that could still make it)
+    unsigned long long sum;     // of their hours
+    unsigned int *records;      // unless only aggregates were asked for
+    unsigned long long nrecords;
+};
+
+int query_parse(char *text, struct query_t *query);
+// The hours filter runs over the hours column first, 4 rows at a time with
+// SSE2, split across threads; names are only looked at for rows it lets
+// through. The store must not change while this runs.
+int query_run(struct dbstore_t *store, const struct query_t *query, struct query_result_t *result);
+void query_free(struct query_result_t *result);
+int run_query(struct dbstore_t *store, char *querystring);
+
+#endif
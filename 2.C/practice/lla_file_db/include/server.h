@@ -0,0 +1,37 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "store.h"
+
+// Longest request line, and rows listed per hold of the read lock
+#define SERVER_LINE_MAX  4096
+#define SERVER_LIST_ROWS 1024
+
+// Keeps the store open and serves it on a Unix domain socket, a thread per
+// connection. A request is one line, an op letter and its argument:
+//   g <record>                      the record with that number
+//   l                               every live record
+//   s <name>                        records with that name
+//   r <low>,<high>                  records by hours, both inclusive
+//   c                               the record count
+//   a <name>,<address>,<hours>      add; OK gives the new record number
+//   u <hours>,<name>,<address>,<hours>
+//   d <hours>
+// The reply is zero or more "<record>\t<name>\t<address>\t<hours>" lines,
+// then "OK <n>" (n records listed, or the count or record number) or
+// "ERR <reason>". Requests may be pipelined.
+//
+// Readers share a reader-writer lock that prefers writers. Changes run one
+// at a time under a mutex, and each takes the lock exclusively only while
+// it is applied (see dbstore_t), not while its log and the file are
+// synced, so a reader never waits on the disk nor sees a half written
+// record. A listing takes the lock a chunk of rows at a time, so a long
+// one doesn't hold up writers; it isn't a snapshot. No reply is sent while
+// the lock is held.
+//
+// Runs until SIGINT or SIGTERM, then answers the requests in flight,
+// closes every connection and returns once no thread uses the store: the
+// caller closes it.
+int server_run(struct dbstore_t *store, char *path);
+
+#endif
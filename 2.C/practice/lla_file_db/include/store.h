@@ -0,0 +1,116 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <pthread.h>
+
+#include "index.h"
+#include "parse.h"
+#include "wal.h"
+
+// Record-level access to a database file, version 1, 2 or 3. Every change
+// is one small WAL transaction written in place with pwrite: the touched
+// record (for versions 2 and 3 its column entries plus new strings), the
+// checksums of the pages it touches (version 3, see pagecrc.h) and the
+// header. With a lock set, a change is logged and synced first, then takes
+// the lock exclusively only to write the database pages and update the
+// header, mapping and index; a checkpoint, when one is due, runs after it
+// is dropped. Readers holding it shared see every change whole. Changes
+// themselves must still come one at a time.
+struct dbstore_t {
+    int fd;
+    char *path;
+    struct wal_t *wal;
+    struct dbheader64_t header; // host byte order, whatever the version
+    struct dbsegments_t segments; // version 2 only, host byte order
+    const char *map;            // read-only view of the file, see store_map
+    size_t maplen;              // mapped, which runs past the end of the file
+    struct dbindex_t *index;    // opened by store_index, then kept in step with every change
+    int index_failed;           // an index update failed: rebuild on next open
+    pthread_rwlock_t *lock;     // NULL, or held shared by readers on other threads
+};
+
+// One record as stored, whichever the version. The strings point into the
+// mapping and are only valid until the next change; a version 1 name that
+// fills all 256 bytes isn't NUL-terminated, so use the lengths.
+struct record_t {
+    const char *name;
+    const char *address;
+    unsigned int namelen;
+    unsigned int addresslen;
+    unsigned int hours;         // host byte order
+};
+
+#define RECORD_DELETED(r) ((r)->namelen == 0)
+
+// Version 3 columns
+#define COLUMN_NAMES     0
+#define COLUMN_ADDRESSES 1
+#define COLUMN_HOURS     2
+
+// Version 1 record position
+#define RECORD_OFFSET(i) ((off_t)sizeof(struct dbheader_t) + (off_t)(i) * (off_t)sizeof(struct employee_t))
+
+// Row numbers are 32 bits wide in the index, which caps version 3
+#define STORE_MAX_ROWS_SMALL 0xffffULL
+#define STORE_MAX_ROWS_LARGE 0xffffffffULL
+
+// Longest name or address, as in an employee_t less its NUL
+#define STORE_STRING_MAX 255
+
+// The header as it goes on disk: 12 bytes for versions 1 and 2, the
+// dbheader64_t for version 3. Returns the length.
+size_t header_to_disk(struct dbheader64_t *host, struct dbheader64_t *disk);
+// Where row i's entry in a version 3 column is
+unsigned long long large_column(const struct dbheader64_t *header, unsigned long long i, int column);
+
+int store_create(char *filename, unsigned short version, struct dbstore_t **storeOut);
+// Checks a version 3 file's page checksums before returning it
+int store_open(char *filename, struct dbstore_t **storeOut);
+// Checkpoints the log, so a closed database needs no replay
+void store_close(struct dbstore_t *store);
+
+// Maps the file (again, if it grew) so records can be read in place.
+int store_map(struct dbstore_t *store);
+int store_record(struct dbstore_t *store, unsigned int index, struct record_t *record);
+// The hours of rows first onwards, in network order, as far as they run
+// contiguously: *rowsOut of them, to the end of a version 3 segment or of
+// the version 2 column. NULL for version 1, where hours sit inside each
+// record.
+const unsigned int *store_hours_column(struct dbstore_t *store, unsigned int first, unsigned int *rowsOut);
+// The name and hours indexes, opened (and rebuilt if stale) on first use,
+// so work that never looks anything up doesn't pay for them.
+struct dbindex_t *store_index(struct dbstore_t *store);
+// Called with each record store_find_name finds; the record is only valid
+// for the call.
+typedef void (*store_visit_t)(unsigned int index, const struct record_t *record, void *arg);
+// Every record named exactly name, looked up through the index. Returns
+// how many there were, 0 also when there is no index.
+unsigned int store_find_name(struct dbstore_t *store, const char *name, store_visit_t found, void *arg);
+// Writes the records to a new version 3 file with room for capacity rows
+// (at least count) and renames it over the database. Only live strings are
+// copied, so this is both the migration from versions 1 and 2 and string
+// compaction; record numbers stay the same.
+int store_rewrite(struct dbstore_t *store, unsigned long long capacity);
+
+int store_read_employee(struct dbstore_t *store, unsigned int index, struct employee_t *employee);
+int store_append_employee(struct dbstore_t *store, struct employee_t *employee);
+int store_update_employee(struct dbstore_t *store, unsigned int index, struct employee_t *employee);
+int store_delete_employee(struct dbstore_t *store, unsigned int index);
+
+// Bulk appends, for loads too big for a transaction per row. Rows and
+// strings are buffered and written straight past the end of the table in
+// large writes, outside the WAL; store_batch_commit syncs them and then
+// logs the header once, so they all appear together or, after a crash,
+// not at all. A version 1 or 2 file is rewritten as version 3 first. The
+// index is not kept up to date row by row: the next lookup rebuilds it.
+// Make no other change to the store while a batch is open.
+struct dbbatch_t;
+int store_batch_begin(struct dbstore_t *store, struct dbbatch_t **batchOut);
+// namelen 0 adds a deleted row, whatever the hours
+int store_batch_add(struct dbbatch_t *batch, const char *name, unsigned int namelen, const char *address,
+                    unsigned int addresslen, unsigned int hours);
+// Commits (unless an add failed to write) and frees the batch
+int store_batch_commit(struct dbbatch_t *batch);
+void store_batch_abort(struct dbbatch_t *batch);
+
+#endif
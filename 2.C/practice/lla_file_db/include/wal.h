@@ -0,0 +1,59 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <sys/types.h>
+
+#define WAL_MAGIC 0x4c4c4157
+// Log size past which a commit checkpoints
+#define WAL_CHECKPOINT_BYTES (1 << 20)
+
+// Redo log kept next to the database as <file>.wal. A transaction is a set
+// of (offset, bytes) images; it is appended to the log and synced before
+// any of them touch the database. The database itself is only synced at a
+// checkpoint, which then empties the log: once the log passes
+// WAL_CHECKPOINT_BYTES, and on close. So a commit costs one fdatasync, not
+// two. Opening replays every complete transaction in the log, in order,
+// and drops the first torn one (bad checksum) and anything after it.
+struct walhdr_t {
+    unsigned int magic;
+    unsigned int crc;       // crc32c of everything after this header
+    unsigned int nwrites;
+    unsigned int length;    // bytes after this header
+};
+
+struct walwrite_t {
+    unsigned long long offset;
+    unsigned int length;
+    unsigned int pad;
+};
+
+struct wal_t {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+    unsigned int nwrites;
+    size_t logged;          // bytes of committed transactions since the last checkpoint
+};
+
+int wal_open(char *dbpath, struct wal_t **walOut);
+void wal_close(struct wal_t *wal);
+int wal_recover(struct wal_t *wal, int dbfd);
+void wal_begin(struct wal_t *wal);
+int wal_add(struct wal_t *wal, off_t offset, const void *data, size_t length);
+// Copies whatever the open transaction writes inside [offset, offset + length)
+// over data, which holds those bytes as the database has them now
+void wal_overlay(struct wal_t *wal, off_t offset, void *data, size_t length);
+int wal_commit(struct wal_t *wal, int dbfd);
+// wal_commit in its three steps, for a caller that makes the change visible
+// under a lock: log and sync it (the change is durable from here), write
+// it to the database, then checkpoint if the log has grown enough.
+int wal_log(struct wal_t *wal);
+int wal_apply(struct wal_t *wal, int dbfd);
+int wal_sync(struct wal_t *wal, int dbfd);
+// Syncs the database and empties the log
+int wal_checkpoint(struct wal_t *wal, int dbfd);
+int write_all(int fd, const void *data, size_t length, off_t offset);
+int read_all(int fd, void *data, size_t length, off_t offset);
+
+#endif
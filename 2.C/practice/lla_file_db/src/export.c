@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "export.h"
+#include "store.h"
+
+// Bytes a record can take beyond 6 per string byte (an NDJSON \u00XX escape)
+#define EXPORT_SLACK 128
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+// Two digits per division, written backwards into a scratch array
+static char *put_uint(char *p, unsigned int v) {
+    char digits[10];
+    char *d = digits + sizeof(digits);
+    while (v >= 100) {
+        unsigned int pair = v % 100;
+        v /= 100;
+        d -= 2;
+        memcpy(d, digit_pairs + pair * 2, 2);
+    }
+    if (v >= 10) {
+        d -= 2;
+        memcpy(d, digit_pairs + v * 2, 2);
+    } else {
+        *--d = '0' + v;
+    }
+    size_t n = digits + sizeof(digits) - d;
+    memcpy(p, d, n);
+    return p + n;
+}
+
+static char *put(char *p, const char *s, size_t n) {
+    memcpy(p, s, n);
+    return p + n;
+}
+
+#define PUT_LITERAL(p, s) put((p), (s), sizeof(s) - 1)
+
+static char *put_u32(char *p, unsigned int v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+// Bytes that make CSV quote a field, and that JSON escapes
+#define SPECIAL_CSV  1
+#define SPECIAL_JSON 2
+
+// One lookup a byte instead of a comparison per special character. The
+// control ranges stop short of \n and \r so no entry is set twice.
+static const unsigned char special[256] = {
+    [0x00 ... 0x09] = SPECIAL_JSON,
+    ['\n'] = SPECIAL_CSV | SPECIAL_JSON,
+    [0x0b ... 0x0c] = SPECIAL_JSON,
+    ['\r'] = SPECIAL_CSV | SPECIAL_JSON,
+    [0x0e ... 0x1f] = SPECIAL_JSON,
+    [','] = SPECIAL_CSV,
+    ['"'] = SPECIAL_CSV | SPECIAL_JSON,
+    ['\\'] = SPECIAL_JSON,
+};
+
+// Quoted only if it holds a comma, quote or line break, with "" for a quote
+static char *put_csv(char *p, const char *s, size_t n) {
+    size_t i = 0;
+    while (i < n && !(special[(unsigned char)s[i]] & SPECIAL_CSV)) {
+        i++;
+    }
+    if (i == n) {
+        return put(p, s, n);
+    }
+    *p++ = '"';
+    for (i = 0; i < n; i++) {
+        if (s[i] == '"') {
+            *p++ = '"';
+        }
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+static char *put_json(char *p, const char *s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    *p++ = '"';
+    size_t start = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = s[i];
+        if (!(special[c] & SPECIAL_JSON)) {
+            continue;
+        }
+        p = put(p, s + start, i - start);
+        start = i + 1;
+        *p++ = '\\';
+        if (c == '"' || c == '\\') {
+            *p++ = c;
+        } else if (c == '\n') {
+            *p++ = 'n';
+        } else if (c == '\t') {
+            *p++ = 't';
+        } else if (c == '\r') {
+            *p++ = 'r';
+        } else {
+            p = PUT_LITERAL(p, "u00");
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0xf];
+        }
+    }
+    p = put(p, s + start, n - start);
+    *p++ = '"';
+    return p;
+}
+
+int export_format(const char *name) {
+    static const char *names[] = {"human", "csv", "ndjson", "binary"};
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return STATUS_ERROR;
+}
+
+int export_begin(struct exporter_t *exporter, int fd, int format) {
+    memset(exporter, 0, sizeof(*exporter));
+    exporter->fd = fd;
+    exporter->format = format;
+    exporter->size = EXPORT_BUFFER;
+    exporter->buf = malloc(exporter->size);
+    if (exporter->buf == NULL) {
+        printf("Malloc failed to export\n");
+        return STATUS_ERROR;
+    }
+    if (format == EXPORT_CSV) {
+        exporter->used = PUT_LITERAL(exporter->buf, "name,address,hours\n") - exporter->buf;
+    }
+    return STATUS_SUCCESS;
+}
+
+// fd may be a pipe or terminal, so no pwrite; short writes are retried
+int export_flush(struct exporter_t *exporter) {
+    size_t done = 0;
+    while (done < exporter->used) {
+        ssize_t n = write(exporter->fd, exporter->buf + done, exporter->used - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("write");
+            return STATUS_ERROR;
+        }
+        done += n;
+    }
+    exporter->written += done;
+    exporter->used = 0;
+    return STATUS_SUCCESS;
+}
+
+int export_record(struct exporter_t *exporter, unsigned int index, const struct record_t *record) {
+    size_t need = 6 * ((size_t)record->namelen + record->addresslen) + EXPORT_SLACK;
+    if (exporter->used + need > exporter->size) {
+        if (export_flush(exporter) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        // Variable-length records are as long as the file says, so one can outgrow the buffer
+        if (need > exporter->size) {
+            char *buf = realloc(exporter->buf, need);
+            if (buf == NULL) {
+                printf("Malloc failed to export\n");
+                return STATUS_ERROR;
+            }
+            exporter->buf = buf;
+            exporter->size = need;
+        }
+    }
+    char *p = exporter->buf + exporter->used;
+    switch (exporter->format) {
+        case EXPORT_HUMAN:
+            p = PUT_LITERAL(p, "Employee ");
+            p = put_uint(p, index);
+            p = PUT_LITERAL(p, "\n\tName: ");
+            p = put(p, record->name, record->namelen);
+            p = PUT_LITERAL(p, "\n\tAddress: ");
+            p = put(p, record->address, record->addresslen);
+            p = PUT_LITERAL(p, "\n\tHours: ");
+            p = put_uint(p, record->hours);
+            *p++ = '\n';
+            break;
+        case EXPORT_CSV:
+            p = put_csv(p, record->name, record->namelen);
+            *p++ = ',';
+            p = put_csv(p, record->address, record->addresslen);
+            *p++ = ',';
+            p = put_uint(p, record->hours);
+            *p++ = '\n';
+            break;
+        case EXPORT_NDJSON:
+            p = PUT_LITERAL(p, "{\"record\":");
+            p = put_uint(p, index);
+            p = PUT_LITERAL(p, ",\"name\":");
+            p = put_json(p, record->name, record->namelen);
+            p = PUT_LITERAL(p, ",\"address\":");
+            p = put_json(p, record->address, record->addresslen);
+            p = PUT_LITERAL(p, ",\"hours\":");
+            p = put_uint(p, record->hours);
+            p = PUT_LITERAL(p, "}\n");
+            break;
+        default:
+            p = put_u32(p, index);
+            p = put_u32(p, record->hours);
+            p = put_u32(p, record->namelen);
+            p = put_u32(p, record->addresslen);
+            p = put(p, record->name, record->namelen);
+            p = put(p, record->address, record->addresslen);
+            break;
+    }
+    exporter->used = p - exporter->buf;
+    return STATUS_SUCCESS;
+}
+
+int export_end(struct exporter_t *exporter) {
+    int status = exporter->buf == NULL ? STATUS_ERROR : export_flush(exporter);
+    free(exporter->buf);
+    exporter->buf = NULL;
+    return status;
+}
+
+int export_employees(struct dbstore_t *store, int fd, int format) {
+    struct exporter_t exporter;
+    int status = export_begin(&exporter, fd, format);
+    for (unsigned long long i = 0; i < store->header.count && status == STATUS_SUCCESS; i++) {
+        struct record_t employee;
+        status = store_record(store, i, &employee);
+        if (status == STATUS_SUCCESS && !RECORD_DELETED(&employee)) {
+            status = export_record(&exporter, i, &employee);
+        }
+    }
+    if (export_end(&exporter) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
+    return status;
+}
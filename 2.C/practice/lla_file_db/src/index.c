@@ -0,0 +1,575 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "index.h"
+
+#define NAME_SIZE sizeof(((struct employee_t *)0)->name)
+#define HASH_INITIAL_SLOTS 1024
+#define SLOTS_PER_PAGE (INDEX_PAGE_SIZE / sizeof(struct hashslot_t))
+// Slots store record + 1, so zeroed pages are empty tables
+#define SLOT_EMPTY     0
+#define SLOT_TOMBSTONE 0xffffffffu
+// Far more than 32-bit record numbers can fill
+#define BT_MAX_HEIGHT  16
+
+static void *index_page(struct dbindex_t *index, unsigned int page) {
+    return index->map + (size_t)page * INDEX_PAGE_SIZE;
+}
+
+// Hands out count zeroed pages: a single page from the free list if there
+// is one, otherwise at the end of the file. The file grows by doubling, and
+// the mapping may move: callers re-fetch page pointers.
+static long index_alloc(struct dbindex_t *index, unsigned int count) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    if (count == 1 && hdr->free_page != 0) {
+        long page = hdr->free_page;
+        unsigned int *free_page = index_page(index, page);
+        hdr->free_page = *free_page;
+        memset(free_page, 0, INDEX_PAGE_SIZE);
+        return page;
+    }
+    size_t need = ((size_t)hdr->page_count + count) * INDEX_PAGE_SIZE;
+    if (need > index->maplen) {
+        size_t len = index->maplen * 2;
+        while (len < need) {
+            len *= 2;
+        }
+        if (ftruncate(index->fd, len) == -1) {
+            perror("ftruncate");
+            return STATUS_ERROR;
+        }
+        void *map = mremap(index->map, index->maplen, len, MREMAP_MAYMOVE);
+        if (map == MAP_FAILED) {
+            perror("mremap");
+            return STATUS_ERROR;
+        }
+        index->map = map;
+        index->maplen = len;
+        hdr = INDEX_HEADER(index);
+    }
+    long first = hdr->page_count;
+    hdr->page_count += count;
+    return first;
+}
+
+// A free page holds the number of the next one in its first 4 bytes
+static void index_free(struct dbindex_t *index, unsigned int page) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    *(unsigned int *)index_page(index, page) = hdr->free_page;
+    hdr->free_page = page;
+}
+
+int index_reset(struct dbindex_t *index) {
+    // Truncating first zeroes every page that gets handed out again
+    if (ftruncate(index->fd, 0) == -1 || ftruncate(index->fd, index->maplen) == -1) {
+        perror("ftruncate");
+        return STATUS_ERROR;
+    }
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    hdr->magic = INDEX_MAGIC;
+    hdr->version = INDEX_VERSION;
+    hdr->clean = 0;
+    hdr->db_count = 0;
+    hdr->page_count = 1;
+    hdr->free_page = 0;
+    long root = index_alloc(index, 1);
+    long slots = index_alloc(index, HASH_INITIAL_SLOTS / SLOTS_PER_PAGE);
+    if (root < 0 || slots < 0) {
+        return STATUS_ERROR;
+    }
+    hdr = INDEX_HEADER(index);
+    ((struct btleaf_t *)index_page(index, root))->leaf = 1;
+    hdr->btree_root = root;
+    hdr->btree_height = 1;
+    hdr->hash_page = slots;
+    hdr->hash_slots = HASH_INITIAL_SLOTS;
+    hdr->hash_used = 0;
+    hdr->hash_tombstones = 0;
+    return STATUS_SUCCESS;
+}
+
+int index_open(char *path, unsigned long long count, struct dbindex_t **indexOut, int *rebuildOut) {
+    struct dbindex_t *index = calloc(1, sizeof(struct dbindex_t));
+    if (index == NULL) {
+        printf("Malloc failed to create the index\n");
+        return STATUS_ERROR;
+    }
+    index->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (index->fd == -1) {
+        perror("open");
+        free(index);
+        return STATUS_ERROR;
+    }
+    struct stat st = {0};
+    fstat(index->fd, &st);
+    size_t len = st.st_size;
+    if (len < 16 * INDEX_PAGE_SIZE || len % INDEX_PAGE_SIZE != 0) {
+        len = 16 * INDEX_PAGE_SIZE;
+        if (ftruncate(index->fd, len) == -1) {
+            perror("ftruncate");
+            close(index->fd);
+            free(index);
+            return STATUS_ERROR;
+        }
+    }
+    index->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, index->fd, 0);
+    if (index->map == MAP_FAILED) {
+        perror("mmap");
+        close(index->fd);
+        free(index);
+        return STATUS_ERROR;
+    }
+    index->maplen = len;
+
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    *rebuildOut = hdr->magic != INDEX_MAGIC || hdr->version != INDEX_VERSION || hdr->clean != 1 ||
+                  hdr->db_count != count || (size_t)hdr->page_count * INDEX_PAGE_SIZE > len;
+    if (*rebuildOut && index_reset(index) != STATUS_SUCCESS) {
+        index_close(index);
+        return STATUS_ERROR;
+    }
+    // Until the next clean close, a crash means a rebuild
+    INDEX_HEADER(index)->clean = 0;
+    msync(index->map, INDEX_PAGE_SIZE, MS_SYNC);
+    *indexOut = index;
+    return STATUS_SUCCESS;
+}
+
+void index_close(struct dbindex_t *index) {
+    if (index == NULL) {
+        return;
+    }
+    // Everything reaches the disk before the header says so
+    msync(index->map, index->maplen, MS_SYNC);
+    INDEX_HEADER(index)->clean = 1;
+    msync(index->map, INDEX_PAGE_SIZE, MS_SYNC);
+    munmap(index->map, index->maplen);
+    close(index->fd);
+    free(index);
+}
+
+// Hash index
+
+// FNV-1a over the name up to its NUL
+unsigned long long index_name_hash(const char *name) {
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < NAME_SIZE && name[i]; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static struct hashslot_t *hash_slot(struct dbindex_t *index, unsigned int slot) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    return (struct hashslot_t *)index_page(index, hdr->hash_page) + slot;
+}
+
+static void hash_place(struct dbindex_t *index, unsigned long long hash, unsigned int stored) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    unsigned int mask = hdr->hash_slots - 1;
+    unsigned int slot = hash & mask;
+    while (hash_slot(index, slot)->record != SLOT_EMPTY) {
+        slot = (slot + 1) & mask;
+    }
+    struct hashslot_t *s = hash_slot(index, slot);
+    s->hash = hash;
+    s->record = stored;
+    hdr->hash_used++;
+}
+
+// Places the live slots of old into the table the header points at, which
+// must be empty
+static void hash_fill(struct dbindex_t *index, const struct hashslot_t *old, unsigned int old_slots) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    hdr->hash_used = 0;
+    hdr->hash_tombstones = 0;
+    for (unsigned int i = 0; i < old_slots; i++) {
+        if (old[i].record != SLOT_EMPTY && old[i].record != SLOT_TOMBSTONE) {
+            hash_place(index, old[i].hash, old[i].record);
+        }
+    }
+}
+
+// Drops the tombstones by placing the live slots again in the same pages,
+// from a copy
+static int hash_rehash(struct dbindex_t *index) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    size_t bytes = (size_t)hdr->hash_slots * sizeof(struct hashslot_t);
+    struct hashslot_t *copy = malloc(bytes);
+    if (copy == NULL) {
+        printf("Malloc failed to rehash the index\n");
+        return STATUS_ERROR;
+    }
+    memcpy(copy, hash_slot(index, 0), bytes);
+    memset(hash_slot(index, 0), 0, bytes);
+    hash_fill(index, copy, hdr->hash_slots);
+    free(copy);
+    return STATUS_SUCCESS;
+}
+
+// Moves the live slots into a table twice as big and frees the old pages,
+// or rehashes in place if most of the old one was tombstones
+static int hash_grow(struct dbindex_t *index) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    unsigned int old_slots = hdr->hash_slots;
+    if ((unsigned long long)(hdr->hash_used - hdr->hash_tombstones) * 4 <= old_slots) {
+        return hash_rehash(index);
+    }
+    long page = index_alloc(index, old_slots * 2 / SLOTS_PER_PAGE);
+    if (page < 0) {
+        return STATUS_ERROR;
+    }
+    hdr = INDEX_HEADER(index);
+    unsigned int old_page = hdr->hash_page;
+    hdr->hash_page = page;
+    hdr->hash_slots = old_slots * 2;
+    hash_fill(index, index_page(index, old_page), old_slots);
+    for (unsigned int i = 0; i < old_slots / SLOTS_PER_PAGE; i++) {
+        index_free(index, old_page + i);
+    }
+    return STATUS_SUCCESS;
+}
+
+static int hash_insert(struct dbindex_t *index, unsigned int record, const char *name) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    if ((unsigned long long)(hdr->hash_used + 1) * 10 > (unsigned long long)hdr->hash_slots * 7 &&
+        hash_grow(index) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    hash_place(index, index_name_hash(name), record + 1);
+    return STATUS_SUCCESS;
+}
+
+static int hash_remove(struct dbindex_t *index, unsigned int record, const char *name) {
+    unsigned long long hash = index_name_hash(name);
+    unsigned int mask = INDEX_HEADER(index)->hash_slots - 1;
+    for (unsigned int slot = hash & mask; hash_slot(index, slot)->record != SLOT_EMPTY; slot = (slot + 1) & mask) {
+        struct hashslot_t *s = hash_slot(index, slot);
+        if (s->record == record + 1 && s->hash == hash) {
+            s->record = SLOT_TOMBSTONE;
+            // Long probes through tombstones would slow every lookup
+            struct idxheader_t *hdr = INDEX_HEADER(index);
+            hdr->hash_tombstones++;
+            return hdr->hash_tombstones > hdr->hash_used - hdr->hash_tombstones ? hash_rehash(index) : STATUS_SUCCESS;
+        }
+    }
+    printf("Record %u missing from the name index\n", record);
+    return STATUS_ERROR;
+}
+
+int index_find_name(struct dbindex_t *index, const char *name, index_visit_t visit, void *arg) {
+    unsigned long long hash = index_name_hash(name);
+    unsigned int mask = INDEX_HEADER(index)->hash_slots - 1;
+    for (unsigned int slot = hash & mask; hash_slot(index, slot)->record != SLOT_EMPTY; slot = (slot + 1) & mask) {
+        struct hashslot_t *s = hash_slot(index, slot);
+        if (s->record != SLOT_TOMBSTONE && s->hash == hash && visit(s->record - 1, arg)) {
+            break;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+// B+-tree
+
+static int key_cmp(struct btkey_t a, struct btkey_t b) {
+    if (a.hours != b.hours) {
+        return a.hours < b.hours ? -1 : 1;
+    }
+    return a.record < b.record ? -1 : a.record > b.record;
+}
+
+// First position whose key is not below key
+static unsigned int lower_bound(const struct btkey_t *keys, unsigned int n, struct btkey_t key) {
+    unsigned int lo = 0, hi = n;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (key_cmp(keys[mid], key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Child to follow: keys equal to a separator live on its right
+static unsigned int child_slot(const struct btinner_t *node, struct btkey_t key) {
+    unsigned int i = lower_bound(node->keys, node->nkeys, key);
+    if (i < node->nkeys && key_cmp(node->keys[i], key) == 0) {
+        i++;
+    }
+    return i;
+}
+
+// Inserts below page. On a split, returns 1 with the separator and the new
+// right sibling; 0 if the node absorbed the key; STATUS_ERROR on failure.
+static int bt_insert(struct dbindex_t *index, unsigned int page, struct btkey_t key, struct btkey_t *sepOut,
+                     unsigned int *rightOut) {
+    struct btleaf_t *leaf = index_page(index, page);
+    if (leaf->leaf) {
+        unsigned int pos = lower_bound(leaf->keys, leaf->nkeys, key);
+        if (leaf->nkeys < BT_LEAF_MAX) {
+            memmove(&leaf->keys[pos + 1], &leaf->keys[pos], (leaf->nkeys - pos) * sizeof(struct btkey_t));
+            leaf->keys[pos] = key;
+            leaf->nkeys++;
+            return 0;
+        }
+        long right = index_alloc(index, 1);
+        if (right < 0) {
+            return STATUS_ERROR;
+        }
+        leaf = index_page(index, page);
+        struct btleaf_t *sibling = index_page(index, right);
+        struct btkey_t all[BT_LEAF_MAX + 1];
+        memcpy(all, leaf->keys, pos * sizeof(struct btkey_t));
+        all[pos] = key;
+        memcpy(all + pos + 1, leaf->keys + pos, (BT_LEAF_MAX - pos) * sizeof(struct btkey_t));
+        unsigned int half = (BT_LEAF_MAX + 1) / 2;
+        memcpy(leaf->keys, all, half * sizeof(struct btkey_t));
+        leaf->nkeys = half;
+        sibling->leaf = 1;
+        memcpy(sibling->keys, all + half, (BT_LEAF_MAX + 1 - half) * sizeof(struct btkey_t));
+        sibling->nkeys = BT_LEAF_MAX + 1 - half;
+        sibling->next = leaf->next;
+        leaf->next = right;
+        *sepOut = sibling->keys[0];
+        *rightOut = right;
+        return 1;
+    }
+
+    struct btinner_t *node = index_page(index, page);
+    unsigned int pos = child_slot(node, key);
+    struct btkey_t sep;
+    unsigned int child;
+    int split = bt_insert(index, node->children[pos], key, &sep, &child);
+    if (split <= 0) {
+        return split;
+    }
+    node = index_page(index, page);
+    if (node->nkeys < BT_INNER_MAX) {
+        memmove(&node->keys[pos + 1], &node->keys[pos], (node->nkeys - pos) * sizeof(struct btkey_t));
+        memmove(&node->children[pos + 2], &node->children[pos + 1], (node->nkeys - pos) * sizeof(unsigned int));
+        node->keys[pos] = sep;
+        node->children[pos + 1] = child;
+        node->nkeys++;
+        return 0;
+    }
+    long right = index_alloc(index, 1);
+    if (right < 0) {
+        return STATUS_ERROR;
+    }
+    node = index_page(index, page);
+    struct btinner_t *sibling = index_page(index, right);
+    struct btkey_t keys[BT_INNER_MAX + 1];
+    unsigned int children[BT_INNER_MAX + 2];
+    memcpy(keys, node->keys, pos * sizeof(struct btkey_t));
+    keys[pos] = sep;
+    memcpy(keys + pos + 1, node->keys + pos, (BT_INNER_MAX - pos) * sizeof(struct btkey_t));
+    memcpy(children, node->children, (pos + 1) * sizeof(unsigned int));
+    children[pos + 1] = child;
+    memcpy(children + pos + 2, node->children + pos + 1, (BT_INNER_MAX - pos) * sizeof(unsigned int));
+    // The middle key moves up; it stays in neither half
+    unsigned int mid = (BT_INNER_MAX + 1) / 2;
+    node->nkeys = mid;
+    memcpy(node->keys, keys, mid * sizeof(struct btkey_t));
+    memcpy(node->children, children, (mid + 1) * sizeof(unsigned int));
+    sibling->leaf = 0;
+    sibling->nkeys = BT_INNER_MAX - mid;
+    memcpy(sibling->keys, keys + mid + 1, sibling->nkeys * sizeof(struct btkey_t));
+    memcpy(sibling->children, children + mid + 1, (sibling->nkeys + 1) * sizeof(unsigned int));
+    *sepOut = keys[mid];
+    *rightOut = right;
+    return 1;
+}
+
+static int btree_insert(struct dbindex_t *index, unsigned int record, unsigned int hours) {
+    struct btkey_t key = {.hours = hours, .record = record};
+    struct btkey_t sep;
+    unsigned int right;
+    int split = bt_insert(index, INDEX_HEADER(index)->btree_root, key, &sep, &right);
+    if (split <= 0) {
+        return split;
+    }
+    long root = index_alloc(index, 1);
+    if (root < 0) {
+        return STATUS_ERROR;
+    }
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    struct btinner_t *node = index_page(index, root);
+    node->leaf = 0;
+    node->nkeys = 1;
+    node->keys[0] = sep;
+    node->children[0] = hdr->btree_root;
+    node->children[1] = right;
+    hdr->btree_root = root;
+    hdr->btree_height++;
+    return STATUS_SUCCESS;
+}
+
+static struct btleaf_t *btree_leaf_for(struct dbindex_t *index, struct btkey_t key) {
+    struct btinner_t *node = index_page(index, INDEX_HEADER(index)->btree_root);
+    while (!node->leaf) {
+        node = index_page(index, node->children[child_slot(node, key)]);
+    }
+    return (struct btleaf_t *)node;
+}
+
+// Takes children[slot] out of an inner node with the separator bounding it:
+// the one on its left, or for the first child the one on its right
+static void inner_drop(struct btinner_t *node, unsigned int slot) {
+    unsigned int key = slot > 0 ? slot - 1 : 0;
+    memmove(&node->keys[key], &node->keys[key + 1], (node->nkeys - key - 1) * sizeof(struct btkey_t));
+    memmove(&node->children[slot], &node->children[slot + 1], (node->nkeys - slot) * sizeof(unsigned int));
+    node->nkeys--;
+}
+
+// Takes the child at slots[level] out of pages[level], freeing any inner
+// node that leaves childless and taking it out of its own parent in turn.
+// A root left with one child then hands over to it.
+static void btree_drop(struct dbindex_t *index, const unsigned int *pages, const unsigned int *slots,
+                       unsigned int level) {
+    for (;;) {
+        struct btinner_t *node = index_page(index, pages[level]);
+        if (node->nkeys > 0 || level == 0) {
+            inner_drop(node, slots[level]);
+            break;
+        }
+        index_free(index, pages[level]);
+        level--;
+    }
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    struct btinner_t *root = index_page(index, hdr->btree_root);
+    while (!root->leaf && root->nkeys == 0) {
+        unsigned int child = root->children[0];
+        index_free(index, hdr->btree_root);
+        hdr->btree_root = child;
+        hdr->btree_height--;
+        root = index_page(index, child);
+    }
+}
+
+// Moves right's keys onto the end of left, its neighbour in the chain
+static void leaf_merge(struct btleaf_t *left, const struct btleaf_t *right) {
+    memcpy(&left->keys[left->nkeys], right->keys, right->nkeys * sizeof(struct btkey_t));
+    left->nkeys += right->nkeys;
+    left->next = right->next;
+}
+
+// A leaf under a quarter full merges with a sibling under the same parent
+// when their keys fit in one page. An empty leaf with no sibling there
+// comes out of the chain and the tree on its own.
+static void btree_compact(struct dbindex_t *index, unsigned int *pages, unsigned int *slots, unsigned int depth,
+                          unsigned int page) {
+    struct btinner_t *parent = index_page(index, pages[depth - 1]);
+    unsigned int slot = slots[depth - 1];
+    struct btleaf_t *leaf = index_page(index, page);
+    if (slot > 0) {
+        unsigned int left_page = parent->children[slot - 1];
+        struct btleaf_t *left = index_page(index, left_page);
+        if (left->nkeys + leaf->nkeys <= BT_LEAF_MAX) {
+            leaf_merge(left, leaf);
+            index_free(index, page);
+            btree_drop(index, pages, slots, depth - 1);
+        }
+        return;
+    }
+    if (parent->nkeys > 0) {
+        unsigned int right_page = parent->children[1];
+        struct btleaf_t *right = index_page(index, right_page);
+        if (leaf->nkeys + right->nkeys <= BT_LEAF_MAX) {
+            leaf_merge(leaf, right);
+            index_free(index, right_page);
+            slots[depth - 1] = 1;
+            btree_drop(index, pages, slots, depth - 1);
+        }
+        return;
+    }
+    if (leaf->nkeys > 0) {
+        return;
+    }
+    // The leaf before it in the chain is the last one under the nearest
+    // ancestor's previous child, if any ancestor has one
+    for (unsigned int level = depth; level-- > 0;) {
+        if (slots[level] > 0) {
+            struct btinner_t *node = index_page(index, pages[level]);
+            node = index_page(index, node->children[slots[level] - 1]);
+            while (!node->leaf) {
+                node = index_page(index, node->children[node->nkeys]);
+            }
+            ((struct btleaf_t *)node)->next = leaf->next;
+            break;
+        }
+    }
+    index_free(index, page);
+    btree_drop(index, pages, slots, depth - 1);
+}
+
+static int btree_remove(struct dbindex_t *index, unsigned int record, unsigned int hours) {
+    struct btkey_t key = {.hours = hours, .record = record};
+    unsigned int pages[BT_MAX_HEIGHT], slots[BT_MAX_HEIGHT], depth = 0;
+    unsigned int page = INDEX_HEADER(index)->btree_root;
+    struct btinner_t *node = index_page(index, page);
+    while (!node->leaf && depth < BT_MAX_HEIGHT) {
+        pages[depth] = page;
+        slots[depth] = child_slot(node, key);
+        page = node->children[slots[depth]];
+        node = index_page(index, page);
+        depth++;
+    }
+    struct btleaf_t *leaf = (struct btleaf_t *)node;
+    unsigned int pos = lower_bound(leaf->keys, leaf->nkeys, key);
+    if (!leaf->leaf || pos == leaf->nkeys || key_cmp(leaf->keys[pos], key) != 0) {
+        printf("Record %u missing from the hours index\n", record);
+        return STATUS_ERROR;
+    }
+    memmove(&leaf->keys[pos], &leaf->keys[pos + 1], (leaf->nkeys - pos - 1) * sizeof(struct btkey_t));
+    leaf->nkeys--;
+    if (depth > 0 && leaf->nkeys < BT_LEAF_MAX / 4) {
+        btree_compact(index, pages, slots, depth, page);
+    }
+    return STATUS_SUCCESS;
+}
+
+int index_range_hours(struct dbindex_t *index, unsigned int lo, unsigned int hi, index_visit_t visit, void *arg) {
+    struct btkey_t key = {.hours = lo, .record = 0};
+    struct btleaf_t *leaf = btree_leaf_for(index, key);
+    unsigned int pos = lower_bound(leaf->keys, leaf->nkeys, key);
+    for (;;) {
+        for (; pos < leaf->nkeys; pos++) {
+            if (leaf->keys[pos].hours > hi) {
+                return STATUS_SUCCESS;
+            }
+            if (visit(leaf->keys[pos].record, arg)) {
+                return STATUS_SUCCESS;
+            }
+        }
+        if (leaf->next == 0) {
+            return STATUS_SUCCESS;
+        }
+        leaf = index_page(index, leaf->next);
+        pos = 0;
+    }
+}
+
+int index_insert(struct dbindex_t *index, unsigned int record, const char *name, unsigned int hours) {
+    if (hash_insert(index, record, name) != STATUS_SUCCESS || btree_insert(index, record, hours) != STATUS_SUCCESS) {
+        printf("Failed to update the index\n");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int index_remove(struct dbindex_t *index, unsigned int record, const char *name, unsigned int hours) {
+    if (hash_remove(index, record, name) != STATUS_SUCCESS || btree_remove(index, record, hours) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
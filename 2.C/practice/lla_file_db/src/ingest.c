@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ingest.h"
+#include "store.h"
+
+// Bad lines reported before going quiet
+#define INGEST_MAX_MESSAGES 10
+
+int csv_split(char *line, size_t length, struct csvfield_t *fields, int max) {
+    char *p = line;
+    char *end = line + length;
+    int n = 0;
+    for (;;) {
+        char *start = p;
+        char *stop;
+        if (p < end && *p == '"') {
+            // Unquote by copying back over the opening quote
+            char *to = p;
+            char *from = p + 1;
+            for (;;) {
+                char *quote = memchr(from, '"', end - from);
+                if (quote == NULL) {
+                    return -1;
+                }
+                memmove(to, from, quote - from);
+                to += quote - from;
+                from = quote + 1;
+                if (from < end && *from == '"') {
+                    *to++ = '"';
+                    from++;
+                    continue;
+                }
+                break;
+            }
+            if (from < end && *from != ',') {
+                return -1;
+            }
+            stop = to;
+            p = from;
+        } else {
+            p = memchr(p, ',', end - p);
+            if (p == NULL) {
+                p = end;
+            }
+            stop = p;
+        }
+        if (n < max) {
+            fields[n].data = start;
+            fields[n].length = stop - start;
+        }
+        n++;
+        if (p == end) {
+            return n;
+        }
+        p++;
+    }
+}
+
+// Digits only, spaces around them allowed
+static int parse_hours(const char *p, unsigned int length, unsigned int *hoursOut) {
+    while (length > 0 && *p == ' ') {
+        p++;
+        length--;
+    }
+    while (length > 0 && p[length - 1] == ' ') {
+        length--;
+    }
+    if (length == 0 || length > 10) {
+        return STATUS_ERROR;
+    }
+    unsigned long long hours = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return STATUS_ERROR;
+        }
+        hours = hours * 10 + (p[i] - '0');
+    }
+    if (hours > 0xffffffffULL) {
+        return STATUS_ERROR;
+    }
+    *hoursOut = hours;
+    return STATUS_SUCCESS;
+}
+
+static void skip_line(struct ingest_stats_t *stats, const char *why) {
+    if (stats->skipped < INGEST_MAX_MESSAGES) {
+        printf("Line %llu: %s\n", stats->lines, why);
+    } else if (stats->skipped == INGEST_MAX_MESSAGES) {
+        printf("Not reporting any more bad lines\n");
+    }
+    stats->skipped++;
+}
+
+// STATUS_ERROR only when the batch itself failed
+static int ingest_line(struct dbbatch_t *batch, char *line, size_t length, struct ingest_stats_t *stats) {
+    stats->lines++;
+    if (length > 0 && line[length - 1] == '\r') {
+        length--;
+    }
+    if (length == 0) {
+        return STATUS_SUCCESS;
+    }
+    struct csvfield_t fields[3];
+    int n = csv_split(line, length, fields, 3);
+    unsigned int hours;
+    if (n != 3) {
+        skip_line(stats, n < 0 ? "unmatched quote" : "expected name,address,hours");
+    } else if (parse_hours(fields[2].data, fields[2].length, &hours) != STATUS_SUCCESS) {
+        if (stats->lines > 1) {
+            skip_line(stats, "hours must be a whole number");
+        }
+    } else if (fields[0].length == 0) {
+        skip_line(stats, "empty name");
+    } else if (fields[0].length > STORE_STRING_MAX || fields[1].length > STORE_STRING_MAX) {
+        skip_line(stats, "name or address too long");
+    } else if (memchr(fields[0].data, '\0', fields[0].length) || memchr(fields[1].data, '\0', fields[1].length)) {
+        skip_line(stats, "NUL byte in a name or address");
+    } else if (store_batch_add(batch, fields[0].data, fields[0].length, fields[1].data, fields[1].length, hours) !=
+               STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    } else {
+        stats->rows++;
+    }
+    return STATUS_SUCCESS;
+}
+
+int ingest_csv(struct dbstore_t *store, int fd, struct ingest_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    char *buf = malloc(INGEST_BUFFER);
+    struct dbbatch_t *batch = NULL;
+    if (buf == NULL) {
+        printf("Malloc failed to load\n");
+        return STATUS_ERROR;
+    }
+    if (store_batch_begin(store, &batch) != STATUS_SUCCESS) {
+        free(buf);
+        return STATUS_ERROR;
+    }
+    int status = STATUS_SUCCESS;
+    int eof = 0;
+    size_t have = 0;
+    while (status == STATUS_SUCCESS && (!eof || have > 0)) {
+        if (!eof) {
+            ssize_t n = read(fd, buf + have, INGEST_BUFFER - have);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                perror("read");
+                status = STATUS_ERROR;
+                break;
+            }
+            eof = n == 0;
+            have += n;
+            stats->bytes += n;
+        }
+        // Whole lines; a last one without a newline once the input ends
+        char *p = buf;
+        char *end = buf + have;
+        while (status == STATUS_SUCCESS && p < end) {
+            char *newline = memchr(p, '\n', end - p);
+            if (newline == NULL && !eof) {
+                break;
+            }
+            if (newline == NULL) {
+                newline = end;
+            }
+            status = ingest_line(batch, p, newline - p, stats);
+            p = newline < end ? newline + 1 : end;
+        }
+        have = end - p;
+        memmove(buf, p, have);
+        if (status == STATUS_SUCCESS && have == INGEST_BUFFER) {
+            printf("Line %llu is longer than %d bytes\n", stats->lines + 1, INGEST_BUFFER);
+            status = STATUS_ERROR;
+        }
+    }
+    free(buf);
+    if (status != STATUS_SUCCESS) {
+        store_batch_abort(batch);
+        stats->rows = 0;
+        return STATUS_ERROR;
+    }
+    if (store_batch_commit(batch) != STATUS_SUCCESS) {
+        stats->rows = 0;
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int bulk_add_employees(struct dbstore_t *store, char *path) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return STATUS_ERROR;
+    }
+    struct ingest_stats_t stats;
+    int status = ingest_csv(store, fd, &stats);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (status != STATUS_SUCCESS) {
+        printf("Nothing was loaded\n");
+        return STATUS_ERROR;
+    }
+    printf("Loaded %llu employees", stats.rows);
+    if (stats.skipped > 0) {
+        printf(", skipped %llu bad lines", stats.skipped);
+    }
+    printf("\n");
+    return stats.skipped > 0 ? STATUS_ERROR : STATUS_SUCCESS;
+}
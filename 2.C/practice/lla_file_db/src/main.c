@@ -4,30 +4,51 @@
 #include <getopt.h>
 
 #include "common.h"
+#include "export.h"
 #include "file.h"
+#include "ingest.h"
 #include "parse.h"
+#include "query.h"
+#include "server.h"
+#include "store.h"
 
 void print_usage(char *argv[]) {
     printf("Usage: %s -n -f <database file>\n", argv[0]);
     printf("\t -n - create new database file\n");
-    printf("\t -f - (required) path to database file");
+    printf("\t -f - (required) path to database file\n");
+    printf("\t -a - add an employee, \"name,address,hours\"\n");
+    printf("\t -b - add every employee in a CSV file of name,address,hours (- for stdin)\n");
+    printf("\t -l - list the employees\n");
+    printf("\t -o - format for -l: human (default), csv, ndjson or binary\n");
+    printf("\t -u - replace the employee with these hours, \"hours,name,address,hours\"\n");
+    printf("\t -d - delete an employee by hours\n");
+    printf("\t -s - find employees by name\n");
+    printf("\t -r - list employees by hours, \"low,high\"\n");
+    printf("\t -q - query, e.g. \"name=Tim;hours=100-200;select=name,hours;top=10\" or \"hours=-40;count;avg\"\n");
+    printf("\t -m - rewrite into the version 3 format, compacting strings\n");
+    printf("\t -S - keep running and serve requests on this Unix socket\n");
     return;
 } 
 
 int main(int argc, char *argv[]) {
     char *filepath = NULL;
     char *addstring = NULL;
+    char *bulkpath = NULL;
     char *updatestring = NULL;
     char *deletestring = NULL;
+    char *searchname = NULL;
+    char *rangestring = NULL;
+    char *socketpath = NULL;
+    char *querystring = NULL;
+    char *formatname = NULL;
     bool newfile = false;
     bool list = false;
+    bool migrate = false;
     //getopt case - what we get from commandline
     int c;
-    int dbfd = -1;
-    struct dbheader_t *header = NULL;
-    struct employee_t *employees = NULL;
+    struct dbstore_t *store = NULL;
     // f: and a: because the both have data coming after
-    while ((c = getopt(argc, argv, "nf:a:lu:d:")) != -1) {
+    while ((c = getopt(argc, argv, "nf:a:b:lo:u:d:s:r:q:mS:")) != -1) {
         switch (c) {
             case 'n':
                 newfile = true;
@@ -38,15 +59,36 @@ int main(int argc, char *argv[]) {
             case 'a':
                 addstring = optarg;
                 break;
+            case 'b':
+                bulkpath = optarg;
+                break;
             case 'l':
                 list = true;
                 break;
+            case 'o':
+                formatname = optarg;
+                break;
             case 'u':
                 updatestring = optarg;
                 break;
             case 'd':
                 deletestring = optarg;
                 break;
+            case 's':
+                searchname = optarg;
+                break;
+            case 'r':
+                rangestring = optarg;
+                break;
+            case 'q':
+                querystring = optarg;
+                break;
+            case 'm':
+                migrate = true;
+                break;
+            case 'S':
+                socketpath = optarg;
+                break;
             case '?':
                 printf("Unknown option -%c\n", c);
                 break;
@@ -61,52 +103,69 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    int format = formatname ? export_format(formatname) : EXPORT_HUMAN;
+    if (format == STATUS_ERROR) {
+        printf("Unknown output format \"%s\"\n", formatname);
+        return -1;
+    }
+
     if (newfile) {
-        dbfd = create_db_file(filepath);
-        if (dbfd == STATUS_ERROR) {
+        if (store_create(filepath, DB_VERSION_CURRENT, &store) == STATUS_ERROR) {
             printf("Unable to create database file\n");
             return -1;
         }
-        if (create_db_header(dbfd, &header) == STATUS_ERROR) {
-            printf("Failed to create db header\n");
-            return -1;
-        }
     } else {
-        dbfd = open_db_file(filepath);
-        if (dbfd == STATUS_ERROR) {
+        if (store_open(filepath, &store) == STATUS_ERROR) {
             printf("Unable to open database file\n");
             return -1;
         }
-        if (validate_db_header(dbfd, &header) == STATUS_ERROR) {
-            printf("Failed to validate database header\n");
-            return -1; 
-        }
     }
 
-    if(read_employees(dbfd, header, &employees) != STATUS_SUCCESS) {
-        printf("Failed to read employees\n");
-        return 0;
+    // Each change is written in place as it happens; there is no final
+    // rewrite of the file
+    int status = STATUS_SUCCESS;
+    // Converts a version 1 or 2 file, or squeezes out version 3 strings
+    if (migrate && store_rewrite(store, store->header.count) != STATUS_SUCCESS) {
+        printf("Failed to rewrite the database\n");
+        status = STATUS_ERROR;
+    }
+
+    if (bulkpath && bulk_add_employees(store, bulkpath) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
+
+    if (addstring && add_employee(store, addstring) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
     }
 
-    if (addstring) {
-        header->count++;
-        employees = realloc(employees, header->count*(sizeof(struct employee_t)));
-        add_employee(header, employees, addstring);
+    if (updatestring && update_employee(store, updatestring) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
     }
 
-    if (updatestring) {
-        update_employee(header, employees, updatestring);
+    if (deletestring && remove_employee(store, deletestring) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
     }
 
-    if (deletestring) {
-        remove_employee(header, &employees, deletestring);
+    if (list && list_employees(store, format) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
     }
 
-    if (list) {
-        list_employees(header, employees);
+    if (searchname && find_employees_by_name(store, searchname) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
     }
 
-    output_file(dbfd, header, employees);
+    if (rangestring && list_employees_by_hours(store, rangestring) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
+
+    if (querystring && run_query(store, querystring) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
+
+    if (socketpath && server_run(store, socketpath) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
 
-    return 0;
+    store_close(store);
+    return status == STATUS_SUCCESS ? 0 : -1;
 }
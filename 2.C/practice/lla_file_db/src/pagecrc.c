@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "checksum.h"
+#include "common.h"
+#include "pagecrc.h"
+#include "parse.h"
+#include "store.h"
+#include "wal.h"
+
+#define PAGES(bytes) (((bytes) + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE)
+
+unsigned int pagecrc_live(const struct dbheader64_t *header, unsigned long long page) {
+    unsigned long long start = page * DB_PAGE_SIZE;
+    if (page == 0 || start >= header->filesize ||
+        (start >= header->checksums && start < header->checksums + CHECKSUM_TABLE_SIZE(header->checksum_pages))) {
+        return 0;
+    }
+    unsigned long long live = header->filesize - start;
+    // Segments are in file order
+    for (unsigned int k = 0; k < header->segment_count && header->segments[k] <= start; k++) {
+        unsigned long long at = start - header->segments[k];
+        if (at >= SEGMENT_SIZE(k)) {
+            continue;
+        }
+        unsigned long long refs = SEGMENT_ROWS(k) * sizeof(unsigned long long);
+        unsigned int width = at < 2 * refs ? sizeof(unsigned long long) : sizeof(unsigned int);
+        unsigned long long row = SEGMENT_FIRST(k) + (at < 2 * refs ? at % refs : at - 2 * refs) / width;
+        live = row < header->count ? (header->count - row) * width : 0;
+        break;
+    }
+    return live < DB_PAGE_SIZE ? live : DB_PAGE_SIZE;
+}
+
+// Host-order checksums of pages first..first+n-1, whose bytes are at data;
+// 0 for a page with nothing live. Full pages go three at a time.
+static void checksum_pages(const struct dbheader64_t *header, const char *data, unsigned long long first,
+                           unsigned int n, unsigned int *crcs) {
+    unsigned int full[3];
+    unsigned int nfull = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int live = pagecrc_live(header, first + i);
+        crcs[i] = 0;
+        if (live == DB_PAGE_SIZE) {
+            full[nfull++] = i;
+        } else if (live > 0) {
+            crcs[i] = crc32c(0, data + (size_t)i * DB_PAGE_SIZE, live);
+        }
+        if (nfull == 3) {
+            unsigned int three[3];
+            crc32c_3(data + (size_t)full[0] * DB_PAGE_SIZE, data + (size_t)full[1] * DB_PAGE_SIZE,
+                     data + (size_t)full[2] * DB_PAGE_SIZE, DB_PAGE_SIZE, three);
+            crcs[full[0]] = three[0];
+            crcs[full[1]] = three[1];
+            crcs[full[2]] = three[2];
+            nfull = 0;
+        }
+    }
+    for (unsigned int j = 0; j < nfull; j++) {
+        crcs[full[j]] = crc32c(0, data + (size_t)full[j] * DB_PAGE_SIZE, DB_PAGE_SIZE);
+    }
+}
+
+// Like read_all, but bytes past the end of the file read as 0
+static int read_pages(int fd, char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = pread(fd, data, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("pread");
+            return STATUS_ERROR;
+        }
+        if (n == 0) {
+            memset(data, 0, length);
+            return STATUS_SUCCESS;
+        }
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Big-endian checksums into table for pages first..end-1 as the file (and
+// wal's open transaction, if any) has them
+static int checksum_file(int fd, struct wal_t *wal, const struct dbheader64_t *header, unsigned long long first,
+                         unsigned long long end, unsigned int *table) {
+    size_t chunk = end - first < PAGECRC_CHUNK ? end - first : PAGECRC_CHUNK;
+    char *data = malloc(chunk * DB_PAGE_SIZE);
+    if (data == NULL) {
+        printf("Malloc failed to checksum pages\n");
+        return STATUS_ERROR;
+    }
+    for (unsigned long long p = first; p < end; p += chunk) {
+        unsigned int n = end - p < chunk ? end - p : chunk;
+        if (read_pages(fd, data, (size_t)n * DB_PAGE_SIZE, p * DB_PAGE_SIZE) != STATUS_SUCCESS) {
+            free(data);
+            return STATUS_ERROR;
+        }
+        if (wal) {
+            wal_overlay(wal, p * DB_PAGE_SIZE, data, (size_t)n * DB_PAGE_SIZE);
+        }
+        checksum_pages(header, data, p, n, table + (p - first));
+    }
+    for (unsigned long long p = first; p < end; p++) {
+        table[p - first] = htonl(table[p - first]);
+    }
+    free(data);
+    return STATUS_SUCCESS;
+}
+
+// A table at the next page boundary with room for twice the file, itself
+// included, which becomes the new end of the file
+static void place_table(struct dbheader64_t *header) {
+    header->checksums = (header->filesize + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE * DB_PAGE_SIZE;
+    header->checksum_pages = 2 * header->checksums / DB_PAGE_SIZE;
+    if (header->checksum_pages < PAGECRC_MIN_PAGES) {
+        header->checksum_pages = PAGECRC_MIN_PAGES;
+    }
+    header->filesize = header->checksums + CHECKSUM_TABLE_SIZE(header->checksum_pages);
+}
+
+int pagecrc_build(int fd, struct dbheader64_t *header) {
+    place_table(header);
+    size_t size = CHECKSUM_TABLE_SIZE(header->checksum_pages);
+    unsigned int *table = calloc(1, size);
+    int status = table ? STATUS_SUCCESS : STATUS_ERROR;
+    if (status == STATUS_SUCCESS) {
+        status = checksum_file(fd, NULL, header, 0, header->checksums / DB_PAGE_SIZE, table);
+    }
+    if (status == STATUS_SUCCESS) {
+        status = write_all(fd, table, size, header->checksums);
+    }
+    if (status != STATUS_SUCCESS) {
+        printf("Failed to write the page checksums\n");
+    }
+    free(table);
+    return status;
+}
+
+// The shadow table: the old entries, plus ones for the old table's pages,
+// which are ordinary pages from now on. Synced before it is committed.
+static int move_table(struct dbstore_t *store, struct dbheader64_t *header) {
+    const struct dbheader64_t *old = &store->header;
+    place_table(header);
+    size_t size = CHECKSUM_TABLE_SIZE(header->checksum_pages);
+    unsigned long long oldpages = PAGES(old->filesize);
+    unsigned long long first = old->checksums / DB_PAGE_SIZE;
+    unsigned long long end = first + CHECKSUM_TABLE_SIZE(old->checksum_pages) / DB_PAGE_SIZE;
+    unsigned int *table = calloc(1, size);
+    int status = table ? STATUS_SUCCESS : STATUS_ERROR;
+    if (status == STATUS_SUCCESS) {
+        status = read_all(store->fd, table, oldpages * sizeof(unsigned int), old->checksums);
+    }
+    if (status == STATUS_SUCCESS) {
+        status = checksum_file(store->fd, store->wal, header, first, end, table + first);
+    }
+    if (status == STATUS_SUCCESS && (write_all(store->fd, table, size, header->checksums) != STATUS_SUCCESS ||
+                                     fdatasync(store->fd) == -1)) {
+        status = STATUS_ERROR;
+    }
+    if (status != STATUS_SUCCESS) {
+        printf("Failed to grow the page checksums\n");
+    }
+    free(table);
+    return status;
+}
+
+// Logs the checksums of the pages holding bytes from..to-1
+static int log_range(struct dbstore_t *store, const struct dbheader64_t *header, unsigned long long from,
+                     unsigned long long to) {
+    if (from >= to) {
+        return STATUS_SUCCESS;
+    }
+    unsigned long long first = from / DB_PAGE_SIZE;
+    unsigned long long end = PAGES(to);
+    unsigned int *table = malloc((end - first) * sizeof(unsigned int));
+    int status = table ? checksum_file(store->fd, store->wal, header, first, end, table) : STATUS_ERROR;
+    if (status == STATUS_SUCCESS) {
+        status = wal_add(store->wal, header->checksums + first * sizeof(unsigned int), table,
+                         (end - first) * sizeof(unsigned int));
+    }
+    free(table);
+    return status;
+}
+
+int pagecrc_log(struct dbstore_t *store, struct dbheader64_t *header, unsigned long long first,
+                unsigned long long end) {
+    if (header->checksums == 0) {
+        return STATUS_SUCCESS;
+    }
+    const struct dbheader64_t *old = &store->header;
+    if (PAGES(header->filesize) > header->checksum_pages && move_table(store, header) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    int status = STATUS_SUCCESS;
+    for (unsigned long long i = first; status == STATUS_SUCCESS && i < end;) {
+        unsigned long long stop = SEGMENT_FIRST(SEGMENT_OF(i) + 1);
+        if (stop > end) {
+            stop = end;
+        }
+        for (int c = COLUMN_NAMES; status == STATUS_SUCCESS && c <= COLUMN_HOURS; c++) {
+            unsigned int width = c == COLUMN_HOURS ? sizeof(unsigned int) : sizeof(unsigned long long);
+            status = log_range(store, header, large_column(header, i, c), large_column(header, stop - 1, c) + width);
+        }
+        i = stop;
+    }
+    // New segments are covered by their rows
+    unsigned long long from = old->filesize;
+    for (unsigned int k = old->segment_count; status == STATUS_SUCCESS && k < header->segment_count; k++) {
+        status = log_range(store, header, from, header->segments[k]);
+        from = header->segments[k] + SEGMENT_SIZE(k);
+    }
+    if (status == STATUS_SUCCESS) {
+        status = log_range(store, header, from, header->filesize);
+    }
+    return status;
+}
+
+struct verify_t {
+    const struct dbheader64_t *header;
+    const char *map;
+    unsigned long long first;
+    unsigned long long end;
+    unsigned long long bad;     // pages that fail
+    unsigned long long firstbad;
+};
+
+static void *verify_range(void *arg) {
+    struct verify_t *verify = arg;
+    const struct dbheader64_t *header = verify->header;
+    const unsigned int *table = (const unsigned int *)(verify->map + header->checksums);
+    unsigned int crcs[PAGECRC_CHUNK];
+    for (unsigned long long p = verify->first; p < verify->end; p += PAGECRC_CHUNK) {
+        unsigned int n = verify->end - p < PAGECRC_CHUNK ? verify->end - p : PAGECRC_CHUNK;
+        checksum_pages(header, verify->map + p * DB_PAGE_SIZE, p, n, crcs);
+        for (unsigned int i = 0; i < n; i++) {
+            if (crcs[i] != ntohl(table[p + i]) && pagecrc_live(header, p + i) > 0) {
+                verify->firstbad = verify->bad++ ? verify->firstbad : p + i;
+            }
+        }
+    }
+    return NULL;
+}
+
+int pagecrc_verify(struct dbstore_t *store) {
+    const struct dbheader64_t *header = &store->header;
+    if (header->version != DB_VERSION_LARGE || header->checksums == 0) {
+        return STATUS_SUCCESS;
+    }
+    if (store_map(store) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    unsigned long long pages = PAGES(header->filesize);
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > PAGECRC_MAX_THREADS) {
+        threads = PAGECRC_MAX_THREADS;
+    }
+    if ((unsigned long long)threads > pages / PAGECRC_THREAD_PAGES) {
+        threads = pages / PAGECRC_THREAD_PAGES;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    struct verify_t verify[PAGECRC_MAX_THREADS];
+    pthread_t tids[PAGECRC_MAX_THREADS];
+    long started = 0;
+    for (long t = 0; t < threads; t++) {
+        verify[t] = (struct verify_t){.header = header, .map = store->map};
+        verify[t].first = pages * t / threads;
+        verify[t].end = pages * (t + 1) / threads;
+    }
+    // The calling thread takes the first share, and any a thread couldn't be started for
+    for (long t = 1; t < threads && pthread_create(&tids[t], NULL, verify_range, &verify[t]) == 0; t++) {
+        started = t;
+    }
+    for (long t = started + 1; t < threads; t++) {
+        verify_range(&verify[t]);
+    }
+    verify_range(&verify[0]);
+    unsigned long long bad = 0;
+    unsigned long long firstbad = 0;
+    for (long t = 0; t < threads; t++) {
+        if (t > 0 && t <= started) {
+            pthread_join(tids[t], NULL);
+        }
+        firstbad = bad == 0 ? verify[t].firstbad : firstbad;
+        bad += verify[t].bad;
+    }
+    if (bad > 0) {
+        printf("%llu pages fail their checksums, the first at offset %llu\n", bad, firstbad * DB_PAGE_SIZE);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
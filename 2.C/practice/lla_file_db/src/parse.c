@@ -5,166 +5,277 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <endian.h>
 
+#include "checksum.h"
 #include "common.h"
+#include "export.h"
 #include "parse.h"
+#include "store.h"
+#include "wal.h"
 
-int create_db_header(int fd, struct dbheader_t **headerOut) {
-    struct dbheader_t *header = calloc(1, sizeof(struct dbheader_t));
-    if (header == -1) {
+int create_db_header(struct dbheader64_t **headerOut) {
+    struct dbheader64_t *header = calloc(1, sizeof(struct dbheader64_t));
+    if (header == NULL) {
         printf("Malloc failed to create db header\n");
         return STATUS_ERROR;
     }
-    header->version = 0x1;
+    header->version = DB_VERSION_CURRENT;
     header->count = 0;
     header->magic = HEADER_MAGIC;
-    header->filesize = sizeof(struct dbheader_t);
+    header->filesize = DB_PAGE_SIZE;
     *headerOut = header;
     return STATUS_SUCCESS;
 }
 
-int validate_db_header(int fd, struct dbheader_t **headerOut) {
+// Fills the host-order header from the 12-byte one of versions 1 and 2
+static void header_from_small(struct dbheader_t *small, struct dbheader64_t *header) {
+    header->count = ntohs(small->count);
+    header->filesize = ntohl(small->filesize);
+}
+
+static int header_from_large(int fd, struct dbheader64_t *header) {
+    struct dbheader64_t disk;
+    if (read_all(fd, &disk, sizeof(disk), 0) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    header->checksums = be64toh(disk.checksums);
+    header->checksum_pages = be64toh(disk.checksum_pages);
+    if (header->checksums) {
+        unsigned int crc = ntohl(disk.crc);
+        disk.crc = 0;
+        if (crc32c(0, &disk, sizeof(disk)) != crc || header->checksums % DB_PAGE_SIZE != 0 ||
+            header->checksums < DB_PAGE_SIZE) {
+            return STATUS_ERROR;
+        }
+    }
+    header->count = be64toh(disk.count);
+    header->filesize = be64toh(disk.filesize);
+    header->segment_count = ntohl(disk.segment_count);
+    if (header->segment_count > DB_MAX_SEGMENTS) {
+        return STATUS_ERROR;
+    }
+    unsigned long long end = DB_PAGE_SIZE;
+    for (unsigned int k = 0; k < header->segment_count; k++) {
+        header->segments[k] = be64toh(disk.segments[k]);
+        if (header->segments[k] < end || header->segments[k] % DB_PAGE_SIZE != 0) {
+            return STATUS_ERROR;
+        }
+        end = header->segments[k] + SEGMENT_SIZE(k);
+    }
+    unsigned long long capacity = header->segment_count ? SEGMENT_FIRST(header->segment_count) : 0;
+    if (header->checksums && (header->checksums + CHECKSUM_TABLE_SIZE(header->checksum_pages) > header->filesize ||
+                              header->checksum_pages * DB_PAGE_SIZE < header->filesize)) {
+        return STATUS_ERROR;
+    }
+    return header->count <= capacity && end <= header->filesize ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+int validate_db_header(int fd, struct dbheader64_t **headerOut) {
     if (fd < 0) {
         printf("Got a bad FD from the user\n");
         return STATUS_ERROR;
     }
-    struct dbheader_t *header = calloc(1, sizeof(struct dbheader_t));
-    if (header == -1) {
+    struct dbheader64_t *header = calloc(1, sizeof(struct dbheader64_t));
+    struct dbheader_t small;
+    if (header == NULL) {
         printf("Malloc failed to create a db header\n");
         return STATUS_ERROR;
     }
-    if (read(fd, header, sizeof(struct dbheader_t)) != sizeof(struct dbheader_t)) {
-        perror("read");
+    if (read_all(fd, &small, sizeof(small), 0) != STATUS_SUCCESS) {
         free(header);
         return STATUS_ERROR;
     }
     // ntohs = Network to Host Short uses the Endienness of the host machine
     // ntohl = Networl to Host Long
-    header->version = ntohs(header->version);
-    header->count = ntohs(header->count);
-    header->magic = ntohl(header->magic);
-    header->filesize = ntohl(header->filesize);
+    header->version = ntohs(small.version);
+    header->magic = ntohl(small.magic);
     if (header->magic != HEADER_MAGIC) {
         printf("Improper header version\n");
         free(header);
         return -1;
     }
-    if (header->version != 1) {
+    if (header->version < DB_VERSION_FIXED || header->version > DB_VERSION_CURRENT) {
         printf("Improper header version\n");
         free(header);
         return -1;
     }
+    if (header->version < DB_VERSION_LARGE) {
+        header_from_small(&small, header);
+    } else if (header_from_large(fd, header) != STATUS_SUCCESS) {
+        printf("Corrupted database\n");
+        free(header);
+        return -1;
+    }
+    // Version 3 grows the file before committing a new segment, so a crash
+    // can leave it longer than the header says; the tail is reused
     struct stat dbstat = {0};
     fstat(fd, &dbstat);
-    if (header ->filesize != dbstat.st_size) {
+    if ((header->version < DB_VERSION_LARGE && header->filesize != (unsigned long long)dbstat.st_size) ||
+        header->filesize > (unsigned long long)dbstat.st_size) {
         printf("Corrupted database\n");
         free(header);
         return -1;
     }
     *headerOut = header;
+    return STATUS_SUCCESS;
 }
 
-int output_file(int fd, struct dbheader_t *dbhdr, struct employee_t *employees) {
+int read_employees(int fd, struct dbheader64_t *dbhdr, struct employee_t **employeesOut) {
     if (fd < 0) {
         printf("Got a bad FD from the user\n");
         return STATUS_ERROR;
     }
-    int realcount = dbhdr->count;
-    int host_size  = sizeof(struct dbheader_t) + realcount * sizeof(struct employee_t);
-    // Host to Network Long
-    dbhdr->magic = htonl(dbhdr->magic);
-    dbhdr->filesize = htonl(host_size);
-    dbhdr->count = htons(dbhdr->count);
-    dbhdr->version = htons(dbhdr->version);
-    lseek(fd, 0, SEEK_SET);
-    write(fd, dbhdr, sizeof(struct dbheader_t));
-    for (int i = 0; i < realcount; i++) {
-        employees[i].hours = htonl(employees[i].hours);
-        write(fd, &employees[i], sizeof(struct employee_t));
-    }
-    if (ftruncate(fd, host_size) == -1) {
-        printf("Error when truncating file\n");
-        perror("ftruncate");
-        return STATUS_ERROR;
-    }
-    return 0;
-}
-
-int read_employees(int fd, struct dbheader_t *dbhdr, struct employee_t **employeesOut) {
-    if (fd < 0) {
-        printf("Got a bad FD from the user\n");
+    if (dbhdr->version != DB_VERSION_FIXED) {
+        printf("Only version 1 records can be read whole\n");
         return STATUS_ERROR;
     }
-    int count = dbhdr->count;
+    size_t count = dbhdr->count;
     struct employee_t *employees = calloc(count, sizeof(struct employee_t));
-    if (employees == -1) {
+    if (employees == NULL && count > 0) {
         printf("Malloc failed\n");
         return STATUS_ERROR;
     }
-    read(fd, employees, count*sizeof(struct employee_t));
-    int i = 0;
-    for (; i < count; i++) {
+    if (read_all(fd, employees, count * sizeof(struct employee_t), sizeof(struct dbheader_t)) != STATUS_SUCCESS) {
+        free(employees);
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < count; i++) {
         employees[i].hours = ntohl(employees[i].hours);
     }
     *employeesOut = employees;
     return STATUS_SUCCESS;
 }
 
-int add_employee(struct dbheader_t *dbhdr, struct employee_t *employees, char *addstring) {
-    char *name = strtok(addstring, ",");
-    char *addr = strtok(NULL, ",");
-    char *hours = strtok(NULL, ",");
-    strncpy(employees[dbhdr->count-1].name, name, sizeof(employees[dbhdr->count-1].name));
-    strncpy(employees[dbhdr->count-1].address, addr, sizeof(employees[dbhdr->count-1].address));
-    employees[dbhdr->count-1].hours = atoi(hours);
+int parse_employee(char *addstring, struct employee_t *employee) {
+    // strtok_r, as the server parses on many threads
+    char *save = NULL;
+    char *name = strtok_r(addstring, ",", &save);
+    char *addr = strtok_r(NULL, ",", &save);
+    char *hours = strtok_r(NULL, ",", &save);
+    if (name == NULL || addr == NULL || hours == NULL) {
+        printf("Expected \"name,address,hours\"\n");
+        return STATUS_ERROR;
+    }
+    memset(employee, 0, sizeof(*employee));
+    strncpy(employee->name, name, sizeof(employee->name) - 1);
+    strncpy(employee->address, addr, sizeof(employee->address) - 1);
+    employee->hours = atoi(hours);
     return STATUS_SUCCESS;
 }
 
-int update_employee(struct dbheader_t *dbhdr, struct employee_t *employees, char *updatestring) {
+int add_employee(struct dbstore_t *store, char *addstring) {
+    struct employee_t employee;
+    if (parse_employee(addstring, &employee) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return store_append_employee(store, &employee);
+}
+
+struct hours_match_t {
+    struct dbstore_t *store;
+    long index;
+};
+
+static int first_live_record(unsigned int record, void *arg) {
+    struct hours_match_t *match = arg;
+    struct record_t employee;
+    if (store_record(match->store, record, &employee) == STATUS_SUCCESS && !RECORD_DELETED(&employee)) {
+        match->index = record;
+        return 1;
+    }
+    return 0;
+}
+
+// Index of the first live record with these hours, or -1
+long find_employee_by_hours(struct dbstore_t *store, unsigned int hours) {
+    struct hours_match_t match = {.store = store, .index = -1};
+    struct dbindex_t *index = store_index(store);
+    if (index) {
+        index_range_hours(index, hours, hours, first_live_record, &match);
+    }
+    return match.index;
+}
+
+int update_employee(struct dbstore_t *store, char *updatestring) {
     char *hours = strtok(updatestring, ",");
-    char *new_name = strtok(NULL, ",");
-    char *new_addr = strtok(NULL, ",");
-    char *new_hours = strtok(NULL, ",");
-    for (int i = 0; i < dbhdr->count; i++) {
-        if (employees[i].hours == atoi(hours)) {
-            strncpy(employees[i].name, new_name, sizeof(employees[i].name));
-            strncpy(employees[i].address, new_addr, sizeof(employees[i].address));
-            employees[i].hours = atoi(new_hours);
-            return STATUS_SUCCESS;
-        }
+    char *rest = strtok(NULL, "");
+    struct employee_t employee;
+    if (hours == NULL || rest == NULL || parse_employee(rest, &employee) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
     }
-    printf("Employee not found\n");
-    return STATUS_ERROR;
+    long index = find_employee_by_hours(store, atoi(hours));
+    if (index < 0) {
+        printf("Employee not found\n");
+        return STATUS_ERROR;
+    }
+    return store_update_employee(store, index, &employee);
 }
 
-int remove_employee(struct dbheader_t *dbhdr, struct employee_t **employeesOut, char *deletestring) {
+int remove_employee(struct dbstore_t *store, char *deletestring) {
     char *hours = strtok(deletestring, ",");
-    struct employee_t *employees = *employeesOut;
-    for (int i = 0; i < dbhdr->count; i++) {
-        if (employees[i].hours == atoi(hours)) {
-            for (int j = i; i < dbhdr->count - 1; j++) {
-                employees[j] = employees[j+1];
-            }
-            dbhdr->count--;
-            struct employee_t *newmem = realloc(employees, dbhdr->count*sizeof(struct employee_t));
-            if (newmem == NULL && dbhdr->count > 0) {
-                printf("Realloc failed\n");
-                return STATUS_ERROR;
-            }
-            *employeesOut = newmem;
-            return STATUS_SUCCESS;
-        }
+    if (hours == NULL) {
+        return STATUS_ERROR;
     }
-    printf("Employee not found\n");
-    return STATUS_ERROR; 
+    long index = find_employee_by_hours(store, atoi(hours));
+    if (index < 0) {
+        printf("Employee not found\n");
+        return STATUS_ERROR;
+    }
+    return store_delete_employee(store, index);
+}
+
+static void print_employee(unsigned int index, const struct record_t *employee) {
+    printf("Employee %u\n", index);
+    printf("\tName: %.*s\n", (int)employee->namelen, employee->name);
+    printf("\tAddress: %.*s\n", (int)employee->addresslen, employee->address);
+    printf("\tHours: %u\n", employee->hours);
 }
 
-void list_employees(struct dbheader_t *dbhdr, struct employee_t *employees) {
-    int i = 0;
-    for (; i < dbhdr->count; i++) {
-        printf("Employee %d\n", i);
-        printf("\tName: %s\n", employees[i].name);
-        printf("\tAddress: %s\n", employees[i].address);
-        printf("\tHours: %d\n", employees[i].hours);
+// Through the exporter rather than print_employee: four printf calls a
+// record are most of the cost of a long listing
+int list_employees(struct dbstore_t *store, int format) {
+    // Anything printf still holds goes first
+    fflush(stdout);
+    return export_employees(store, STDOUT_FILENO, format);
+}
+
+static void print_named(unsigned int record, const struct record_t *employee, void *arg) {
+    (void)arg;
+    print_employee(record, employee);
+}
+
+int find_employees_by_name(struct dbstore_t *store, char *name) {
+    if (store_index(store) == NULL) {
+        return STATUS_ERROR;
+    }
+    if (store_find_name(store, name, print_named, NULL) == 0) {
+        printf("Employee not found\n");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+static int print_record(unsigned int record, void *arg) {
+    struct dbstore_t *store = arg;
+    struct record_t employee;
+    if (store_record(store, record, &employee) == STATUS_SUCCESS) {
+        print_employee(record, &employee);
+    }
+    return 0;
+}
+
+// rangestring is "lo,hi", both inclusive
+int list_employees_by_hours(struct dbstore_t *store, char *rangestring) {
+    char *lo = strtok(rangestring, ",");
+    char *hi = strtok(NULL, ",");
+    if (lo == NULL || hi == NULL) {
+        printf("Expected \"low,high\" hours\n");
+        return STATUS_ERROR;
+    }
+    struct dbindex_t *index = store_index(store);
+    if (index == NULL) {
+        return STATUS_ERROR;
     }
+    return index_range_hours(index, atoi(lo), atoi(hi), print_record, store);
 }
@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "common.h"
+#include "query.h"
+#include "store.h"
+
+// Rows handed to select_hours at a time
+#define QUERY_BLOCK 4096
+
+#ifdef __SSE2__
+// Network to host order, four at a time: swap the bytes of each 16-bit
+// half, then the halves
+static inline __m128i ntohl4(__m128i x) {
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+}
+
+// All ones in the lanes where h - lo <= span, compared unsigned
+static inline __m128i in_range4(__m128i h, __m128i lo, __m128i span) {
+    const __m128i sign = _mm_set1_epi32((int)0x80000000);
+    __m128i above = _mm_cmpgt_epi32(_mm_xor_si128(_mm_sub_epi32(h, lo), sign), _mm_xor_si128(span, sign));
+    return _mm_xor_si128(above, _mm_set1_epi32(-1));
+}
+#endif
+
+// Adds the count and sum of the hours in [lo, hi] among n column entries
+static void aggregate_hours(const unsigned int *column, unsigned int n, unsigned int lo, unsigned int hi,
+                            unsigned long long *countOut, unsigned long long *sumOut) {
+    unsigned long long count = 0;
+    unsigned long long sum = 0;
+    unsigned int span = hi - lo;
+    unsigned int j = 0;
+#ifdef __SSE2__
+    __m128i vlo = _mm_set1_epi32((int)lo);
+    __m128i vspan = _mm_set1_epi32((int)span);
+    __m128i zero = _mm_setzero_si128();
+    __m128i vcount = zero;
+    __m128i vsum = zero;
+    for (; j + 4 <= n; j += 4) {
+        __m128i h = ntohl4(_mm_loadu_si128((const __m128i *)(column + j)));
+        __m128i in = in_range4(h, vlo, vspan);
+        vcount = _mm_sub_epi32(vcount, in);
+        h = _mm_and_si128(h, in);
+        vsum = _mm_add_epi64(vsum, _mm_add_epi64(_mm_unpacklo_epi32(h, zero), _mm_unpackhi_epi32(h, zero)));
+    }
+    unsigned int counts[4];
+    unsigned long long sums[2];
+    _mm_storeu_si128((__m128i *)counts, vcount);
+    _mm_storeu_si128((__m128i *)sums, vsum);
+    count = (unsigned long long)counts[0] + counts[1] + counts[2] + counts[3];
+    sum = sums[0] + sums[1];
+#endif
+    for (; j < n; j++) {
+        unsigned int h = ntohl(column[j]);
+        unsigned int in = h - lo <= span;
+        count += in;
+        sum += in ? h : 0;
+    }
+    *countOut += count;
+    *sumOut += sum;
+}
+
+// Fills selected with the offsets of the entries in [lo, hi], returning
+// how many there are
+static unsigned int select_hours(const unsigned int *column, unsigned int n, unsigned int lo, unsigned int hi,
+                                 unsigned int *selected) {
+    unsigned int span = hi - lo;
+    unsigned int found = 0;
+    unsigned int j = 0;
+#ifdef __SSE2__
+    __m128i vlo = _mm_set1_epi32((int)lo);
+    __m128i vspan = _mm_set1_epi32((int)span);
+    for (; j + 4 <= n; j += 4) {
+        __m128i h = ntohl4(_mm_loadu_si128((const __m128i *)(column + j)));
+        unsigned int bits = _mm_movemask_ps(_mm_castsi128_ps(in_range4(h, vlo, vspan)));
+        while (bits) {
+            selected[found++] = j + __builtin_ctz(bits);
+            bits &= bits - 1;
+        }
+    }
+#endif
+    for (; j < n; j++) {
+        selected[found] = j;
+        found += ntohl(column[j]) - lo <= span;
+    }
+    return found;
+}
+
+struct topk_t {
+    unsigned int hours;
+    unsigned int record;
+};
+
+// More hours first, then the lower record
+static int top_before(struct topk_t a, struct topk_t b) {
+    return a.hours > b.hours || (a.hours == b.hours && a.record < b.record);
+}
+
+static int top_compare(const void *a, const void *b) {
+    return top_before(*(const struct topk_t *)a, *(const struct topk_t *)b) ? -1 : 1;
+}
+
+// A heap of the k best so far, the one that would go first at the root
+static void top_push(struct topk_t *heap, unsigned int *n, unsigned int k, struct topk_t item) {
+    unsigned int i;
+    if (*n < k) {
+        for (i = (*n)++; i > 0 && top_before(heap[(i - 1) / 2], item); i = (i - 1) / 2) {
+            heap[i] = heap[(i - 1) / 2];
+        }
+        heap[i] = item;
+        return;
+    }
+    if (!top_before(item, heap[0])) {
+        return;
+    }
+    for (i = 0;;) {
+        unsigned int child = 2 * i + 1;
+        if (child >= *n) {
+            break;
+        }
+        if (child + 1 < *n && top_before(heap[child], heap[child + 1])) {
+            child++;
+        }
+        if (!top_before(item, heap[child])) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+// One thread's share of the rows, and what it found
+struct scan_t {
+    struct dbstore_t *store;
+    const struct query_t *query;
+    unsigned long long first;
+    unsigned long long end;
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned int *records;      // matches in record order
+    unsigned long long nrecords;
+    unsigned long long cap;
+    struct topk_t *top;
+    unsigned int ntop;
+    int failed;
+};
+
+// A row the hours filter let through
+static void scan_match(struct scan_t *scan, unsigned int record, unsigned int hours) {
+    const struct query_t *query = scan->query;
+    // Only a row with 0 hours can be a tombstone
+    if (hours == 0 || query->prefixlen > 0) {
+        struct record_t row;
+        if (store_record(scan->store, record, &row) != STATUS_SUCCESS || RECORD_DELETED(&row) ||
+            row.namelen < query->prefixlen || memcmp(row.name, query->prefix, query->prefixlen) != 0) {
+            return;
+        }
+    }
+    scan->count++;
+    scan->sum += hours;
+    if (query->aggregates) {
+        return;
+    }
+    if (query->top) {
+        top_push(scan->top, &scan->ntop, query->top, (struct topk_t){hours, record});
+        return;
+    }
+    if (scan->nrecords == scan->cap) {
+        unsigned long long cap = scan->cap ? scan->cap * 2 : 4096;
+        unsigned int *records = realloc(scan->records, cap * sizeof(unsigned int));
+        if (records == NULL) {
+            scan->failed = 1;
+            return;
+        }
+        scan->records = records;
+        scan->cap = cap;
+    }
+    scan->records[scan->nrecords++] = record;
+}
+
+// n rows from first, their hours contiguous in column
+static void scan_column(struct scan_t *scan, unsigned long long first, unsigned int n, const unsigned int *column,
+                        unsigned int *selected) {
+    const struct query_t *query = scan->query;
+    unsigned int lo = query->lo;
+    // Aggregates of hours alone never look at a row, except to tell
+    // whether one with 0 hours is live
+    if (query->aggregates && query->prefixlen == 0) {
+        if (lo <= query->hi && query->hi > 0) {
+            aggregate_hours(column, n, lo ? lo : 1, query->hi, &scan->count, &scan->sum);
+        }
+        if (lo > 0) {
+            return;
+        }
+        lo = 0;
+    }
+    unsigned int hi = query->aggregates && query->prefixlen == 0 ? 0 : query->hi;
+    for (unsigned int b = 0; b < n; b += QUERY_BLOCK) {
+        unsigned int m = n - b < QUERY_BLOCK ? n - b : QUERY_BLOCK;
+        // Once the top K are full, a row needs more hours than the last of
+        // them: rows come in record order, so a tie never gets in
+        if (query->top && !query->aggregates && scan->ntop == query->top && scan->top[0].hours >= lo) {
+            if (scan->top[0].hours >= hi) {
+                return;
+            }
+            lo = scan->top[0].hours + 1;
+        }
+        unsigned int found = select_hours(column + b, m, lo, hi, selected);
+        for (unsigned int s = 0; s < found; s++) {
+            scan_match(scan, first + b + selected[s], ntohl(column[b + selected[s]]));
+        }
+    }
+}
+
+static void *scan_range(void *arg) {
+    struct scan_t *scan = arg;
+    const struct query_t *query = scan->query;
+    unsigned int *selected = malloc(QUERY_BLOCK * sizeof(unsigned int));
+    scan->failed = selected == NULL;
+    for (unsigned long long i = scan->first; i < scan->end && !scan->failed;) {
+        unsigned int rows;
+        const unsigned int *column = store_hours_column(scan->store, i, &rows);
+        if (column == NULL) {
+            // Version 1: the hours sit inside each record
+            struct record_t row;
+            if (store_record(scan->store, i, &row) == STATUS_SUCCESS && row.hours - query->lo <= query->hi - query->lo) {
+                scan_match(scan, i, row.hours);
+            }
+            i++;
+            continue;
+        }
+        if (rows > scan->end - i) {
+            rows = scan->end - i;
+        }
+        scan_column(scan, i, rows, column, selected);
+        i += rows;
+    }
+    free(selected);
+    return NULL;
+}
+
+static unsigned int query_threads(const struct query_t *query, unsigned long long count) {
+    long threads = query->threads ? (long)query->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > QUERY_MAX_THREADS) {
+        threads = QUERY_MAX_THREADS;
+    }
+    if ((unsigned long long)threads > count / QUERY_MIN_SPLIT) {
+        threads = count / QUERY_MIN_SPLIT;
+    }
+    return threads < 1 ? 1 : threads;
+}
+
+int query_run(struct dbstore_t *store, const struct query_t *query, struct query_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    if (query->lo > query->hi) {
+        return STATUS_SUCCESS;
+    }
+    // Mapped up front, so the threads only ever read
+    if (store_map(store) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    unsigned long long count = store->header.count;
+    unsigned int threads = query_threads(query, count);
+    struct scan_t *scans = calloc(threads, sizeof(struct scan_t));
+    pthread_t tids[QUERY_MAX_THREADS];
+    int status = scans ? STATUS_SUCCESS : STATUS_ERROR;
+    unsigned int started = 0;
+    for (unsigned int t = 0; status == STATUS_SUCCESS && t < threads; t++) {
+        scans[t] = (struct scan_t){.store = store, .query = query};
+        scans[t].first = count * t / threads;
+        scans[t].end = count * (t + 1) / threads;
+        if (query->top && !query->aggregates &&
+            (scans[t].top = malloc(query->top * sizeof(struct topk_t))) == NULL) {
+            status = STATUS_ERROR;
+        }
+    }
+    // The calling thread takes the first share
+    for (unsigned int t = 1; status == STATUS_SUCCESS && t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, scan_range, &scans[t]) != 0) {
+            status = STATUS_ERROR;
+            break;
+        }
+        started = t;
+    }
+    if (status == STATUS_SUCCESS) {
+        scan_range(&scans[0]);
+    }
+    for (unsigned int t = 1; t <= started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    unsigned long long nrecords = 0;
+    for (unsigned int t = 0; scans && t < threads; t++) {
+        result->count += scans[t].count;
+        result->sum += scans[t].sum;
+        nrecords += query->top ? scans[t].ntop : scans[t].nrecords;
+        if (scans[t].failed) {
+            status = STATUS_ERROR;
+        }
+    }
+    if (status == STATUS_SUCCESS && !query->aggregates && nrecords > 0 &&
+        (result->records = malloc(nrecords * sizeof(unsigned int))) == NULL) {
+        status = STATUS_ERROR;
+    }
+    if (status == STATUS_SUCCESS && !query->aggregates && query->top) {
+        // Every thread's best into the first heap, then in order
+        for (unsigned int t = 1; t < threads; t++) {
+            for (unsigned int i = 0; i < scans[t].ntop; i++) {
+                top_push(scans[0].top, &scans[0].ntop, query->top, scans[t].top[i]);
+            }
+        }
+        qsort(scans[0].top, scans[0].ntop, sizeof(struct topk_t), top_compare);
+        for (unsigned int i = 0; i < scans[0].ntop; i++) {
+            result->records[result->nrecords++] = scans[0].top[i].record;
+        }
+    } else if (status == STATUS_SUCCESS && !query->aggregates) {
+        for (unsigned int t = 0; t < threads; t++) {
+            memcpy(result->records + result->nrecords, scans[t].records, scans[t].nrecords * sizeof(unsigned int));
+            result->nrecords += scans[t].nrecords;
+        }
+    }
+    for (unsigned int t = 0; scans && t < threads; t++) {
+        free(scans[t].records);
+        free(scans[t].top);
+    }
+    free(scans);
+    if (status != STATUS_SUCCESS) {
+        printf("Query failed\n");
+        query_free(result);
+    }
+    return status;
+}
+
+void query_free(struct query_result_t *result) {
+    free(result->records);
+    result->records = NULL;
+    result->nrecords = 0;
+}
+
+// Digits only, at most max
+static int parse_number(const char *text, unsigned long long max, unsigned int *numberOut) {
+    unsigned long long number = 0;
+    if (*text == '\0') {
+        return STATUS_ERROR;
+    }
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9' || (number = number * 10 + (*text - '0')) > max) {
+            return STATUS_ERROR;
+        }
+    }
+    *numberOut = number;
+    return STATUS_SUCCESS;
+}
+
+// "n", "lo-hi", "lo-" or "-hi"
+static int parse_range(char *text, unsigned int *loOut, unsigned int *hiOut) {
+    char *dash = strchr(text, '-');
+    if (dash == NULL) {
+        if (parse_number(text, 0xffffffffULL, loOut) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        *hiOut = *loOut;
+        return STATUS_SUCCESS;
+    }
+    *dash = '\0';
+    *loOut = 0;
+    *hiOut = 0xffffffff;
+    if ((*text && parse_number(text, 0xffffffffULL, loOut) != STATUS_SUCCESS) ||
+        (dash[1] && parse_number(dash + 1, 0xffffffffULL, hiOut) != STATUS_SUCCESS)) {
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+static int parse_fields(char *text, unsigned int *fieldsOut) {
+    char *save = NULL;
+    *fieldsOut = 0;
+    for (char *field = strtok_r(text, ",", &save); field; field = strtok_r(NULL, ",", &save)) {
+        if (strcmp(field, "name") == 0) {
+            *fieldsOut |= QUERY_NAME;
+        } else if (strcmp(field, "address") == 0) {
+            *fieldsOut |= QUERY_ADDRESS;
+        } else if (strcmp(field, "hours") == 0) {
+            *fieldsOut |= QUERY_HOURS;
+        } else {
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int query_parse(char *text, struct query_t *query) {
+    memset(query, 0, sizeof(*query));
+    query->hi = 0xffffffff;
+    query->fields = QUERY_NAME | QUERY_ADDRESS | QUERY_HOURS;
+    char *save = NULL;
+    for (char *term = strtok_r(text, ";", &save); term; term = strtok_r(NULL, ";", &save)) {
+        while (*term == ' ') {
+            term++;
+        }
+        char *value = strchr(term, '=');
+        if (value) {
+            *value++ = '\0';
+        }
+        int status = STATUS_SUCCESS;
+        if (strcmp(term, "name") == 0 && value && strlen(value) < sizeof(query->prefix)) {
+            query->prefixlen = strlen(value);
+            memcpy(query->prefix, value, query->prefixlen);
+        } else if (strcmp(term, "hours") == 0 && value) {
+            status = parse_range(value, &query->lo, &query->hi);
+        } else if (strcmp(term, "select") == 0 && value) {
+            status = parse_fields(value, &query->fields);
+        } else if (strcmp(term, "top") == 0 && value) {
+            status = parse_number(value, QUERY_MAX_TOP, &query->top);
+        } else if (strcmp(term, "threads") == 0 && value) {
+            status = parse_number(value, QUERY_MAX_THREADS, &query->threads);
+        } else if (strcmp(term, "count") == 0 && value == NULL) {
+            query->aggregates |= QUERY_COUNT;
+        } else if (strcmp(term, "sum") == 0 && value == NULL) {
+            query->aggregates |= QUERY_SUM;
+        } else if (strcmp(term, "avg") == 0 && value == NULL) {
+            query->aggregates |= QUERY_AVG;
+        } else {
+            status = STATUS_ERROR;
+        }
+        if (status != STATUS_SUCCESS) {
+            printf("Bad query term \"%s\"\n", term);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int run_query(struct dbstore_t *store, char *querystring) {
+    struct query_t query;
+    struct query_result_t result;
+    if (query_parse(querystring, &query) != STATUS_SUCCESS || query_run(store, &query, &result) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    if (query.aggregates & QUERY_COUNT) {
+        printf("Count: %llu\n", result.count);
+    }
+    if (query.aggregates & QUERY_SUM) {
+        printf("Sum: %llu\n", result.sum);
+    }
+    if (query.aggregates & QUERY_AVG) {
+        printf("Average: %.2f\n", result.count ? (double)result.sum / result.count : 0.0);
+    }
+    for (unsigned long long i = 0; i < result.nrecords; i++) {
+        struct record_t employee;
+        if (store_record(store, result.records[i], &employee) != STATUS_SUCCESS) {
+            continue;
+        }
+        printf("Employee %u\n", result.records[i]);
+        if (query.fields & QUERY_NAME) {
+            printf("\tName: %.*s\n", (int)employee.namelen, employee.name);
+        }
+        if (query.fields & QUERY_ADDRESS) {
+            printf("\tAddress: %.*s\n", (int)employee.addresslen, employee.address);
+        }
+        if (query.fields & QUERY_HOURS) {
+            printf("\tHours: %u\n", employee.hours);
+        }
+    }
+    query_free(&result);
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,428 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "index.h"
+#include "parse.h"
+#include "server.h"
+#include "store.h"
+
+#define SERVER_BACKLOG 128
+
+// One per process, shared with the connection threads
+static struct server_t {
+    struct dbstore_t *store;
+    pthread_rwlock_t lock;      // readers shared; the store takes it to publish a change
+    pthread_mutex_t writer;     // one change at a time
+    pthread_mutex_t clients_lock;
+    pthread_cond_t drained;     // signalled when the last connection ends
+    int *clients;               // sockets of the open connections
+    size_t nclients;
+    size_t clients_cap;
+} server = {.writer = PTHREAD_MUTEX_INITIALIZER, .clients_lock = PTHREAD_MUTEX_INITIALIZER,
+            .drained = PTHREAD_COND_INITIALIZER};
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+// A reply built in memory under the lock and sent after it is dropped
+struct reply_t {
+    char *buf;
+    size_t len;
+    size_t cap;
+    unsigned long long records;
+};
+
+static void reply_printf(struct reply_t *reply, const char *format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        size_t room = reply->cap - reply->len;
+        int n = vsnprintf(reply->buf ? reply->buf + reply->len : NULL, room, format, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < room) {
+            reply->len += n;
+            return;
+        }
+        size_t cap = reply->cap ? reply->cap * 2 : 4096;
+        while (cap - reply->len <= (size_t)n) {
+            cap *= 2;
+        }
+        char *buf = realloc(reply->buf, cap);
+        if (buf == NULL) {
+            return;
+        }
+        reply->buf = buf;
+        reply->cap = cap;
+    }
+}
+
+static void reply_record(struct reply_t *reply, unsigned int index, const struct record_t *record) {
+    reply_printf(reply, "%u\t%.*s\t%.*s\t%u\n", index, (int)record->namelen, record->name, (int)record->addresslen,
+                 record->address, record->hours);
+    reply->records++;
+}
+
+static int reply_send(int fd, struct reply_t *reply) {
+    size_t sent = 0;
+    while (sent < reply->len) {
+        ssize_t n = send(fd, reply->buf + sent, reply->len - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return STATUS_ERROR;
+        }
+        sent += n;
+    }
+    reply->len = 0;
+    return STATUS_SUCCESS;
+}
+
+static void reply_named(unsigned int index, const struct record_t *record, void *arg) {
+    reply_record(arg, index, record);
+}
+
+struct range_match_t {
+    struct dbstore_t *store;
+    struct reply_t *reply;
+};
+
+static int reply_in_range(unsigned int index, void *arg) {
+    struct range_match_t *match = arg;
+    struct record_t record;
+    if (store_record(match->store, index, &record) == STATUS_SUCCESS) {
+        reply_record(match->reply, index, &record);
+    }
+    return 0;
+}
+
+// Reads. store_record and the index lookups only read, as long as the
+// index was opened and the file mapped before (see server_run; a change
+// remaps under the lock), so any number of these run at once.
+static const char *serve_read(char op, char *arg, struct reply_t *reply) {
+    struct dbstore_t *store = server.store;
+    const char *error = NULL;
+    pthread_rwlock_rdlock(&server.lock);
+    if (op == 'g') {
+        struct record_t record;
+        unsigned long index = strtoul(arg, NULL, 10);
+        if (index > 0xffffffffUL || store_record(store, index, &record) != STATUS_SUCCESS ||
+            RECORD_DELETED(&record)) {
+            error = "no such employee";
+        } else {
+            reply_record(reply, index, &record);
+        }
+    } else if (op == 'c') {
+        reply->records = store->header.count;
+    } else if (store->index == NULL) {
+        error = "no index";
+    } else if (op == 's') {
+        store_find_name(store, arg, reply_named, reply);
+    } else {
+        char *comma = strchr(arg, ',');
+        struct range_match_t match = {.store = store, .reply = reply};
+        if (comma == NULL) {
+            error = "expected low,high";
+        } else {
+            index_range_hours(store->index, strtoul(arg, NULL, 10), strtoul(comma + 1, NULL, 10), reply_in_range,
+                              &match);
+        }
+    }
+    pthread_rwlock_unlock(&server.lock);
+    return error;
+}
+
+// A chunk of rows per hold of the lock, sent before the next
+static const char *serve_list(int fd, struct reply_t *reply) {
+    struct dbstore_t *store = server.store;
+    unsigned long long next = 0;
+    for (;;) {
+        pthread_rwlock_rdlock(&server.lock);
+        unsigned long long count = store->header.count;
+        unsigned long long end = next + SERVER_LIST_ROWS < count ? next + SERVER_LIST_ROWS : count;
+        for (; next < end; next++) {
+            struct record_t record;
+            if (store_record(store, next, &record) == STATUS_SUCCESS && !RECORD_DELETED(&record)) {
+                reply_record(reply, next, &record);
+            }
+        }
+        pthread_rwlock_unlock(&server.lock);
+        if (next >= count) {
+            return NULL;
+        }
+        if (reply_send(fd, reply) != STATUS_SUCCESS) {
+            return "client went away";
+        }
+    }
+}
+
+static const char *serve_change(char op, char *arg, struct reply_t *reply) {
+    struct dbstore_t *store = server.store;
+    struct employee_t employee;
+    unsigned int hours = 0;
+    // Parsed before taking the lock
+    if (op == 'a' && parse_employee(arg, &employee) != STATUS_SUCCESS) {
+        return "expected name,address,hours";
+    }
+    if (op == 'u') {
+        char *comma = strchr(arg, ',');
+        if (comma == NULL || parse_employee(comma + 1, &employee) != STATUS_SUCCESS) {
+            return "expected hours,name,address,hours";
+        }
+    }
+    if (op != 'a') {
+        hours = strtoul(arg, NULL, 10);
+    }
+    const char *error = NULL;
+    pthread_mutex_lock(&server.writer);
+    long index = op == 'a' ? (long)store->header.count : find_employee_by_hours(store, hours);
+    if (index < 0) {
+        error = "employee not found";
+    } else if ((op == 'a' && store_append_employee(store, &employee) != STATUS_SUCCESS) ||
+               (op == 'u' && store_update_employee(store, index, &employee) != STATUS_SUCCESS) ||
+               (op == 'd' && store_delete_employee(store, index) != STATUS_SUCCESS)) {
+        error = "change failed";
+    } else {
+        reply->records = index;
+    }
+    pthread_mutex_unlock(&server.writer);
+    return error;
+}
+
+static int serve_request(int fd, char *line, struct reply_t *reply) {
+    char op = line[0];
+    char *arg = line[0] && line[1] == ' ' ? line + 2 : line + (line[0] != '\0');
+    const char *error = NULL;
+    reply->records = 0;
+    switch (op) {
+        case 'g':
+        case 'c':
+        case 's':
+        case 'r':
+            error = serve_read(op, arg, reply);
+            break;
+        case 'l':
+            error = serve_list(fd, reply);
+            break;
+        case 'a':
+        case 'u':
+        case 'd':
+            error = serve_change(op, arg, reply);
+            break;
+        default:
+            error = "unknown request";
+    }
+    if (error) {
+        reply_printf(reply, "ERR %s\n", error);
+    } else {
+        reply_printf(reply, "OK %llu\n", reply->records);
+    }
+    return reply_send(fd, reply);
+}
+
+static int client_add(int fd) {
+    int status = STATUS_SUCCESS;
+    pthread_mutex_lock(&server.clients_lock);
+    if (server.nclients == server.clients_cap) {
+        size_t cap = server.clients_cap ? server.clients_cap * 2 : 64;
+        int *clients = realloc(server.clients, cap * sizeof(int));
+        if (clients == NULL) {
+            status = STATUS_ERROR;
+        } else {
+            server.clients = clients;
+            server.clients_cap = cap;
+        }
+    }
+    if (status == STATUS_SUCCESS) {
+        server.clients[server.nclients++] = fd;
+    }
+    pthread_mutex_unlock(&server.clients_lock);
+    return status;
+}
+
+static void client_remove(int fd) {
+    pthread_mutex_lock(&server.clients_lock);
+    for (size_t i = 0; i < server.nclients; i++) {
+        if (server.clients[i] == fd) {
+            server.clients[i] = server.clients[--server.nclients];
+            break;
+        }
+    }
+    if (server.nclients == 0) {
+        pthread_cond_broadcast(&server.drained);
+    }
+    pthread_mutex_unlock(&server.clients_lock);
+}
+
+// Shutting a socket down ends its thread's read, or its next send, once
+// the request in flight is answered
+static void clients_drain(void) {
+    pthread_mutex_lock(&server.clients_lock);
+    for (size_t i = 0; i < server.nclients; i++) {
+        shutdown(server.clients[i], SHUT_RDWR);
+    }
+    while (server.nclients > 0) {
+        pthread_cond_wait(&server.drained, &server.clients_lock);
+    }
+    pthread_mutex_unlock(&server.clients_lock);
+    free(server.clients);
+    server.clients = NULL;
+    server.clients_cap = 0;
+}
+
+static void *serve_connection(void *arg) {
+    int fd = (int)(long)arg;
+    char *buf = malloc(SERVER_LINE_MAX);
+    struct reply_t reply = {0};
+    size_t have = 0;
+    while (buf) {
+        char *newline = memchr(buf, '\n', have);
+        if (newline == NULL) {
+            if (have == SERVER_LINE_MAX) {
+                reply_printf(&reply, "ERR request too long\n");
+                reply_send(fd, &reply);
+                break;
+            }
+            ssize_t n = read(fd, buf + have, SERVER_LINE_MAX - have);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            have += n;
+            continue;
+        }
+        *newline = '\0';
+        if (newline > buf && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        int status = serve_request(fd, buf, &reply);
+        size_t used = newline + 1 - buf;
+        memmove(buf, newline + 1, have - used);
+        have -= used;
+        if (status != STATUS_SUCCESS) {
+            break;
+        }
+    }
+    free(reply.buf);
+    free(buf);
+    // Last, as server_run may return once the connection is gone
+    client_remove(fd);
+    close(fd);
+    return NULL;
+}
+
+// Only a socket left by an earlier run is removed, never another file
+static int listen_on(char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path is too long\n");
+        return STATUS_ERROR;
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SERVER_BACKLOG) == -1) {
+        perror("socket");
+        if (fd != -1) {
+            close(fd);
+        }
+        return STATUS_ERROR;
+    }
+    return fd;
+}
+
+int server_run(struct dbstore_t *store, char *path) {
+    // Everything a reader would otherwise set up lazily happens now
+    if (store_index(store) == NULL) {
+        printf("Serving without the index\n");
+    }
+    if (store_map(store) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    server.store = store;
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&server.lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    store->lock = &server.lock;
+
+    int fd = listen_on(path);
+    if (fd == STATUS_ERROR) {
+        return STATUS_ERROR;
+    }
+    // No SA_RESTART, so a signal breaks accept
+    struct sigaction action = {.sa_handler = on_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving %s on %s\n", store->path, path);
+    fflush(stdout);
+
+    // Connection threads start with the signals blocked, so they land here
+    sigset_t signals, unblocked;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_attr_t detached;
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+    int status = STATUS_SUCCESS;
+    while (!stopping) {
+        int client = accept(fd, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            status = STATUS_ERROR;
+            break;
+        }
+        if (client_add(client) != STATUS_SUCCESS) {
+            printf("Failed to track a connection\n");
+            close(client);
+            continue;
+        }
+        pthread_t thread;
+        pthread_sigmask(SIG_BLOCK, &signals, &unblocked);
+        if (pthread_create(&thread, &detached, serve_connection, (void *)(long)client) != 0) {
+            printf("Failed to start a connection thread\n");
+            client_remove(client);
+            close(client);
+        }
+        pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+    }
+    pthread_attr_destroy(&detached);
+    close(fd);
+    unlink(path);
+    // Requests in flight finish; after that no thread is left to take the locks
+    clients_drain();
+    store->lock = NULL;
+    pthread_rwlock_destroy(&server.lock);
+    pthread_mutex_destroy(&server.writer);
+    return status;
+}
@@ -0,0 +1,912 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "checksum.h"
+#include "common.h"
+#include "file.h"
+#include "pagecrc.h"
+#include "parse.h"
+#include "store.h"
+#include "wal.h"
+
+// Rows per column chunk when rewriting, and bytes of strings buffered
+#define REWRITE_ROWS    65536
+#define REWRITE_STRINGS (1 << 20)
+
+#define ROUND_UP(n, to) (((n) + (to) - 1) / (to) * (to))
+
+size_t header_to_disk(struct dbheader64_t *host, struct dbheader64_t *disk) {
+    if (host->version < DB_VERSION_LARGE) {
+        struct dbheader_t *small = (struct dbheader_t *)disk;
+        small->magic = htonl(host->magic);
+        small->version = htons(host->version);
+        small->count = htons(host->count);
+        small->filesize = htonl(host->filesize);
+        return sizeof(*small);
+    }
+    memset(disk, 0, sizeof(*disk));
+    disk->magic = htonl(host->magic);
+    disk->version = htons(host->version);
+    disk->count = htobe64(host->count);
+    disk->filesize = htobe64(host->filesize);
+    disk->segment_count = htonl(host->segment_count);
+    for (unsigned int k = 0; k < host->segment_count; k++) {
+        disk->segments[k] = htobe64(host->segments[k]);
+    }
+    disk->checksums = htobe64(host->checksums);
+    disk->checksum_pages = htobe64(host->checksum_pages);
+    if (host->checksums) {
+        disk->crc = htonl(crc32c(0, disk, sizeof(*disk)));
+    }
+    return sizeof(*disk);
+}
+
+// Version 2 columns packed one after the other behind the header, heap last
+static void segments_for(unsigned int capacity, struct dbsegments_t *segments) {
+    segments->capacity = capacity;
+    segments->names = sizeof(struct dbheader_t) + sizeof(struct dbsegments_t);
+    segments->addresses = segments->names + capacity * sizeof(struct strref_t);
+    segments->hours = segments->addresses + capacity * sizeof(struct strref_t);
+    segments->heap = segments->hours + capacity * sizeof(unsigned int);
+}
+
+static int read_segments(struct dbstore_t *store) {
+    struct dbsegments_t disk;
+    if (read_all(store->fd, &disk, sizeof(disk), sizeof(struct dbheader_t)) != STATUS_SUCCESS) {
+        printf("Corrupted database\n");
+        return STATUS_ERROR;
+    }
+    struct dbsegments_t *segments = &store->segments;
+    segments_for(ntohl(disk.capacity), segments);
+    if (segments->names != ntohl(disk.names) || segments->addresses != ntohl(disk.addresses) ||
+        segments->hours != ntohl(disk.hours) || segments->heap != ntohl(disk.heap) ||
+        segments->capacity < store->header.count || segments->heap > store->header.filesize) {
+        printf("Corrupted database\n");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+unsigned long long large_column(const struct dbheader64_t *header, unsigned long long i, int column) {
+    int k = SEGMENT_OF(i);
+    unsigned long long row = i - SEGMENT_FIRST(k);
+    unsigned long long offset = header->segments[k] + column * SEGMENT_ROWS(k) * sizeof(unsigned long long);
+    return offset + row * (column == COLUMN_HOURS ? sizeof(unsigned int) : sizeof(unsigned long long));
+}
+
+// <path><suffix> in a new string
+static char *store_path(struct dbstore_t *store, const char *suffix) {
+    size_t pathlen = strlen(store->path) + strlen(suffix) + 1;
+    char *path = malloc(pathlen);
+    if (path == NULL) {
+        printf("Malloc failed\n");
+        return NULL;
+    }
+    snprintf(path, pathlen, "%s%s", store->path, suffix);
+    return path;
+}
+
+// Opens <filename>.idx, refilling it from the records if it can't be trusted
+struct dbindex_t *store_index(struct dbstore_t *store) {
+    if (store->index || store->index_failed) {
+        return store->index;
+    }
+    char *path = store_path(store, ".idx");
+    if (path == NULL) {
+        store->index_failed = 1;
+        return NULL;
+    }
+    int rebuild = 0;
+    int status = index_open(path, store->header.count, &store->index, &rebuild);
+    free(path);
+    for (unsigned int i = 0; status == STATUS_SUCCESS && rebuild && i < store->header.count; i++) {
+        struct record_t record;
+        status = store_record(store, i, &record);
+        if (status == STATUS_SUCCESS && !RECORD_DELETED(&record)) {
+            status = index_insert(store->index, i, record.name, record.hours);
+        }
+    }
+    if (status != STATUS_SUCCESS) {
+        printf("Failed to open the index\n");
+        store->index_failed = 1;
+        return NULL;
+    }
+    return store->index;
+}
+
+struct name_match_t {
+    struct dbstore_t *store;
+    const char *name;
+    size_t namelen;
+    store_visit_t found;
+    void *arg;
+    unsigned int count;
+};
+
+static int visit_if_named(unsigned int index, void *arg) {
+    struct name_match_t *match = arg;
+    struct record_t record;
+    // The index matches on a hash; the name itself decides
+    if (store_record(match->store, index, &record) == STATUS_SUCCESS && record.namelen == match->namelen &&
+        memcmp(record.name, match->name, match->namelen) == 0) {
+        match->found(index, &record, match->arg);
+        match->count++;
+    }
+    return 0;
+}
+
+unsigned int store_find_name(struct dbstore_t *store, const char *name, store_visit_t found, void *arg) {
+    struct name_match_t match = {.store = store, .name = name, .namelen = strlen(name), .found = found, .arg = arg};
+    struct dbindex_t *index = store_index(store);
+    if (index != NULL) {
+        index_find_name(index, name, visit_if_named, &match);
+    }
+    return match.count;
+}
+
+int store_create(char *filename, unsigned short version, struct dbstore_t **storeOut) {
+    if (version != DB_VERSION_FIXED && version != DB_VERSION_LARGE) {
+        printf("Can't create a version %u database\n", version);
+        return STATUS_ERROR;
+    }
+    int fd = create_db_file(filename);
+    if (fd == STATUS_ERROR) {
+        return STATUS_ERROR;
+    }
+    struct dbstore_t *store = calloc(1, sizeof(struct dbstore_t));
+    struct dbheader64_t *header = NULL;
+    if (store == NULL || (store->path = strdup(filename)) == NULL || create_db_header(&header) == STATUS_ERROR) {
+        printf("Malloc failed to create the store\n");
+        if (store) {
+            free(store->path);
+        }
+        free(store);
+        close(fd);
+        return STATUS_ERROR;
+    }
+    store->fd = fd;
+    store->header = *header;
+    store->header.version = version;
+    if (version == DB_VERSION_FIXED) {
+        store->header.filesize = sizeof(struct dbheader_t);
+    }
+    free(header);
+    struct dbheader64_t disk;
+    int status = version == DB_VERSION_LARGE ? pagecrc_build(fd, &store->header) : STATUS_SUCCESS;
+    size_t disklen = header_to_disk(&store->header, &disk);
+    if (status != STATUS_SUCCESS || write_all(fd, &disk, disklen, 0) != STATUS_SUCCESS || ftruncate(fd, store->header.filesize) == -1 ||
+        fdatasync(fd) == -1 || wal_open(filename, &store->wal) != STATUS_SUCCESS ||
+        store_map(store) != STATUS_SUCCESS || store_index(store) == NULL) {
+        printf("Failed to write the new database\n");
+        store_close(store);
+        return STATUS_ERROR;
+    }
+    *storeOut = store;
+    return STATUS_SUCCESS;
+}
+
+int store_open(char *filename, struct dbstore_t **storeOut) {
+    int fd = open_db_file(filename);
+    if (fd == STATUS_ERROR) {
+        return STATUS_ERROR;
+    }
+    struct dbstore_t *store = calloc(1, sizeof(struct dbstore_t));
+    if (store == NULL || (store->path = strdup(filename)) == NULL) {
+        printf("Malloc failed to create the store\n");
+        free(store);
+        close(fd);
+        return STATUS_ERROR;
+    }
+    store->fd = fd;
+    // Finish any transaction a crash interrupted before looking at the header
+    if (wal_open(filename, &store->wal) != STATUS_SUCCESS || wal_recover(store->wal, fd) != STATUS_SUCCESS) {
+        store_close(store);
+        return STATUS_ERROR;
+    }
+    struct dbheader64_t *header = NULL;
+    if (validate_db_header(fd, &header) == STATUS_ERROR) {
+        store_close(store);
+        return STATUS_ERROR;
+    }
+    store->header = *header;
+    free(header);
+    if ((store->header.version == DB_VERSION_COLUMNAR && read_segments(store) != STATUS_SUCCESS) ||
+        store_map(store) != STATUS_SUCCESS || pagecrc_verify(store) != STATUS_SUCCESS) {
+        store_close(store);
+        return STATUS_ERROR;
+    }
+    *storeOut = store;
+    return STATUS_SUCCESS;
+}
+
+void store_close(struct dbstore_t *store) {
+    if (store == NULL) {
+        return;
+    }
+    if (store->index) {
+        INDEX_HEADER(store->index)->db_count = store->index_failed ? ~0ULL : store->header.count;
+        index_close(store->index);
+    }
+    if (store->map) {
+        munmap((void *)store->map, store->maplen);
+    }
+    if (store->wal && store->wal->logged > 0) {
+        wal_checkpoint(store->wal, store->fd);
+    }
+    wal_close(store->wal);
+    close(store->fd);
+    free(store->path);
+    free(store);
+}
+
+// Maps a quarter more than the file holds (pages past the end are never
+// touched), so a growing file isn't remapped on every append
+int store_map(struct dbstore_t *store) {
+    size_t want = store->header.filesize;
+    if (store->map && store->maplen >= want) {
+        return STATUS_SUCCESS;
+    }
+    if (store->map) {
+        munmap((void *)store->map, store->maplen);
+        store->map = NULL;
+    }
+    want = ROUND_UP(want + want / 4, DB_PAGE_SIZE);
+    void *map = mmap(NULL, want, PROT_READ, MAP_SHARED, store->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return STATUS_ERROR;
+    }
+    store->map = map;
+    store->maplen = want;
+    return STATUS_SUCCESS;
+}
+
+// Writes go through pwrite to the same page cache, so the view stays
+// current; only growth needs a new mapping. Done before a record is looked
+// at, so pointers into it stay valid while it is read.
+static int store_remap(struct dbstore_t *store) {
+    return store->maplen < store->header.filesize ? store_map(store) : STATUS_SUCCESS;
+}
+
+// length bytes at offset inside the file, or NULL
+static const void *store_at(struct dbstore_t *store, unsigned long long offset, size_t length) {
+    if (offset + length > store->header.filesize) {
+        return NULL;
+    }
+    return store->map + offset;
+}
+
+static const char *store_string(struct dbstore_t *store, unsigned long long offset, unsigned int length) {
+    return length == 0 ? "" : store_at(store, offset, length + 1);
+}
+
+int store_record(struct dbstore_t *store, unsigned int index, struct record_t *record) {
+    if (index >= store->header.count || store_remap(store) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    if (store->header.version == DB_VERSION_FIXED) {
+        const struct employee_t *employee = store_at(store, RECORD_OFFSET(index), sizeof(struct employee_t));
+        if (employee == NULL) {
+            return STATUS_ERROR;
+        }
+        record->name = employee->name;
+        record->namelen = strnlen(employee->name, sizeof(employee->name));
+        record->address = employee->address;
+        record->addresslen = strnlen(employee->address, sizeof(employee->address));
+        record->hours = EMPLOYEE_HOURS(employee);
+        return STATUS_SUCCESS;
+    }
+    if (store->header.version == DB_VERSION_LARGE) {
+        // validate_db_header checked the segments lie inside the file
+        const struct dbheader64_t *header = &store->header;
+        const char *map = store->map;
+        unsigned long long name =
+            be64toh(*(const unsigned long long *)(map + large_column(header, index, COLUMN_NAMES)));
+        unsigned long long address =
+            be64toh(*(const unsigned long long *)(map + large_column(header, index, COLUMN_ADDRESSES)));
+        record->hours = ntohl(*(const unsigned int *)(map + large_column(header, index, COLUMN_HOURS)));
+        record->namelen = STRREF64_LENGTH(name);
+        record->addresslen = STRREF64_LENGTH(address);
+        record->name = store_string(store, STRREF64_OFFSET(name), record->namelen);
+        record->address = store_string(store, STRREF64_OFFSET(address), record->addresslen);
+        return record->name && record->address ? STATUS_SUCCESS : STATUS_ERROR;
+    }
+    const struct dbsegments_t *segments = &store->segments;
+    const struct strref_t *name = store_at(store, segments->names + (size_t)index * sizeof(struct strref_t),
+                                           sizeof(struct strref_t));
+    const struct strref_t *address = store_at(store, segments->addresses + (size_t)index * sizeof(struct strref_t),
+                                              sizeof(struct strref_t));
+    const unsigned int *hours = store_at(store, segments->hours + (size_t)index * sizeof(unsigned int),
+                                         sizeof(unsigned int));
+    if (name == NULL || address == NULL || hours == NULL) {
+        return STATUS_ERROR;
+    }
+    record->namelen = ntohl(name->length);
+    record->addresslen = ntohl(address->length);
+    record->name = store_string(store, (size_t)segments->heap + ntohl(name->offset), record->namelen);
+    record->address = store_string(store, (size_t)segments->heap + ntohl(address->offset), record->addresslen);
+    record->hours = ntohl(*hours);
+    return record->name && record->address ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+const unsigned int *store_hours_column(struct dbstore_t *store, unsigned int first, unsigned int *rowsOut) {
+    *rowsOut = 0;
+    if (first >= store->header.count || store_remap(store) != STATUS_SUCCESS) {
+        return NULL;
+    }
+    unsigned long long end = store->header.count;
+    if (store->header.version == DB_VERSION_COLUMNAR) {
+        *rowsOut = end - first;
+        return (const unsigned int *)(store->map + store->segments.hours) + first;
+    }
+    if (store->header.version == DB_VERSION_LARGE) {
+        int k = SEGMENT_OF(first);
+        if (SEGMENT_FIRST(k + 1) < end) {
+            end = SEGMENT_FIRST(k + 1);
+        }
+        *rowsOut = end - first;
+        return (const unsigned int *)(store->map + large_column(&store->header, first, COLUMN_HOURS));
+    }
+    return NULL;
+}
+
+int store_read_employee(struct dbstore_t *store, unsigned int index, struct employee_t *employee) {
+    struct record_t record;
+    if (store_record(store, index, &record) != STATUS_SUCCESS) {
+        printf("No employee %u\n", index);
+        return STATUS_ERROR;
+    }
+    memset(employee, 0, sizeof(*employee));
+    memcpy(employee->name, record.name, record.namelen);
+    memcpy(employee->address, record.address, record.addresslen);
+    employee->hours = record.hours;
+    return STATUS_SUCCESS;
+}
+
+// Copies name\0address\0 into strings, returning the bytes used (0 for a
+// deleted record, which has no strings)
+static unsigned int employee_strings(struct employee_t *employee, char *strings, unsigned int *namelenOut,
+                                     unsigned int *addresslenOut) {
+    unsigned int namelen = strnlen(employee->name, sizeof(employee->name));
+    unsigned int addresslen = strnlen(employee->address, sizeof(employee->address));
+    *namelenOut = namelen;
+    *addresslenOut = namelen ? addresslen : 0;
+    if (namelen == 0) {
+        return 0;
+    }
+    memcpy(strings, employee->name, namelen);
+    strings[namelen] = '\0';
+    memcpy(strings + namelen + 1, employee->address, addresslen);
+    strings[namelen + 1 + addresslen] = '\0';
+    return namelen + addresslen + 2;
+}
+
+// Logs the new column entries, with the strings appended to the heap
+static int log_columnar(struct dbstore_t *store, unsigned int index, struct employee_t *employee,
+                        struct dbheader64_t *header) {
+    char strings[sizeof(employee->name) + sizeof(employee->address) + 2];
+    unsigned int namelen, addresslen;
+    unsigned int used = employee_strings(employee, strings, &namelen, &addresslen);
+    unsigned int heapused = header->filesize - store->segments.heap;
+    struct strref_t refs[2] = {{0}};
+    if (used > 0) {
+        refs[0] = (struct strref_t){htonl(heapused), htonl(namelen)};
+        refs[1] = (struct strref_t){htonl(heapused + namelen + 1), htonl(addresslen)};
+        if (wal_add(store->wal, header->filesize, strings, used) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        header->filesize += used;
+    }
+    unsigned int hours = htonl(employee->hours);
+    const struct dbsegments_t *segments = &store->segments;
+    if (wal_add(store->wal, segments->names + (off_t)index * sizeof(struct strref_t), &refs[0],
+                sizeof(refs[0])) != STATUS_SUCCESS ||
+        wal_add(store->wal, segments->addresses + (off_t)index * sizeof(struct strref_t), &refs[1],
+                sizeof(refs[1])) != STATUS_SUCCESS ||
+        wal_add(store->wal, segments->hours + (off_t)index * sizeof(unsigned int), &hours,
+                sizeof(hours)) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Version 3: a row past the last segment first gets a new segment at the
+// next page boundary. The file is extended before the transaction, so a
+// crash leaves only an unused tail.
+static int log_large(struct dbstore_t *store, unsigned int index, struct employee_t *employee,
+                     struct dbheader64_t *header) {
+    if (index == SEGMENT_FIRST(header->segment_count)) {
+        unsigned int k = header->segment_count;
+        if (k == DB_MAX_SEGMENTS) {
+            printf("Database is full\n");
+            return STATUS_ERROR;
+        }
+        header->segments[k] = ROUND_UP(header->filesize, DB_PAGE_SIZE);
+        header->segment_count++;
+        header->filesize = header->segments[k] + SEGMENT_SIZE(k);
+        if (ftruncate(store->fd, header->filesize) == -1) {
+            perror("ftruncate");
+            return STATUS_ERROR;
+        }
+    }
+    char strings[sizeof(employee->name) + sizeof(employee->address) + 2];
+    unsigned int namelen, addresslen;
+    unsigned int used = employee_strings(employee, strings, &namelen, &addresslen);
+    unsigned long long refs[2] = {0, 0};
+    if (used > 0) {
+        refs[0] = htobe64(STRREF64(header->filesize, namelen));
+        refs[1] = htobe64(STRREF64(header->filesize + namelen + 1, addresslen));
+        if (wal_add(store->wal, header->filesize, strings, used) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        header->filesize += used;
+    }
+    unsigned int hours = htonl(employee->hours);
+    if (wal_add(store->wal, large_column(header, index, COLUMN_NAMES), &refs[0], sizeof(refs[0])) != STATUS_SUCCESS ||
+        wal_add(store->wal, large_column(header, index, COLUMN_ADDRESSES), &refs[1], sizeof(refs[1])) !=
+            STATUS_SUCCESS ||
+        wal_add(store->wal, large_column(header, index, COLUMN_HOURS), &hours, sizeof(hours)) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Runs after the change is durable, so a failure here only costs a rebuild.
+// The index was opened before the change, so it doesn't already hold it.
+static void store_reindex(struct dbstore_t *store, unsigned int index, struct employee_t *old,
+                          struct employee_t *new) {
+    if (store->index == NULL) {
+        return;
+    }
+    if (old && !EMPLOYEE_DELETED(old) &&
+        index_remove(store->index, index, old->name, old->hours) != STATUS_SUCCESS) {
+        store->index_failed = 1;
+    }
+    if (new && !EMPLOYEE_DELETED(new) &&
+        index_insert(store->index, index, new->name, new->hours) != STATUS_SUCCESS) {
+        store->index_failed = 1;
+    }
+}
+
+static void store_lock(struct dbstore_t *store) {
+    if (store->lock) {
+        pthread_rwlock_wrlock(store->lock);
+    }
+}
+
+static void store_unlock(struct dbstore_t *store) {
+    if (store->lock) {
+        pthread_rwlock_unlock(store->lock);
+    }
+}
+
+// Logs the record (and the header when it changes), then applies both and
+// moves the index from old (NULL for an append) to the new record.
+// index == count appends.
+static int store_commit(struct dbstore_t *store, unsigned int index, struct employee_t *employee,
+                        struct employee_t *old) {
+    struct dbheader64_t header = store->header;
+    if (index == header.count) {
+        header.count++;
+    }
+    wal_begin(store->wal);
+    int status = STATUS_SUCCESS;
+    if (header.version == DB_VERSION_FIXED) {
+        struct employee_t disk = *employee;
+        disk.hours = htonl(employee->hours);
+        status = wal_add(store->wal, RECORD_OFFSET(index), &disk, sizeof(disk));
+        if (header.count != store->header.count) {
+            header.filesize = RECORD_OFFSET(header.count);
+        }
+    } else if (header.version == DB_VERSION_COLUMNAR) {
+        status = log_columnar(store, index, employee, &header);
+    } else {
+        status = log_large(store, index, employee, &header);
+    }
+    if (status != STATUS_SUCCESS || pagecrc_log(store, &header, index, index + 1) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    if (memcmp(&header, &store->header, sizeof(header)) != 0) {
+        struct dbheader64_t diskhdr;
+        size_t disklen = header_to_disk(&header, &diskhdr);
+        if (wal_add(store->wal, 0, &diskhdr, disklen) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+    }
+    if (wal_log(store->wal) != STATUS_SUCCESS) {
+        printf("Failed to commit change\n");
+        return STATUS_ERROR;
+    }
+    // Durable from here: a failure below is repaired by replaying the log
+    store_lock(store);
+    status = wal_apply(store->wal, store->fd);
+    if (status == STATUS_SUCCESS) {
+        store->header = header;
+        store_reindex(store, index, old, employee);
+        status = store_remap(store);
+    }
+    store_unlock(store);
+    if (status != STATUS_SUCCESS || wal_sync(store->wal, store->fd) != STATUS_SUCCESS) {
+        printf("Failed to commit change\n");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int store_append_employee(struct dbstore_t *store, struct employee_t *employee) {
+    unsigned long long limit = store->header.version < DB_VERSION_LARGE ? STORE_MAX_ROWS_SMALL : STORE_MAX_ROWS_LARGE;
+    if (store->header.count == limit) {
+        printf("Database is full\n");
+        return STATUS_ERROR;
+    }
+    // Full version 2 columns: move everything to a version 3 file
+    if (store->header.version == DB_VERSION_COLUMNAR && store->header.count == store->segments.capacity &&
+        store_rewrite(store, store->header.count + 1) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    store_index(store);
+    return store_commit(store, store->header.count, employee, NULL);
+}
+
+int store_update_employee(struct dbstore_t *store, unsigned int index, struct employee_t *employee) {
+    struct employee_t old;
+    store_index(store);
+    if (store_read_employee(store, index, &old) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return store_commit(store, index, employee, &old);
+}
+
+// The slot stays, marked deleted, so no other record moves
+int store_delete_employee(struct dbstore_t *store, unsigned int index) {
+    struct employee_t old;
+    struct employee_t tombstone = {0};
+    store_index(store);
+    if (store_read_employee(store, index, &old) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return store_commit(store, index, &tombstone, &old);
+}
+
+// Makes the rename itself durable
+static int sync_parent(const char *path) {
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        return STATUS_ERROR;
+    }
+    int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    free(copy);
+    if (fd == -1 || fsync(fd) == -1) {
+        perror("fsync");
+        if (fd != -1) {
+            close(fd);
+        }
+        return STATUS_ERROR;
+    }
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+// Output side of store_rewrite: column chunks for up to REWRITE_ROWS rows
+// of one segment, and strings buffered until they fill REWRITE_STRINGS
+struct rewrite_t {
+    int fd;
+    struct dbheader64_t header;
+    unsigned long long *names;
+    unsigned long long *addresses;
+    unsigned int *hours;
+    char *strings;
+    size_t used;
+    unsigned long long strings_at;  // file offset of strings[0]
+};
+
+static int rewrite_alloc(struct rewrite_t *out) {
+    out->names = malloc(REWRITE_ROWS * sizeof(unsigned long long));
+    out->addresses = malloc(REWRITE_ROWS * sizeof(unsigned long long));
+    out->hours = malloc(REWRITE_ROWS * sizeof(unsigned int));
+    out->strings = malloc(REWRITE_STRINGS);
+    return out->names && out->addresses && out->hours && out->strings ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+static void rewrite_free(struct rewrite_t *out) {
+    free(out->names);
+    free(out->addresses);
+    free(out->hours);
+    free(out->strings);
+}
+
+static int rewrite_flush_strings(struct rewrite_t *out) {
+    if (write_all(out->fd, out->strings, out->used, out->strings_at) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    out->strings_at += out->used;
+    out->used = 0;
+    return STATUS_SUCCESS;
+}
+
+static unsigned long long rewrite_string(struct rewrite_t *out, const char *string, unsigned int length) {
+    memcpy(out->strings + out->used, string, length);
+    out->strings[out->used + length] = '\0';
+    unsigned long long ref = STRREF64(out->strings_at + out->used, length);
+    out->used += length + 1;
+    return htobe64(ref);
+}
+
+// The buffered column entries for rows first..first+n-1, all in one segment
+static int rewrite_columns(struct rewrite_t *out, unsigned long long first, unsigned int n) {
+    size_t refs = (size_t)n * sizeof(unsigned long long);
+    if (write_all(out->fd, out->names, refs, large_column(&out->header, first, COLUMN_NAMES)) != STATUS_SUCCESS ||
+        write_all(out->fd, out->addresses, refs, large_column(&out->header, first, COLUMN_ADDRESSES)) !=
+            STATUS_SUCCESS ||
+        write_all(out->fd, out->hours, (size_t)n * sizeof(unsigned int),
+                  large_column(&out->header, first, COLUMN_HOURS)) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Rows first..first+n-1, all in one segment
+static int rewrite_rows(struct dbstore_t *store, struct rewrite_t *out, unsigned long long first, unsigned int n) {
+    for (unsigned int r = 0; r < n; r++) {
+        struct record_t record;
+        if (store_record(store, first + r, &record) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        out->hours[r] = 0;
+        out->names[r] = out->addresses[r] = 0;
+        if (RECORD_DELETED(&record)) {
+            continue;
+        }
+        out->hours[r] = htonl(record.hours);
+        if (out->used + record.namelen + record.addresslen + 2 > REWRITE_STRINGS &&
+            rewrite_flush_strings(out) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        out->names[r] = rewrite_string(out, record.name, record.namelen);
+        out->addresses[r] = rewrite_string(out, record.address, record.addresslen);
+    }
+    return rewrite_columns(out, first, n);
+}
+
+static int rewrite_file(struct dbstore_t *store, struct rewrite_t *out) {
+    unsigned long long count = out->header.count;
+    for (unsigned long long i = 0; i < count;) {
+        unsigned long long end = SEGMENT_FIRST(SEGMENT_OF(i) + 1);
+        unsigned int n = REWRITE_ROWS;
+        if (end > count) {
+            end = count;
+        }
+        if (end - i < n) {
+            n = end - i;
+        }
+        if (rewrite_rows(store, out, i, n) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        i += n;
+    }
+    if (rewrite_flush_strings(out) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    out->header.filesize = out->strings_at;
+    if (pagecrc_build(out->fd, &out->header) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    struct dbheader64_t disk;
+    size_t disklen = header_to_disk(&out->header, &disk);
+    if (write_all(out->fd, &disk, disklen, 0) != STATUS_SUCCESS || ftruncate(out->fd, out->header.filesize) == -1 ||
+        fdatasync(out->fd) == -1) {
+        perror("rewrite");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int store_rewrite(struct dbstore_t *store, unsigned long long capacity) {
+    struct rewrite_t out = {.fd = -1};
+    out.header.magic = HEADER_MAGIC;
+    out.header.version = DB_VERSION_LARGE;
+    out.header.count = store->header.count;
+    if (capacity < out.header.count) {
+        capacity = out.header.count;
+    }
+    // Segments back to back, strings after the last
+    unsigned long long end = DB_PAGE_SIZE;
+    while (SEGMENT_FIRST(out.header.segment_count) < capacity) {
+        unsigned int k = out.header.segment_count++;
+        out.header.segments[k] = end;
+        end += SEGMENT_SIZE(k);
+    }
+    out.strings_at = end;
+
+    // The log holds offsets into the old file, so it must be empty before
+    // the new one takes its name
+    if (wal_checkpoint(store->wal, store->fd) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    char *tmppath = store_path(store, ".tmp");
+    int status = STATUS_ERROR;
+    if (tmppath == NULL || rewrite_alloc(&out) != STATUS_SUCCESS) {
+        printf("Malloc failed to rewrite the database\n");
+    } else if ((out.fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror("open");
+    } else if (store_remap(store) != STATUS_SUCCESS || rewrite_file(store, &out) != STATUS_SUCCESS ||
+               rename(tmppath, store->path) == -1) {
+        close(out.fd);
+        unlink(tmppath);
+    } else {
+        status = STATUS_SUCCESS;
+    }
+    free(tmppath);
+    rewrite_free(&out);
+    if (status != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    // The new file is in place now, so switch to it even if the directory sync fails
+    status = sync_parent(store->path);
+    store_lock(store);
+    close(store->fd);
+    store->fd = out.fd;
+    store->header = out.header;
+    if (store->map) {
+        munmap((void *)store->map, store->maplen);
+        store->map = NULL;
+        store->maplen = 0;
+    }
+    if (store_map(store) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
+    store_unlock(store);
+    return status;
+}
+
+// A bulk append: the rewrite buffers, aimed at the store's own file past
+// its last row and the end of its strings
+struct dbbatch_t {
+    struct dbstore_t *store;
+    struct rewrite_t out;       // out.header runs ahead of store->header
+    unsigned long long first;   // row of out.names[0]
+    unsigned int rows;          // column entries buffered
+    int failed;                 // a write failed, so nothing is committed
+};
+
+int store_batch_begin(struct dbstore_t *store, struct dbbatch_t **batchOut) {
+    // Batches fill version 3 segments; older files move to version 3 first
+    if (store->header.version != DB_VERSION_LARGE && store_rewrite(store, store->header.count) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    struct dbbatch_t *batch = calloc(1, sizeof(struct dbbatch_t));
+    if (batch == NULL || rewrite_alloc(&batch->out) != STATUS_SUCCESS) {
+        printf("Malloc failed to start the batch\n");
+        if (batch) {
+            rewrite_free(&batch->out);
+        }
+        free(batch);
+        return STATUS_ERROR;
+    }
+    batch->store = store;
+    batch->out.fd = store->fd;
+    batch->out.header = store->header;
+    batch->out.strings_at = store->header.filesize;
+    batch->first = store->header.count;
+    *batchOut = batch;
+    return STATUS_SUCCESS;
+}
+
+static int batch_flush_rows(struct dbbatch_t *batch) {
+    if (batch->rows > 0 && rewrite_columns(&batch->out, batch->first, batch->rows) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    batch->first += batch->rows;
+    batch->rows = 0;
+    return STATUS_SUCCESS;
+}
+
+// The next segment starts at the first page boundary past the strings
+static int batch_add_segment(struct dbbatch_t *batch) {
+    struct rewrite_t *out = &batch->out;
+    unsigned int k = out->header.segment_count;
+    if (k == DB_MAX_SEGMENTS) {
+        printf("Database is full\n");
+        return STATUS_ERROR;
+    }
+    if (rewrite_flush_strings(out) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    out->header.segments[k] = ROUND_UP(out->strings_at, DB_PAGE_SIZE);
+    out->header.segment_count++;
+    out->strings_at = out->header.segments[k] + SEGMENT_SIZE(k);
+    if (ftruncate(out->fd, out->strings_at) == -1) {
+        perror("ftruncate");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int store_batch_add(struct dbbatch_t *batch, const char *name, unsigned int namelen, const char *address,
+                    unsigned int addresslen, unsigned int hours) {
+    struct rewrite_t *out = &batch->out;
+    struct dbheader64_t *header = &out->header;
+    if (namelen > STORE_STRING_MAX || addresslen > STORE_STRING_MAX) {
+        printf("Names and addresses are at most %d bytes\n", STORE_STRING_MAX);
+        return STATUS_ERROR;
+    }
+    if (!batch->failed && header->count == STORE_MAX_ROWS_LARGE) {
+        printf("Database is full\n");
+        batch->failed = 1;
+    }
+    // Column chunks never cross into the next segment
+    int boundary = header->count == SEGMENT_FIRST(header->segment_count);
+    if (!batch->failed && (boundary || batch->rows == REWRITE_ROWS)) {
+        batch->failed = batch_flush_rows(batch) != STATUS_SUCCESS ||
+                        (boundary && batch_add_segment(batch) != STATUS_SUCCESS);
+    }
+    if (!batch->failed && out->used + namelen + addresslen + 2 > REWRITE_STRINGS) {
+        batch->failed = rewrite_flush_strings(out) != STATUS_SUCCESS;
+    }
+    if (batch->failed) {
+        return STATUS_ERROR;
+    }
+    unsigned int r = batch->rows++;
+    out->names[r] = out->addresses[r] = out->hours[r] = 0;
+    if (namelen > 0) {
+        out->names[r] = rewrite_string(out, name, namelen);
+        out->addresses[r] = rewrite_string(out, address, addresslen);
+        out->hours[r] = htonl(hours);
+    }
+    header->count++;
+    return STATUS_SUCCESS;
+}
+
+int store_batch_commit(struct dbbatch_t *batch) {
+    struct dbstore_t *store = batch->store;
+    struct rewrite_t *out = &batch->out;
+    int status = batch->failed ? STATUS_ERROR : STATUS_SUCCESS;
+    if (status == STATUS_SUCCESS && out->header.count != store->header.count) {
+        // Rows and strings reach the disk before the header that points at them
+        if (batch_flush_rows(batch) != STATUS_SUCCESS || rewrite_flush_strings(out) != STATUS_SUCCESS ||
+            fdatasync(store->fd) == -1) {
+            printf("Failed to write the batch\n");
+            status = STATUS_ERROR;
+        }
+    }
+    if (status == STATUS_SUCCESS && out->header.count != store->header.count) {
+        out->header.filesize = out->strings_at;
+        wal_begin(store->wal);
+        int logged = pagecrc_log(store, &out->header, store->header.count, out->header.count);
+        struct dbheader64_t disk;
+        size_t disklen = header_to_disk(&out->header, &disk);
+        if (logged != STATUS_SUCCESS || wal_add(store->wal, 0, &disk, disklen) != STATUS_SUCCESS ||
+            wal_commit(store->wal, store->fd) != STATUS_SUCCESS) {
+            printf("Failed to commit change\n");
+            status = STATUS_ERROR;
+        } else {
+            // An open index no longer covers every row. Closing it stale means
+            // a rebuild in one pass on next use; a closed one already has the
+            // old count.
+            store_lock(store);
+            store->header = out->header;
+            if (store->index) {
+                INDEX_HEADER(store->index)->db_count = ~0ULL;
+                index_close(store->index);
+                store->index = NULL;
+            }
+            status = store_remap(store);
+            store_unlock(store);
+        }
+    }
+    store_batch_abort(batch);
+    return status;
+}
+
+// Whatever was written stays past the end of the file, unused
+void store_batch_abort(struct dbbatch_t *batch) {
+    rewrite_free(&batch->out);
+    free(batch);
+}
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "wal.h"
+
+// pwrite until everything is out; a short write is not an error by itself
+int write_all(int fd, const void *data, size_t length, off_t offset) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t n = pwrite(fd, p, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pwrite");
+            return STATUS_ERROR;
+        }
+        p += n;
+        length -= n;
+        offset += n;
+    }
+    return STATUS_SUCCESS;
+}
+
+// pread until length bytes are in; running out of file is an error
+int read_all(int fd, void *data, size_t length, off_t offset) {
+    char *p = data;
+    while (length > 0) {
+        ssize_t n = pread(fd, p, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                perror("pread");
+            } else {
+                printf("Unexpected end of file\n");
+            }
+            return STATUS_ERROR;
+        }
+        p += n;
+        length -= n;
+        offset += n;
+    }
+    return STATUS_SUCCESS;
+}
+
+int wal_open(char *dbpath, struct wal_t **walOut) {
+    struct wal_t *wal = calloc(1, sizeof(struct wal_t));
+    if (wal == NULL) {
+        printf("Malloc failed to create the log\n");
+        return STATUS_ERROR;
+    }
+    size_t pathlen = strlen(dbpath) + 5;
+    char *path = malloc(pathlen);
+    if (path == NULL) {
+        printf("Malloc failed to create the log\n");
+        free(wal);
+        return STATUS_ERROR;
+    }
+    snprintf(path, pathlen, "%s.wal", dbpath);
+    wal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (wal->fd == -1) {
+        perror("open");
+        free(wal);
+        return STATUS_ERROR;
+    }
+    *walOut = wal;
+    return STATUS_SUCCESS;
+}
+
+void wal_close(struct wal_t *wal) {
+    if (wal == NULL) {
+        return;
+    }
+    close(wal->fd);
+    free(wal->buf);
+    free(wal);
+}
+
+static int wal_write_images(int dbfd, const char *body, unsigned int nwrites, size_t length) {
+    size_t pos = 0;
+    for (unsigned int i = 0; i < nwrites; i++) {
+        struct walwrite_t write;
+        if (length - pos < sizeof(write)) {
+            return STATUS_ERROR;
+        }
+        memcpy(&write, body + pos, sizeof(write));
+        pos += sizeof(write);
+        if (length - pos < write.length) {
+            return STATUS_ERROR;
+        }
+        if (write_all(dbfd, body + pos, write.length, write.offset) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        pos += write.length;
+    }
+    return STATUS_SUCCESS;
+}
+
+int wal_checkpoint(struct wal_t *wal, int dbfd) {
+    if (fdatasync(dbfd) == -1) {
+        perror("fdatasync");
+        return STATUS_ERROR;
+    }
+    // Synced too: a log left over from before a rewrite mustn't be replayed
+    // into the new file
+    if (ftruncate(wal->fd, 0) == -1 || fdatasync(wal->fd) == -1) {
+        perror("ftruncate");
+        return STATUS_ERROR;
+    }
+    wal->logged = 0;
+    return STATUS_SUCCESS;
+}
+
+int wal_sync(struct wal_t *wal, int dbfd) {
+    return wal->logged >= WAL_CHECKPOINT_BYTES ? wal_checkpoint(wal, dbfd) : STATUS_SUCCESS;
+}
+
+int wal_recover(struct wal_t *wal, int dbfd) {
+    off_t size = lseek(wal->fd, 0, SEEK_END);
+    if (size <= 0) {
+        return size == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+    }
+    char *log = malloc(size);
+    if (log == NULL) {
+        printf("Malloc failed to read the log\n");
+        return STATUS_ERROR;
+    }
+    if (read_all(wal->fd, log, size, 0) != STATUS_SUCCESS) {
+        free(log);
+        return STATUS_ERROR;
+    }
+    // A transaction that fails its checksum was never fully synced, so the
+    // database was never touched by it, nor by anything after it
+    int status = STATUS_SUCCESS;
+    unsigned int transactions = 0;
+    size_t pos = 0;
+    while (status == STATUS_SUCCESS && size - pos >= sizeof(struct walhdr_t)) {
+        struct walhdr_t hdr;
+        memcpy(&hdr, log + pos, sizeof(hdr));
+        const char *body = log + pos + sizeof(hdr);
+        if (hdr.magic != WAL_MAGIC || size - pos - sizeof(hdr) < hdr.length || crc32c(0, body, hdr.length) != hdr.crc) {
+            break;
+        }
+        status = wal_write_images(dbfd, body, hdr.nwrites, hdr.length);
+        pos += sizeof(hdr) + hdr.length;
+        transactions++;
+    }
+    if (pos < (size_t)size) {
+        printf("Discarding incomplete log\n");
+    }
+    if (transactions > 0) {
+        printf("Replayed %u transactions from the log\n", transactions);
+    }
+    free(log);
+    return status == STATUS_SUCCESS ? wal_checkpoint(wal, dbfd) : STATUS_ERROR;
+}
+
+void wal_begin(struct wal_t *wal) {
+    wal->len = sizeof(struct walhdr_t);
+    wal->nwrites = 0;
+}
+
+int wal_add(struct wal_t *wal, off_t offset, const void *data, size_t length) {
+    size_t need = wal->len + sizeof(struct walwrite_t) + length;
+    if (need > wal->cap) {
+        size_t cap = wal->cap ? wal->cap : 4096;
+        while (cap < need) {
+            cap *= 2;
+        }
+        char *buf = realloc(wal->buf, cap);
+        if (buf == NULL) {
+            printf("Malloc failed to grow the log\n");
+            return STATUS_ERROR;
+        }
+        wal->buf = buf;
+        wal->cap = cap;
+    }
+    struct walwrite_t write = {.offset = offset, .length = length, .pad = 0};
+    memcpy(wal->buf + wal->len, &write, sizeof(write));
+    memcpy(wal->buf + wal->len + sizeof(write), data, length);
+    wal->len = need;
+    wal->nwrites++;
+    return STATUS_SUCCESS;
+}
+
+void wal_overlay(struct wal_t *wal, off_t offset, void *data, size_t length) {
+    size_t pos = sizeof(struct walhdr_t);
+    for (unsigned int i = 0; i < wal->nwrites; i++) {
+        struct walwrite_t write;
+        memcpy(&write, wal->buf + pos, sizeof(write));
+        pos += sizeof(write);
+        unsigned long long from = write.offset > (unsigned long long)offset ? write.offset : (unsigned long long)offset;
+        unsigned long long to = write.offset + write.length;
+        if (to > (unsigned long long)offset + length) {
+            to = offset + length;
+        }
+        if (from < to) {
+            memcpy((char *)data + (from - offset), wal->buf + pos + (from - write.offset), to - from);
+        }
+        pos += write.length;
+    }
+}
+
+int wal_log(struct wal_t *wal) {
+    if (wal->nwrites == 0) {
+        return STATUS_SUCCESS;
+    }
+    struct walhdr_t hdr = {
+        .magic = WAL_MAGIC,
+        .nwrites = wal->nwrites,
+        .length = wal->len - sizeof(struct walhdr_t),
+    };
+    hdr.crc = crc32c(0, wal->buf + sizeof(hdr), hdr.length);
+    memcpy(wal->buf, &hdr, sizeof(hdr));
+    // After the transactions since the last checkpoint
+    if (write_all(wal->fd, wal->buf, wal->len, wal->logged) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    if (fdatasync(wal->fd) == -1) {
+        perror("fdatasync");
+        return STATUS_ERROR;
+    }
+    wal->logged += wal->len;
+    return STATUS_SUCCESS;
+}
+
+int wal_apply(struct wal_t *wal, int dbfd) {
+    if (wal->nwrites == 0) {
+        return STATUS_SUCCESS;
+    }
+    return wal_write_images(dbfd, wal->buf + sizeof(struct walhdr_t), wal->nwrites,
+                            wal->len - sizeof(struct walhdr_t));
+}
+
+int wal_commit(struct wal_t *wal, int dbfd) {
+    if (wal->nwrites == 0) {
+        return STATUS_SUCCESS;
+    }
+    if (wal_log(wal) != STATUS_SUCCESS || wal_apply(wal, dbfd) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return wal_sync(wal, dbfd);
+}
@@ -0,0 +1,35 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Shared by the test programs: a CHECK that fails is reported with its
+// line and counted, and main returns nonzero if any did
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// /tmp/<name>_<pid>.db, so runs don't collide
+static inline void test_path(char *path, size_t size, const char *name) {
+    snprintf(path, size, "/tmp/%s_%d.db", name, (int)getpid());
+}
+
+// The database and its .wal and .idx
+static inline void remove_db(char *path) {
+    size_t len = strlen(path);
+    unlink(path);
+    snprintf(path + len, 8, ".wal");
+    unlink(path);
+    snprintf(path + len, 8, ".idx");
+    unlink(path);
+    path[len] = '\0';
+}
+
+#endif
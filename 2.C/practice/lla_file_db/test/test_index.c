@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "index.h"
+#include "store.h"
+#include "check.h"
+
+// The name hash and hours B+-tree against a scan of the records, after
+// adds, updates and deletes, and after a process dies with the index open
+// so the next one has to rebuild it. Then the index on its own, with most
+// keys deleted and put back over and over: the tree keeps no empty leaves
+// and the file doesn't grow.
+
+#define ROWS  3000
+#define NAMES 700
+#define KEYS  50000
+#define ROUNDS 5
+
+struct visited_t {
+    unsigned int *records;
+    unsigned int n;
+    unsigned int cap;
+};
+
+static int visit(unsigned int record, void *arg) {
+    struct visited_t *v = arg;
+    if (v->n < v->cap) {
+        v->records[v->n] = record;
+    }
+    v->n++;
+    return 0;
+}
+
+static void make_employee(struct employee_t *e, unsigned int i, unsigned int round) {
+    memset(e, 0, sizeof(*e));
+    snprintf(e->name, sizeof(e->name), "Employee %u", (i * 7 + round) % NAMES);
+    snprintf(e->address, sizeof(e->address), "%u Elm St", i);
+    e->hours = (i * 2654435761U + round * 977) % 1000;
+}
+
+static int by_hours_then_record(const void *a, const void *b) {
+    const struct btkey_t *x = a, *y = b;
+    if (x->hours != y->hours) {
+        return x->hours < y->hours ? -1 : 1;
+    }
+    return x->record < y->record ? -1 : x->record > y->record;
+}
+
+// Every live record is found by its name, each name lookup finds only
+// records with that hash, and every hours range lists exactly the live
+// records in it, in (hours, record) order
+static void check_index(struct dbstore_t *store) {
+    struct dbindex_t *index = store_index(store);
+    CHECK(index != NULL);
+    if (index == NULL) {
+        return;
+    }
+    unsigned int count = store->header.count;
+    struct btkey_t *live = malloc(count * sizeof(*live));
+    unsigned int *found = malloc(count * sizeof(*found));
+    unsigned int nlive = 0;
+    int missing = 0, wrong = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        struct record_t record;
+        CHECK(store_record(store, i, &record) == STATUS_SUCCESS);
+        if (RECORD_DELETED(&record)) {
+            continue;
+        }
+        live[nlive++] = (struct btkey_t){record.hours, i};
+        char name[256] = {0};
+        memcpy(name, record.name, record.namelen);
+        struct visited_t v = {found, 0, count};
+        index_find_name(index, name, visit, &v);
+        int hit = 0;
+        for (unsigned int j = 0; j < v.n && j < v.cap; j++) {
+            struct record_t other;
+            hit |= found[j] == i;
+            // A tombstone must never be returned
+            wrong += store_record(store, found[j], &other) != STATUS_SUCCESS || RECORD_DELETED(&other);
+        }
+        missing += !hit;
+    }
+    CHECK(missing == 0);
+    CHECK(wrong == 0);
+    qsort(live, nlive, sizeof(*live), by_hours_then_record);
+
+    static const unsigned int ranges[][2] = {{0, 0xffffffff}, {0, 0}, {100, 199}, {500, 500}, {990, 5000}, {2000, 3000}};
+    for (unsigned int r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        unsigned int lo = ranges[r][0], hi = ranges[r][1];
+        struct visited_t v = {found, 0, count};
+        CHECK(index_range_hours(index, lo, hi, visit, &v) == STATUS_SUCCESS);
+        unsigned int expected = 0;
+        int order = 0;
+        for (unsigned int j = 0; j < nlive; j++) {
+            if (live[j].hours >= lo && live[j].hours <= hi) {
+                order += expected < v.n && found[expected] != live[j].record;
+                expected++;
+            }
+        }
+        CHECK(v.n == expected);
+        CHECK(order == 0);
+    }
+    free(live);
+    free(found);
+}
+
+static unsigned int index_is_clean(const char *path) {
+    char idxpath[300];
+    struct idxheader_t header = {0};
+    snprintf(idxpath, sizeof(idxpath), "%s.idx", path);
+    FILE *f = fopen(idxpath, "r");
+    if (f == NULL || fread(&header, sizeof(header), 1, f) != 1) {
+        header.clean = 0;
+    }
+    if (f) {
+        fclose(f);
+    }
+    return header.clean;
+}
+
+static void test_changes(char *path) {
+    struct dbstore_t *store = NULL;
+    CHECK(store_create(path, DB_VERSION_CURRENT, &store) == STATUS_SUCCESS);
+    if (store == NULL) {
+        return;
+    }
+    struct employee_t e;
+    for (unsigned int i = 0; i < ROWS; i++) {
+        make_employee(&e, i, 0);
+        CHECK(store_append_employee(store, &e) == STATUS_SUCCESS);
+    }
+    check_index(store);
+    for (unsigned int i = 0; i < ROWS; i += 5) {
+        make_employee(&e, i, 1);
+        CHECK(store_update_employee(store, i, &e) == STATUS_SUCCESS);
+    }
+    for (unsigned int i = 3; i < ROWS; i += 4) {
+        CHECK(store_delete_employee(store, i) == STATUS_SUCCESS);
+    }
+    // Deleted, then filled again
+    for (unsigned int i = 3; i < ROWS; i += 40) {
+        make_employee(&e, i, 2);
+        CHECK(store_update_employee(store, i, &e) == STATUS_SUCCESS);
+    }
+    check_index(store);
+    store_close(store);
+
+    // Reopened clean, the index is used as it was left
+    CHECK(index_is_clean(path));
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        check_index(store);
+        store_close(store);
+    }
+}
+
+// A child makes changes and dies without closing anything, leaving the
+// index marked dirty; the next open rebuilds it
+static void test_unclean_close(char *path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        struct dbstore_t *store = NULL;
+        if (store_open(path, &store) != STATUS_SUCCESS || store_index(store) == NULL) {
+            _exit(1);
+        }
+        struct employee_t e;
+        for (unsigned int i = 1; i < ROWS; i += 9) {
+            make_employee(&e, i, 3);
+            if (store_update_employee(store, i, &e) != STATUS_SUCCESS) {
+                _exit(1);
+            }
+        }
+        for (unsigned int i = 0; i < 200; i++) {
+            make_employee(&e, ROWS + i, 3);
+            if (store_append_employee(store, &e) != STATUS_SUCCESS) {
+                _exit(1);
+            }
+        }
+        if (store_delete_employee(store, 2) != STATUS_SUCCESS) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    int status = 1;
+    CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(!index_is_clean(path));
+
+    struct dbstore_t *store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        CHECK(store->header.count == ROWS + 200);
+        check_index(store);
+        store_close(store);
+    }
+    CHECK(index_is_clean(path));
+}
+
+static unsigned int key_hours(unsigned int i, unsigned int round) {
+    return (i * 2654435761U + round * 40503U) % 100000;
+}
+
+static void key_name(char *name, unsigned int i) {
+    memset(name, 0, 256);
+    snprintf(name, 256, "Employee %u", i % NAMES);
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Leaves in the chain, and how many of them are empty
+static unsigned int count_leaves(struct dbindex_t *index, unsigned int *emptyOut) {
+    struct idxheader_t *hdr = INDEX_HEADER(index);
+    struct btinner_t *node = (struct btinner_t *)(index->map + (size_t)hdr->btree_root * INDEX_PAGE_SIZE);
+    while (!node->leaf) {
+        node = (struct btinner_t *)(index->map + (size_t)node->children[0] * INDEX_PAGE_SIZE);
+    }
+    unsigned int leaves = 0;
+    *emptyOut = 0;
+    for (struct btleaf_t *leaf = (struct btleaf_t *)node;;) {
+        leaves++;
+        *emptyOut += leaf->nkeys == 0;
+        if (leaf->next == 0) {
+            break;
+        }
+        leaf = (struct btleaf_t *)(index->map + (size_t)leaf->next * INDEX_PAGE_SIZE);
+    }
+    return leaves;
+}
+
+// Every range over the kept keys, every 10th, matches, and so does a name
+static void check_kept(struct dbindex_t *index, unsigned int round) {
+    struct btkey_t *kept = malloc(KEYS / 10 * sizeof(*kept));
+    unsigned int *found = malloc(KEYS * sizeof(*found));
+    unsigned int nkept = 0;
+    for (unsigned int i = 0; i < KEYS; i += 10) {
+        kept[nkept++] = (struct btkey_t){key_hours(i, 0), i};
+    }
+    qsort(kept, nkept, sizeof(*kept), by_hours_then_record);
+    static const unsigned int ranges[][2] = {{0, 0xffffffff}, {0, 999}, {25000, 25999}, {99000, 100000}};
+    for (unsigned int r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        struct visited_t v = {found, 0, KEYS};
+        CHECK(index_range_hours(index, ranges[r][0], ranges[r][1], visit, &v) == STATUS_SUCCESS);
+        unsigned int expected = 0;
+        int order = 0;
+        for (unsigned int j = 0; j < nkept; j++) {
+            if (kept[j].hours >= ranges[r][0] && kept[j].hours <= ranges[r][1]) {
+                order += expected < v.n && found[expected] != kept[j].record;
+                expected++;
+            }
+        }
+        if (v.n != expected || order) {
+            printf("Round %u, hours %u-%u: %u found, %u expected\n", round, ranges[r][0], ranges[r][1], v.n,
+                   expected);
+        }
+        CHECK(v.n == expected && order == 0);
+    }
+    char name[256];
+    key_name(name, 20);
+    struct visited_t v = {found, 0, KEYS};
+    index_find_name(index, name, visit, &v);
+    unsigned int named = 0;
+    for (unsigned int i = 0; i < KEYS; i += 10) {
+        named += i % NAMES == 20;
+    }
+    CHECK(v.n == named);
+
+    free(kept);
+    free(found);
+}
+
+// Nine keys in ten deleted, then put back with other hours and deleted
+// again, round after round
+static void test_delete_most(char *path) {
+    char idxpath[300], name[256];
+    struct dbindex_t *index = NULL;
+    int rebuild = 0;
+    remove_db(path);
+    snprintf(idxpath, sizeof(idxpath), "%s.idx", path);
+    CHECK(index_open(idxpath, 0, &index, &rebuild) == STATUS_SUCCESS && rebuild);
+    if (index == NULL) {
+        return;
+    }
+    for (unsigned int i = 0; i < KEYS; i++) {
+        key_name(name, i);
+        CHECK(index_insert(index, i, name, key_hours(i, 0)) == STATUS_SUCCESS);
+    }
+    unsigned int full_pages = INDEX_HEADER(index)->page_count;
+    off_t full_size = file_size(idxpath);
+    unsigned int empty = 0;
+    unsigned int full_leaves = count_leaves(index, &empty);
+    for (unsigned int round = 1; round <= ROUNDS; round++) {
+        for (unsigned int i = 0; i < KEYS; i++) {
+            if (i % 10) {
+                key_name(name, i);
+                CHECK(index_remove(index, i, name, key_hours(i, round - 1)) == STATUS_SUCCESS);
+            }
+        }
+        check_kept(index, round);
+        // Merged down to well under the leaves the full tree had
+        CHECK(count_leaves(index, &empty) * 4 < full_leaves && empty == 0);
+        CHECK(INDEX_HEADER(index)->hash_tombstones <= INDEX_HEADER(index)->hash_used / 2);
+        for (unsigned int i = 0; i < KEYS; i++) {
+            if (i % 10) {
+                key_name(name, i);
+                CHECK(index_insert(index, i, name, key_hours(i, round)) == STATUS_SUCCESS);
+            }
+        }
+    }
+    // Freed pages were used again, so the file is no bigger than it was full
+    CHECK(INDEX_HEADER(index)->page_count <= full_pages);
+    CHECK(file_size(idxpath) == full_size);
+    index_close(index);
+}
+
+int main(void) {
+    char path[256];
+    test_path(path, sizeof(path), "test_index");
+    remove_db(path);
+    test_changes(path);
+    test_unclean_close(path);
+    test_delete_most(path);
+    remove_db(path);
+    printf("test_index: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "store.h"
+#include "check.h"
+
+// The -m rewrite from version 1 to version 3: every record, live or
+// deleted, reads back the same afterwards, and again after a reopen.
+// Version 2 files can be read but no longer created, so only version 1 is
+// built here.
+
+#define ROWS 2500
+
+struct copy_t {
+    char name[256];
+    char address[256];
+    unsigned int namelen;
+    unsigned int addresslen;
+    unsigned int hours;
+};
+
+// Names of every length up to the full 255, addresses with commas and
+// quotes, and every 7th row deleted
+static void fill(struct dbstore_t *store) {
+    struct employee_t e;
+    for (unsigned int i = 0; i < ROWS; i++) {
+        memset(&e, 0, sizeof(e));
+        unsigned int len = i % 256 ? i % 256 : 1;
+        for (unsigned int j = 0; j < len; j++) {
+            e.name[j] = 'a' + (i + j) % 26;
+        }
+        snprintf(e.address, sizeof(e.address), "%u Main St, \"Apt %u\"", i, i % 13);
+        e.hours = i * 37 % 2000;
+        CHECK(store_append_employee(store, &e) == STATUS_SUCCESS);
+    }
+    for (unsigned int i = 0; i < ROWS; i += 7) {
+        CHECK(store_delete_employee(store, i) == STATUS_SUCCESS);
+    }
+}
+
+static struct copy_t *snapshot(struct dbstore_t *store) {
+    struct copy_t *copies = calloc(store->header.count, sizeof(*copies));
+    for (unsigned int i = 0; copies && i < store->header.count; i++) {
+        struct record_t record;
+        CHECK(store_record(store, i, &record) == STATUS_SUCCESS);
+        copies[i].namelen = record.namelen;
+        copies[i].addresslen = record.addresslen;
+        memcpy(copies[i].name, record.name, record.namelen);
+        memcpy(copies[i].address, record.address, record.addresslen);
+        copies[i].hours = record.hours;
+    }
+    return copies;
+}
+
+// Deleted rows only have to stay deleted; their strings are not copied
+static int differences(struct dbstore_t *store, const struct copy_t *copies) {
+    int differ = 0;
+    for (unsigned int i = 0; i < ROWS; i++) {
+        struct record_t record;
+        if (store_record(store, i, &record) != STATUS_SUCCESS) {
+            differ++;
+        } else if (RECORD_DELETED(&copies[i])) {
+            differ += !RECORD_DELETED(&record);
+        } else {
+            differ += record.namelen != copies[i].namelen || record.addresslen != copies[i].addresslen ||
+                      record.hours != copies[i].hours || memcmp(record.name, copies[i].name, record.namelen) ||
+                      memcmp(record.address, copies[i].address, record.addresslen);
+        }
+    }
+    return differ;
+}
+
+static void test_migrate(char *path, unsigned short version) {
+    struct dbstore_t *store = NULL;
+    remove_db(path);
+    CHECK(store_create(path, version, &store) == STATUS_SUCCESS);
+    if (store == NULL) {
+        return;
+    }
+    fill(store);
+    CHECK(store->header.version == version && store->header.count == ROWS);
+    struct copy_t *copies = snapshot(store);
+    CHECK(copies != NULL && differences(store, copies) == 0);
+
+    CHECK(store_rewrite(store, store->header.count) == STATUS_SUCCESS);
+    CHECK(store->header.version == DB_VERSION_LARGE && store->header.count == ROWS);
+    CHECK(differences(store, copies) == 0);
+    store_close(store);
+
+    store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        CHECK(store->header.version == DB_VERSION_LARGE && store->header.count == ROWS);
+        CHECK(differences(store, copies) == 0);
+        store_close(store);
+    }
+    free(copies);
+}
+
+int main(void) {
+    char path[256];
+    test_path(path, sizeof(path), "test_migrate");
+    test_migrate(path, DB_VERSION_FIXED);
+    remove_db(path);
+    printf("test_migrate: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "store.h"
+#include "check.h"
+
+// One byte flipped in a closed version 3 file: anywhere live, store_open
+// must refuse the file; in a free row nothing checks it and the file still
+// opens.
+
+// Within segment 0, so rows count..1023 are free
+#define ROWS 600
+
+static int flip(const char *path, off_t at) {
+    int fd = open(path, O_RDWR);
+    char c;
+    int status = fd != -1 && read_all(fd, &c, 1, at) == STATUS_SUCCESS ? STATUS_SUCCESS : STATUS_ERROR;
+    c ^= 0x10;
+    if (status == STATUS_SUCCESS) {
+        status = write_all(fd, &c, 1, at);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return status;
+}
+
+// Flips the byte at at, tries to open the file, then flips it back
+static int opens_with_flip(char *path, off_t at) {
+    struct dbstore_t *store = NULL;
+    CHECK(flip(path, at) == STATUS_SUCCESS);
+    int opened = store_open(path, &store) == STATUS_SUCCESS;
+    store_close(store);
+    CHECK(flip(path, at) == STATUS_SUCCESS);
+    return opened;
+}
+
+int main(void) {
+    char path[256];
+    test_path(path, sizeof(path), "test_pagecrc");
+    remove_db(path);
+    struct dbstore_t *store = NULL;
+    CHECK(store_create(path, DB_VERSION_CURRENT, &store) == STATUS_SUCCESS);
+    if (store == NULL) {
+        return 1;
+    }
+    struct employee_t e;
+    for (unsigned int i = 0; i < ROWS; i++) {
+        memset(&e, 0, sizeof(e));
+        snprintf(e.name, sizeof(e.name), "Employee %u", i);
+        snprintf(e.address, sizeof(e.address), "%u Elm St", i);
+        e.hours = i;
+        CHECK(store_append_employee(store, &e) == STATUS_SUCCESS);
+    }
+    CHECK(store_delete_employee(store, 10) == STATUS_SUCCESS);
+    struct record_t record;
+    CHECK(store_record(store, 7, &record) == STATUS_SUCCESS);
+    struct dbheader64_t header = store->header;
+    off_t name = record.name - store->map;
+    store_close(store);
+    CHECK(header.checksums != 0);
+
+    // Untouched, and then with each byte put back, it opens
+    CHECK(opens_with_flip(path, large_column(&header, ROWS + 5, COLUMN_HOURS)));
+    CHECK(opens_with_flip(path, large_column(&header, 1000, COLUMN_NAMES) + 3));
+
+    // The header's own checksum
+    CHECK(!opens_with_flip(path, offsetof(struct dbheader64_t, count)));
+    // A live row's hours and string ref, a deleted row's ref, and a string
+    CHECK(!opens_with_flip(path, large_column(&header, 3, COLUMN_HOURS) + 3));
+    CHECK(!opens_with_flip(path, large_column(&header, ROWS - 1, COLUMN_ADDRESSES)));
+    CHECK(!opens_with_flip(path, large_column(&header, 10, COLUMN_NAMES) + 1));
+    CHECK(!opens_with_flip(path, name + 2));
+    // The table's entry for the page holding row 3's hours
+    CHECK(!opens_with_flip(path, header.checksums + large_column(&header, 3, COLUMN_HOURS) / DB_PAGE_SIZE * 4 + 2));
+
+    store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    store_close(store);
+    remove_db(path);
+    printf("test_pagecrc: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
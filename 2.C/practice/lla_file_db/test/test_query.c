@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "query.h"
+#include "store.h"
+#include "check.h"
+
+// query_run against a plain loop over store_record, on a version 3 table
+// big enough to split across threads and a small version 1 one. Hours
+// include 0, which a tombstone also has, and repeat a lot, so top-K has
+// ties to break by record.
+
+#define ROWS_LARGE 300000
+#define ROWS_FIXED 3000
+
+static const char *queries[] = {
+    "count;sum",
+    "hours=100-200;count;sum;avg",
+    "hours=0;count;sum",
+    "hours=-40;count;sum",
+    "hours=900-;count",
+    "name=Al;count;sum",
+    "name=Bo;hours=500-;count;sum",
+    "name=Nobody;count",
+    "hours=5",
+    "name=Chen 1;hours=10-20",
+    "top=10",
+    "top=1000",
+    "hours=100-900;top=100",
+    "hours=0;top=7",
+    "name=Chen;top=25",
+};
+
+static const char *first[] = {"Alice", "Bob", "Chen", "Dana", "Al"};
+
+static unsigned int hours_of(unsigned int i) {
+    return (i * 2654435761U) % 1000;
+}
+
+// Every 11th row deleted, some after the fact with store_delete_employee
+static int build(char *path, unsigned short version, unsigned int rows) {
+    struct dbstore_t *store = NULL;
+    remove_db(path);
+    if (store_create(path, version, &store) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    int failed = 0;
+    if (version == DB_VERSION_LARGE) {
+        struct dbbatch_t *batch = NULL;
+        char name[64], address[64];
+        failed = store_batch_begin(store, &batch) != STATUS_SUCCESS;
+        for (unsigned int i = 0; i < rows && !failed; i++) {
+            int namelen = i % 11 == 0 ? 0 : snprintf(name, sizeof(name), "%s %u", first[i % 5], i);
+            int addresslen = snprintf(address, sizeof(address), "%u Main St", i);
+            failed = store_batch_add(batch, name, namelen, address, addresslen, hours_of(i)) != STATUS_SUCCESS;
+        }
+        failed = failed || store_batch_commit(batch) != STATUS_SUCCESS;
+    } else {
+        struct employee_t e;
+        for (unsigned int i = 0; i < rows && !failed; i++) {
+            memset(&e, 0, sizeof(e));
+            snprintf(e.name, sizeof(e.name), "%s %u", first[i % 5], i);
+            snprintf(e.address, sizeof(e.address), "%u Main St", i);
+            e.hours = hours_of(i);
+            failed = store_append_employee(store, &e) != STATUS_SUCCESS ||
+                     (i % 11 == 0 && store_delete_employee(store, i) != STATUS_SUCCESS);
+        }
+    }
+    for (unsigned int i = 6; i < rows && !failed; i += 1001) {
+        failed = store_delete_employee(store, i) != STATUS_SUCCESS;
+    }
+    store_close(store);
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+struct match_t {
+    unsigned int hours;
+    unsigned int record;
+};
+
+// More hours first, then the lower record, as query_run ranks them
+static int by_top(const void *a, const void *b) {
+    const struct match_t *x = a, *y = b;
+    if (x->hours != y->hours) {
+        return x->hours > y->hours ? -1 : 1;
+    }
+    return x->record < y->record ? -1 : 1;
+}
+
+static void check_query(struct dbstore_t *store, const char *text, unsigned int threads) {
+    char buf[256];
+    struct query_t query;
+    snprintf(buf, sizeof(buf), "%s;threads=%u", text, threads);
+    CHECK(query_parse(buf, &query) == STATUS_SUCCESS);
+
+    // The reference: every row, one at a time
+    unsigned int count = store->header.count;
+    struct match_t *matches = malloc(count * sizeof(*matches));
+    unsigned long long n = 0, sum = 0;
+    for (unsigned int i = 0; matches && i < count; i++) {
+        struct record_t record;
+        CHECK(store_record(store, i, &record) == STATUS_SUCCESS);
+        if (!RECORD_DELETED(&record) && record.hours >= query.lo && record.hours <= query.hi &&
+            record.namelen >= query.prefixlen && memcmp(record.name, query.prefix, query.prefixlen) == 0) {
+            matches[n++] = (struct match_t){record.hours, i};
+            sum += record.hours;
+        }
+    }
+
+    struct query_result_t result = {0};
+    CHECK(matches != NULL && query_run(store, &query, &result) == STATUS_SUCCESS);
+    int wrong = 0;
+    if (query.aggregates) {
+        wrong += result.count != n || result.sum != sum;
+    } else if (query.top) {
+        qsort(matches, n, sizeof(*matches), by_top);
+        unsigned long long k = n < query.top ? n : query.top;
+        wrong += result.nrecords != k;
+        for (unsigned long long j = 0; j < k && j < result.nrecords; j++) {
+            wrong += result.records[j] != matches[j].record;
+        }
+    } else {
+        wrong += result.count != n || result.sum != sum || result.nrecords != n;
+        for (unsigned long long j = 0; j < n && j < result.nrecords; j++) {
+            wrong += result.records[j] != matches[j].record;
+        }
+    }
+    if (wrong) {
+        printf("\"%s\" on %u threads: %llu rows expected\n", text, threads, n);
+    }
+    CHECK(wrong == 0);
+    query_free(&result);
+    free(matches);
+}
+
+static void test_queries(char *path, unsigned short version, unsigned int rows) {
+    struct dbstore_t *store = NULL;
+    CHECK(build(path, version, rows) == STATUS_SUCCESS);
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store == NULL) {
+        return;
+    }
+    CHECK(store->header.version == version && store->header.count == rows);
+    for (unsigned int q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        check_query(store, queries[q], 1);
+        check_query(store, queries[q], 4);
+    }
+    store_close(store);
+}
+
+int main(void) {
+    char path[256];
+    test_path(path, sizeof(path), "test_query");
+    test_queries(path, DB_VERSION_LARGE, ROWS_LARGE);
+    test_queries(path, DB_VERSION_FIXED, ROWS_FIXED);
+    remove_db(path);
+    printf("test_query: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
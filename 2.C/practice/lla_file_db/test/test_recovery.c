@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "pagecrc.h"
+#include "store.h"
+#include "wal.h"
+#include "check.h"
+
+// Crashes of the whole store. A child process makes changes and dies with
+// _exit, closing nothing. Its writes are all in the page cache, so to look
+// like a crash between logging and applying, every byte the log's
+// transactions wrote is put back from a copy of the file taken before the
+// child ran. Writes made outside the log stay, as they would on disk: new
+// segments, a moved checksum table, batch rows past count. Then the file
+// is opened again, which replays the log and checks every page.
+
+#define ROWS    1500
+#define APPENDS 200
+#define UPDATES 7       // every 7th row is updated
+#define DELETES 11      // every 11th, from row 3, is then deleted
+// Rows that fill segments 0 to 5 exactly, so the next append adds segment 6
+#define MOVE_ROWS SEGMENT_FIRST(6)
+#define MOVE_APPENDS 5
+
+static void make_employee(struct employee_t *e, unsigned int i, unsigned int round) {
+    memset(e, 0, sizeof(*e));
+    snprintf(e->name, sizeof(e->name), "Employee %05u", i);
+    snprintf(e->address, sizeof(e->address), round ? "%05u Elm Street, take %u" : "%05u Elm Street", i, round);
+    e->hours = (i * 37 + round * 101) % 1000;
+}
+
+// A new file of rows rows, loaded as one batch, closed
+static int build(char *path, unsigned long long rows) {
+    struct dbstore_t *store = NULL;
+    struct dbbatch_t *batch = NULL;
+    struct employee_t e;
+    remove_db(path);
+    int failed = store_create(path, DB_VERSION_CURRENT, &store) != STATUS_SUCCESS ||
+                 store_batch_begin(store, &batch) != STATUS_SUCCESS;
+    for (unsigned long long i = 0; i < rows && !failed; i++) {
+        make_employee(&e, i, 0);
+        failed = store_batch_add(batch, e.name, strlen(e.name), e.address, strlen(e.address), e.hours) !=
+                 STATUS_SUCCESS;
+    }
+    failed = failed || store_batch_commit(batch) != STATUS_SUCCESS;
+    store_close(store);
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+static int copy_file(const char *from, const char *to) {
+    static char buf[1 << 16];
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int status = in != -1 && out != -1 ? STATUS_SUCCESS : STATUS_ERROR;
+    for (off_t at = 0; status == STATUS_SUCCESS;) {
+        ssize_t n = pread(in, buf, sizeof(buf), at);
+        if (n <= 0) {
+            status = n == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+            break;
+        }
+        status = write_all(out, buf, n, at);
+        at += n;
+    }
+    if (in != -1) {
+        close(in);
+    }
+    if (out != -1) {
+        close(out);
+    }
+    return status;
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Puts back, from snapshot, every byte the transactions in the log wrote,
+// so the database looks as if none had been applied; bytes past the end of
+// the snapshot go back to zero. Sets ends[t] to where transaction t ends
+// in the log, for up to maxends of them. Returns the number of
+// transactions, or -1.
+static int unapply(const char *path, const char *walpath, const char *snapshot, size_t *ends, int maxends) {
+    off_t size = file_size(walpath);
+    char *log = size > 0 ? malloc(size) : NULL;
+    int wal = open(walpath, O_RDONLY);
+    int db = open(path, O_RDWR);
+    int old = open(snapshot, O_RDONLY);
+    off_t oldsize = file_size(snapshot);
+    int transactions = log && wal != -1 && db != -1 && old != -1 && read_all(wal, log, size, 0) == STATUS_SUCCESS
+                           ? 0
+                           : -1;
+    size_t pos = 0;
+    while (transactions >= 0 && size - pos >= sizeof(struct walhdr_t)) {
+        struct walhdr_t hdr;
+        memcpy(&hdr, log + pos, sizeof(hdr));
+        if (hdr.magic != WAL_MAGIC || size - pos - sizeof(hdr) < hdr.length) {
+            break;
+        }
+        size_t at = pos + sizeof(hdr);
+        for (unsigned int i = 0; i < hdr.nwrites && transactions >= 0; i++) {
+            struct walwrite_t write;
+            memcpy(&write, log + at, sizeof(write));
+            at += sizeof(write);
+            char *before = calloc(1, write.length);
+            off_t kept = oldsize - (off_t)write.offset;
+            kept = kept < 0 ? 0 : kept > write.length ? write.length : kept;
+            if (before == NULL || (kept > 0 && read_all(old, before, kept, write.offset) != STATUS_SUCCESS) ||
+                write_all(db, before, write.length, write.offset) != STATUS_SUCCESS) {
+                transactions = -1;
+            }
+            free(before);
+            at += write.length;
+        }
+        pos += sizeof(hdr) + hdr.length;
+        if (transactions >= 0 && transactions < maxends) {
+            ends[transactions] = pos;
+        }
+        transactions += transactions >= 0;
+    }
+    free(log);
+    if (wal != -1) {
+        close(wal);
+    }
+    if (db != -1) {
+        close(db);
+    }
+    if (old != -1) {
+        close(old);
+    }
+    return transactions;
+}
+
+// Runs changes in a child that then dies without closing the store;
+// returns 1 if it got through them
+static int crash_after(char *path, int (*changes)(struct dbstore_t *store)) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        struct dbstore_t *store = NULL;
+        _exit(store_open(path, &store) != STATUS_SUCCESS || changes(store) != STATUS_SUCCESS);
+    }
+    int status = 1;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// APPENDS appends, then updates, then deletes, one transaction each, and
+// last an update of row 0 of its own
+static int some_changes(struct dbstore_t *store) {
+    struct employee_t e;
+    int failed = 0;
+    for (unsigned int i = ROWS; i < ROWS + APPENDS && !failed; i++) {
+        make_employee(&e, i, 1);
+        failed = store_append_employee(store, &e) != STATUS_SUCCESS;
+    }
+    for (unsigned int i = 0; i < ROWS + APPENDS && !failed; i += UPDATES) {
+        make_employee(&e, i, 2);
+        failed = store_update_employee(store, i, &e) != STATUS_SUCCESS;
+    }
+    for (unsigned int i = 3; i < ROWS + APPENDS && !failed; i += DELETES) {
+        failed = store_delete_employee(store, i) != STATUS_SUCCESS;
+    }
+    make_employee(&e, 0, 3);
+    failed = failed || store_update_employee(store, 0, &e) != STATUS_SUCCESS;
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+static unsigned int some_changes_count(void) {
+    return APPENDS + (ROWS + APPENDS + UPDATES - 1) / UPDATES + (ROWS + APPENDS - 3 + DELETES - 1) / DELETES + 1;
+}
+
+// The rows as some_changes leaves them; without the last, row 0 keeps its
+// first update
+static int differences(struct dbstore_t *store, int last) {
+    int differ = 0;
+    for (unsigned int i = 0; i < ROWS + APPENDS; i++) {
+        struct employee_t e;
+        struct record_t record;
+        make_employee(&e, i, i >= ROWS);
+        if (i % UPDATES == 0) {
+            make_employee(&e, i, i == 0 && last ? 3 : 2);
+        }
+        int deleted = i >= 3 && (i - 3) % DELETES == 0;
+        if (store_record(store, i, &record) != STATUS_SUCCESS) {
+            differ++;
+        } else if (deleted) {
+            differ += !RECORD_DELETED(&record);
+        } else {
+            differ += record.namelen != strlen(e.name) || memcmp(record.name, e.name, record.namelen) ||
+                      record.addresslen != strlen(e.address) || memcmp(record.address, e.address, record.addresslen) ||
+                      record.hours != e.hours;
+        }
+    }
+    return differ;
+}
+
+// Recovery replays every complete transaction: none of them had reached
+// the database, all of them are there after the reopen, and every page
+// checksum agrees
+static void test_replays_everything(char *path, const char *walpath, const char *snapshot) {
+    CHECK(build(path, ROWS) == STATUS_SUCCESS && copy_file(path, snapshot) == STATUS_SUCCESS);
+    CHECK(crash_after(path, some_changes));
+    // Under WAL_CHECKPOINT_BYTES, so the child never checkpointed
+    CHECK(unapply(path, walpath, snapshot, NULL, 0) == (int)some_changes_count());
+
+    struct dbstore_t *store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        CHECK(file_size(walpath) == 0);
+        CHECK(store->header.count == ROWS + APPENDS);
+        CHECK(differences(store, 1) == 0);
+        CHECK(pagecrc_verify(store) == STATUS_SUCCESS);
+        store_close(store);
+    }
+}
+
+// The log cut off in the middle of the last transaction: it is dropped,
+// every one before it replays, and the checksums still agree
+static void test_torn_log(char *path, const char *walpath, const char *snapshot) {
+    size_t *ends = malloc(some_changes_count() * sizeof(*ends));
+    CHECK(build(path, ROWS) == STATUS_SUCCESS && copy_file(path, snapshot) == STATUS_SUCCESS);
+    CHECK(crash_after(path, some_changes));
+    int n = unapply(path, walpath, snapshot, ends, some_changes_count());
+    CHECK(ends != NULL && n == (int)some_changes_count());
+    if (ends != NULL && n >= 2) {
+        CHECK(truncate(walpath, ends[n - 2] + (ends[n - 1] - ends[n - 2]) / 2) == 0);
+    }
+    struct dbstore_t *store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        CHECK(store->header.count == ROWS + APPENDS);
+        CHECK(differences(store, 0) == 0);
+        store_close(store);
+    }
+    // And it reopens clean, with nothing left to replay
+    store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        CHECK(differences(store, 0) == 0);
+        store_close(store);
+    }
+    free(ends);
+}
+
+// More than a column chunk and a string buffer of rows, written past count
+// and never committed
+static int open_batch(struct dbstore_t *store) {
+    struct dbbatch_t *batch = NULL;
+    char name[64], address[64];
+    int failed = store_batch_begin(store, &batch) != STATUS_SUCCESS;
+    for (unsigned int i = 0; i < 100000 && !failed; i++) {
+        int namelen = snprintf(name, sizeof(name), "Uncommitted %u", i);
+        int addresslen = snprintf(address, sizeof(address), "%u Nowhere Lane, nowhere at all", i);
+        failed = store_batch_add(batch, name, namelen, address, addresslen, i) != STATUS_SUCCESS;
+    }
+    return failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+// Writes past count change no checksum until their header commits
+static void test_uncommitted_batch(char *path, const char *walpath) {
+    CHECK(build(path, ROWS) == STATUS_SUCCESS);
+    off_t before = file_size(path);
+    CHECK(crash_after(path, open_batch));
+    CHECK(file_size(path) > before && file_size(walpath) == 0);
+
+    struct dbstore_t *store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store == NULL) {
+        return;
+    }
+    CHECK(store->header.count == ROWS);
+    struct employee_t e;
+    struct record_t record;
+    make_employee(&e, ROWS - 1, 0);
+    CHECK(store_record(store, ROWS - 1, &record) == STATUS_SUCCESS && record.hours == e.hours &&
+          memcmp(record.name, e.name, record.namelen) == 0);
+    // The rows after it are overwritten as if the batch had never been
+    make_employee(&e, ROWS, 1);
+    CHECK(store_append_employee(store, &e) == STATUS_SUCCESS);
+    store_close(store);
+    store = NULL;
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store) {
+        CHECK(store->header.count == ROWS + 1);
+        CHECK(store_record(store, ROWS, &record) == STATUS_SUCCESS && record.hours == e.hours &&
+              memcmp(record.address, e.address, record.addresslen) == 0);
+        store_close(store);
+    }
+}
+
+// The first append adds segment 6, which takes the file past what the
+// smallest checksum table covers, so it moves the table; a few more follow
+static int move_table_appends(struct dbstore_t *store) {
+    unsigned long long table = store->header.checksums;
+    struct employee_t e;
+    for (unsigned int i = 0; i < MOVE_APPENDS; i++) {
+        make_employee(&e, MOVE_ROWS + i, 1);
+        if (store_append_employee(store, &e) != STATUS_SUCCESS || store->header.checksums == table) {
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+// The shadow table is synced before the header switches to it: with the
+// log lost, the old header and table are still in force; with it
+// replayed, the new ones are, and every page checks out either way
+static void test_table_move(char *path, const char *walpath, const char *snapshot) {
+    struct dbstore_t *store = NULL;
+    CHECK(build(path, MOVE_ROWS) == STATUS_SUCCESS && copy_file(path, snapshot) == STATUS_SUCCESS);
+    CHECK(store_open(path, &store) == STATUS_SUCCESS);
+    if (store == NULL) {
+        return;
+    }
+    struct dbheader64_t old = store->header;
+    store_close(store);
+    CHECK(old.checksum_pages == PAGECRC_MIN_PAGES);
+    CHECK((old.filesize + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE * DB_PAGE_SIZE + SEGMENT_SIZE(6) >
+          PAGECRC_MIN_PAGES * DB_PAGE_SIZE);
+
+    for (int lost = 1; lost >= 0; lost--) {
+        CHECK(copy_file(snapshot, path) == STATUS_SUCCESS);
+        CHECK(crash_after(path, move_table_appends));
+        CHECK(unapply(path, walpath, snapshot, NULL, 0) == MOVE_APPENDS);
+        if (lost) {
+            CHECK(truncate(walpath, 0) == 0);
+        }
+        store = NULL;
+        CHECK(store_open(path, &store) == STATUS_SUCCESS);
+        if (store == NULL) {
+            continue;
+        }
+        if (lost) {
+            CHECK(store->header.count == MOVE_ROWS && store->header.checksums == old.checksums);
+        } else {
+            CHECK(store->header.count == MOVE_ROWS + MOVE_APPENDS && store->header.checksums > old.checksums);
+            CHECK(store->header.checksum_pages > PAGECRC_MIN_PAGES);
+            struct employee_t e;
+            struct record_t record;
+            make_employee(&e, MOVE_ROWS + MOVE_APPENDS - 1, 1);
+            CHECK(store_record(store, MOVE_ROWS + MOVE_APPENDS - 1, &record) == STATUS_SUCCESS &&
+                  record.addresslen == strlen(e.address) && memcmp(record.address, e.address, record.addresslen) == 0);
+        }
+        CHECK(pagecrc_verify(store) == STATUS_SUCCESS);
+        store_close(store);
+    }
+}
+
+int main(void) {
+    char path[256], walpath[sizeof(path) + 4], snapshot[sizeof(path) + 5];
+    test_path(path, sizeof(path), "test_recovery");
+    snprintf(walpath, sizeof(walpath), "%s.wal", path);
+    snprintf(snapshot, sizeof(snapshot), "%s.copy", path);
+    test_replays_everything(path, walpath, snapshot);
+    test_torn_log(path, walpath, snapshot);
+    test_uncommitted_batch(path, walpath);
+    test_table_move(path, walpath, snapshot);
+    remove_db(path);
+    unlink(snapshot);
+    printf("test_recovery: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "wal.h"
+#include "check.h"
+
+// wal_recover against a plain file standing in for the database: each
+// transaction is logged and synced but never applied, as if the process
+// died right after wal_log, then the log is opened again and replayed.
+
+#define DB_BYTES 8192
+
+static int make_db(const char *path) {
+    char zeros[DB_BYTES] = {0};
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1 && write_all(fd, zeros, sizeof(zeros), 0) != STATUS_SUCCESS) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Logs one transaction writing fill over [offset, offset + length) and
+// 'H' over the first 16 bytes, as a header image would be
+static int log_only(struct wal_t *wal, off_t offset, size_t length, char fill) {
+    char data[1024];
+    char header[16];
+    memset(data, fill, length);
+    memset(header, 'H', sizeof(header));
+    wal_begin(wal);
+    int status = wal_add(wal, offset, data, length) == STATUS_SUCCESS &&
+                 wal_add(wal, 0, header, sizeof(header)) == STATUS_SUCCESS
+                     ? wal_log(wal)
+                     : STATUS_ERROR;
+    return status;
+}
+
+static int bytes_are(int fd, off_t offset, size_t length, char fill) {
+    char data[DB_BYTES];
+    if (read_all(fd, data, length, offset) != STATUS_SUCCESS) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != fill) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Reopens the log the way store_open does and replays it into fd
+static int recover(char *path, int fd) {
+    struct wal_t *wal = NULL;
+    int status = wal_open(path, &wal) == STATUS_SUCCESS ? wal_recover(wal, fd) : STATUS_ERROR;
+    wal_close(wal);
+    return status;
+}
+
+static void test_replays_unapplied(char *path, const char *walpath) {
+    int fd = make_db(path);
+    struct wal_t *wal = NULL;
+    CHECK(fd != -1 && wal_open(path, &wal) == STATUS_SUCCESS);
+    if (wal == NULL) {
+        return;
+    }
+    CHECK(log_only(wal, 100, 200, 'a') == STATUS_SUCCESS);
+    CHECK(log_only(wal, 4000, 300, 'b') == STATUS_SUCCESS);
+    // Two transactions, one after the other in the log
+    CHECK((size_t)file_size(walpath) == wal->logged);
+    wal_close(wal);
+    CHECK(bytes_are(fd, 100, 200, '\0') && bytes_are(fd, 4000, 300, '\0'));
+
+    CHECK(recover(path, fd) == STATUS_SUCCESS);
+    CHECK(bytes_are(fd, 0, 16, 'H'));
+    CHECK(bytes_are(fd, 100, 200, 'a'));
+    CHECK(bytes_are(fd, 4000, 300, 'b'));
+    CHECK(bytes_are(fd, 300, 3700, '\0') && bytes_are(fd, 4300, DB_BYTES - 4300, '\0'));
+    // Replayed, the database synced and the log emptied
+    CHECK(file_size(walpath) == 0);
+    // Nothing left to do the second time
+    CHECK(recover(path, fd) == STATUS_SUCCESS && bytes_are(fd, 100, 200, 'a'));
+    close(fd);
+}
+
+// Three transactions logged, then damage to the log. Returns the fd with
+// the replay done, or -1.
+static int recover_damaged(char *path, const char *walpath, void (*damage)(const char *walpath, size_t *ends)) {
+    int fd = make_db(path);
+    struct wal_t *wal = NULL;
+    size_t ends[3];
+    if (fd == -1 || wal_open(path, &wal) != STATUS_SUCCESS) {
+        return -1;
+    }
+    static const char fills[3] = {'a', 'b', 'c'};
+    for (int t = 0; t < 3; t++) {
+        CHECK(log_only(wal, 1000 + t * 1000, 500, fills[t]) == STATUS_SUCCESS);
+        ends[t] = wal->logged;
+    }
+    wal_close(wal);
+    damage(walpath, ends);
+    CHECK(recover(path, fd) == STATUS_SUCCESS);
+    CHECK(file_size(walpath) == 0);
+    return fd;
+}
+
+static void truncate_mid_last(const char *walpath, size_t *ends) {
+    CHECK(truncate(walpath, ends[1] + (ends[2] - ends[1]) / 2) == 0);
+}
+
+static void truncate_mid_header(const char *walpath, size_t *ends) {
+    CHECK(truncate(walpath, ends[1] + sizeof(struct walhdr_t) / 2) == 0);
+}
+
+// A byte of the second transaction's body: its CRC no longer matches
+static void flip_second(const char *walpath, size_t *ends) {
+    int fd = open(walpath, O_RDWR);
+    char c;
+    off_t at = ends[0] + sizeof(struct walhdr_t) + sizeof(struct walwrite_t) + 10;
+    CHECK(fd != -1 && read_all(fd, &c, 1, at) == STATUS_SUCCESS);
+    c ^= 0x40;
+    CHECK(write_all(fd, &c, 1, at) == STATUS_SUCCESS);
+    close(fd);
+}
+
+// Garbage where a fourth transaction would start
+static void append_garbage(const char *walpath, size_t *ends) {
+    char junk[100];
+    memset(junk, 0x5a, sizeof(junk));
+    int fd = open(walpath, O_RDWR);
+    CHECK(fd != -1 && write_all(fd, junk, sizeof(junk), ends[2]) == STATUS_SUCCESS);
+    close(fd);
+}
+
+static void test_discards_torn_tail(char *path, const char *walpath) {
+    // Torn in the middle of the last transaction: the first two survive
+    int fd = recover_damaged(path, walpath, truncate_mid_last);
+    CHECK(fd != -1 && bytes_are(fd, 1000, 500, 'a') && bytes_are(fd, 2000, 500, 'b') &&
+          bytes_are(fd, 3000, 500, '\0'));
+    close(fd);
+
+    fd = recover_damaged(path, walpath, truncate_mid_header);
+    CHECK(fd != -1 && bytes_are(fd, 1000, 500, 'a') && bytes_are(fd, 2000, 500, 'b') &&
+          bytes_are(fd, 3000, 500, '\0'));
+    close(fd);
+
+    // A bad CRC stops the replay there: nothing after it is trusted either
+    fd = recover_damaged(path, walpath, flip_second);
+    CHECK(fd != -1 && bytes_are(fd, 1000, 500, 'a') && bytes_are(fd, 2000, 500, '\0') &&
+          bytes_are(fd, 3000, 500, '\0'));
+    close(fd);
+
+    fd = recover_damaged(path, walpath, append_garbage);
+    CHECK(fd != -1 && bytes_are(fd, 1000, 500, 'a') && bytes_are(fd, 2000, 500, 'b') &&
+          bytes_are(fd, 3000, 500, 'c'));
+    close(fd);
+}
+
+// A checkpoint empties the log, and the next transaction starts it again
+static void test_checkpoint(char *path, const char *walpath) {
+    int fd = make_db(path);
+    struct wal_t *wal = NULL;
+    CHECK(fd != -1 && wal_open(path, &wal) == STATUS_SUCCESS);
+    if (wal == NULL) {
+        return;
+    }
+    wal_begin(wal);
+    CHECK(wal_add(wal, 10, "xxx", 3) == STATUS_SUCCESS && wal_commit(wal, fd) == STATUS_SUCCESS);
+    // Applied, but the log is only emptied once it passes WAL_CHECKPOINT_BYTES
+    CHECK(bytes_are(fd, 10, 3, 'x') && wal->logged > 0 && file_size(walpath) > 0);
+    CHECK(wal_checkpoint(wal, fd) == STATUS_SUCCESS && wal->logged == 0 && file_size(walpath) == 0);
+    CHECK(log_only(wal, 50, 10, 'q') == STATUS_SUCCESS);
+    CHECK((size_t)file_size(walpath) == wal->logged);
+    wal_close(wal);
+    CHECK(recover(path, fd) == STATUS_SUCCESS && bytes_are(fd, 50, 10, 'q'));
+    close(fd);
+}
+
+int main(void) {
+    char path[256], walpath[sizeof(path) + 4];
+    test_path(path, sizeof(path), "test_wal");
+    snprintf(walpath, sizeof(walpath), "%s.wal", path);
+    test_replays_unapplied(path, walpath);
+    test_discards_torn_tail(path, walpath);
+    test_checkpoint(path, walpath);
+    remove_db(path);
+    printf("test_wal: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#include "common.h"
+#include "ollama_client.h"
+#include "mock_ollama.h"
+#include <time.h>
+
+#define BENCH_AGENTS      4
+#define BENCH_ROUNDS      10
+#define BENCH_TOKENS      20
+#define BENCH_TOKEN_DELAY 2000  // microseconds between streamed tokens
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void count_token(const char *token, size_t length, void *user_data) {
+    (void)token;
+    (void)length;
+    (*(size_t *)user_data)++;
+}
+
+int main(void) {
+    static const char *agents[BENCH_AGENTS] = {"structure", "dependency", "configuration", "validation"};
+    MockOllama mock;
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return 1;
+    if (mock_ollama_start(&mock, BENCH_TOKENS, BENCH_TOKEN_DELAY) != 0) return 1;
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", mock.port);
+    OllamaClient *client = ollama_client_create(url, BENCH_AGENTS);
+    if (!client) return 1;
+
+    // Serial: one blocking call per agent
+    double start = now_seconds();
+    for (size_t i = 0; i < BENCH_ROUNDS * BENCH_AGENTS; i++) {
+        ResponseBuffer *response = ollama_client_generate(client, "mock", agents[i % BENCH_AGENTS]);
+        if (!response) return 1;
+        response_buffer_free(response);
+    }
+    double serial = (now_seconds() - start) / BENCH_ROUNDS;
+
+    size_t tokens[BENCH_AGENTS] = {0};
+    OllamaRequest requests[BENCH_AGENTS];
+    start = now_seconds();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (int i = 0; i < BENCH_AGENTS; i++) {
+            requests[i] = (OllamaRequest){.model = "mock", .prompt = agents[i],
+                                          .on_token = count_token, .user_data = &tokens[i]};
+        }
+        if (ollama_client_generate_batch(client, requests, BENCH_AGENTS) != STATUS_SUCCESS) {
+            fprintf(stderr, "Batch failed\n");
+            return 1;
+        }
+    }
+    double batch = (now_seconds() - start) / BENCH_ROUNDS;
+    for (int i = 0; i < BENCH_AGENTS; i++) {
+        if (tokens[i] != (size_t)BENCH_ROUNDS * (BENCH_TOKENS + 1)) {
+            fprintf(stderr, "Agent %d received %zu tokens\n", i, tokens[i]);
+            return 1;
+        }
+    }
+
+    printf("%d agents x %d tokens, %d us/token\n", BENCH_AGENTS, BENCH_TOKENS, BENCH_TOKEN_DELAY);
+    printf("serial  %8.1f ms per scaffold\n", serial * 1e3);
+    printf("batch   %8.1f ms per scaffold (%.1fx)\n", batch * 1e3, serial / batch);
+
+    ollama_client_destroy(client);
+    mock_ollama_stop(&mock);
+    curl_global_cleanup();
+    return 0;
+}
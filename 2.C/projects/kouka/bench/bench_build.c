@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_build.h"
+#include "kk_filegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// A 10k-source project: 50 modules of 200 Java files each. Every module is
+// one step with its directory as input; a link step depends on all of them.
+#define BENCH_MODULES 50
+#define BENCH_FILES   200
+#define BENCH_NOOPS   5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static char* generate_project(ProjectPlan *plan) {
+    size_t capacity = (size_t)BENCH_MODULES * BENCH_FILES * 256 + 65536;
+    char *text = malloc(capacity);
+    size_t used = 0;
+    for (int m = 0; text && m < BENCH_MODULES; m++) {
+        for (int f = 0; f < BENCH_FILES; f++) {
+            char path[128];
+            snprintf(path, sizeof(path), "mod%d/src/main/java/mod%d/Class%d.java", m, m, f);
+            int n = snprintf(text + used, capacity - used,
+                             "package mod%d;\n\npublic class Class%d {\n    int value() { return %d; }\n}\n",
+                             m, f, f);
+            if (project_plan_add_file(plan, path, text + used, (size_t)n) != STATUS_SUCCESS) {
+                free(text);
+                return NULL;
+            }
+            used += (size_t)n;
+        }
+    }
+    if (!text) return NULL;
+    char *json = text + used;
+    size_t n = (size_t)snprintf(json, capacity - used, "{\"steps\": [\n");
+    for (int m = 0; m < BENCH_MODULES; m++) {
+        n += (size_t)snprintf(json + n, capacity - used - n,
+                              " {\"name\": \"mod%d\", \"command\": \"touch out/mod%d.stamp\","
+                              " \"inputs\": [\"mod%d/src\"], \"outputs\": [\"out/mod%d.stamp\"]},\n",
+                              m, m, m, m);
+    }
+    n += (size_t)snprintf(json + n, capacity - used - n,
+                          " {\"name\": \"link\", \"command\": \"touch out/app.stamp\","
+                          " \"inputs\": [\"out/mod*.stamp\"], \"outputs\": [\"out/app.stamp\"], \"deps\": [");
+    for (int m = 0; m < BENCH_MODULES; m++) {
+        n += (size_t)snprintf(json + n, capacity - used - n, "%s\"mod%d\"", m ? ", " : "", m);
+    }
+    n += (size_t)snprintf(json + n, capacity - used - n, "]}\n]}\n");
+    if (project_plan_add_dir(plan, "out") != STATUS_SUCCESS ||
+        project_plan_add_file(plan, "commands.json", json, n) != STATUS_SUCCESS) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+static int timed_run(BuildGraph *graph, const BuildOptions *options, BuildStats *stats, double *seconds) {
+    double start = now_seconds();
+    int status = build_run(graph, options, stats);
+    *seconds = now_seconds() - start;
+    return status;
+}
+
+static void report(const char *label, double seconds, const BuildStats *stats) {
+    printf("%-16s %8.1f ms  (%zu executed, %zu up to date, %zu inputs, %zu hashed)\n", label, seconds * 1e3,
+           stats->executed, stats->up_to_date, stats->files, stats->files_hashed);
+}
+
+int main(void) {
+    const char *base = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+    char root[256], path[512];
+    snprintf(root, sizeof(root), "%s/kk_bench_build_%d", base, (int)getpid());
+
+    ProjectPlan plan;
+    project_plan_init(&plan);
+    char *text = generate_project(&plan);
+    int failed = !text || file_generator_write(&plan, root, NULL, NULL) != STATUS_SUCCESS;
+
+    BuildGraph graph;
+    build_graph_init(&graph);
+    snprintf(path, sizeof(path), "%s/commands.json", root);
+    failed = failed || build_graph_load(&graph, path) != STATUS_SUCCESS;
+
+    BuildOptions options = {.root = root, .quiet = 1};
+    BuildStats stats;
+    double seconds;
+    if (!failed) {
+        printf("project: %d modules x %d sources, %zu steps (%s)\n", BENCH_MODULES, BENCH_FILES, graph.count,
+               base);
+        // Everything written in the last moment is hashed again once, see
+        // RACY_WINDOW_NS, so let the sources age past it first
+        usleep(200000);
+        failed = timed_run(&graph, &options, &stats, &seconds) != STATUS_SUCCESS || stats.executed != graph.count;
+        report("cold build", seconds, &stats);
+    }
+    if (!failed) {
+        // The first no-op still rehashes the stamps the cold build just wrote
+        usleep(200000);
+        failed = timed_run(&graph, &options, &stats, &seconds) != STATUS_SUCCESS || stats.executed != 0;
+        report("first no-op", seconds, &stats);
+        double best = 0;
+        for (int i = 0; i < BENCH_NOOPS && !failed; i++) {
+            failed = timed_run(&graph, &options, &stats, &seconds) != STATUS_SUCCESS || stats.executed != 0;
+            if (i == 0 || seconds < best) best = seconds;
+        }
+        report("no-op rebuild", best, &stats);
+    }
+    if (!failed) {
+        snprintf(path, sizeof(path), "%s/mod7/src/main/java/mod7/Class3.java", root);
+        FILE *file = fopen(path, "a");
+        failed = !file;
+        if (file) {
+            fputs("// touched\n", file);
+            fclose(file);
+        }
+        failed = failed || timed_run(&graph, &options, &stats, &seconds) != STATUS_SUCCESS || stats.executed != 2;
+        report("one file edited", seconds, &stats);
+    }
+    if (failed) {
+        fprintf(stderr, "bench_build failed\n");
+    }
+    build_graph_free(&graph);
+    nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    project_plan_free(&plan);
+    free(text);
+    return failed;
+}
@@ -0,0 +1,96 @@
+#include "ollama_client.h"
+#include "mock_ollama.h"
+#include <time.h>
+
+#define BENCH_REQUESTS 2000
+#define BENCH_TOKENS   16
+#define BENCH_THREADS  OLLAMA_DEFAULT_POOL_SIZE
+
+typedef struct ThreadArgs {
+    OllamaClient *client;
+    size_t requests;
+    int failed;
+} ThreadArgs;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Baseline: a fresh client (and TCP connection) per prompt, as call_ollama
+// used to open.
+static double run_one_shot(const char *url) {
+    double start = now_seconds();
+    for (size_t i = 0; i < BENCH_REQUESTS; i++) {
+        OllamaClient *client = ollama_client_create(url, 1);
+        ResponseBuffer *response = client ? ollama_client_generate(client, "mock", "hello") : NULL;
+        ollama_client_destroy(client);
+        if (!response) return -1;
+        response_buffer_free(response);
+    }
+    return now_seconds() - start;
+}
+
+static void *pooled_worker(void *arg) {
+    ThreadArgs *args = (ThreadArgs *)arg;
+    for (size_t i = 0; i < args->requests; i++) {
+        ResponseBuffer *response = ollama_client_generate(args->client, "mock", "hello");
+        if (!response) {
+            args->failed = 1;
+            return NULL;
+        }
+        response_buffer_free(response);
+    }
+    return NULL;
+}
+
+static double run_pooled(const char *url, size_t threads) {
+    OllamaClient *client = ollama_client_create(url, OLLAMA_DEFAULT_POOL_SIZE);
+    if (!client) return -1;
+    pthread_t tids[BENCH_THREADS];
+    ThreadArgs args[BENCH_THREADS];
+    int failed = 0;
+    double start = now_seconds();
+    for (size_t t = 0; t < threads; t++) {
+        args[t] = (ThreadArgs){.client = client, .requests = BENCH_REQUESTS / threads};
+        pthread_create(&tids[t], NULL, pooled_worker, &args[t]);
+    }
+    for (size_t t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        failed |= args[t].failed;
+    }
+    double elapsed = now_seconds() - start;
+    ollama_client_destroy(client);
+    return failed ? -1 : elapsed;
+}
+
+static int report(const char *name, MockOllama *mock, unsigned long conns_before, double elapsed) {
+    if (elapsed < 0) {
+        fprintf(stderr, "%s: request failed\n", name);
+        return 1;
+    }
+    printf("%-10s %6d requests  %8.0f req/s  %5lu TCP connections\n", name, BENCH_REQUESTS,
+           BENCH_REQUESTS / elapsed, mock->connections - conns_before);
+    return 0;
+}
+
+int main(void) {
+    MockOllama mock;
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return 1;
+    if (mock_ollama_start(&mock, BENCH_TOKENS, 0) != 0) return 1;
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", mock.port);
+
+    int failed = 0;
+    unsigned long conns = mock.connections;
+    failed |= report("one-shot", &mock, conns, run_one_shot(url));
+    conns = mock.connections;
+    failed |= report("pooled", &mock, conns, run_pooled(url, 1));
+    conns = mock.connections;
+    failed |= report("pooled x4", &mock, conns, run_pooled(url, BENCH_THREADS));
+
+    mock_ollama_stop(&mock);
+    curl_global_cleanup();
+    return failed;
+}
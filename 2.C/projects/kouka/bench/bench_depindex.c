@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_depindex.h"
+#include "kk_filegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// A synthetic repository: 50k artifacts x 2 versions = 100k POMs. Artifact
+// i depends on up to 4 artifacts below i/8, so low indices play the role of
+// core libraries and the top ones of starters, which gives closures the size
+// of a Spring Boot application (tens to a few hundred artifacts).
+#define BENCH_ARTIFACTS 50000
+#define BENCH_VERSIONS  2
+#define BENCH_FANOUT    4
+#define BENCH_ROOTS     10
+#define BENCH_RESOLVES  2000
+#define BENCH_LOOKUPS   1000000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return *state >> 33;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+// POM text for every file, kept in one buffer that outlives the write
+static char* generate_repository(ProjectPlan *plan) {
+    size_t capacity = (size_t)BENCH_ARTIFACTS * BENCH_VERSIONS * 1024;
+    char *text = malloc(capacity);
+    size_t used = 0;
+    uint64_t seed = 42;
+    for (size_t i = 0; text && i < BENCH_ARTIFACTS; i++) {
+        for (int v = 0; v < BENCH_VERSIONS; v++) {
+            char *pom = text + used;
+            int n = snprintf(pom, capacity - used,
+                             "<?xml version=\"1.0\"?>\n<project>\n  <modelVersion>4.0.0</modelVersion>\n"
+                             "  <groupId>org.synth.g%zu</groupId>\n  <artifactId>a%zu</artifactId>\n"
+                             "  <version>1.%d</version>\n  <dependencies>\n",
+                             i / 100, i, v);
+            size_t deps = i >= 8 ? 1 + next_random(&seed) % BENCH_FANOUT : 0;
+            for (size_t d = 0; d < deps; d++) {
+                size_t target = next_random(&seed) % (i / 8);
+                n += snprintf(pom + n, capacity - used - (size_t)n,
+                              "    <dependency>\n      <groupId>org.synth.g%zu</groupId>\n"
+                              "      <artifactId>a%zu</artifactId>\n      <version>1.%d</version>\n"
+                              "%s    </dependency>\n",
+                              target / 100, target, (int)(next_random(&seed) % BENCH_VERSIONS),
+                              d == 3 ? "      <scope>test</scope>\n" : "");
+            }
+            n += snprintf(pom + n, capacity - used - (size_t)n, "  </dependencies>\n</project>\n");
+            char path[128];
+            snprintf(path, sizeof(path), "org/synth/g%zu/a%zu/1.%d/a%zu-1.%d.pom", i / 100, i, v, i, v);
+            if (project_plan_add_file(plan, path, pom, (size_t)n) != STATUS_SUCCESS) {
+                free(text);
+                return NULL;
+            }
+            used += (size_t)n;
+        }
+    }
+    return text;
+}
+
+int main(void) {
+    const char *base = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+    char repo[256], index_path[256];
+    snprintf(repo, sizeof(repo), "%s/kk_bench_depindex_%d", base, (int)getpid());
+    snprintf(index_path, sizeof(index_path), "%s/kk_bench_depindex_%d.idx", base, (int)getpid());
+
+    ProjectPlan plan;
+    project_plan_init(&plan);
+    char *text = generate_repository(&plan);
+    int failed = !text || file_generator_write(&plan, repo, NULL, NULL) != STATUS_SUCCESS;
+
+    DepIndexBuildStats stats;
+    double start = now_seconds();
+    failed = failed || dep_index_build(repo, index_path, &stats) != STATUS_SUCCESS;
+    double build = now_seconds() - start;
+
+    start = now_seconds();
+    DepIndex *index = failed ? NULL : dep_index_open(index_path);
+    double open_time = now_seconds() - start;
+    DepResolver resolver;
+    failed = failed || !index || dep_resolver_init(&resolver, index) != STATUS_SUCCESS;
+
+    if (!failed) {
+        // Root sets drawn from the top 1000 artifacts, the "starters"
+        uint64_t seed = 7;
+        size_t closure = 0, largest = 0;
+        start = now_seconds();
+        for (int r = 0; r < BENCH_RESOLVES && !failed; r++) {
+            uint32_t roots[BENCH_ROOTS];
+            for (int k = 0; k < BENCH_ROOTS; k++) {
+                char key[64];
+                size_t i = BENCH_ARTIFACTS - 1 - next_random(&seed) % 1000;
+                int n = snprintf(key, sizeof(key), "org.synth.g%zu:a%zu", i / 100, i);
+                long artifact = dep_index_find(index, key, (size_t)n);
+                failed = artifact < 0;
+                roots[k] = failed ? 0 : dep_index_version(index, (uint32_t)artifact, NULL);
+            }
+            failed = failed || dep_resolver_resolve(&resolver, roots, BENCH_ROOTS) != STATUS_SUCCESS;
+            closure += resolver.count;
+            if (resolver.count > largest) largest = resolver.count;
+        }
+        double resolve = (now_seconds() - start) / BENCH_RESOLVES;
+
+        static const char json[] =
+            "{\"dependencies\": [\"org.synth.g499:a49999:1.1\", \"org.synth.g499:a49950\",\n"
+            " {\"groupId\": \"org.synth.g498\", \"artifactId\": \"a49876\", \"version\": \"1.0\"},\n"
+            " \"org.synth.g497:a49710:1.0\", \"org.synth.g496:a49601:1.1\"]}";
+        start = now_seconds();
+        for (int r = 0; r < BENCH_RESOLVES && !failed; r++) {
+            failed = dep_resolver_resolve_json(&resolver, json, sizeof(json) - 1) != STATUS_SUCCESS;
+        }
+        double resolve_json = (now_seconds() - start) / BENCH_RESOLVES;
+
+        start = now_seconds();
+        long found = 0;
+        for (int r = 0; r < BENCH_LOOKUPS; r++) {
+            char key[64];
+            size_t i = next_random(&seed) % BENCH_ARTIFACTS;
+            int n = snprintf(key, sizeof(key), "org.synth.g%zu:a%zu", i / 100, i);
+            found += dep_index_find(index, key, (size_t)n) >= 0;
+        }
+        double lookup = (now_seconds() - start) / BENCH_LOOKUPS;
+        failed = failed || found != BENCH_LOOKUPS;
+
+        if (!failed) {
+            printf("repository: %zu POMs, %zu artifacts, %zu versions, %zu edges (%s)\n", stats.poms,
+                   stats.artifacts, stats.versions, stats.edges, base);
+            printf("build index     %8.0f ms  (%.0f POMs/s, %.1f MB)\n", build * 1e3, stats.poms / build,
+                   index->map_size / 1e6);
+            printf("open (mmap)     %8.3f ms\n", open_time * 1e3);
+            printf("lookup          %8.0f ns  (group:artifact binary search)\n", lookup * 1e9);
+            printf("resolve         %8.1f us  (%d roots, mean closure %.0f, largest %zu)\n", resolve * 1e6,
+                   BENCH_ROOTS, (double)closure / BENCH_RESOLVES, largest);
+            printf("resolve json    %8.1f us  (5 roots, closure %zu)\n", resolve_json * 1e6, resolver.count);
+        }
+        dep_resolver_free(&resolver);
+    }
+    dep_index_close(index);
+    unlink(index_path);
+    nftw(repo, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    project_plan_free(&plan);
+    free(text);
+    return failed;
+}
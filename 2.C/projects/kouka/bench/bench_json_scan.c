@@ -0,0 +1,92 @@
+#include "kk_json.h"
+#include "kk_scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_STREAM "bench/data/ollama_generate.ndjson"
+#define TARGET_BYTES   (1ul << 30)
+#define CHUNK_SIZE     16384  // curl's default receive buffer
+
+typedef struct Digest {
+    unsigned long long hash;
+    size_t bytes;
+} Digest;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// FNV-1a over every delivered value, so all ISAs must agree byte for byte.
+static void digest_value(const char *value, size_t length, void *agent_response) {
+    Digest *digest = (Digest *)agent_response;
+    for (size_t i = 0; i < length; i++) {
+        digest->hash = (digest->hash ^ (unsigned char)value[i]) * 1099511628211ull;
+    }
+    digest->bytes += length;
+}
+
+static char *load_file(const char *path, size_t *length) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc((size_t)size);
+    if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *length = (size_t)size;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : DEFAULT_STREAM;
+    size_t length = 0;
+    char *stream = load_file(path, &length);
+    if (!stream || length == 0) {
+        return 1;
+    }
+    size_t rounds = TARGET_BYTES / length + 1;
+    printf("%s: %zu bytes x %zu rounds\n", path, length, rounds);
+
+    Digest reference = {0};
+    double scalar_rate = 0;
+    for (int isa = SCAN_ISA_SCALAR; isa <= SCAN_ISA_AVX2; isa++) {
+        if (scan_select_isa((ScanIsa)isa) != (ScanIsa)isa) {
+            printf("%-7s not supported on this CPU\n", scan_isa_name((ScanIsa)isa));
+            continue;
+        }
+        Digest digest = {0};
+        double start = now_seconds();
+        for (size_t r = 0; r < rounds; r++) {
+            JsonParser parser;
+            json_parser_init(&parser, digest_value, &digest);
+            json_parser_set_zero_copy(&parser, 1);
+            for (size_t off = 0; off < length; off += CHUNK_SIZE) {
+                size_t n = length - off < CHUNK_SIZE ? length - off : CHUNK_SIZE;
+                json_parse(&parser, stream + off, n);
+            }
+            json_parser_free(&parser);
+        }
+        double elapsed = now_seconds() - start;
+        double rate = (double)length * (double)rounds / elapsed / 1e9;
+        if (isa == SCAN_ISA_SCALAR) {
+            reference = digest;
+            scalar_rate = rate;
+        } else if (digest.hash != reference.hash || digest.bytes != reference.bytes) {
+            fprintf(stderr, "%s output differs from scalar\n", scan_isa_name((ScanIsa)isa));
+            return 1;
+        }
+        printf("%-7s %6.2f GB/s  (%.2fx scalar)\n", scan_isa_name((ScanIsa)isa), rate, rate / scalar_rate);
+    }
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "common.h"
+#include "kk_json.h"
+#include "kk_json_tokenizer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_STREAM "bench/data/ollama_generate.ndjson"
+#define TARGET_BYTES   (256ul << 20)
+#define CHUNK_SIZE     16384
+
+typedef struct Totals {
+    size_t response_bytes;
+    size_t done_flags;
+    size_t context_items;
+    long long eval_count;
+} Totals;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void on_response(const JsonToken *token, void *user_data) {
+    ((Totals *)user_data)->response_bytes += token->length;
+}
+
+static void on_done(const JsonToken *token, void *user_data) {
+    ((Totals *)user_data)->done_flags += token->type == JSON_TOKEN_TRUE;
+}
+
+static void on_context_item(const JsonToken *token, void *user_data) {
+    (void)token;
+    ((Totals *)user_data)->context_items++;
+}
+
+static void on_eval_count(const JsonToken *token, void *user_data) {
+    json_token_to_int64(token, &((Totals *)user_data)->eval_count);
+}
+
+static void on_value(const char *value, size_t length, void *agent_response) {
+    (void)value;
+    ((Totals *)agent_response)->response_bytes += length;
+}
+
+static char *load_file(const char *path, size_t *length) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc((size_t)size);
+    if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *length = (size_t)size;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : DEFAULT_STREAM;
+    size_t length = 0;
+    char *stream = load_file(path, &length);
+    if (!stream || length == 0) {
+        return 1;
+    }
+    size_t rounds = TARGET_BYTES / length + 1;
+    double total = (double)length * (double)rounds;
+    printf("%s: %zu bytes x %zu rounds\n", path, length, rounds);
+
+    Totals totals = {0};
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    json_tokenizer_subscribe(&tok, "$.response", on_response, &totals);
+    json_tokenizer_subscribe(&tok, "$.done", on_done, &totals);
+    json_tokenizer_subscribe(&tok, "$.context[*]", on_context_item, &totals);
+    json_tokenizer_subscribe(&tok, "$.eval_count", on_eval_count, &totals);
+    double start = now_seconds();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t off = 0; off < length; off += CHUNK_SIZE) {
+            size_t n = length - off < CHUNK_SIZE ? length - off : CHUNK_SIZE;
+            if (json_tokenizer_feed(&tok, stream + off, n) != STATUS_SUCCESS) {
+                fprintf(stderr, "tokenizer error at byte %zu: %s\n", tok.error_offset, tok.error);
+                return 1;
+            }
+        }
+    }
+    double elapsed = now_seconds() - start;
+    json_tokenizer_free(&tok);
+    printf("tokenizer   %8.1f MB/s  (4 paths: %zu response bytes, %zu done, %zu context items, eval_count %lld)\n",
+           total / elapsed / 1e6, totals.response_bytes / rounds, totals.done_flags / rounds,
+           totals.context_items / rounds, totals.eval_count);
+
+    // The specialised "response"-only parser, for reference
+    Totals reference = {0};
+    start = now_seconds();
+    for (size_t r = 0; r < rounds; r++) {
+        JsonParser parser;
+        json_parser_init(&parser, on_value, &reference);
+        json_parser_set_zero_copy(&parser, 1);
+        for (size_t off = 0; off < length; off += CHUNK_SIZE) {
+            size_t n = length - off < CHUNK_SIZE ? length - off : CHUNK_SIZE;
+            json_parse(&parser, stream + off, n);
+        }
+        json_parser_free(&parser);
+    }
+    elapsed = now_seconds() - start;
+    printf("JsonParser  %8.1f MB/s  (response only)\n", total / elapsed / 1e6);
+    if (reference.response_bytes != totals.response_bytes) {
+        fprintf(stderr, "response bytes differ: %zu vs %zu\n", reference.response_bytes, totals.response_bytes);
+        return 1;
+    }
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "ollama_client.h"
+#include "kk_json_writer.h"
+#include "kk_scan.h"
+#include "mock_ollama.h"
+#include <time.h>
+
+#define DEFAULT_SOURCE "src/ollama_client.c"
+#define PROMPT_BYTES   (128 * 1024)
+#define TARGET_BYTES   (1ul << 30)
+#define BENCH_REQUESTS 500
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// A prompt that embeds source code, the case that used to be truncated:
+// the file is repeated up to PROMPT_BYTES.
+static char *build_prompt(const char *path, size_t *length) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    char *prompt = malloc(PROMPT_BYTES + 1);
+    size_t n = 0;
+    while (prompt && n < PROMPT_BYTES) {
+        size_t got = fread(prompt + n, 1, PROMPT_BYTES - n, f);
+        if (got == 0) {
+            if (n == 0) break;
+            rewind(f);
+        }
+        n += got;
+    }
+    fclose(f);
+    if (prompt) prompt[n] = '\0';
+    *length = n;
+    return n ? prompt : NULL;
+}
+
+// Byte-at-a-time escaping into a preallocated buffer, for comparison.
+static size_t escape_bytewise(char *out, const char *in, size_t length) {
+    size_t o = 0;
+    out[o++] = '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)in[i];
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c == '\n') {
+            out[o++] = '\\';
+            out[o++] = 'n';
+        } else if (c < 0x20) {
+            o += (size_t)sprintf(out + o, "\\u%04x", c);
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    out[o++] = '"';
+    return o;
+}
+
+static double run_bytewise(const char *prompt, size_t length, size_t rounds, size_t *out_length) {
+    char *out = malloc(length * 6 + 2);
+    double start = now_seconds();
+    for (size_t r = 0; r < rounds; r++) {
+        *out_length = escape_bytewise(out, prompt, length);
+    }
+    double elapsed = now_seconds() - start;
+    free(out);
+    return (double)length * (double)rounds / elapsed / 1e9;
+}
+
+// The writer is reset between rounds, so after the first body it no longer
+// allocates, just as when it is reused for consecutive requests.
+static double run_writer(const char *prompt, size_t length, size_t rounds, size_t *out_length) {
+    JsonWriter writer;
+    json_writer_init(&writer, NULL, 0);
+    double start = now_seconds();
+    for (size_t r = 0; r < rounds; r++) {
+        json_writer_reset(&writer);
+        json_writer_string(&writer, prompt, length);
+    }
+    double elapsed = now_seconds() - start;
+    *out_length = writer.length;
+    json_writer_free(&writer);
+    return (double)length * (double)rounds / elapsed / 1e9;
+}
+
+static double run_requests(const char *prompt) {
+    MockOllama mock;
+    if (mock_ollama_start(&mock, 16, 0) != 0) return -1;
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", mock.port);
+    OllamaClient *client = ollama_client_create(url, 1);
+    double start = now_seconds(), elapsed = -1;
+    for (size_t i = 0; client && i < BENCH_REQUESTS; i++) {
+        ResponseBuffer *response = ollama_client_generate(client, "mock", prompt);
+        if (!response) break;
+        response_buffer_free(response);
+        if (i + 1 == BENCH_REQUESTS) elapsed = now_seconds() - start;
+    }
+    ollama_client_destroy(client);
+    mock_ollama_stop(&mock);
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t length = 0;
+    char *prompt = build_prompt(argc > 1 ? argv[1] : DEFAULT_SOURCE, &length);
+    if (!prompt) return 1;
+    size_t rounds = TARGET_BYTES / length + 1;
+    printf("prompt: %zu bytes x %zu rounds\n", length, rounds);
+
+    size_t reference_length = 0, out_length = 0;
+    double bytewise = run_bytewise(prompt, length, rounds, &reference_length);
+    printf("bytewise  %5.2f GB/s\n", bytewise);
+    int failed = 0;
+    for (int isa = SCAN_ISA_SCALAR; isa <= SCAN_ISA_AVX2; isa++) {
+        if (scan_select_isa((ScanIsa)isa) != (ScanIsa)isa) {
+            printf("%-9s not supported on this CPU\n", scan_isa_name((ScanIsa)isa));
+            continue;
+        }
+        double rate = run_writer(prompt, length, rounds, &out_length);
+        printf("%-9s %5.2f GB/s  (%.2fx bytewise)\n", scan_isa_name((ScanIsa)isa), rate, rate / bytewise);
+        if (out_length != reference_length) {
+            fprintf(stderr, "%s: %zu escaped bytes, expected %zu\n", scan_isa_name((ScanIsa)isa),
+                    out_length, reference_length);
+            failed = 1;
+        }
+    }
+    scan_select_isa(SCAN_ISA_AVX2);
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return 1;
+    double elapsed = run_requests(prompt);
+    if (elapsed < 0) {
+        fprintf(stderr, "request with %zu byte prompt failed\n", length);
+        failed = 1;
+    } else {
+        printf("generate  %5.0f req/s with a %zu KB prompt\n", BENCH_REQUESTS / elapsed, length / 1024);
+    }
+    curl_global_cleanup();
+    free(prompt);
+    return failed;
+}
@@ -0,0 +1,73 @@
+#include "common.h"
+#include "ollama_client.h"
+#include "mock_ollama.h"
+#include <time.h>
+
+#define BENCH_REQUESTS 500
+#define BENCH_TOKENS   64
+#define BENCH_DELAY_US 50
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double run(const char *url, KkMetrics *metrics) {
+    OllamaClient *client = ollama_client_create(url, 1);
+    if (!client) return -1;
+    ollama_client_set_metrics(client, metrics);
+    double start = now_seconds();
+    for (size_t i = 0; i < BENCH_REQUESTS; i++) {
+        ResponseBuffer *response = ollama_client_generate(client, "mock", "hello");
+        if (!response) {
+            ollama_client_destroy(client);
+            return -1;
+        }
+        response_buffer_free(response);
+    }
+    double elapsed = now_seconds() - start;
+    ollama_client_destroy(client);
+    return elapsed;
+}
+
+static void print_latency(const char *name, const LatencyHistogram *histogram) {
+    printf("%-12s p50 %7llu us  p90 %7llu us  p99 %7llu us  (%llu samples)\n", name,
+           (unsigned long long)histogram_percentile(histogram, 50),
+           (unsigned long long)histogram_percentile(histogram, 90),
+           (unsigned long long)histogram_percentile(histogram, 99), (unsigned long long)histogram->count);
+}
+
+int main(void) {
+    MockOllama mock;
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return 1;
+    if (mock_ollama_start(&mock, BENCH_TOKENS, BENCH_DELAY_US) != 0) return 1;
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", mock.port);
+
+    KkMetrics *metrics = metrics_create();
+    double plain = run(url, NULL);
+    double traced = run(url, metrics);
+    int failed = !metrics || plain < 0 || traced < 0;
+    ModelMetrics *snapshot = malloc(sizeof(ModelMetrics));
+    if (!failed && snapshot && metrics_snapshot(metrics, "mock", snapshot) == STATUS_SUCCESS) {
+        printf("without metrics %7.0f req/s\n", BENCH_REQUESTS / plain);
+        printf("with metrics    %7.0f req/s  (%+.1f%% time)\n", BENCH_REQUESTS / traced,
+               (traced / plain - 1) * 100);
+        print_latency("ttfb", &snapshot->latency[METRIC_TTFB]);
+        print_latency("ttft", &snapshot->latency[METRIC_TTFT]);
+        print_latency("inter-token", &snapshot->latency[METRIC_INTER_TOKEN]);
+        print_latency("total", &snapshot->latency[METRIC_TOTAL]);
+        printf("eval rate    p50 %7llu tokens/s (from eval_count/eval_duration)\n",
+               (unsigned long long)histogram_percentile(&snapshot->eval_rate, 50));
+        failed = snapshot->requests != BENCH_REQUESTS || snapshot->failures != 0 ||
+                 snapshot->tokens != (unsigned long)BENCH_REQUESTS * BENCH_TOKENS;
+    } else {
+        failed = 1;
+    }
+    free(snapshot);
+    metrics_destroy(metrics);
+    mock_ollama_stop(&mock);
+    curl_global_cleanup();
+    return failed;
+}
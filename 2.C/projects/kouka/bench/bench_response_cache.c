@@ -0,0 +1,88 @@
+#include "ollama_client.h"
+#include "mock_ollama.h"
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_TOKENS   64
+#define BENCH_DELAY_US 200
+#define BENCH_PROMPTS  20
+#define BENCH_LOOKUPS  200000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double run_prompts(OllamaClient *client) {
+    char prompt[64];
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_PROMPTS; i++) {
+        snprintf(prompt, sizeof(prompt), "scaffold spring-boot module %d", i);
+        ResponseBuffer *response = ollama_client_generate(client, "mock", prompt);
+        if (!response) return -1;
+        response_buffer_free(response);
+    }
+    return (now_seconds() - start) / BENCH_PROMPTS;
+}
+
+// Average lookup latency for keys already in memory, or only in the mmap'd
+// store when the LRU is too small to hold them.
+static double run_lookups(ResponseCache *cache) {
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        char prompt[64];
+        snprintf(prompt, sizeof(prompt), "scaffold spring-boot module %d", i % BENCH_PROMPTS);
+        size_t length;
+        char *value = response_cache_get(cache, response_cache_key("mock", prompt, NULL), &length);
+        if (!value) return -1;
+        free(value);
+    }
+    return (now_seconds() - start) / BENCH_LOOKUPS;
+}
+
+int main(void) {
+    MockOllama mock;
+    char path[] = "/tmp/kk_cache_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    close(fd);
+    unlink(path);
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return 1;
+    if (mock_ollama_start(&mock, BENCH_TOKENS, BENCH_DELAY_US) != 0) return 1;
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", mock.port);
+
+    ResponseCacheConfig config = {.disk_path = path};
+    ResponseCache *cache = response_cache_create(&config);
+    OllamaClient *client = ollama_client_create(url, 1);
+    int failed = !cache || !client;
+    if (!failed) {
+        ollama_client_set_cache(client, cache);
+        double miss = run_prompts(client);
+        double hit = run_prompts(client);
+        double memory = run_lookups(cache);
+        response_cache_destroy(cache);
+        // Reopen with a one-entry LRU so lookups are served from the mmap'd file
+        config.max_entries = 1;
+        cache = response_cache_create(&config);
+        double disk = cache ? run_lookups(cache) : -1;
+        failed = miss < 0 || hit < 0 || memory < 0 || disk < 0;
+        if (!failed) {
+            ResponseCacheStats stats;
+            response_cache_stats(cache, &stats);
+            printf("miss (server)    %10.1f us per prompt\n", miss * 1e6);
+            printf("hit via client   %10.1f us per prompt  (%.0fx)\n", hit * 1e6, miss / hit);
+            printf("memory lookup    %10.3f us\n", memory * 1e6);
+            printf("disk lookup      %10.3f us  (%lu disk hits, %lu memory hits)\n", disk * 1e6,
+                   stats.disk_hits, stats.hits);
+        }
+    }
+
+    ollama_client_destroy(client);
+    response_cache_destroy(cache);
+    unlink(path);
+    mock_ollama_stop(&mock);
+    curl_global_cleanup();
+    return failed;
+}
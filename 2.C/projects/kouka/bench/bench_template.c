@@ -0,0 +1,118 @@
+#include "common.h"
+#include "kk_template.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BENCH_RENDERS 2000000
+#define COMPILE_RENDERS 200000
+#define WRITE_BATCH   64
+
+// A Java skeleton, the smallest and most frequent scaffold file
+static const char JAVA_SOURCE[] =
+    "package {{package}};\n"
+    "\n"
+    "{{#imports}}\n"
+    "import {{import}};\n"
+    "{{/imports}}\n"
+    "\n"
+    "@{{annotation}}\n"
+    "public class {{name}} {\n"
+    "    private final {{type}} {{field}};\n"
+    "}\n";
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void set(const Template *tpl, TemplateValue *values, const char *name, const char *value) {
+    int slot = template_var_index(tpl, name);
+    if (slot >= 0) {
+        values[slot] = (TemplateValue){.data = value, .length = strlen(value)};
+    }
+}
+
+static TemplateValue* bind(const Template *tpl, TemplateValue *rows) {
+    TemplateValue *values = calloc(tpl->var_count, sizeof(TemplateValue));
+    memset(rows, 0, 2 * tpl->var_count * sizeof(TemplateValue));
+    set(tpl, values, "package", "com.example.demo.web");
+    set(tpl, values, "annotation", "RestController");
+    set(tpl, values, "name", "GreetingController");
+    set(tpl, values, "type", "GreetingService");
+    set(tpl, values, "field", "service");
+    set(tpl, rows, "import", "org.springframework.web.bind.annotation.GetMapping");
+    set(tpl, rows + tpl->var_count, "import", "org.springframework.web.bind.annotation.RestController");
+    values[template_var_index(tpl, "imports")] = (TemplateValue){.rows = rows, .row_count = 2};
+    return values;
+}
+
+int main(void) {
+    TemplateCache *cache = template_cache_create();
+    const Template *tpl = cache ? template_cache_get(cache, JAVA_SOURCE, sizeof(JAVA_SOURCE) - 1) : NULL;
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (!tpl || null_fd < 0) return 1;
+    TemplateValue rows[64];
+    TemplateValue *values = bind(tpl, rows);
+    TemplateOutput out;
+    template_output_init(&out);
+    int failed = 0;
+
+    // Compiling on every use, what regenerating from source text costs
+    double start = now_seconds();
+    for (int i = 0; i < COMPILE_RENDERS && !failed; i++) {
+        Template *fresh = template_compile(JAVA_SOURCE, sizeof(JAVA_SOURCE) - 1);
+        failed = !fresh || template_render(fresh, values, &out) != STATUS_SUCCESS;
+        template_output_reset(&out);
+        template_free(fresh);
+    }
+    double compile_each = (now_seconds() - start) / COMPILE_RENDERS;
+
+    start = now_seconds();
+    for (int i = 0; i < BENCH_RENDERS && !failed; i++) {
+        tpl = template_cache_get(cache, JAVA_SOURCE, sizeof(JAVA_SOURCE) - 1);
+        failed = template_render(tpl, values, &out) != STATUS_SUCCESS;
+        template_output_reset(&out);
+    }
+    double cached = (now_seconds() - start) / BENCH_RENDERS;
+
+    start = now_seconds();
+    for (int i = 0; i < BENCH_RENDERS && !failed; i++) {
+        failed = template_render(tpl, values, &out) != STATUS_SUCCESS;
+        template_output_reset(&out);
+    }
+    double compiled = (now_seconds() - start) / BENCH_RENDERS;
+    size_t render_bytes = 0;
+    template_render(tpl, values, &out);
+    render_bytes = out.bytes;
+    template_output_reset(&out);
+
+    // Rendered straight to a file descriptor, one writev per WRITE_BATCH files
+    start = now_seconds();
+    for (int i = 0; i < BENCH_RENDERS && !failed; i++) {
+        failed = template_render(tpl, values, &out) != STATUS_SUCCESS;
+        if (!failed && (i + 1) % WRITE_BATCH == 0) {
+            failed = template_output_write(&out, null_fd) != STATUS_SUCCESS;
+        }
+    }
+    failed |= template_output_write(&out, null_fd) != STATUS_SUCCESS;
+    double written = (now_seconds() - start) / BENCH_RENDERS;
+
+    if (!failed) {
+        printf("java skeleton: %zu bytes, %zu ops, %zu names\n", render_bytes, tpl->op_count, tpl->var_count);
+        printf("compile + render      %10.0f renders/s\n", 1 / compile_each);
+        printf("cache lookup + render %10.0f renders/s\n", 1 / cached);
+        printf("render                %10.0f renders/s  (target > 1000000)\n", 1 / compiled);
+        printf("render + writev       %10.0f renders/s  (%d per writev, %.0f MB/s)\n", 1 / written, WRITE_BATCH,
+               render_bytes / written / 1e6);
+    }
+    template_output_free(&out);
+    free(values);
+    close(null_fd);
+    template_cache_destroy(cache);
+    return failed;
+}
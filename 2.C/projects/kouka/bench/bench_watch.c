@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_watch.h"
+#include "kk_filegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// The bench_build project (50 modules x 200 sources, a link step over all
+// module stamps) under a watcher. Each round edits one source file and
+// times edit -> changes collected -> rebuild started -> rebuild finished.
+#define BENCH_MODULES 50
+#define BENCH_FILES   200
+#define BENCH_EDITS   20
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static char* generate_project(ProjectPlan *plan) {
+    size_t capacity = (size_t)BENCH_MODULES * BENCH_FILES * 256 + 65536;
+    char *text = malloc(capacity);
+    size_t used = 0;
+    for (int m = 0; text && m < BENCH_MODULES; m++) {
+        for (int f = 0; f < BENCH_FILES; f++) {
+            char path[128];
+            snprintf(path, sizeof(path), "mod%d/src/main/java/mod%d/Class%d.java", m, m, f);
+            int n = snprintf(text + used, capacity - used,
+                             "package mod%d;\n\npublic class Class%d {\n    int value() { return %d; }\n}\n",
+                             m, f, f);
+            if (project_plan_add_file(plan, path, text + used, (size_t)n) != STATUS_SUCCESS) {
+                free(text);
+                return NULL;
+            }
+            used += (size_t)n;
+        }
+    }
+    if (!text) return NULL;
+    char *json = text + used;
+    size_t n = (size_t)snprintf(json, capacity - used, "{\"steps\": [\n");
+    for (int m = 0; m < BENCH_MODULES; m++) {
+        n += (size_t)snprintf(json + n, capacity - used - n,
+                              " {\"name\": \"mod%d\", \"command\": \"touch out/mod%d.stamp\","
+                              " \"inputs\": [\"mod%d/src\"], \"outputs\": [\"out/mod%d.stamp\"]},\n",
+                              m, m, m, m);
+    }
+    n += (size_t)snprintf(json + n, capacity - used - n,
+                          " {\"name\": \"link\", \"command\": \"touch out/app.stamp\","
+                          " \"inputs\": [\"out/mod*.stamp\"], \"outputs\": [\"out/app.stamp\"], \"deps\": [");
+    for (int m = 0; m < BENCH_MODULES; m++) {
+        n += (size_t)snprintf(json + n, capacity - used - n, "%s\"mod%d\"", m ? ", " : "", m);
+    }
+    n += (size_t)snprintf(json + n, capacity - used - n, "]}\n]}\n");
+    if (project_plan_add_dir(plan, "out") != STATUS_SUCCESS ||
+        project_plan_add_file(plan, "commands.json", json, n) != STATUS_SUCCESS) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+// Lets the writes of the previous rebuild (stamps) run through the watcher
+static void settle(BuildWatcher *watcher) {
+    BuildStats stats;
+    while (build_watcher_wait(watcher, 100) > 0) {
+        build_watcher_rebuild(watcher, &stats);
+    }
+}
+
+int main(void) {
+    const char *base = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+    char root[256], path[512];
+    snprintf(root, sizeof(root), "%s/kk_bench_watch_%d", base, (int)getpid());
+
+    ProjectPlan plan;
+    project_plan_init(&plan);
+    char *text = generate_project(&plan);
+    int failed = !text || file_generator_write(&plan, root, NULL, NULL) != STATUS_SUCCESS;
+
+    BuildWatcher watcher = {.fd = -1};
+    BuildOptions options = {.root = root, .quiet = 1};
+    BuildStats stats;
+    snprintf(path, sizeof(path), "%s/commands.json", root);
+    double start = now_seconds();
+    failed = failed || build_watcher_init(&watcher, path, &options, 0) != STATUS_SUCCESS;
+    double init = now_seconds() - start;
+    if (!failed) {
+        failed = build_watcher_rebuild(&watcher, &stats) != STATUS_SUCCESS;
+        settle(&watcher);
+    }
+
+    double collect[BENCH_EDITS], rebuild[BENCH_EDITS];
+    size_t rescanned = 0;
+    for (int i = 0; i < BENCH_EDITS && !failed; i++) {
+        snprintf(path, sizeof(path), "%s/mod%d/src/main/java/mod%d/Class%d.java", root, i * 7 % BENCH_MODULES,
+                 i * 7 % BENCH_MODULES, i);
+        start = now_seconds();
+        FILE *file = fopen(path, "a");
+        failed = !file;
+        if (file) {
+            fprintf(file, "// edit %d\n", i);
+            fclose(file);
+        }
+        failed = failed || build_watcher_wait(&watcher, 1000) != 1;
+        collect[i] = now_seconds() - start;
+        failed = failed || build_watcher_rebuild(&watcher, &stats) != STATUS_SUCCESS || stats.executed != 2;
+        rebuild[i] = now_seconds() - start;
+        rescanned += stats.files_hashed;
+        settle(&watcher);
+    }
+
+    if (!failed) {
+        qsort(collect, BENCH_EDITS, sizeof(double), compare_doubles);
+        qsort(rebuild, BENCH_EDITS, sizeof(double), compare_doubles);
+        printf("project: %d modules x %d sources, %zu steps, %zu watches (%s)\n", BENCH_MODULES, BENCH_FILES,
+               watcher.graph.count, watcher.watch_count, base);
+        printf("watcher init      %8.1f ms\n", init * 1e3);
+        printf("edit -> rebuild   %8.1f ms median, %.1f ms max  (debounce %d ms)\n",
+               collect[BENCH_EDITS / 2] * 1e3, collect[BENCH_EDITS - 1] * 1e3, watcher.debounce_ms);
+        printf("edit -> built     %8.1f ms median, %.1f ms max  (%.1f files hashed per edit)\n",
+               rebuild[BENCH_EDITS / 2] * 1e3, rebuild[BENCH_EDITS - 1] * 1e3, (double)rescanned / BENCH_EDITS);
+    } else {
+        fprintf(stderr, "bench_watch failed\n");
+    }
+    build_watcher_free(&watcher);
+    nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    project_plan_free(&plan);
+    free(text);
+    return failed;
+}
@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+#include "mock_ollama.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+typedef struct MockConnection {
+    MockOllama *mock;
+    int fd;
+    char prompt[128];  // still JSON-escaped, as it was sent
+} MockConnection;
+
+static int write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int write_chunk(int fd, const char *data, size_t length) {
+    char size_line[32];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+    if (write_all(fd, size_line, (size_t)n) < 0) return -1;
+    if (write_all(fd, data, length) < 0) return -1;
+    return write_all(fd, "\r\n", 2);
+}
+
+static int send_stream(MockConnection *conn) {
+    static const char *words[] = {"public ", "class ", "Application ", "{\\n", "    ", "@Bean ",
+                                  "\\\"spring\\\" ", "}\\n"};
+    static const char header[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/x-ndjson\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Connection: keep-alive\r\n\r\n";
+    if (write_all(conn->fd, header, sizeof(header) - 1) < 0) return -1;
+
+    char line[256];
+    size_t n_words = sizeof(words) / sizeof(words[0]);
+    int echo = __atomic_load_n(&conn->mock->echo_prompt, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < conn->mock->tokens_per_response; i++) {
+        int n = snprintf(line, sizeof(line),
+                         "{\"model\":\"mock\",\"created_at\":\"2025-01-01T00:00:00Z\","
+                         "\"response\":\"%s\",\"done\":false}\n", echo ? conn->prompt : words[i % n_words]);
+        if (write_chunk(conn->fd, line, (size_t)n) < 0) return -1;
+        if (conn->mock->token_delay_us) usleep(conn->mock->token_delay_us);
+    }
+    int n = snprintf(line, sizeof(line),
+                     "{\"model\":\"mock\",\"created_at\":\"2025-01-01T00:00:00Z\",\"response\":\"\","
+                     "\"done\":true,\"eval_count\":%zu,\"eval_duration\":%zu}\n",
+                     conn->mock->tokens_per_response, conn->mock->tokens_per_response * 1000);
+    if (write_chunk(conn->fd, line, (size_t)n) < 0) return -1;
+    return write_all(conn->fd, "0\r\n\r\n", 5);
+}
+
+// Copies the "prompt" string of a request body, escapes and all, cut short
+// at the buffer's size.
+static void copy_prompt(MockConnection *conn, const char *body, size_t length) {
+    size_t copied = 0;
+    const char *p = memmem(body, length, "\"prompt\":\"", 10);
+    if (p) {
+        const char *end = body + length;
+        for (p += 10; p < end && *p != '"' && copied + 2 < sizeof(conn->prompt); p++) {
+            if (*p == '\\' && p + 1 < end) {
+                conn->prompt[copied++] = *p++;
+            }
+            conn->prompt[copied++] = *p;
+        }
+    }
+    conn->prompt[copied] = '\0';
+}
+
+// Reads one request (headers + Content-Length body) out of buf, refilling as
+// needed. Returns 0 on success, -1 when the peer closed or errored.
+static int read_request(MockConnection *conn, char *buf, size_t cap, size_t *buffered) {
+    char *headers_end = NULL;
+    while (!(headers_end = memmem(buf, *buffered, "\r\n\r\n", 4))) {
+        if (*buffered == cap) return -1;
+        ssize_t n = recv(conn->fd, buf + *buffered, cap - *buffered, 0);
+        if (n <= 0) return -1;
+        *buffered += (size_t)n;
+    }
+    size_t header_len = (size_t)(headers_end - buf) + 4;
+    size_t content_length = 0;
+    int expect_continue = 0;
+    for (char *line = buf; line < headers_end; ) {
+        char *eol = memmem(line, (size_t)(headers_end - line) + 2, "\r\n", 2);
+        if (!eol) break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtoul(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Expect: 100-continue", 20) == 0) {
+            expect_continue = 1;
+        }
+        line = eol + 2;
+    }
+    if (expect_continue) {
+        static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (write_all(conn->fd, cont, sizeof(cont) - 1) < 0) return -1;
+    }
+    // A body that fits is read whole for its prompt; a larger one is only
+    // consumed so the next request lines up.
+    size_t remaining = header_len + content_length;
+    if (remaining <= cap) {
+        while (*buffered < remaining) {
+            ssize_t n = recv(conn->fd, buf + *buffered, cap - *buffered, 0);
+            if (n <= 0) return -1;
+            *buffered += (size_t)n;
+        }
+        copy_prompt(conn, buf + header_len, content_length);
+        memmove(buf, buf + remaining, *buffered - remaining);
+        *buffered -= remaining;
+        return 0;
+    }
+    conn->prompt[0] = '\0';
+    while (remaining > 0) {
+        if (*buffered >= remaining) {
+            memmove(buf, buf + remaining, *buffered - remaining);
+            *buffered -= remaining;
+            return 0;
+        }
+        remaining -= *buffered;
+        *buffered = 0;
+        ssize_t n = recv(conn->fd, buf, cap, 0);
+        if (n <= 0) return -1;
+        *buffered = (size_t)n;
+    }
+    return 0;
+}
+
+static void *connection_main(void *arg) {
+    MockConnection *conn = (MockConnection *)arg;
+    size_t cap = 1 << 16;
+    char *buf = malloc(cap);
+    size_t buffered = 0;
+    while (buf && __atomic_load_n(&conn->mock->running, __ATOMIC_RELAXED)) {
+        if (read_request(conn, buf, cap, &buffered) < 0) break;
+        __atomic_fetch_add(&conn->mock->requests, 1, __ATOMIC_RELAXED);
+        if (send_stream(conn) < 0) break;
+    }
+    free(buf);
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+static void *accept_main(void *arg) {
+    MockOllama *mock = (MockOllama *)arg;
+    while (__atomic_load_n(&mock->running, __ATOMIC_RELAXED)) {
+        int fd = accept(mock->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        __atomic_fetch_add(&mock->connections, 1, __ATOMIC_RELAXED);
+        MockConnection *conn = malloc(sizeof(MockConnection));
+        pthread_t thread;
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->mock = mock;
+        conn->fd = fd;
+        if (pthread_create(&thread, NULL, connection_main, conn) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+int mock_ollama_start(MockOllama *mock, size_t tokens_per_response, unsigned token_delay_us) {
+    memset(mock, 0, sizeof(MockOllama));
+    mock->tokens_per_response = tokens_per_response;
+    mock->token_delay_us = token_delay_us;
+    mock->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (mock->listen_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(mock->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if (bind(mock->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(mock->listen_fd, 512) < 0 ||
+        getsockname(mock->listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        perror("mock_ollama");
+        close(mock->listen_fd);
+        return -1;
+    }
+    mock->port = ntohs(addr.sin_port);
+    mock->running = 1;
+    if (pthread_create(&mock->accept_thread, NULL, accept_main, mock) != 0) {
+        close(mock->listen_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void mock_ollama_stop(MockOllama *mock) {
+    __atomic_store_n(&mock->running, 0, __ATOMIC_RELAXED);
+    shutdown(mock->listen_fd, SHUT_RDWR);
+    close(mock->listen_fd);
+    pthread_join(mock->accept_thread, NULL);
+}
@@ -0,0 +1,27 @@
+#ifndef MOCK_OLLAMA_H
+#define MOCK_OLLAMA_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Minimal in-process HTTP/1.1 server that answers POST /api/generate with a
+// chunked NDJSON stream shaped like Ollama's. Connections are kept alive, and
+// the number of accepted TCP connections is counted so benchmarks can show
+// whether the client reused them. With echo_prompt set, every token is the
+// request's own prompt, so tests can tell concurrent streams apart.
+typedef struct MockOllama {
+    int listen_fd;
+    int port;
+    size_t tokens_per_response;
+    unsigned token_delay_us;
+    volatile int echo_prompt;  // set with __atomic_store_n once started
+    volatile int running;
+    volatile unsigned long connections;
+    volatile unsigned long requests;
+    pthread_t accept_thread;
+} MockOllama;
+
+int mock_ollama_start(MockOllama *mock, size_t tokens_per_response, unsigned token_delay_us);
+void mock_ollama_stop(MockOllama *mock);
+
+#endif
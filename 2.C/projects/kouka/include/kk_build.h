@@ -0,0 +1,122 @@
+#ifndef KK_BUILD_H
+#define KK_BUILD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The engine behind `kk build`. commands.json describes build steps:
+//
+//   {"steps": [
+//     {"name": "compile", "command": "javac -d out @sources.txt",
+//      "inputs": ["src", "lib/*.jar"], "outputs": ["out"], "deps": ["generate"]}
+//   ]}
+//
+// Inputs are files, directories (every file below them) or glob(3)
+// patterns, relative to the project root. A step's fingerprint is an XXH64
+// over its command, the content of its inputs and the fingerprints of the
+// steps it depends on; a step whose fingerprint matches the last successful
+// run and whose outputs all exist is skipped. Content hashes are reused
+// while a file's size, mtime and inode are unchanged, so a no-op build only
+// stats its inputs.
+//
+// Fingerprints live in <root>/.kouka/build.db: a BuildDbHeader followed by
+// file_count BuildFileRecords and step_count BuildStepRecords.
+
+#define BUILD_DB_MAGIC "KKBUILD1"
+#define BUILD_DB_PATH  ".kouka/build.db"
+
+typedef enum {
+    BUILD_STEP_PENDING = 0,
+    BUILD_STEP_UP_TO_DATE,
+    BUILD_STEP_EXECUTED,
+    BUILD_STEP_FAILED,
+    BUILD_STEP_SKIPPED,  // a dependency failed
+} BuildStepState;
+
+typedef struct BuildFileRecord {
+    uint64_t path_hash;
+    int64_t mtime_ns;
+    uint64_t size;
+    uint64_t inode;
+    uint64_t content_hash;
+} BuildFileRecord;
+
+typedef struct BuildStepRecord {
+    uint64_t name_hash;
+    uint64_t fingerprint;
+} BuildStepRecord;
+
+typedef struct BuildDbHeader {
+    char magic[8];
+    uint64_t file_count;
+    uint64_t step_count;
+} BuildDbHeader;
+
+typedef struct BuildStep {
+    char *name;
+    char *command;
+    char **inputs;
+    size_t input_count;
+    char **outputs;
+    size_t output_count;
+    char **dep_names;
+    size_t dep_count;
+    uint32_t *deps;  // indices of dep_names, filled in by build_graph_parse
+    uint32_t *dependents;
+    size_t dependent_count;
+    // Per-run state
+    int remaining;  // unfinished deps
+    BuildStepState state;
+    uint64_t fingerprint;
+    BuildFileRecord *files;  // inputs as seen this run
+    size_t file_count;
+    size_t file_capacity;
+    size_t files_hashed;  // inputs whose content had to be read
+    int changed;          // ran, or its fingerprint moved, this run
+    // Set by the watcher when nothing under the step's inputs or outputs
+    // changed; the next run keeps its last result without a rescan
+    int unchanged;
+} BuildStep;
+
+typedef struct BuildGraph {
+    BuildStep *steps;
+    size_t count;
+    size_t capacity;
+} BuildGraph;
+
+// The fingerprint database, loaded into memory
+typedef struct BuildDb BuildDb;
+
+typedef struct BuildOptions {
+    const char *root;  // project root; NULL = "."
+    size_t jobs;       // 0 = online CPUs
+    int quiet;         // don't echo step names
+} BuildOptions;
+
+typedef struct BuildStats {
+    size_t steps;
+    size_t executed;
+    size_t up_to_date;
+    size_t failed;
+    size_t skipped;
+    size_t files;
+    size_t files_hashed;
+} BuildStats;
+
+void build_graph_init(BuildGraph *graph);
+void build_graph_free(BuildGraph *graph);
+// Parses commands.json, resolves deps by name and rejects cycles.
+int build_graph_parse(BuildGraph *graph, const char *json, size_t length);
+int build_graph_load(BuildGraph *graph, const char *path);
+
+BuildDb* build_db_open(const char *root);
+void build_db_close(BuildDb *db);
+
+// Runs every out-of-date step, independent ones in parallel, and records
+// the new fingerprints. Returns STATUS_ERROR if any step failed.
+int build_run(BuildGraph *graph, const BuildOptions *options, BuildStats *stats);
+// Same, against a database that stays in memory between runs; *db is
+// replaced with this run's records (and also written to disk).
+int build_run_with_db(BuildGraph *graph, const BuildOptions *options, BuildDb **db, BuildStats *stats);
+
+#endif
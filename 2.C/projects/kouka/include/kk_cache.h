@@ -0,0 +1,98 @@
+#ifndef KK_CACHE_H
+#define KK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+// Content-addressed cache of model answers, keyed by XXH64 of
+// (model, prompt, options). Lookups hit an in-memory LRU first, then an
+// optional append-only store that is mmap'd from disk, so answers survive
+// across kk runs.
+//
+// Store layout: a CacheFileHeader followed by CacheRecords, each followed by
+// its value padded to 8 bytes. Replaced records are flagged dead and dropped
+// when the store is compacted on reaching max_disk_bytes.
+//
+// Several kk processes may share one store: writers hold flock(LOCK_EX) and
+// readers LOCK_SH, and each catches its index up with the file under the
+// lock before trusting an offset.
+
+#define RESPONSE_CACHE_MAGIC "KKCACHE2"
+
+typedef struct ResponseCacheConfig {
+    size_t max_entries;     // in-memory LRU, 0 = 1024
+    size_t max_bytes;       // in-memory value bytes, 0 = 64 MB
+    long ttl_seconds;       // 0 = entries never expire
+    const char *disk_path;  // NULL = memory only
+    size_t max_disk_bytes;  // 0 = 256 MB
+} ResponseCacheConfig;
+
+typedef struct ResponseCacheStats {
+    unsigned long hits;       // served from memory
+    unsigned long disk_hits;  // served from the mmap'd store
+    unsigned long misses;
+    unsigned long stores;
+    unsigned long evictions;
+    unsigned long expirations;
+    size_t entries;
+    size_t bytes;
+    size_t disk_bytes;
+} ResponseCacheStats;
+
+typedef struct CacheEntry {
+    uint64_t key;
+    time_t created;
+    char *value;
+    size_t length;
+    struct CacheEntry *lru_prev;  // toward most recently used
+    struct CacheEntry *lru_next;
+    struct CacheEntry *bucket_next;
+} CacheEntry;
+
+typedef struct CacheFileHeader {
+    char magic[8];
+    uint64_t used;        // bytes of header + records in use
+    uint64_t generation;  // bumped by every compaction, which moves records
+} CacheFileHeader;
+
+typedef struct CacheRecord {
+    uint64_t key;
+    int64_t created;
+    uint32_t length;
+    uint32_t dead;
+} CacheRecord;
+
+typedef struct ResponseCache {
+    ResponseCacheConfig config;
+    CacheEntry **buckets;
+    size_t bucket_count;
+    CacheEntry *lru_head;
+    CacheEntry *lru_tail;
+    size_t entry_count;
+    size_t bytes;
+    int disk_fd;
+    unsigned char *disk_map;
+    size_t disk_capacity;
+    uint64_t *disk_keys;  // open-addressed index: key -> record offset
+    uint64_t *disk_offsets;
+    size_t disk_slots;
+    size_t disk_count;
+    uint64_t disk_indexed;     // store bytes the index covers
+    uint64_t disk_generation;  // header generation the index was built from
+    ResponseCacheStats stats;
+    time_t (*now)(void);  // clock, replaceable for tests
+    pthread_mutex_t lock;
+} ResponseCache;
+
+uint64_t response_cache_key(const char *model, const char *prompt, const char *options);
+
+ResponseCache* response_cache_create(const ResponseCacheConfig *config);
+void response_cache_destroy(ResponseCache *cache);
+// Returns a malloc'd NUL-terminated copy of the cached answer, or NULL.
+char* response_cache_get(ResponseCache *cache, uint64_t key, size_t *length);
+int response_cache_put(ResponseCache *cache, uint64_t key, const char *value, size_t length);
+void response_cache_stats(ResponseCache *cache, ResponseCacheStats *stats);
+
+#endif
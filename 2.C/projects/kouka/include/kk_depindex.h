@@ -0,0 +1,126 @@
+#ifndef KK_DEPINDEX_H
+#define KK_DEPINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Local artifact index for the Dependency Agent, so dependencies.json can be
+// resolved without asking Maven Central. dep_index_build scans a directory of
+// POMs (a ~/.m2 repository or a mirror) once and writes a single file that
+// dep_index_open maps read-only:
+//
+//   DepIndexHeader
+//   DepArtifact[artifact_count]   sorted by "groupId:artifactId"
+//   DepVersion[version_count + 1] grouped by artifact, oldest first
+//   DepEdge[edge_count]           dependencies of version v are
+//                                 edges[versions[v].first_edge ..
+//                                       versions[v + 1].first_edge)
+//   strings
+//
+// Dependency versions are resolved to version indices at build time, so
+// walking the graph never touches a string.
+
+#define DEP_INDEX_MAGIC "KKDEPIX1"
+
+typedef enum {
+    DEP_SCOPE_COMPILE = 0,
+    DEP_SCOPE_RUNTIME,
+    DEP_SCOPE_PROVIDED,
+    DEP_SCOPE_TEST,
+    DEP_SCOPE_SYSTEM,
+    DEP_SCOPE_IMPORT,
+} DepScope;
+
+#define DEP_EDGE_OPTIONAL 0x100u
+
+typedef struct DepIndexHeader {
+    char magic[8];
+    uint32_t artifact_count;
+    uint32_t version_count;
+    uint32_t edge_count;
+    uint32_t reserved;
+    uint64_t artifacts_offset;
+    uint64_t versions_offset;
+    uint64_t edges_offset;
+    uint64_t strings_offset;
+    uint64_t strings_length;
+} DepIndexHeader;
+
+typedef struct DepArtifact {
+    uint32_t key;  // "groupId:artifactId", offset into strings
+    uint32_t key_length;
+    uint32_t first_version;
+    uint32_t version_count;
+} DepArtifact;
+
+typedef struct DepVersion {
+    uint32_t artifact;
+    uint32_t version;  // offset into strings
+    uint32_t version_length;
+    uint32_t first_edge;
+} DepVersion;
+
+typedef struct DepEdge {
+    uint32_t target;  // version index
+    uint32_t flags;   // DepScope | DEP_EDGE_OPTIONAL
+} DepEdge;
+
+typedef struct DepIndex {
+    unsigned char *map;
+    size_t map_size;
+    const DepIndexHeader *header;
+    const DepArtifact *artifacts;
+    const DepVersion *versions;
+    const DepEdge *edges;
+    const char *strings;
+} DepIndex;
+
+typedef struct DepIndexBuildStats {
+    size_t poms;
+    size_t skipped;     // unreadable, or no coordinates
+    size_t artifacts;
+    size_t versions;
+    size_t edges;
+    size_t unresolved;  // dependencies on artifacts not in the directory
+} DepIndexBuildStats;
+
+// Maven's "nearest wins": a breadth-first walk where the first version of
+// an artifact reached is the one used. Scratch space is sized for the index
+// once, so resolving allocates nothing.
+typedef struct DepResolver {
+    const DepIndex *index;
+    uint32_t *seen;  // per artifact, == generation once chosen
+    uint32_t generation;
+    uint32_t *versions;  // the result, in the order found
+    size_t count;
+    size_t missing;  // roots not in the index
+} DepResolver;
+
+// Recurses into pom_dir for *.pom and pom.xml files. Versions missing from
+// a dependency, version ranges and versions not in the directory resolve
+// to the newest version present.
+int dep_index_build(const char *pom_dir, const char *index_path, DepIndexBuildStats *stats);
+
+DepIndex* dep_index_open(const char *path);
+void dep_index_close(DepIndex *index);
+// Artifact index for "groupId:artifactId", or -1.
+long dep_index_find(const DepIndex *index, const char *key, size_t length);
+// Version index of artifact at version, or its newest version when version
+// is NULL, empty or unknown.
+uint32_t dep_index_version(const DepIndex *index, uint32_t artifact, const char *version);
+int dep_version_compare(const char *a, size_t a_length, const char *b, size_t b_length);
+// Writes "groupId:artifactId:version" into buffer (truncating) and returns it.
+const char* dep_index_coordinates(const DepIndex *index, uint32_t version, char *buffer, size_t size);
+
+int dep_resolver_init(DepResolver *resolver, const DepIndex *index);
+void dep_resolver_free(DepResolver *resolver);
+// Resolves the transitive closure of the given version indices. Roots are
+// always included; from there only compile and runtime dependencies that
+// aren't optional are followed.
+int dep_resolver_resolve(DepResolver *resolver, const uint32_t *roots, size_t root_count);
+// Same, for a dependencies.json body:
+//   {"dependencies": [{"groupId": ..., "artifactId": ..., "version": ...},
+//                     "groupId:artifactId:version", ...]}
+int dep_resolver_resolve_json(DepResolver *resolver, const char *json, size_t length);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef KK_FILEGEN_H
+#define KK_FILEGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The "File Generator -> Project Directory" stage. A ProjectPlan lists every
+// directory and file of a scaffold. file_generator_write creates the
+// directories parents-first, then writes files from a thread pool. On Linux
+// each worker batches open/write/close through its own io_uring; elsewhere,
+// or when io_uring is unavailable, it uses open/pwrite/close.
+//
+// Paths are relative to the project root and come from the model, so any
+// absolute path or "."/".." component is rejected.
+
+typedef struct PlanEntry {
+    char *path;
+    const char *content;  // files only; not owned, must outlive the write
+    size_t length;
+    int is_dir;
+} PlanEntry;
+
+typedef struct ProjectPlan {
+    PlanEntry *entries;  // a directory always comes before anything inside it
+    size_t count;
+    size_t capacity;
+    size_t dir_count;
+    size_t file_count;
+    uint64_t *dir_hashes;  // open-addressed set of every path, for dedup
+    size_t *dir_slots;     // entry index + 1, 0 = empty
+    size_t dir_slot_count;
+} ProjectPlan;
+
+typedef enum {
+    FILEGEN_BACKEND_AUTO = 0,
+    FILEGEN_BACKEND_IO_URING,
+    FILEGEN_BACKEND_PWRITE,
+} FileGenBackend;
+
+typedef struct FileGenOptions {
+    size_t threads;        // 0 = online CPUs
+    FileGenBackend backend;
+    unsigned queue_depth;  // io_uring entries per worker, 0 = 64
+} FileGenOptions;
+
+typedef struct FileGenStats {
+    size_t dirs;
+    size_t files;
+    size_t bytes;
+    FileGenBackend backend;  // what was actually used
+} FileGenStats;
+
+void project_plan_init(ProjectPlan *plan);
+void project_plan_free(ProjectPlan *plan);
+// Adds the directory and any missing parents; adding one twice is a no-op.
+int project_plan_add_dir(ProjectPlan *plan, const char *path);
+// Adds the file and any missing parent directories; adding one twice
+// replaces its content.
+int project_plan_add_file(ProjectPlan *plan, const char *path, const char *content, size_t length);
+
+// Creates root (and its parents) if needed, then the whole plan under it.
+// Existing files are truncated and rewritten.
+int file_generator_write(const ProjectPlan *plan, const char *root, const FileGenOptions *options,
+                         FileGenStats *stats);
+const char* file_generator_backend_name(FileGenBackend backend);
+
+#endif
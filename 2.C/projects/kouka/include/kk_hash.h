@@ -0,0 +1,23 @@
+#ifndef KK_HASH_H
+#define KK_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XXH64, bit-compatible with the reference xxHash implementation, so
+// digests can be compared against `xxh64sum` output.
+typedef struct Xxh64State {
+    uint64_t total_length;
+    uint64_t v[4];
+    unsigned char buffer[32];
+    size_t buffered;
+    uint64_t seed;
+} Xxh64State;
+
+uint64_t xxh64(const void *data, size_t length, uint64_t seed);
+
+void xxh64_init(Xxh64State *state, uint64_t seed);
+void xxh64_update(Xxh64State *state, const void *data, size_t length);
+uint64_t xxh64_digest(const Xxh64State *state);
+
+#endif
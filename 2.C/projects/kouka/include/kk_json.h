@@ -4,25 +4,43 @@
 #include <stddef.h>
 #include <stdio.h>
 
+// In zero-copy mode value may point straight into the chunk passed to
+// json_parse and is not NUL-terminated; it is only valid during the call.
 typedef void (*json_value_callback)(const char *value, size_t length, void *agent_response);
 
+// All parsing state lives in the JsonParser itself and json_parse touches no
+// globals, so independent parsers can run concurrently on different threads.
+// A single parser must only be fed by one thread at a time.
 typedef struct {
     int in_string;
     int escape_next;
+    int unicode_remaining;          // hex digits still expected after \u
+    unsigned int unicode_value;
+    unsigned int pending_high_surrogate;
     int depth;
     int array_depth;
     char current_key[1024];
     size_t key_pos;
     int is_parsing_key;
     int parsing_response_value;
-    char value_buffer[4096];
+    char *value_buffer;       // grows as needed, values are never truncated
+    size_t value_capacity;
     size_t value_pos;
+    int zero_copy;
+    const char *value_start;  // zero-copy slice of the current chunk, NULL once copied
     json_value_callback callback;
     int found_response;
     void *agent_response;
 } JsonParser;
 
 void json_parser_init(JsonParser *parser, json_value_callback callback, void *agent_response);
+// Values that start and end inside one chunk and contain no escapes are
+// handed to the callback as slices of the chunk instead of being copied.
+void json_parser_set_zero_copy(JsonParser *parser, int enabled);
 void json_parse(JsonParser *parser, const char *chunk, size_t length);
+void json_parser_free(JsonParser *parser);
+
+// Writes codepoint as UTF-8 into out and returns the byte count (1-4).
+size_t json_utf8_encode(unsigned int codepoint, char out[4]);
 
 #endif
\ No newline at end of file
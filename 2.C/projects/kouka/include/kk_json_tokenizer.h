@@ -0,0 +1,101 @@
+#ifndef KK_JSON_TOKENIZER_H
+#define KK_JSON_TOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// General SAX-style streaming JSON tokenizer. Input may be split anywhere
+// (inside strings, numbers, literals or \uXXXX escapes) and several
+// top-level values may follow each other, as in Ollama's NDJSON streams.
+// Callers subscribe to JSON paths and get a callback per matching token;
+// no DOM is built.
+//
+// Paths start at "$", object members append ".key" and array elements
+// append "[*]": "$.message.content", "$.eval_count", "$.context[*]",
+// "$.message.tool_calls[*].function.name". A container's own path gets its
+// _START and _END tokens.
+
+#define JSON_MAX_DEPTH         64
+#define JSON_PATH_MAX          512
+#define JSON_MAX_SUBSCRIPTIONS 32
+
+typedef enum {
+    JSON_TOKEN_NULL,
+    JSON_TOKEN_TRUE,
+    JSON_TOKEN_FALSE,
+    JSON_TOKEN_NUMBER,
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_OBJECT_START,
+    JSON_TOKEN_OBJECT_END,
+    JSON_TOKEN_ARRAY_START,
+    JSON_TOKEN_ARRAY_END,
+} JsonTokenType;
+
+// value is the decoded UTF-8 string or the raw number text, NUL-terminated,
+// and only valid during the callback. It is NULL for other token types.
+typedef struct JsonToken {
+    JsonTokenType type;
+    const char *value;
+    size_t length;
+    const char *path;
+    size_t path_length;
+    int depth;
+} JsonToken;
+
+typedef void (*json_token_callback)(const JsonToken *token, void *user_data);
+
+typedef struct JsonSubscription {
+    char *path;  // NULL matches every token
+    size_t path_length;
+    json_token_callback callback;
+    void *user_data;
+} JsonSubscription;
+
+typedef struct JsonFrame {
+    unsigned char is_array;
+    unsigned char state;
+    size_t path_length;  // length of the container's own path
+} JsonFrame;
+
+typedef struct JsonTokenizer {
+    JsonFrame frames[JSON_MAX_DEPTH];
+    int depth;
+    int lex_state;
+    int string_is_key;
+    const char *literal;  // "true", "false" or "null" while matching one
+    size_t literal_pos;
+    uint32_t unicode_value;
+    int unicode_digits;
+    uint32_t pending_high_surrogate;
+    char *text;  // current string/number, grows as needed
+    size_t text_length;
+    size_t text_capacity;
+    char path[JSON_PATH_MAX];
+    size_t path_length;
+    JsonSubscription subscriptions[JSON_MAX_SUBSCRIPTIONS];
+    size_t subscription_count;
+    size_t offset;  // total bytes consumed, for error reporting
+    const char *error;
+    size_t error_offset;
+} JsonTokenizer;
+
+void json_tokenizer_init(JsonTokenizer *tokenizer);
+void json_tokenizer_free(JsonTokenizer *tokenizer);
+// Subscribes to one path, or every token when path is NULL.
+int json_tokenizer_subscribe(JsonTokenizer *tokenizer, const char *path, json_token_callback callback,
+                             void *user_data);
+// Returns STATUS_ERROR on malformed input; the tokenizer then ignores further
+// input until json_tokenizer_reset. Subscriptions survive a reset.
+int json_tokenizer_feed(JsonTokenizer *tokenizer, const char *chunk, size_t length);
+// End of input. Emits a number still waiting for a delimiter (a final
+// NDJSON line without its newline, or a bare "42") and fails on a string,
+// literal or container left open. Fed input after success starts a new
+// top-level value, as if a newline had arrived.
+int json_tokenizer_finish(JsonTokenizer *tokenizer);
+void json_tokenizer_reset(JsonTokenizer *tokenizer);
+// True between top-level values, i.e. no document is half-parsed.
+int json_tokenizer_at_boundary(const JsonTokenizer *tokenizer);
+
+int json_token_to_int64(const JsonToken *token, long long *out);
+
+#endif
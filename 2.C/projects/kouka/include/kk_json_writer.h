@@ -0,0 +1,46 @@
+#ifndef KK_JSON_WRITER_H
+#define KK_JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming JSON serializer for request bodies. Commas are inserted
+// automatically and strings are escaped 64 bytes at a time with the scan
+// kernels from kk_scan.h. Output starts in optional caller storage (e.g. a
+// stack array, so typical bodies never touch the heap) and moves to a
+// growable heap buffer only when it outgrows it. Reset keeps the buffer for
+// reuse.
+
+#define JSON_WRITER_MAX_DEPTH 63
+
+typedef struct JsonWriter {
+    char *data;  // always NUL-terminated
+    size_t length;
+    size_t capacity;
+    int owns_data;  // 0 while data is the caller's storage
+    int depth;
+    uint64_t has_members;  // bit per depth: a comma precedes the next member
+    int after_key;
+    int failed;  // out of memory or nesting too deep; output is incomplete
+} JsonWriter;
+
+void json_writer_init(JsonWriter *writer, char *storage, size_t capacity);
+void json_writer_reset(JsonWriter *writer);
+void json_writer_free(JsonWriter *writer);
+// Makes room for at least `additional` more bytes up front.
+int json_writer_reserve(JsonWriter *writer, size_t additional);
+
+void json_writer_begin_object(JsonWriter *writer);
+void json_writer_end_object(JsonWriter *writer);
+void json_writer_begin_array(JsonWriter *writer);
+void json_writer_end_array(JsonWriter *writer);
+void json_writer_key(JsonWriter *writer, const char *key);
+void json_writer_string(JsonWriter *writer, const char *value, size_t length);
+void json_writer_int(JsonWriter *writer, long long value);
+void json_writer_bool(JsonWriter *writer, int value);
+// Inserts already-serialized JSON as one value, e.g. an "options" object.
+void json_writer_raw(JsonWriter *writer, const char *json, size_t length);
+// STATUS_ERROR if anything was dropped.
+int json_writer_status(const JsonWriter *writer);
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef KK_METRICS_H
+#define KK_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "kk_json_tokenizer.h"
+
+// Latency metrics for model calls, grouped by model so runs against
+// different models can be compared.
+//
+// Histograms are HDR-style log-linear: values below 64 get a bucket each,
+// and every power of two above that is split into 32 buckets, so any
+// recorded value is reported within ~3% across 1 us .. 12 days.
+
+#define HISTOGRAM_SUB_BITS    5
+#define HISTOGRAM_SUB_COUNT   (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_SHIFT   34
+#define HISTOGRAM_BUCKETS     (2 * HISTOGRAM_SUB_COUNT + HISTOGRAM_MAX_SHIFT * HISTOGRAM_SUB_COUNT)
+#define METRICS_MODEL_NAME    64
+
+typedef struct LatencyHistogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} LatencyHistogram;
+
+typedef enum {
+    METRIC_DNS,          // curl name lookup
+    METRIC_CONNECT,      // TCP connect (0 on a reused connection)
+    METRIC_TTFB,         // first response byte
+    METRIC_TTFT,         // first parsed token
+    METRIC_INTER_TOKEN,  // gap between consecutive tokens
+    METRIC_TOTAL,
+    METRIC_COUNT
+} MetricKind;
+
+// Everything is in microseconds except eval_rate, in tokens per second as
+// reported by Ollama's eval_count / eval_duration.
+typedef struct ModelMetrics {
+    char model[METRICS_MODEL_NAME];
+    unsigned long requests;
+    unsigned long failures;
+    unsigned long tokens;
+    unsigned long long eval_count;
+    LatencyHistogram latency[METRIC_COUNT];
+    LatencyHistogram eval_rate;
+} ModelMetrics;
+
+typedef struct KkMetrics {
+    ModelMetrics *models;
+    size_t model_count;
+    size_t model_capacity;
+    pthread_mutex_t lock;
+} KkMetrics;
+
+// curl's transfer timings for one request, in microseconds from its start.
+typedef struct RequestTimings {
+    uint64_t dns_us;
+    uint64_t connect_us;
+    uint64_t ttfb_us;
+    uint64_t total_us;
+} RequestTimings;
+
+// Per-request state filled in while the response streams. Gaps go into a
+// private histogram and are merged once at the end, so the token path
+// takes no lock.
+typedef struct RequestTrace {
+    uint64_t start_ns;
+    uint64_t first_token_ns;
+    uint64_t last_token_ns;
+    unsigned long tokens;
+    long long eval_count;
+    long long eval_duration;
+    LatencyHistogram inter_token;
+    JsonTokenizer tokenizer;  // picks eval_count/eval_duration off the final record
+} RequestTrace;
+
+void histogram_reset(LatencyHistogram *histogram);
+void histogram_record(LatencyHistogram *histogram, uint64_t value);
+void histogram_merge(LatencyHistogram *into, const LatencyHistogram *from);
+// Smallest value v such that percentile% of recorded values are <= v,
+// rounded up to its bucket's upper bound.
+uint64_t histogram_percentile(const LatencyHistogram *histogram, double percentile);
+
+KkMetrics* metrics_create(void);
+void metrics_destroy(KkMetrics *metrics);
+void metrics_record(KkMetrics *metrics, const char *model, const RequestTrace *trace,
+                    const RequestTimings *timings, int succeeded);
+// Copies one model's metrics out under the lock; STATUS_ERROR if unknown.
+int metrics_snapshot(KkMetrics *metrics, const char *model, ModelMetrics *out);
+int metrics_write_json(KkMetrics *metrics, FILE *out);
+int metrics_write_prometheus(KkMetrics *metrics, FILE *out);
+
+uint64_t metrics_now_ns(void);
+void request_trace_begin(RequestTrace *trace);
+void request_trace_token(RequestTrace *trace);
+void request_trace_feed(RequestTrace *trace, const char *chunk, size_t length);
+void request_trace_free(RequestTrace *trace);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef KK_SCAN_H
+#define KK_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorized byte classification for the JSON parser, in the style of
+// simdjson's stage 1: a 64-byte block is classified at once into bitmasks
+// (bit i set = byte i is interesting), and the parser then jumps from set
+// bit to set bit instead of testing every byte. The widest instruction set
+// the CPU supports is picked at first use.
+
+#define SCAN_BLOCK_SIZE 64
+
+typedef enum {
+    SCAN_ISA_SCALAR = 0,
+    SCAN_ISA_SSE2,
+    SCAN_ISA_AVX2,
+} ScanIsa;
+
+typedef struct ScanMasks {
+    uint64_t string;      // '"' and '\\': the bytes that end a plain string run
+    uint64_t structural;  // '"' '{' '}' '[' ']' ':' ','
+} ScanMasks;
+
+// Classifies data[0 .. length), length <= SCAN_BLOCK_SIZE.
+void scan_block(const char *data, size_t length, ScanMasks *masks);
+// Writer side: bytes a JSON string must escape ('"', '\\' and controls
+// below 0x20) in data[0 .. length), length <= SCAN_BLOCK_SIZE.
+uint64_t scan_escape_block(const char *data, size_t length);
+
+ScanIsa scan_active_isa(void);
+// Forces a narrower implementation (benchmarks/tests). Requests for an ISA
+// the CPU lacks fall back to the best supported one; returns what is in use.
+ScanIsa scan_select_isa(ScanIsa isa);
+const char* scan_isa_name(ScanIsa isa);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef KK_TEMPLATE_H
+#define KK_TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// The "Configuration Agent -> Template Engine" stage. Scaffold templates
+// (pom.xml, application.yml, Java skeletons) use a small mustache subset:
+//
+//   {{name}}                  substitute a value
+//   {{#name}}...{{/name}}     repeat once per row, or once if name is non-empty
+//   {{^name}}...{{/name}}     render only if name is empty or has no rows
+//   {{! comment }}
+//
+// A section tag alone on its line takes the whole line with it. Nothing is
+// escaped; the output is source code, not HTML.
+//
+// template_compile turns the source into a flat op list once, with every
+// name resolved to a slot. Rendering walks the ops and appends iovecs that
+// point into the template and the caller's values, so no output is copied
+// until it is written with writev.
+
+typedef enum {
+    TEMPLATE_OP_TEXT = 0,   // a = offset, b = length
+    TEMPLATE_OP_VAR,        // a = slot
+    TEMPLATE_OP_SECTION,    // a = slot, b = index of the matching END
+    TEMPLATE_OP_INVERTED,   // a = slot, b = index of the matching END
+    TEMPLATE_OP_END,
+} TemplateOpcode;
+
+typedef struct TemplateOp {
+    uint32_t opcode;
+    uint32_t a;
+    uint32_t b;
+} TemplateOp;
+
+typedef struct Template {
+    char *source;
+    size_t length;
+    TemplateOp *ops;
+    size_t op_count;
+    char **names;  // slot -> name
+    size_t var_count;
+    size_t max_depth;  // deepest section nesting
+} Template;
+
+// A slot's value. A section with rows repeats once per row; rows holds
+// row_count consecutive arrays of var_count values, and a name that is unset
+// in the row (data and rows both NULL) is looked up in the enclosing scope.
+typedef struct TemplateValue {
+    const char *data;
+    size_t length;
+    const struct TemplateValue *rows;
+    size_t row_count;
+} TemplateValue;
+
+// Scatter-gather output: iov entries point at template text and values.
+typedef struct TemplateOutput {
+    struct iovec *iov;
+    size_t count;
+    size_t capacity;
+    size_t bytes;
+} TemplateOutput;
+
+// Compiled templates keyed by XXH64 of their source.
+typedef struct TemplateCache {
+    uint64_t *keys;
+    Template **templates;
+    size_t slot_count;
+    size_t count;
+    pthread_mutex_t lock;
+} TemplateCache;
+
+// Returns NULL (and reports the line) on unbalanced or unterminated tags.
+Template* template_compile(const char *source, size_t length);
+void template_free(Template *tpl);
+// Slot for name, or -1 if the template doesn't use it.
+int template_var_index(const Template *tpl, const char *name);
+
+// values has var_count entries; unset slots render as empty.
+int template_render(const Template *tpl, const TemplateValue *values, TemplateOutput *out);
+
+void template_output_init(TemplateOutput *out);
+void template_output_reset(TemplateOutput *out);
+void template_output_free(TemplateOutput *out);
+// Writes everything with writev, IOV_MAX entries at a time, then resets.
+int template_output_write(TemplateOutput *out, int fd);
+// Returns the output as a malloc'd NUL-terminated string.
+char* template_output_join(const TemplateOutput *out);
+
+TemplateCache* template_cache_create(void);
+void template_cache_destroy(TemplateCache *cache);
+// Compiles source on first use. The template stays owned by the cache.
+const Template* template_cache_get(TemplateCache *cache, const char *source, size_t length);
+
+#endif
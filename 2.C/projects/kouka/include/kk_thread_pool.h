@@ -0,0 +1,35 @@
+#ifndef KK_THREAD_POOL_H
+#define KK_THREAD_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*thread_pool_task)(void *arg);
+
+typedef struct ThreadPoolJob {
+    thread_pool_task task;
+    void *arg;
+    struct ThreadPoolJob *next;
+} ThreadPoolJob;
+
+// Fixed-size pool of worker threads fed from a FIFO queue.
+typedef struct ThreadPool {
+    pthread_t *threads;
+    size_t thread_count;
+    ThreadPoolJob *head;
+    ThreadPoolJob *tail;
+    size_t pending;  // queued + running jobs
+    int shutting_down;
+    pthread_mutex_t lock;
+    pthread_cond_t job_available;
+    pthread_cond_t all_done;
+} ThreadPool;
+
+// thread_count == 0 uses the number of online CPUs.
+ThreadPool* thread_pool_create(size_t thread_count);
+int thread_pool_submit(ThreadPool *pool, thread_pool_task task, void *arg);
+// Blocks until every submitted job has finished.
+void thread_pool_wait(ThreadPool *pool);
+void thread_pool_destroy(ThreadPool *pool);
+
+#endif
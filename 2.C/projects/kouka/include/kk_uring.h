@@ -0,0 +1,55 @@
+#ifndef KK_URING_H
+#define KK_URING_H
+
+#include <stddef.h>
+
+// Minimal io_uring ring over the raw syscalls, so kk needs no liburing.
+// One thread owns a ring. Queue SQEs with uring_get_sqe, submit them with
+// uring_submit_and_wait, then drain completions with
+// uring_peek_cqe/uring_cqe_seen. uring_init fails (and callers fall back to
+// plain syscalls) when the kernel lacks io_uring, has it disabled, or the
+// build has no <linux/io_uring.h>.
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define KK_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef KK_HAVE_IO_URING
+struct io_uring_sqe;
+struct io_uring_cqe;
+#endif
+
+typedef struct Uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail;  // next SQE to hand out, published on submit
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Uring;
+
+int uring_init(Uring *ring, unsigned entries);
+void uring_free(Uring *ring);
+// Zeroed SQE, or NULL when the submission queue is full.
+struct io_uring_sqe* uring_get_sqe(Uring *ring);
+// Submits everything queued and waits for wait_nr completions.
+// Returns the number submitted or -errno.
+int uring_submit_and_wait(Uring *ring, unsigned wait_nr);
+struct io_uring_cqe* uring_peek_cqe(Uring *ring);
+void uring_cqe_seen(Uring *ring);
+
+#endif
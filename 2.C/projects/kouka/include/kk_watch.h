@@ -0,0 +1,45 @@
+#ifndef KK_WATCH_H
+#define KK_WATCH_H
+
+#include "kk_build.h"
+#include <stddef.h>
+
+#define WATCH_DEFAULT_DEBOUNCE_MS 20
+
+// The engine behind `kk watch`. Watches every directory under the project
+// root with inotify (dotfiles and dot-directories excluded) and keeps the
+// build graph and fingerprint database in memory, so each rebuild only
+// rescans the steps whose inputs or outputs were touched.
+typedef struct BuildWatcher {
+    char *root;
+    char *commands_path;
+    char *commands_name;   // commands_path relative to root, NULL if outside it
+    BuildOptions options;
+    BuildGraph graph;
+    BuildDb *db;
+    int fd;
+    char **dirs;           // indexed by watch descriptor, relative to root ("" = root)
+    size_t dir_capacity;
+    size_t watch_count;
+    char **changes;        // paths relative to root, sorted and unique after a wait
+    size_t change_count;
+    size_t change_capacity;
+    int overflowed;        // events were lost; the next rebuild rescans everything
+    int reload;            // commands.json itself changed
+    int built;             // a rebuild has run since init
+    int debounce_ms;
+} BuildWatcher;
+
+// options->root is the watched tree; debounce_ms == 0 uses the default.
+int build_watcher_init(BuildWatcher *watcher, const char *commands_path, const BuildOptions *options,
+                       int debounce_ms);
+// Blocks until something changes (or timeout_ms passes, -1 = forever), then
+// keeps collecting until debounce_ms go by without another event. Returns
+// the number of distinct changed paths, 0 on timeout.
+int build_watcher_wait(BuildWatcher *watcher, int timeout_ms);
+// Runs the steps affected by the changes collected so far. The first call
+// checks every step.
+int build_watcher_rebuild(BuildWatcher *watcher, BuildStats *stats);
+void build_watcher_free(BuildWatcher *watcher);
+
+#endif
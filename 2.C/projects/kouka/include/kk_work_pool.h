@@ -0,0 +1,50 @@
+#ifndef KK_WORK_POOL_H
+#define KK_WORK_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*work_pool_task)(void *arg);
+
+typedef struct WorkItem {
+    work_pool_task task;
+    void *arg;
+} WorkItem;
+
+// Ring buffer of items. The owning worker pushes and pops at the tail
+// (newest first, so it stays on what it just made ready); thieves take the
+// head (oldest first).
+typedef struct WorkDeque {
+    WorkItem *items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t lock;
+} WorkDeque;
+
+// Work-stealing pool for task graphs where running tasks submit the tasks
+// they unblock. Unlike ThreadPool's single FIFO, each worker has its own
+// deque and only touches another's when it runs dry.
+typedef struct WorkPool {
+    pthread_t *threads;
+    size_t thread_count;
+    WorkDeque *deques;
+    size_t next_deque;  // round robin for submits from outside the pool
+    size_t queued;      // items sitting in deques
+    size_t pending;     // queued + running items
+    unsigned long steals;
+    int shutting_down;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+} WorkPool;
+
+// thread_count == 0 uses the number of online CPUs.
+WorkPool* work_pool_create(size_t thread_count);
+// From a worker, goes to that worker's own deque.
+int work_pool_submit(WorkPool *pool, work_pool_task task, void *arg);
+// Blocks until every submitted task, and everything they submitted, is done.
+void work_pool_wait(WorkPool *pool);
+void work_pool_destroy(WorkPool *pool);
+
+#endif
@@ -4,18 +4,107 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <curl/curl.h>
+#include "kk_json.h"
+#include "kk_cache.h"
+#include "kk_metrics.h"
 
+#define OLLAMA_DEFAULT_URL       "http://localhost:11434"
+#define OLLAMA_DEFAULT_POOL_SIZE 4
+// Raw bytes kept by a streaming ResponseBuffer: enough for any one record
+#define RESPONSE_TAIL_LIMIT      (16 * 1024)
+
+typedef void (*ollama_token_callback)(const char *token, size_t length, void *user_data);
+
+// Two modes:
+// - retained (tail_limit == 0): data accumulates the whole raw HTTP body.
+// - streaming (tail_limit > 0): every chunk is parsed straight out of curl's
+//   buffer and released; data is a ring of at most tail_limit bytes holding
+//   only the trailing partial NDJSON record (read it with
+//   response_buffer_tail). With on_token set, tokens go to the callback
+//   instead of parsed_response, so memory stays constant however long the
+//   generation runs.
 typedef struct ResponseBuffer {
     char *data;
     size_t size;
     size_t parsed_offset;
     size_t allocated_size;
+    size_t tail_limit;
+    size_t tail_start;  // ring head in streaming mode
+    size_t bytes_received;
     char *parsed_response;
+    size_t parsed_length;
+    size_t parsed_capacity;
+    ollama_token_callback on_token;
+    void *token_user_data;
+    int keep_response;  // with on_token, also accumulate parsed_response
+    RequestTrace *trace;  // set while the client is measuring this response
+    JsonParser parser;  // per-response, so buffers can be parsed on any thread
 } ResponseBuffer;
 
+// A client owns a fixed pool of keep-alive easy handles plus a CURLSH that
+// shares DNS and the connection cache between them, so consecutive prompts
+// reuse the same TCP connection instead of opening a new one each time.
+typedef struct OllamaClient {
+    char *generate_url;
+    CURLSH *share;
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+    struct curl_slist *headers;
+    CURL **idle_handles;
+    size_t idle_count;
+    size_t pool_size;
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_available;
+    ResponseCache *cache;  // optional, not owned
+    KkMetrics *metrics;    // optional, not owned
+} OllamaClient;
+
+// One prompt of a batch. on_token is invoked on the batch thread for every
+// "response" fragment as soon as it arrives; status/curl_code/http_status are
+// filled in when the stream finishes.
+typedef struct OllamaRequest {
+    const char *model;
+    const char *prompt;
+    ollama_token_callback on_token;
+    void *user_data;
+    int status;
+    CURLcode curl_code;
+    long http_status;
+} OllamaRequest;
+
 size_t write_callback(void *contents, size_t size, size_t no_memb, void *user_data);
 int parse_ollama_response(ResponseBuffer *buffer);
+ResponseBuffer* response_buffer_create(void);
+ResponseBuffer* response_buffer_create_streaming(size_t tail_limit, ollama_token_callback on_token,
+                                                 void *user_data);
+// Copies the buffered partial record into out (NUL-terminated, truncated
+// to out_size - 1) and returns its full length.
+size_t response_buffer_tail(const ResponseBuffer *buffer, char *out, size_t out_size);
+void response_buffer_free(ResponseBuffer *buffer);
+
+OllamaClient* ollama_client_create(const char *base_url, size_t pool_size);
+void ollama_client_destroy(OllamaClient *client);
+// Answers for a (model, prompt) already in the cache are served without a
+// request; successful answers are stored. The cache must outlive the client.
+void ollama_client_set_cache(OllamaClient *client, ResponseCache *cache);
+// Records timings of every request sent (cache hits are not model calls and
+// are not recorded). The metrics must outlive the client.
+void ollama_client_set_metrics(OllamaClient *client, KkMetrics *metrics);
+// Returns the accumulated answer in parsed_response; the raw body is not kept.
+ResponseBuffer* ollama_client_generate(OllamaClient *client, const char *model, const char *prompt);
+// Constant-memory variant: tokens are only handed to on_token.
+int ollama_client_generate_stream(OllamaClient *client, const char *model, const char *prompt,
+                                  ollama_token_callback on_token, void *user_data);
+// Drives all requests concurrently on the calling thread through one
+// curl_multi event loop, so the batch takes as long as its slowest stream.
+// Returns STATUS_SUCCESS only if every request succeeded.
+int ollama_client_generate_batch(OllamaClient *client, OllamaRequest *requests, size_t count);
+
+// Sends through the client given to call_ollama_set_client, so every call
+// shares its pool, connections and cache. NULL if none was set.
 ResponseBuffer* call_ollama(const char *model, const char *prompt);
+// The client main creates once; not owned, must outlive the calls.
+void call_ollama_set_client(OllamaClient *client);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,756 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_build.h"
+#include "kk_hash.h"
+#include "kk_json_tokenizer.h"
+#include "kk_work_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <glob.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define PATH_BUFFER  4096
+#define HASH_CHUNK   (64 * 1024)
+// File timestamps come from a coarse clock, so a file written in the same
+// tick as it was hashed can change again without its mtime moving. Records
+// this close to the start of the run are stored so they never match.
+#define RACY_WINDOW_NS 100000000ll
+
+// Graph
+
+void build_graph_init(BuildGraph *graph) {
+    memset(graph, 0, sizeof(BuildGraph));
+}
+
+static void free_strings(char **strings, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+}
+
+void build_graph_free(BuildGraph *graph) {
+    for (size_t i = 0; i < graph->count; i++) {
+        BuildStep *step = &graph->steps[i];
+        free(step->name);
+        free(step->command);
+        free_strings(step->inputs, step->input_count);
+        free_strings(step->outputs, step->output_count);
+        free_strings(step->dep_names, step->dep_count);
+        free(step->deps);
+        free(step->dependents);
+        free(step->files);
+    }
+    free(graph->steps);
+    memset(graph, 0, sizeof(BuildGraph));
+}
+
+typedef struct GraphParse {
+    BuildGraph *graph;
+    int failed;
+    const char *error;
+} GraphParse;
+
+static int append_string(char ***list, size_t *count, const char *value, size_t length) {
+    char **grown = realloc(*list, (*count + 1) * sizeof(char *));
+    if (!grown) return STATUS_ERROR;
+    *list = grown;
+    grown[*count] = strndup(value, length);
+    if (!grown[*count]) return STATUS_ERROR;
+    (*count)++;
+    return STATUS_SUCCESS;
+}
+
+static int path_equals(const JsonToken *token, const char *path) {
+    return token->path_length == strlen(path) && memcmp(token->path, path, token->path_length) == 0;
+}
+
+static void on_graph_token(const JsonToken *token, void *user_data) {
+    GraphParse *parse = user_data;
+    BuildGraph *graph = parse->graph;
+    if (parse->failed) return;
+    if (path_equals(token, "$.steps[*]")) {
+        if (token->type == JSON_TOKEN_OBJECT_START) {
+            if (graph->count == graph->capacity) {
+                size_t capacity = graph->capacity ? graph->capacity * 2 : 16;
+                BuildStep *steps = realloc(graph->steps, capacity * sizeof(BuildStep));
+                if (!steps) {
+                    parse->failed = 1;
+                    return;
+                }
+                graph->steps = steps;
+                graph->capacity = capacity;
+            }
+            memset(&graph->steps[graph->count++], 0, sizeof(BuildStep));
+        } else if (token->type == JSON_TOKEN_OBJECT_END) {
+            BuildStep *step = &graph->steps[graph->count - 1];
+            if (!step->name || !step->command) {
+                parse->error = "every step needs a name and a command";
+                parse->failed = 1;
+            }
+        } else {
+            parse->error = "steps must be objects";
+            parse->failed = 1;
+        }
+        return;
+    }
+    if (token->type != JSON_TOKEN_STRING || graph->count == 0) return;
+    BuildStep *step = &graph->steps[graph->count - 1];
+    int status = STATUS_SUCCESS;
+    if (path_equals(token, "$.steps[*].name") && !step->name) {
+        step->name = strndup(token->value, token->length);
+        status = step->name ? STATUS_SUCCESS : STATUS_ERROR;
+    } else if (path_equals(token, "$.steps[*].command") && !step->command) {
+        step->command = strndup(token->value, token->length);
+        status = step->command ? STATUS_SUCCESS : STATUS_ERROR;
+    } else if (path_equals(token, "$.steps[*].inputs[*]")) {
+        status = append_string(&step->inputs, &step->input_count, token->value, token->length);
+    } else if (path_equals(token, "$.steps[*].outputs[*]")) {
+        status = append_string(&step->outputs, &step->output_count, token->value, token->length);
+    } else if (path_equals(token, "$.steps[*].deps[*]")) {
+        status = append_string(&step->dep_names, &step->dep_count, token->value, token->length);
+    }
+    if (status != STATUS_SUCCESS) {
+        parse->failed = 1;
+    }
+}
+
+static long find_step(const BuildGraph *graph, const char *name) {
+    for (size_t i = 0; i < graph->count; i++) {
+        if (strcmp(graph->steps[i].name, name) == 0) return (long)i;
+    }
+    return -1;
+}
+
+// Resolves dep names and checks for cycles with Kahn's algorithm.
+static int link_graph(BuildGraph *graph) {
+    for (size_t i = 0; i < graph->count; i++) {
+        BuildStep *step = &graph->steps[i];
+        if (find_step(graph, step->name) != (long)i) {
+            fprintf(stderr, "commands.json: step \"%s\" is defined twice\n", step->name);
+            return STATUS_ERROR;
+        }
+        step->deps = calloc(step->dep_count ? step->dep_count : 1, sizeof(uint32_t));
+        if (!step->deps) {
+            fprintf(stderr, "Failed to allocate build graph\n");
+            return STATUS_ERROR;
+        }
+        for (size_t d = 0; d < step->dep_count; d++) {
+            long dep = find_step(graph, step->dep_names[d]);
+            if (dep < 0) {
+                fprintf(stderr, "commands.json: step \"%s\" depends on unknown step \"%s\"\n", step->name,
+                        step->dep_names[d]);
+                return STATUS_ERROR;
+            }
+            step->deps[d] = (uint32_t)dep;
+            BuildStep *target = &graph->steps[dep];
+            uint32_t *dependents = realloc(target->dependents, (target->dependent_count + 1) * sizeof(uint32_t));
+            if (!dependents) {
+                fprintf(stderr, "Failed to allocate build graph\n");
+                return STATUS_ERROR;
+            }
+            target->dependents = dependents;
+            target->dependents[target->dependent_count++] = (uint32_t)i;
+        }
+    }
+
+    uint32_t *ready = malloc((graph->count ? graph->count : 1) * sizeof(uint32_t));
+    if (!ready) {
+        fprintf(stderr, "Failed to allocate build graph\n");
+        return STATUS_ERROR;
+    }
+    size_t ready_count = 0, visited = 0;
+    for (size_t i = 0; i < graph->count; i++) {
+        graph->steps[i].remaining = (int)graph->steps[i].dep_count;
+        if (graph->steps[i].remaining == 0) ready[ready_count++] = (uint32_t)i;
+    }
+    while (visited < ready_count) {
+        BuildStep *step = &graph->steps[ready[visited++]];
+        for (size_t d = 0; d < step->dependent_count; d++) {
+            if (--graph->steps[step->dependents[d]].remaining == 0) {
+                ready[ready_count++] = step->dependents[d];
+            }
+        }
+    }
+    free(ready);
+    if (visited != graph->count) {
+        fprintf(stderr, "commands.json: steps depend on each other in a cycle\n");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int build_graph_parse(BuildGraph *graph, const char *json, size_t length) {
+    GraphParse parse = {.graph = graph};
+    JsonTokenizer tokenizer;
+    json_tokenizer_init(&tokenizer);
+    int status = json_tokenizer_subscribe(&tokenizer, NULL, on_graph_token, &parse);
+    if (status == STATUS_SUCCESS) {
+        status = json_tokenizer_feed(&tokenizer, json, length);
+    }
+    if (status == STATUS_SUCCESS && !json_tokenizer_at_boundary(&tokenizer)) {
+        fprintf(stderr, "commands.json: truncated\n");
+        status = STATUS_ERROR;
+    }
+    json_tokenizer_free(&tokenizer);
+    if (parse.failed) {
+        fprintf(stderr, "commands.json: %s\n", parse.error ? parse.error : "out of memory");
+        status = STATUS_ERROR;
+    }
+    if (status == STATUS_SUCCESS) {
+        status = link_graph(graph);
+    }
+    return status;
+}
+
+int build_graph_load(BuildGraph *graph, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return STATUS_ERROR;
+    }
+    char *json = NULL;
+    size_t length = 0, capacity = 0;
+    int status = STATUS_SUCCESS;
+    for (;;) {
+        if (length == capacity) {
+            capacity = capacity ? capacity * 2 : 16384;
+            char *grown = realloc(json, capacity);
+            if (!grown) {
+                fprintf(stderr, "Failed to allocate %s\n", path);
+                status = STATUS_ERROR;
+                break;
+            }
+            json = grown;
+        }
+        size_t n = fread(json + length, 1, capacity - length, file);
+        if (n == 0) break;
+        length += n;
+    }
+    if (ferror(file)) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        status = STATUS_ERROR;
+    }
+    fclose(file);
+    if (status == STATUS_SUCCESS) {
+        status = build_graph_parse(graph, json, length);
+    }
+    free(json);
+    return status;
+}
+
+// Fingerprint database
+
+struct BuildDb {
+    BuildFileRecord *files;
+    size_t file_count;
+    BuildStepRecord *steps;
+    size_t step_count;
+    uint32_t *file_slots;  // open-addressed by path_hash, index + 1
+    size_t file_slot_count;
+    uint32_t *step_slots;  // open-addressed by name_hash, index + 1
+    size_t step_slot_count;
+};
+
+static size_t slots_for(size_t count) {
+    size_t slots = 16;
+    while (slots < count * 2) slots *= 2;
+    return slots;
+}
+
+static uint32_t* index_records(const void *records, size_t size, size_t count, size_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t hash;
+        memcpy(&hash, (const char *)records + i * size, sizeof(hash));
+        size_t slot = (size_t)hash & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = (uint32_t)(i + 1);
+    }
+    return slots;
+}
+
+// Takes ownership of files and steps. Returns NULL (and frees them) when
+// the index can't be allocated.
+static BuildDb* build_db_wrap(BuildFileRecord *files, size_t file_count, BuildStepRecord *steps,
+                              size_t step_count) {
+    BuildDb *db = calloc(1, sizeof(BuildDb));
+    if (db) {
+        db->files = files;
+        db->file_count = file_count;
+        db->steps = steps;
+        db->step_count = step_count;
+        db->file_slot_count = slots_for(file_count);
+        db->step_slot_count = slots_for(step_count);
+        db->file_slots = index_records(files, sizeof(BuildFileRecord), file_count, db->file_slot_count);
+        db->step_slots = index_records(steps, sizeof(BuildStepRecord), step_count, db->step_slot_count);
+    }
+    if (!db || !db->file_slots || !db->step_slots) {
+        fprintf(stderr, "Failed to allocate build database\n");
+        build_db_close(db);
+        if (!db) {
+            free(files);
+            free(steps);
+        }
+        return NULL;
+    }
+    return db;
+}
+
+// A missing or unreadable database just means everything is rebuilt.
+BuildDb* build_db_open(const char *root) {
+    char path[PATH_BUFFER];
+    snprintf(path, sizeof(path), "%s/%s", root ? root : ".", BUILD_DB_PATH);
+    FILE *file = fopen(path, "rb");
+    BuildDbHeader header = {.file_count = 0, .step_count = 0};
+    BuildFileRecord *files = NULL;
+    BuildStepRecord *steps = NULL;
+    if (file) {
+        int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, BUILD_DB_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.file_count < (1ull << 32) && header.step_count < (1ull << 32);
+        if (ok) {
+            files = malloc((header.file_count ? header.file_count : 1) * sizeof(BuildFileRecord));
+            steps = malloc((header.step_count ? header.step_count : 1) * sizeof(BuildStepRecord));
+            ok = files && steps &&
+                 fread(files, sizeof(BuildFileRecord), header.file_count, file) == header.file_count &&
+                 fread(steps, sizeof(BuildStepRecord), header.step_count, file) == header.step_count;
+        }
+        fclose(file);
+        if (!ok) {
+            fprintf(stderr, "Ignoring unreadable build database %s\n", path);
+            header.file_count = header.step_count = 0;
+        }
+    }
+    return build_db_wrap(files, header.file_count, steps, header.step_count);
+}
+
+void build_db_close(BuildDb *db) {
+    if (!db) return;
+    free(db->files);
+    free(db->steps);
+    free(db->file_slots);
+    free(db->step_slots);
+    free(db);
+}
+
+static const BuildFileRecord* build_db_file(const BuildDb *db, uint64_t path_hash) {
+    size_t mask = db->file_slot_count - 1;
+    for (size_t slot = (size_t)path_hash & mask; db->file_slots[slot]; slot = (slot + 1) & mask) {
+        const BuildFileRecord *record = &db->files[db->file_slots[slot] - 1];
+        if (record->path_hash == path_hash) return record;
+    }
+    return NULL;
+}
+
+static const BuildStepRecord* build_db_step(const BuildDb *db, uint64_t name_hash) {
+    size_t mask = db->step_slot_count - 1;
+    for (size_t slot = (size_t)name_hash & mask; db->step_slots[slot]; slot = (slot + 1) & mask) {
+        const BuildStepRecord *record = &db->steps[db->step_slots[slot] - 1];
+        if (record->name_hash == name_hash) return record;
+    }
+    return NULL;
+}
+
+// Keeps this run's file records (once each) and the fingerprints of steps
+// that are now up to date. Steps skipped because of a failure keep their
+// previous fingerprint.
+static BuildDb* build_db_collect(const BuildDb *old, const BuildGraph *graph) {
+    size_t total = 0;
+    for (size_t i = 0; i < graph->count; i++) {
+        total += graph->steps[i].file_count;
+    }
+    size_t slot_count = slots_for(total);
+    uint64_t *seen = calloc(slot_count, sizeof(uint64_t));
+    BuildFileRecord *files = malloc((total ? total : 1) * sizeof(BuildFileRecord));
+    BuildStepRecord *steps = malloc((graph->count ? graph->count : 1) * sizeof(BuildStepRecord));
+    if (!seen || !files || !steps) {
+        fprintf(stderr, "Failed to allocate build database\n");
+        free(seen);
+        free(files);
+        free(steps);
+        return NULL;
+    }
+    size_t file_count = 0, step_count = 0;
+    for (size_t i = 0; i < graph->count; i++) {
+        const BuildStep *step = &graph->steps[i];
+        for (size_t f = 0; f < step->file_count; f++) {
+            // path_hash 0 marks an empty slot, so that one hash is never deduplicated
+            uint64_t hash = step->files[f].path_hash;
+            size_t slot = (size_t)hash & (slot_count - 1);
+            while (seen[slot] && seen[slot] != hash) slot = (slot + 1) & (slot_count - 1);
+            if (seen[slot] == hash && hash != 0) continue;
+            seen[slot] = hash;
+            files[file_count++] = step->files[f];
+        }
+        uint64_t name_hash = xxh64(step->name, strlen(step->name), 0);
+        if (step->state == BUILD_STEP_UP_TO_DATE || step->state == BUILD_STEP_EXECUTED) {
+            steps[step_count++] = (BuildStepRecord){.name_hash = name_hash, .fingerprint = step->fingerprint};
+        } else if (step->state == BUILD_STEP_SKIPPED) {
+            const BuildStepRecord *previous = build_db_step(old, name_hash);
+            if (previous) steps[step_count++] = *previous;
+        }
+    }
+    free(seen);
+    return build_db_wrap(files, file_count, steps, step_count);
+}
+
+static int write_records(FILE *file, const void *records, size_t size, size_t count) {
+    return count == 0 || fwrite(records, size, count, file) == count ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+static int build_db_save(const BuildDb *db, const char *root) {
+    char dir[PATH_BUFFER], path[PATH_BUFFER], tmp[PATH_BUFFER + 8];
+    snprintf(dir, sizeof(dir), "%s/.kouka", root);
+    snprintf(path, sizeof(path), "%s/%s", root, BUILD_DB_PATH);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create %s: %s\n", dir, strerror(errno));
+        return STATUS_ERROR;
+    }
+    BuildDbHeader header = {.file_count = db->file_count, .step_count = db->step_count};
+    memcpy(header.magic, BUILD_DB_MAGIC, sizeof(header.magic));
+    FILE *file = fopen(tmp, "wb");
+    int status = file ? STATUS_SUCCESS : STATUS_ERROR;
+    if (status == STATUS_SUCCESS) {
+        if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+            write_records(file, db->files, sizeof(BuildFileRecord), db->file_count) != STATUS_SUCCESS ||
+            write_records(file, db->steps, sizeof(BuildStepRecord), db->step_count) != STATUS_SUCCESS) {
+            status = STATUS_ERROR;
+        }
+        if (fclose(file) != 0) status = STATUS_ERROR;
+    }
+    if (status != STATUS_SUCCESS || rename(tmp, path) < 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        status = STATUS_ERROR;
+    }
+    return status;
+}
+
+// Steps
+
+typedef struct StepTask StepTask;
+
+typedef struct BuildRun {
+    BuildGraph *graph;
+    StepTask *tasks;  // one per step
+    const BuildDb *db;
+    const char *root;
+    int64_t started_ns;
+    WorkPool *pool;
+    int quiet;
+    pthread_mutex_t output_lock;
+} BuildRun;
+
+typedef struct InputScan {
+    BuildRun *run;
+    BuildStep *step;
+    uint64_t mix;  // order-independent sum over (path, content) hashes
+    uint64_t count;
+    int failed;
+} InputScan;
+
+static int hash_file(const char *path, uint64_t *hash) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return STATUS_ERROR;
+    char *buffer = malloc(HASH_CHUNK);
+    Xxh64State state;
+    xxh64_init(&state, 0);
+    ssize_t n = 0;
+    while (buffer && (n = read(fd, buffer, HASH_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        xxh64_update(&state, buffer, (size_t)n);
+    }
+    close(fd);
+    free(buffer);
+    if (!buffer || n < 0) return STATUS_ERROR;
+    *hash = xxh64_digest(&state);
+    return STATUS_SUCCESS;
+}
+
+static void mix_input(InputScan *scan, uint64_t path_hash, uint64_t content_hash) {
+    uint64_t pair[2] = {path_hash, content_hash};
+    scan->mix += xxh64(pair, sizeof(pair), 0);
+    scan->count++;
+}
+
+static void scan_file(InputScan *scan, const char *path, const struct stat *st) {
+    BuildStep *step = scan->step;
+    BuildFileRecord record = {
+        .path_hash = xxh64(path, strlen(path), 0),
+        .mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec,
+        .size = (uint64_t)st->st_size,
+        .inode = (uint64_t)st->st_ino,
+    };
+    const BuildFileRecord *known = build_db_file(scan->run->db, record.path_hash);
+    if (known && known->mtime_ns == record.mtime_ns && known->size == record.size && known->inode == record.inode) {
+        record.content_hash = known->content_hash;
+    } else if (hash_file(path, &record.content_hash) == STATUS_SUCCESS) {
+        step->files_hashed++;
+    } else {
+        fprintf(stderr, "Failed to read %s: %s\n", path, strerror(errno));
+        scan->failed = 1;
+        return;
+    }
+    if (step->file_count == step->file_capacity) {
+        size_t capacity = step->file_capacity ? step->file_capacity * 2 : 64;
+        BuildFileRecord *files = realloc(step->files, capacity * sizeof(BuildFileRecord));
+        if (!files) {
+            fprintf(stderr, "Failed to allocate build inputs\n");
+            scan->failed = 1;
+            return;
+        }
+        step->files = files;
+        step->file_capacity = capacity;
+    }
+    if (record.mtime_ns >= scan->run->started_ns - RACY_WINDOW_NS) {
+        record.inode = UINT64_MAX;
+    }
+    step->files[step->file_count++] = record;
+    mix_input(scan, record.path_hash, record.content_hash);
+}
+
+// Dotfiles and dot-directories (.git, .kouka) are not inputs.
+static void scan_path(InputScan *scan, const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        // A missing input still counts, so creating it triggers a rebuild
+        mix_input(scan, xxh64(path, strlen(path), 0), 0);
+        return;
+    }
+    if (S_ISREG(st.st_mode)) {
+        scan_file(scan, path, &st);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        scan->failed = 1;
+        return;
+    }
+    struct dirent *entry;
+    char child[PATH_BUFFER];
+    while (!scan->failed && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child)) continue;
+        if (entry->d_type == DT_REG) {
+            struct stat child_st;
+            if (stat(child, &child_st) == 0) scan_file(scan, child, &child_st);
+        } else {
+            scan_path(scan, child);
+        }
+    }
+    closedir(dir);
+}
+
+static int compute_fingerprint(BuildRun *run, BuildStep *step) {
+    InputScan scan = {.run = run, .step = step};
+    char path[PATH_BUFFER];
+    step->file_count = 0;
+    for (size_t i = 0; i < step->input_count && !scan.failed; i++) {
+        snprintf(path, sizeof(path), "%s/%s", run->root, step->inputs[i]);
+        if (strpbrk(step->inputs[i], "*?[")) {
+            glob_t matches;
+            if (glob(path, 0, NULL, &matches) == 0) {
+                for (size_t m = 0; m < matches.gl_pathc; m++) {
+                    scan_path(&scan, matches.gl_pathv[m]);
+                }
+            }
+            globfree(&matches);
+        } else {
+            scan_path(&scan, path);
+        }
+    }
+    if (scan.failed) return STATUS_ERROR;
+    Xxh64State state;
+    xxh64_init(&state, 0);
+    xxh64_update(&state, step->command, strlen(step->command) + 1);
+    xxh64_update(&state, &scan.mix, sizeof(scan.mix));
+    xxh64_update(&state, &scan.count, sizeof(scan.count));
+    for (size_t d = 0; d < step->dep_count; d++) {
+        const BuildStep *dep = &run->graph->steps[step->deps[d]];
+        xxh64_update(&state, &dep->fingerprint, sizeof(dep->fingerprint));
+    }
+    step->fingerprint = xxh64_digest(&state);
+    return STATUS_SUCCESS;
+}
+
+static int outputs_exist(const BuildRun *run, const BuildStep *step) {
+    char path[PATH_BUFFER];
+    struct stat st;
+    for (size_t i = 0; i < step->output_count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", run->root, step->outputs[i]);
+        if (stat(path, &st) < 0) return 0;
+    }
+    return 1;
+}
+
+static int run_command(const BuildRun *run, const BuildStep *step) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Failed to start %s: %s\n", step->name, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (pid == 0) {
+        if (chdir(run->root) < 0) _exit(127);
+        execl("/bin/sh", "sh", "-c", step->command, (char *)NULL);
+        _exit(127);
+    }
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Failed to wait for %s: %s\n", step->name, strerror(errno));
+            return STATUS_ERROR;
+        }
+    }
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+        fprintf(stderr, "Step %s failed (%s %d)\n", step->name, WIFEXITED(wstatus) ? "exit" : "signal",
+                WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : WTERMSIG(wstatus));
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+struct StepTask {
+    BuildRun *run;
+    uint32_t index;
+};
+
+static void step_task(void *arg);
+
+static void submit_step(BuildRun *run, StepTask *task) {
+    if (work_pool_submit(run->pool, step_task, task) != STATUS_SUCCESS) {
+        step_task(task);
+    }
+}
+
+static void step_task(void *arg) {
+    StepTask *task = arg;
+    BuildRun *run = task->run;
+    BuildStep *step = &run->graph->steps[task->index];
+    uint64_t previous = step->fingerprint;
+    BuildStepState last_state = step->state;
+    int deps_changed = 0;
+
+    step->state = BUILD_STEP_PENDING;
+    for (size_t d = 0; d < step->dep_count; d++) {
+        const BuildStep *dep = &run->graph->steps[step->deps[d]];
+        if (dep->state == BUILD_STEP_FAILED || dep->state == BUILD_STEP_SKIPPED) {
+            step->state = BUILD_STEP_SKIPPED;
+        }
+        deps_changed |= dep->changed;
+    }
+    if (step->state == BUILD_STEP_PENDING && step->unchanged && !deps_changed &&
+        (last_state == BUILD_STEP_UP_TO_DATE || last_state == BUILD_STEP_EXECUTED)) {
+        // The watcher saw nothing touch this step: keep last run's result
+        // without looking at the file system
+        step->state = BUILD_STEP_UP_TO_DATE;
+    } else if (step->state == BUILD_STEP_PENDING) {
+        if (compute_fingerprint(run, step) != STATUS_SUCCESS) {
+            step->state = BUILD_STEP_FAILED;
+        } else {
+            const BuildStepRecord *last = build_db_step(run->db, xxh64(step->name, strlen(step->name), 0));
+            if (last && last->fingerprint == step->fingerprint && outputs_exist(run, step)) {
+                step->state = BUILD_STEP_UP_TO_DATE;
+            } else {
+                if (!run->quiet) {
+                    pthread_mutex_lock(&run->output_lock);
+                    printf("[build] %s\n", step->name);
+                    fflush(stdout);
+                    pthread_mutex_unlock(&run->output_lock);
+                }
+                step->state = run_command(run, step) == STATUS_SUCCESS ? BUILD_STEP_EXECUTED : BUILD_STEP_FAILED;
+            }
+        }
+    }
+    step->changed = step->state == BUILD_STEP_EXECUTED || step->fingerprint != previous;
+
+    // The last dep to finish makes a dependent ready; the atomic decrement
+    // also publishes this step's state and fingerprint to it
+    for (size_t d = 0; d < step->dependent_count; d++) {
+        uint32_t next = step->dependents[d];
+        if (__atomic_sub_fetch(&run->graph->steps[next].remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+            submit_step(run, &run->tasks[next]);
+        }
+    }
+}
+
+int build_run_with_db(BuildGraph *graph, const BuildOptions *options, BuildDb **db, BuildStats *stats) {
+    BuildOptions opts = {0};
+    if (options) opts = *options;
+    if (!opts.root) opts.root = ".";
+    BuildStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(BuildStats));
+
+    StepTask *tasks = malloc((graph->count ? graph->count : 1) * sizeof(StepTask));
+    BuildRun run = {.graph = graph, .tasks = tasks, .db = *db, .root = opts.root, .quiet = opts.quiet};
+    pthread_mutex_init(&run.output_lock, NULL);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    run.started_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    run.pool = tasks ? work_pool_create(opts.jobs) : NULL;
+    if (!run.pool) {
+        free(tasks);
+        pthread_mutex_destroy(&run.output_lock);
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < graph->count; i++) {
+        BuildStep *step = &graph->steps[i];
+        tasks[i] = (StepTask){.run = &run, .index = (uint32_t)i};
+        step->remaining = (int)step->dep_count;
+        step->files_hashed = 0;
+    }
+    for (size_t i = 0; i < graph->count; i++) {
+        if (graph->steps[i].dep_count == 0) {
+            submit_step(&run, &tasks[i]);
+        }
+    }
+    work_pool_wait(run.pool);
+    work_pool_destroy(run.pool);
+
+    stats->steps = graph->count;
+    for (size_t i = 0; i < graph->count; i++) {
+        BuildStep *step = &graph->steps[i];
+        step->unchanged = 0;
+        stats->files += step->file_count;
+        stats->files_hashed += step->files_hashed;
+        switch (step->state) {
+            case BUILD_STEP_UP_TO_DATE: stats->up_to_date++; break;
+            case BUILD_STEP_EXECUTED:   stats->executed++; break;
+            case BUILD_STEP_FAILED:     stats->failed++; break;
+            default:                    stats->skipped++; break;
+        }
+    }
+    BuildDb *next = build_db_collect(*db, graph);
+    int status = next ? build_db_save(next, opts.root) : STATUS_ERROR;
+    if (next) {
+        build_db_close(*db);
+        *db = next;
+    }
+    if (stats->failed > 0) status = STATUS_ERROR;
+    free(tasks);
+    pthread_mutex_destroy(&run.output_lock);
+    return status;
+}
+
+int build_run(BuildGraph *graph, const BuildOptions *options, BuildStats *stats) {
+    BuildDb *db = build_db_open(options ? options->root : NULL);
+    if (!db) return STATUS_ERROR;
+    int status = build_run_with_db(graph, options, &db, stats);
+    build_db_close(db);
+    return status;
+}
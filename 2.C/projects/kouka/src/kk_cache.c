@@ -0,0 +1,560 @@
+#include "common.h"
+#include "kk_cache.h"
+#include "kk_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DEFAULT_MAX_ENTRIES    1024
+#define DEFAULT_MAX_BYTES      (64UL * 1024 * 1024)
+#define DEFAULT_MAX_DISK_BYTES (256UL * 1024 * 1024)
+#define INITIAL_DISK_CAPACITY  (1024UL * 1024)
+
+#define RECORD_SIZE(length) (sizeof(CacheRecord) + (((size_t)(length) + 7) & ~(size_t)7))
+
+uint64_t response_cache_key(const char *model, const char *prompt, const char *options) {
+    // The terminating NULs separate the fields, so ("ab", "c") != ("a", "bc")
+    Xxh64State state;
+    xxh64_init(&state, 0);
+    xxh64_update(&state, model, strlen(model) + 1);
+    xxh64_update(&state, prompt, strlen(prompt) + 1);
+    if (options) {
+        xxh64_update(&state, options, strlen(options) + 1);
+    }
+    return xxh64_digest(&state);
+}
+
+static int is_expired(const ResponseCache *cache, time_t created, time_t now) {
+    return cache->config.ttl_seconds > 0 && now - created >= cache->config.ttl_seconds;
+}
+
+// In-memory LRU
+
+static void lru_unlink(ResponseCache *cache, CacheEntry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else cache->lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else cache->lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(ResponseCache *cache, CacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) cache->lru_head->lru_prev = entry;
+    else cache->lru_tail = entry;
+    cache->lru_head = entry;
+}
+
+static CacheEntry** bucket_slot(ResponseCache *cache, uint64_t key) {
+    CacheEntry **slot = &cache->buckets[key & (cache->bucket_count - 1)];
+    while (*slot && (*slot)->key != key) {
+        slot = &(*slot)->bucket_next;
+    }
+    return slot;
+}
+
+static void memory_remove(ResponseCache *cache, CacheEntry **slot) {
+    CacheEntry *entry = *slot;
+    *slot = entry->bucket_next;
+    lru_unlink(cache, entry);
+    cache->entry_count--;
+    cache->bytes -= entry->length;
+    free(entry->value);
+    free(entry);
+}
+
+static void memory_insert(ResponseCache *cache, uint64_t key, time_t created, const char *value,
+                          size_t length) {
+    if (length > cache->config.max_bytes) {
+        return;
+    }
+    CacheEntry **slot = bucket_slot(cache, key);
+    if (*slot) {
+        memory_remove(cache, slot);
+        slot = bucket_slot(cache, key);
+    }
+    CacheEntry *entry = malloc(sizeof(CacheEntry));
+    char *copy = malloc(length + 1);
+    if (!entry || !copy) {
+        fprintf(stderr, "Failed to allocate cache entry\n");
+        free(entry);
+        free(copy);
+        return;
+    }
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    entry->key = key;
+    entry->created = created;
+    entry->value = copy;
+    entry->length = length;
+    entry->bucket_next = NULL;
+    *slot = entry;
+    lru_push_front(cache, entry);
+    cache->entry_count++;
+    cache->bytes += length;
+
+    while (cache->entry_count > cache->config.max_entries || cache->bytes > cache->config.max_bytes) {
+        memory_remove(cache, bucket_slot(cache, cache->lru_tail->key));
+        cache->stats.evictions++;
+    }
+}
+
+// mmap'd store
+
+static CacheFileHeader* disk_header(const ResponseCache *cache) {
+    return (CacheFileHeader *)cache->disk_map;
+}
+
+static CacheRecord* disk_record(const ResponseCache *cache, uint64_t offset) {
+    return (CacheRecord *)(cache->disk_map + offset);
+}
+
+static size_t disk_find_slot(const ResponseCache *cache, uint64_t key) {
+    size_t mask = cache->disk_slots - 1;
+    size_t i = (size_t)key & mask;
+    while (cache->disk_offsets[i] && cache->disk_keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int disk_index_resize(ResponseCache *cache, size_t slots) {
+    uint64_t *old_keys = cache->disk_keys;
+    uint64_t *old_offsets = cache->disk_offsets;
+    size_t old_slots = cache->disk_slots;
+    cache->disk_keys = calloc(slots, sizeof(uint64_t));
+    cache->disk_offsets = calloc(slots, sizeof(uint64_t));
+    if (!cache->disk_keys || !cache->disk_offsets) {
+        fprintf(stderr, "Failed to allocate cache index\n");
+        free(cache->disk_keys);
+        free(cache->disk_offsets);
+        cache->disk_keys = old_keys;
+        cache->disk_offsets = old_offsets;
+        return STATUS_ERROR;
+    }
+    cache->disk_slots = slots;
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old_offsets[i]) {
+            size_t slot = disk_find_slot(cache, old_keys[i]);
+            cache->disk_keys[slot] = old_keys[i];
+            cache->disk_offsets[slot] = old_offsets[i];
+        }
+    }
+    free(old_keys);
+    free(old_offsets);
+    return STATUS_SUCCESS;
+}
+
+// Offsets are never 0 (the header lives there), so 0 marks an empty slot.
+static void disk_index_put(ResponseCache *cache, uint64_t key, uint64_t offset) {
+    if ((cache->disk_count + 1) * 2 > cache->disk_slots &&
+        disk_index_resize(cache, cache->disk_slots * 2) != STATUS_SUCCESS) {
+        return;
+    }
+    size_t slot = disk_find_slot(cache, key);
+    if (!cache->disk_offsets[slot]) {
+        cache->disk_count++;
+    }
+    cache->disk_keys[slot] = key;
+    cache->disk_offsets[slot] = offset;
+}
+
+// Indexes the records from `offset` up to the header's used mark. Only
+// reads the store, so it is safe under a shared lock; a later record for a
+// key simply replaces the earlier one in the index.
+static void disk_index_scan(ResponseCache *cache, uint64_t offset) {
+    uint64_t used = disk_header(cache)->used;
+    while (offset + sizeof(CacheRecord) <= used) {
+        CacheRecord *record = disk_record(cache, offset);
+        if (offset + RECORD_SIZE(record->length) > used) {
+            break;
+        }
+        if (!record->dead) {
+            disk_index_put(cache, record->key, offset);
+        }
+        offset += RECORD_SIZE(record->length);
+    }
+    cache->disk_indexed = offset;
+}
+
+static void disk_index_rebuild(ResponseCache *cache) {
+    memset(cache->disk_offsets, 0, cache->disk_slots * sizeof(uint64_t));
+    cache->disk_count = 0;
+    cache->disk_generation = disk_header(cache)->generation;
+    disk_index_scan(cache, sizeof(CacheFileHeader));
+}
+
+static int disk_map(ResponseCache *cache, size_t capacity) {
+    if (cache->disk_map) {
+        munmap(cache->disk_map, cache->disk_capacity);
+        cache->disk_map = NULL;
+    }
+    void *map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, cache->disk_fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return STATUS_ERROR;
+    }
+    cache->disk_map = map;
+    cache->disk_capacity = capacity;
+    return STATUS_SUCCESS;
+}
+
+static int disk_lock(ResponseCache *cache, int operation) {
+    while (flock(cache->disk_fd, operation) < 0) {
+        if (errno != EINTR) {
+            perror("flock");
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+static void disk_unlock(ResponseCache *cache) {
+    flock(cache->disk_fd, LOCK_UN);
+}
+
+// Called with the store locked. Another process may have grown, shrunk,
+// appended to or compacted the file since we last looked: remap to its
+// current size, then index what was appended, or everything after a
+// compaction.
+static int disk_sync(ResponseCache *cache) {
+    struct stat st;
+    if (fstat(cache->disk_fd, &st) < 0) {
+        perror("fstat");
+        return STATUS_ERROR;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(CacheFileHeader)) {
+        return STATUS_ERROR;
+    }
+    if (size != cache->disk_capacity && disk_map(cache, size) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    CacheFileHeader *header = disk_header(cache);
+    if (header->used > size) {
+        return STATUS_ERROR;
+    }
+    if (header->generation != cache->disk_generation || header->used < cache->disk_indexed) {
+        disk_index_rebuild(cache);
+    } else if (header->used > cache->disk_indexed) {
+        disk_index_scan(cache, cache->disk_indexed);
+    }
+    return STATUS_SUCCESS;
+}
+
+static int disk_grow(ResponseCache *cache, size_t needed) {
+    size_t capacity = cache->disk_capacity * 2;
+    if (capacity < needed) capacity = needed;
+    if (capacity > cache->config.max_disk_bytes) capacity = cache->config.max_disk_bytes;
+    if (ftruncate(cache->disk_fd, (off_t)capacity) < 0) {
+        perror("ftruncate");
+        return STATUS_ERROR;
+    }
+    return disk_map(cache, capacity);
+}
+
+// Slides live, unexpired records to the front, dropping the oldest ones
+// until `reserve` more bytes fit under max_disk_bytes. Called with the store
+// locked exclusively and the index in sync, so a record is live exactly when
+// the index points at it.
+static void disk_compact(ResponseCache *cache, size_t reserve, time_t now) {
+    size_t capacity = 64, count = 0;
+    uint64_t *live = malloc(capacity * sizeof(uint64_t));
+    for (uint64_t offset = sizeof(CacheFileHeader); live && offset < cache->disk_indexed; ) {
+        CacheRecord *record = disk_record(cache, offset);
+        if (cache->disk_offsets[disk_find_slot(cache, record->key)] == offset &&
+            !is_expired(cache, (time_t)record->created, now)) {
+            if (count == capacity) {
+                capacity *= 2;
+                uint64_t *grown = realloc(live, capacity * sizeof(uint64_t));
+                if (!grown) {
+                    free(live);
+                    live = NULL;
+                    break;
+                }
+                live = grown;
+            }
+            live[count++] = offset;
+        }
+        offset += RECORD_SIZE(record->length);
+    }
+    if (!live) {
+        fprintf(stderr, "Failed to compact response cache\n");
+        return;
+    }
+
+    size_t budget = cache->config.max_disk_bytes - sizeof(CacheFileHeader);
+    budget = reserve < budget ? budget - reserve : 0;
+    size_t first = count, kept = 0;
+    while (first > 0 && kept + RECORD_SIZE(disk_record(cache, live[first - 1])->length) <= budget) {
+        first--;
+        kept += RECORD_SIZE(disk_record(cache, live[first])->length);
+    }
+
+    uint64_t write = sizeof(CacheFileHeader);
+    for (size_t i = first; i < count; i++) {
+        size_t size = RECORD_SIZE(disk_record(cache, live[i])->length);
+        memmove(cache->disk_map + write, cache->disk_map + live[i], size);
+        write += size;
+    }
+    free(live);
+    disk_header(cache)->used = write;
+    disk_header(cache)->generation++;
+    disk_index_rebuild(cache);
+}
+
+// Maps the store and indexes it, starting it over if it is new or corrupt.
+// Called with the store locked exclusively.
+static int disk_load(ResponseCache *cache) {
+    struct stat st;
+    if (fstat(cache->disk_fd, &st) < 0) {
+        perror("fstat");
+        return STATUS_ERROR;
+    }
+    size_t size = (size_t)st.st_size;
+    int fresh = size < sizeof(CacheFileHeader);
+    if (fresh) {
+        size = INITIAL_DISK_CAPACITY < cache->config.max_disk_bytes ? INITIAL_DISK_CAPACITY
+                                                                     : cache->config.max_disk_bytes;
+        if (ftruncate(cache->disk_fd, (off_t)size) < 0) {
+            perror("ftruncate");
+            return STATUS_ERROR;
+        }
+    }
+    if (disk_map(cache, size) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    CacheFileHeader *header = disk_header(cache);
+    if (!fresh && (memcmp(header->magic, RESPONSE_CACHE_MAGIC, 8) != 0 || header->used > size)) {
+        fprintf(stderr, "Ignoring corrupt response cache %s\n", cache->config.disk_path);
+        fresh = 1;
+    }
+    if (fresh) {
+        memcpy(header->magic, RESPONSE_CACHE_MAGIC, 8);
+        header->used = sizeof(CacheFileHeader);
+        header->generation = 0;
+    }
+    disk_index_rebuild(cache);
+    // A torn final record (crash mid-append) is dropped
+    header->used = cache->disk_indexed;
+    return STATUS_SUCCESS;
+}
+
+static int disk_open(ResponseCache *cache) {
+    cache->disk_fd = open(cache->config.disk_path, O_RDWR | O_CREAT, 0644);
+    if (cache->disk_fd < 0) {
+        perror("open");
+        return STATUS_ERROR;
+    }
+    cache->disk_slots = 64;
+    cache->disk_keys = calloc(cache->disk_slots, sizeof(uint64_t));
+    cache->disk_offsets = calloc(cache->disk_slots, sizeof(uint64_t));
+    if (!cache->disk_keys || !cache->disk_offsets) {
+        fprintf(stderr, "Failed to allocate cache index\n");
+        return STATUS_ERROR;
+    }
+    // Exclusive, so two kk processes starting together don't both set up
+    // the file
+    if (disk_lock(cache, LOCK_EX) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    int status = disk_load(cache);
+    disk_unlock(cache);
+    return status;
+}
+
+// Called with the store locked exclusively and the index in sync
+static void disk_append(ResponseCache *cache, uint64_t key, time_t created, const char *value,
+                        size_t length) {
+    size_t size = RECORD_SIZE(length);
+    if (length > UINT32_MAX || sizeof(CacheFileHeader) + size > cache->config.max_disk_bytes) {
+        return;
+    }
+    uint64_t offset = disk_header(cache)->used;
+    if (offset + size > cache->config.max_disk_bytes) {
+        disk_compact(cache, size, created);
+        offset = disk_header(cache)->used;
+        if (offset + size > cache->config.max_disk_bytes) {
+            return;
+        }
+    }
+    if (offset + size > cache->disk_capacity && disk_grow(cache, offset + size) != STATUS_SUCCESS) {
+        return;
+    }
+    CacheRecord *record = disk_record(cache, offset);
+    record->key = key;
+    record->created = (int64_t)created;
+    record->length = (uint32_t)length;
+    record->dead = 0;
+    memcpy(record + 1, value, length);
+    size_t slot = disk_find_slot(cache, key);
+    if (cache->disk_offsets[slot]) {
+        disk_record(cache, cache->disk_offsets[slot])->dead = 1;
+    }
+    // Publish the record only once its bytes are in place
+    disk_header(cache)->used = offset + size;
+    disk_index_put(cache, key, offset);
+    cache->disk_indexed = offset + size;
+}
+
+ResponseCache* response_cache_create(const ResponseCacheConfig *config) {
+    ResponseCache *cache = calloc(1, sizeof(ResponseCache));
+    if (!cache) {
+        fprintf(stderr, "Failed to allocate response cache\n");
+        return NULL;
+    }
+    if (config) {
+        cache->config = *config;
+    }
+    if (!cache->config.max_entries) cache->config.max_entries = DEFAULT_MAX_ENTRIES;
+    if (!cache->config.max_bytes) cache->config.max_bytes = DEFAULT_MAX_BYTES;
+    if (!cache->config.max_disk_bytes) cache->config.max_disk_bytes = DEFAULT_MAX_DISK_BYTES;
+    cache->disk_fd = -1;
+    cache->bucket_count = 16;
+    while (cache->bucket_count < cache->config.max_entries * 2) {
+        cache->bucket_count *= 2;
+    }
+    cache->buckets = calloc(cache->bucket_count, sizeof(CacheEntry *));
+    if (!cache->buckets) {
+        fprintf(stderr, "Failed to allocate response cache\n");
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    if (cache->config.disk_path && disk_open(cache) != STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to open response cache %s\n", cache->config.disk_path);
+        response_cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void response_cache_destroy(ResponseCache *cache) {
+    if (!cache) return;
+    while (cache->lru_head) {
+        memory_remove(cache, bucket_slot(cache, cache->lru_head->key));
+    }
+    free(cache->buckets);
+    if (cache->disk_map && disk_lock(cache, LOCK_EX) == STATUS_SUCCESS) {
+        // Shrink the file to what is in use so idle capacity doesn't linger;
+        // other processes remap to the new size under their next lock
+        if (disk_sync(cache) == STATUS_SUCCESS &&
+            ftruncate(cache->disk_fd, (off_t)disk_header(cache)->used) < 0) {
+            perror("ftruncate");
+        }
+        disk_unlock(cache);
+    }
+    if (cache->disk_map) {
+        munmap(cache->disk_map, cache->disk_capacity);
+    }
+    if (cache->disk_fd >= 0) close(cache->disk_fd);
+    free(cache->disk_keys);
+    free(cache->disk_offsets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+static time_t cache_now(const ResponseCache *cache) {
+    return cache->now ? cache->now() : time(NULL);
+}
+
+// Called with the store locked and the index in sync. The record's bounds
+// and key are checked against the store itself, so a damaged file costs a
+// miss rather than another prompt's answer.
+static char* disk_lookup(ResponseCache *cache, uint64_t key, time_t now, time_t *created, size_t *length) {
+    uint64_t offset = cache->disk_offsets[disk_find_slot(cache, key)];
+    uint64_t used = disk_header(cache)->used;
+    if (!offset || offset + sizeof(CacheRecord) > used) {
+        return NULL;
+    }
+    CacheRecord *record = disk_record(cache, offset);
+    if (offset + RECORD_SIZE(record->length) > used || record->key != key || record->dead) {
+        return NULL;
+    }
+    if (is_expired(cache, (time_t)record->created, now)) {
+        cache->stats.expirations++;
+        return NULL;
+    }
+    char *copy = malloc(record->length + 1);
+    if (copy) {
+        memcpy(copy, record + 1, record->length);
+        copy[record->length] = '\0';
+        *created = (time_t)record->created;
+        *length = record->length;
+    }
+    return copy;
+}
+
+char* response_cache_get(ResponseCache *cache, uint64_t key, size_t *length) {
+    char *copy = NULL;
+    pthread_mutex_lock(&cache->lock);
+    time_t now = cache_now(cache);
+    CacheEntry **slot = bucket_slot(cache, key);
+    if (*slot && is_expired(cache, (*slot)->created, now)) {
+        memory_remove(cache, slot);
+        cache->stats.expirations++;
+    } else if (*slot) {
+        CacheEntry *entry = *slot;
+        lru_unlink(cache, entry);
+        lru_push_front(cache, entry);
+        copy = malloc(entry->length + 1);
+        if (copy) {
+            memcpy(copy, entry->value, entry->length + 1);
+            *length = entry->length;
+            cache->stats.hits++;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return copy;
+    }
+
+    if (cache->disk_map && disk_lock(cache, LOCK_SH) == STATUS_SUCCESS) {
+        time_t created = 0;
+        if (disk_sync(cache) == STATUS_SUCCESS) {
+            copy = disk_lookup(cache, key, now, &created, length);
+        }
+        disk_unlock(cache);
+        if (copy) {
+            memory_insert(cache, key, created, copy, *length);
+            cache->stats.disk_hits++;
+            pthread_mutex_unlock(&cache->lock);
+            return copy;
+        }
+    }
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+int response_cache_put(ResponseCache *cache, uint64_t key, const char *value, size_t length) {
+    if (!cache || !value) {
+        return STATUS_ERROR;
+    }
+    pthread_mutex_lock(&cache->lock);
+    time_t now = cache_now(cache);
+    memory_insert(cache, key, now, value, length);
+    if (cache->disk_map && disk_lock(cache, LOCK_EX) == STATUS_SUCCESS) {
+        if (disk_sync(cache) == STATUS_SUCCESS) {
+            disk_append(cache, key, now, value, length);
+        }
+        disk_unlock(cache);
+    }
+    cache->stats.stores++;
+    pthread_mutex_unlock(&cache->lock);
+    return STATUS_SUCCESS;
+}
+
+void response_cache_stats(ResponseCache *cache, ResponseCacheStats *stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    stats->entries = cache->entry_count;
+    stats->bytes = cache->bytes;
+    stats->disk_bytes = cache->disk_map ? disk_header(cache)->used : 0;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,1012 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_depindex.h"
+#include "kk_json_tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ARENA_BLOCK   (1 << 20)
+#define XML_PATH_MAX  256
+#define KEY_MAX       512
+
+// Versions
+
+typedef struct VersionToken {
+    const char *text;
+    size_t length;
+    int numeric;
+} VersionToken;
+
+// Splits on '.', '-' and '_' and between digits and letters, as Maven does.
+static int next_token(const char *s, size_t length, size_t *pos, VersionToken *token) {
+    size_t i = *pos;
+    while (i < length && (s[i] == '.' || s[i] == '-' || s[i] == '_')) i++;
+    if (i >= length) {
+        *pos = i;
+        return 0;
+    }
+    size_t start = i;
+    int numeric = isdigit((unsigned char)s[i]) != 0;
+    while (i < length && s[i] != '.' && s[i] != '-' && s[i] != '_' &&
+           (isdigit((unsigned char)s[i]) != 0) == numeric) {
+        i++;
+    }
+    token->text = s + start;
+    token->length = i - start;
+    token->numeric = numeric;
+    *pos = i;
+    return 1;
+}
+
+// Qualifier order: alpha < beta < milestone < rc < snapshot < release < sp < others
+static int qualifier_rank(const VersionToken *token) {
+    static const struct { const char *name; int rank; } ranks[] = {
+        {"alpha", 1}, {"a", 1}, {"beta", 2}, {"b", 2}, {"milestone", 3}, {"m", 3}, {"rc", 4}, {"cr", 4},
+        {"snapshot", 5}, {"ga", 6}, {"final", 6}, {"release", 6}, {"sp", 7},
+    };
+    for (size_t i = 0; i < sizeof(ranks) / sizeof(ranks[0]); i++) {
+        if (strlen(ranks[i].name) == token->length && strncasecmp(ranks[i].name, token->text, token->length) == 0) {
+            return ranks[i].rank;
+        }
+    }
+    return 8;
+}
+
+#define RELEASE_RANK 6
+
+static int compare_numbers(const VersionToken *a, const VersionToken *b) {
+    size_t ai = 0, bi = 0;
+    while (ai + 1 < a->length && a->text[ai] == '0') ai++;
+    while (bi + 1 < b->length && b->text[bi] == '0') bi++;
+    size_t al = a->length - ai, bl = b->length - bi;
+    if (al != bl) return al < bl ? -1 : 1;
+    int cmp = memcmp(a->text + ai, b->text + bi, al);
+    return cmp < 0 ? -1 : cmp > 0;
+}
+
+// What a version that has run out of tokens compares as against the rest of
+// a longer one: 1.0 < 1.0.1, but 1.0 > 1.0-rc1.
+static int compare_tail(const VersionToken *rest) {
+    if (rest->numeric) return -1;
+    int rank = qualifier_rank(rest);
+    return rank < RELEASE_RANK ? 1 : rank == RELEASE_RANK ? 0 : -1;
+}
+
+int dep_version_compare(const char *a, size_t a_length, const char *b, size_t b_length) {
+    size_t ai = 0, bi = 0;
+    for (;;) {
+        VersionToken ta, tb;
+        int has_a = next_token(a, a_length, &ai, &ta);
+        int has_b = next_token(b, b_length, &bi, &tb);
+        if (!has_a && !has_b) return 0;
+        if (!has_a) {
+            int cmp = compare_tail(&tb);
+            if (cmp != 0) return cmp;
+            continue;
+        }
+        if (!has_b) {
+            int cmp = compare_tail(&ta);
+            if (cmp != 0) return -cmp;
+            continue;
+        }
+        if (ta.numeric != tb.numeric) {
+            return ta.numeric ? 1 : -1;
+        }
+        int cmp;
+        if (ta.numeric) {
+            cmp = compare_numbers(&ta, &tb);
+        } else {
+            int ra = qualifier_rank(&ta), rb = qualifier_rank(&tb);
+            cmp = ra != rb ? (ra < rb ? -1 : 1) : 0;
+            if (cmp == 0 && ra == 8) {
+                size_t n = ta.length < tb.length ? ta.length : tb.length;
+                cmp = strncasecmp(ta.text, tb.text, n);
+                if (cmp == 0 && ta.length != tb.length) cmp = ta.length < tb.length ? -1 : 1;
+            }
+        }
+        if (cmp != 0) return cmp < 0 ? -1 : 1;
+    }
+}
+
+// POM reading
+
+typedef struct Arena {
+    char **blocks;
+    size_t block_count;
+    char *cursor;
+    size_t left;
+} Arena;
+
+static char* arena_strndup(Arena *arena, const char *s, size_t length) {
+    if (length + 1 > arena->left) {
+        size_t size = length + 1 > ARENA_BLOCK ? length + 1 : ARENA_BLOCK;
+        char **blocks = realloc(arena->blocks, (arena->block_count + 1) * sizeof(char *));
+        char *block = blocks ? malloc(size) : NULL;
+        if (!block) {
+            if (blocks) arena->blocks = blocks;
+            fprintf(stderr, "Failed to allocate dependency index\n");
+            return NULL;
+        }
+        arena->blocks = blocks;
+        arena->blocks[arena->block_count++] = block;
+        arena->cursor = block;
+        arena->left = size;
+    }
+    char *copy = arena->cursor;
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    arena->cursor += length + 1;
+    arena->left -= length + 1;
+    return copy;
+}
+
+static void arena_free(Arena *arena) {
+    for (size_t i = 0; i < arena->block_count; i++) {
+        free(arena->blocks[i]);
+    }
+    free(arena->blocks);
+    memset(arena, 0, sizeof(Arena));
+}
+
+typedef struct PomDep {
+    char *group;
+    char *artifact;
+    char *version;
+    uint32_t flags;
+} PomDep;
+
+typedef struct PomProperty {
+    char *name;
+    char *value;
+} PomProperty;
+
+typedef struct Pom {
+    char *group;
+    char *artifact;
+    char *version;
+    char *key;  // "groupId:artifactId"
+    PomDep *deps;
+    size_t dep_count;
+} Pom;
+
+// Per-file parse state; deps and properties are reused across files.
+typedef struct PomParser {
+    Arena *arena;
+    char *group, *artifact, *version, *parent_group, *parent_version;
+    PomDep *deps;
+    size_t dep_count, dep_capacity;
+    PomProperty *properties;
+    size_t property_count, property_capacity;
+    int failed;
+} PomParser;
+
+static const char* property_value(const PomParser *p, const char *name, size_t length) {
+    static const struct { const char *name; size_t field; } builtin[] = {
+        {"project.version", offsetof(PomParser, version)},
+        {"pom.version", offsetof(PomParser, version)},
+        {"version", offsetof(PomParser, version)},
+        {"project.groupId", offsetof(PomParser, group)},
+        {"pom.groupId", offsetof(PomParser, group)},
+        {"project.artifactId", offsetof(PomParser, artifact)},
+        {"project.parent.version", offsetof(PomParser, parent_version)},
+        {"project.parent.groupId", offsetof(PomParser, parent_group)},
+    };
+    for (size_t i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) {
+        if (strlen(builtin[i].name) == length && memcmp(builtin[i].name, name, length) == 0) {
+            return *(char *const *)((const char *)p + builtin[i].field);
+        }
+    }
+    for (size_t i = 0; i < p->property_count; i++) {
+        if (strlen(p->properties[i].name) == length && memcmp(p->properties[i].name, name, length) == 0) {
+            return p->properties[i].value;
+        }
+    }
+    return NULL;
+}
+
+// Expands ${name} references; NULL if one can't be resolved.
+static char* expand(PomParser *p, char *value) {
+    if (!value || !strstr(value, "${")) return value;
+    char out[KEY_MAX];
+    size_t n = 0;
+    for (const char *s = value; *s; ) {
+        const char *close = s[0] == '$' && s[1] == '{' ? strchr(s, '}') : NULL;
+        const char *piece = s;
+        size_t length = 1;
+        if (close) {
+            piece = property_value(p, s + 2, (size_t)(close - s - 2));
+            if (!piece || strstr(piece, "${")) return NULL;
+            length = strlen(piece);
+            s = close + 1;
+        } else {
+            s++;
+        }
+        if (n + length >= sizeof(out)) return NULL;
+        memcpy(out + n, piece, length);
+        n += length;
+    }
+    return arena_strndup(p->arena, out, n);
+}
+
+static uint32_t scope_flags(const char *scope) {
+    static const char *names[] = {"compile", "runtime", "provided", "test", "system", "import"};
+    for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(scope, names[i]) == 0) return i;
+    }
+    return DEP_SCOPE_COMPILE;
+}
+
+static int path_is(const char *path, size_t length, const char *expected) {
+    return strlen(expected) == length && memcmp(path, expected, length) == 0;
+}
+
+static void pom_open_element(PomParser *p, const char *path, size_t length) {
+    if (!path_is(path, length, "project/dependencies/dependency")) return;
+    if (p->dep_count == p->dep_capacity) {
+        size_t capacity = p->dep_capacity ? p->dep_capacity * 2 : 16;
+        PomDep *deps = realloc(p->deps, capacity * sizeof(PomDep));
+        if (!deps) {
+            p->failed = 1;
+            return;
+        }
+        p->deps = deps;
+        p->dep_capacity = capacity;
+    }
+    memset(&p->deps[p->dep_count++], 0, sizeof(PomDep));
+}
+
+static void pom_value(PomParser *p, const char *path, size_t length, const char *value, size_t value_length) {
+    static const char dep_prefix[] = "project/dependencies/dependency/";
+    static const char property_prefix[] = "project/properties/";
+    char *copy = NULL;
+    char **target = NULL;
+    if (length > sizeof(dep_prefix) - 1 && memcmp(path, dep_prefix, sizeof(dep_prefix) - 1) == 0) {
+        if (p->dep_count == 0) return;
+        PomDep *dep = &p->deps[p->dep_count - 1];
+        const char *field = path + sizeof(dep_prefix) - 1;
+        size_t field_length = length - (sizeof(dep_prefix) - 1);
+        if (path_is(field, field_length, "groupId")) target = &dep->group;
+        else if (path_is(field, field_length, "artifactId")) target = &dep->artifact;
+        else if (path_is(field, field_length, "version")) target = &dep->version;
+        else if (path_is(field, field_length, "scope") || path_is(field, field_length, "optional")) {
+            char text[16];
+            size_t n = value_length < sizeof(text) - 1 ? value_length : sizeof(text) - 1;
+            memcpy(text, value, n);
+            text[n] = '\0';
+            if (field[0] == 's') {
+                dep->flags = (dep->flags & DEP_EDGE_OPTIONAL) | scope_flags(text);
+            } else if (strcmp(text, "true") == 0) {
+                dep->flags |= DEP_EDGE_OPTIONAL;
+            }
+        }
+    } else if (length > sizeof(property_prefix) - 1 &&
+               memcmp(path, property_prefix, sizeof(property_prefix) - 1) == 0 &&
+               !memchr(path + sizeof(property_prefix) - 1, '/', length - (sizeof(property_prefix) - 1))) {
+        if (p->property_count == p->property_capacity) {
+            size_t capacity = p->property_capacity ? p->property_capacity * 2 : 16;
+            PomProperty *properties = realloc(p->properties, capacity * sizeof(PomProperty));
+            if (!properties) {
+                p->failed = 1;
+                return;
+            }
+            p->properties = properties;
+            p->property_capacity = capacity;
+        }
+        PomProperty *property = &p->properties[p->property_count];
+        property->name = arena_strndup(p->arena, path + sizeof(property_prefix) - 1,
+                                       length - (sizeof(property_prefix) - 1));
+        property->value = arena_strndup(p->arena, value, value_length);
+        if (!property->name || !property->value) p->failed = 1;
+        p->property_count++;
+        return;
+    } else if (path_is(path, length, "project/groupId")) target = &p->group;
+    else if (path_is(path, length, "project/artifactId")) target = &p->artifact;
+    else if (path_is(path, length, "project/version")) target = &p->version;
+    else if (path_is(path, length, "project/parent/groupId")) target = &p->parent_group;
+    else if (path_is(path, length, "project/parent/version")) target = &p->parent_version;
+    if (target) {
+        copy = arena_strndup(p->arena, value, value_length);
+        if (!copy) p->failed = 1;
+        *target = copy;
+    }
+}
+
+static int is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+// Just enough XML for POMs: elements, text, comments, declarations. Leaf
+// element text is reported with its slash-separated path; attributes,
+// entities and CDATA are ignored.
+static void pom_scan(PomParser *p, const char *s, size_t length) {
+    const char *end = s + length;
+    char path[XML_PATH_MAX];
+    size_t path_length = 0;
+    size_t overflow = 0;  // elements nested past XML_PATH_MAX
+    const char *text = NULL;
+    while (s < end && !p->failed) {
+        const char *lt = memchr(s, '<', (size_t)(end - s));
+        if (!lt) break;
+        if (end - lt >= 4 && memcmp(lt, "<!--", 4) == 0) {
+            const char *close = memmem(lt + 4, (size_t)(end - lt - 4), "-->", 3);
+            s = close ? close + 3 : end;
+            continue;
+        }
+        if (end - lt >= 9 && memcmp(lt, "<![CDATA[", 9) == 0) {
+            const char *close = memmem(lt + 9, (size_t)(end - lt - 9), "]]>", 3);
+            s = close ? close + 3 : end;
+            text = NULL;
+            continue;
+        }
+        const char *gt = memchr(lt, '>', (size_t)(end - lt));
+        if (!gt) break;
+        s = gt + 1;
+        if (lt[1] == '?' || lt[1] == '!') continue;
+        if (lt[1] == '/') {
+            if (overflow > 0) {
+                overflow--;
+                continue;
+            }
+            if (text) {
+                const char *value = text, *value_end = lt;
+                while (value < value_end && is_space(*value)) value++;
+                while (value_end > value && is_space(value_end[-1])) value_end--;
+                pom_value(p, path, path_length, value, (size_t)(value_end - value));
+                text = NULL;
+            }
+            while (path_length > 0 && path[path_length - 1] != '/') path_length--;
+            if (path_length > 0) path_length--;
+            continue;
+        }
+        const char *name = lt + 1, *name_end = name;
+        while (name_end < gt && !is_space(*name_end) && *name_end != '/') name_end++;
+        if (gt[-1] == '/') {
+            text = NULL;
+            continue;  // <empty/>
+        }
+        size_t name_length = (size_t)(name_end - name);
+        if (overflow > 0 || path_length + name_length + 2 > sizeof(path)) {
+            overflow++;
+            continue;
+        }
+        if (path_length > 0) path[path_length++] = '/';
+        memcpy(path + path_length, name, name_length);
+        path_length += name_length;
+        pom_open_element(p, path, path_length);
+        text = s;
+    }
+}
+
+static int read_file(const char *path, char **data, size_t *length) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return STATUS_ERROR;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return STATUS_ERROR;
+    }
+    *data = malloc((size_t)st.st_size + 1);
+    size_t n = 0;
+    while (*data && n < (size_t)st.st_size) {
+        ssize_t got = read(fd, *data + n, (size_t)st.st_size - n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        n += (size_t)got;
+    }
+    close(fd);
+    if (!*data) return STATUS_ERROR;
+    *length = n;
+    return STATUS_SUCCESS;
+}
+
+typedef struct PomSet {
+    Pom *poms;
+    size_t count;
+    size_t capacity;
+    Arena arena;
+    PomParser parser;
+    DepIndexBuildStats *stats;
+} PomSet;
+
+static int pom_load(PomSet *set, const char *file) {
+    char *data;
+    size_t length;
+    set->stats->poms++;
+    if (read_file(file, &data, &length) != STATUS_SUCCESS) {
+        set->stats->skipped++;
+        return STATUS_SUCCESS;
+    }
+    PomParser *p = &set->parser;
+    PomDep *deps = p->deps;
+    PomProperty *properties = p->properties;
+    size_t dep_capacity = p->dep_capacity, property_capacity = p->property_capacity;
+    memset(p, 0, sizeof(PomParser));
+    p->arena = &set->arena;
+    p->deps = deps;
+    p->dep_capacity = dep_capacity;
+    p->properties = properties;
+    p->property_capacity = property_capacity;
+    pom_scan(p, data, length);
+    free(data);
+    if (p->failed) {
+        fprintf(stderr, "Failed to allocate dependency index\n");
+        return STATUS_ERROR;
+    }
+
+    // groupId and version are inherited from the parent when omitted
+    if (!p->group) p->group = p->parent_group;
+    if (!p->version) p->version = p->parent_version;
+    p->group = expand(p, p->group);
+    p->version = expand(p, p->version);
+    if (!p->group || !p->artifact || !p->version) {
+        set->stats->skipped++;
+        return STATUS_SUCCESS;
+    }
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+        Pom *poms = realloc(set->poms, capacity * sizeof(Pom));
+        if (!poms) {
+            fprintf(stderr, "Failed to allocate dependency index\n");
+            return STATUS_ERROR;
+        }
+        set->poms = poms;
+        set->capacity = capacity;
+    }
+    Pom *pom = &set->poms[set->count];
+    char key[KEY_MAX];
+    int key_length = snprintf(key, sizeof(key), "%s:%s", p->group, p->artifact);
+    pom->group = p->group;
+    pom->artifact = p->artifact;
+    pom->version = p->version;
+    pom->key = key_length > 0 && (size_t)key_length < sizeof(key)
+                   ? arena_strndup(&set->arena, key, (size_t)key_length) : NULL;
+    pom->dep_count = 0;
+    pom->deps = p->dep_count ? malloc(p->dep_count * sizeof(PomDep)) : NULL;
+    if (!pom->key || (p->dep_count && !pom->deps)) {
+        free(pom->deps);
+        set->stats->skipped++;
+        return STATUS_SUCCESS;
+    }
+    for (size_t i = 0; i < p->dep_count; i++) {
+        PomDep dep = p->deps[i];
+        dep.group = expand(p, dep.group);
+        dep.artifact = expand(p, dep.artifact);
+        dep.version = expand(p, dep.version);
+        if (!dep.group || !dep.artifact) {
+            set->stats->unresolved++;
+            continue;
+        }
+        pom->deps[pom->dep_count++] = dep;
+    }
+    set->count++;
+    return STATUS_SUCCESS;
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name), m = strlen(suffix);
+    return n >= m && strcmp(name + n - m, suffix) == 0;
+}
+
+static int pom_walk(PomSet *set, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "Failed to open %s: %s\n", dir, strerror(errno));
+        return STATUS_ERROR;
+    }
+    int status = STATUS_SUCCESS;
+    struct dirent *entry;
+    while (status == STATUS_SUCCESS && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path)) continue;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path, &st) < 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR) {
+            status = pom_walk(set, path);
+        } else if (type == DT_REG && (has_suffix(entry->d_name, ".pom") || strcmp(entry->d_name, "pom.xml") == 0)) {
+            status = pom_load(set, path);
+        }
+    }
+    closedir(d);
+    return status;
+}
+
+// Index building
+
+typedef struct SortEntry {
+    const Pom *pom;
+} SortEntry;
+
+static int compare_poms(const void *a, const void *b) {
+    const Pom *pa = ((const SortEntry *)a)->pom, *pb = ((const SortEntry *)b)->pom;
+    int cmp = strcmp(pa->key, pb->key);
+    if (cmp != 0) return cmp;
+    return dep_version_compare(pa->version, strlen(pa->version), pb->version, strlen(pb->version));
+}
+
+typedef struct StringTable {
+    char *data;
+    size_t length;
+    size_t capacity;
+} StringTable;
+
+static long string_append(StringTable *table, const char *s, size_t length) {
+    if (table->length + length > UINT32_MAX) return -1;
+    if (table->length + length > table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 1 << 16;
+        while (capacity < table->length + length) capacity *= 2;
+        char *data = realloc(table->data, capacity);
+        if (!data) return -1;
+        table->data = data;
+        table->capacity = capacity;
+    }
+    memcpy(table->data + table->length, s, length);
+    table->length += length;
+    return (long)(table->length - length);
+}
+
+static long find_artifact(const DepArtifact *artifacts, uint32_t count, const char *strings, const char *key,
+                          size_t length) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const DepArtifact *artifact = &artifacts[mid];
+        size_t n = artifact->key_length < length ? artifact->key_length : length;
+        int cmp = memcmp(strings + artifact->key, key, n);
+        if (cmp == 0 && artifact->key_length != length) cmp = artifact->key_length < length ? -1 : 1;
+        if (cmp == 0) return (long)mid;
+        if (cmp < 0) low = mid + 1;
+        else high = mid;
+    }
+    return -1;
+}
+
+static uint32_t find_version(const DepArtifact *artifact, const DepVersion *versions, const char *strings,
+                             const char *version) {
+    uint32_t newest = artifact->first_version + artifact->version_count - 1;
+    // Ranges ("[1.0,2.0)") and unknown versions take the newest
+    if (!version || !*version || version[0] == '[' || version[0] == '(') return newest;
+    size_t length = strlen(version);
+    uint32_t low = artifact->first_version, high = newest + 1;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const DepVersion *v = &versions[mid];
+        int cmp = dep_version_compare(strings + v->version, v->version_length, version, length);
+        if (cmp == 0) return mid;
+        if (cmp < 0) low = mid + 1;
+        else high = mid;
+    }
+    return newest;
+}
+
+static int write_all(int fd, const void *data, size_t length) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return STATUS_ERROR;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return STATUS_SUCCESS;
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static int write_index(const char *path, DepIndexHeader *header, const DepArtifact *artifacts,
+                       const DepVersion *versions, const DepEdge *edges, const StringTable *strings) {
+    static const char zeros[8] = {0};
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        fprintf(stderr, "Index path too long: %s\n", path);
+        return STATUS_ERROR;
+    }
+    size_t artifacts_size = header->artifact_count * sizeof(DepArtifact);
+    size_t versions_size = (header->version_count + 1) * sizeof(DepVersion);
+    size_t edges_size = header->edge_count * sizeof(DepEdge);
+    header->artifacts_offset = align8(sizeof(DepIndexHeader));
+    header->versions_offset = align8(header->artifacts_offset + artifacts_size);
+    header->edges_offset = align8(header->versions_offset + versions_size);
+    header->strings_offset = align8(header->edges_offset + edges_size);
+    header->strings_length = strings->length;
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create %s: %s\n", tmp, strerror(errno));
+        return STATUS_ERROR;
+    }
+    // Every section is already 8-byte sized except the strings, so padding
+    // only ever follows the header
+    int status = write_all(fd, header, sizeof(DepIndexHeader));
+    size_t pad = header->artifacts_offset - sizeof(DepIndexHeader);
+    if (status == STATUS_SUCCESS && pad) status = write_all(fd, zeros, pad);
+    if (status == STATUS_SUCCESS) status = write_all(fd, artifacts, artifacts_size);
+    if (status == STATUS_SUCCESS) status = write_all(fd, versions, versions_size);
+    if (status == STATUS_SUCCESS) status = write_all(fd, edges, edges_size);
+    if (status == STATUS_SUCCESS) status = write_all(fd, strings->data, strings->length);
+    if (close(fd) < 0) status = STATUS_ERROR;
+    if (status != STATUS_SUCCESS || rename(tmp, path) < 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int dep_index_build(const char *pom_dir, const char *index_path, DepIndexBuildStats *stats) {
+    DepIndexBuildStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(DepIndexBuildStats));
+    PomSet set = {.stats = stats};
+    int status = pom_walk(&set, pom_dir);
+
+    SortEntry *order = status == STATUS_SUCCESS ? malloc((set.count ? set.count : 1) * sizeof(SortEntry)) : NULL;
+    DepArtifact *artifacts = order ? malloc((set.count ? set.count : 1) * sizeof(DepArtifact)) : NULL;
+    DepVersion *versions = artifacts ? malloc((set.count + 1) * sizeof(DepVersion)) : NULL;
+    DepEdge *edges = NULL;
+    StringTable strings = {0};
+    if (!versions) {
+        if (status == STATUS_SUCCESS) fprintf(stderr, "Failed to allocate dependency index\n");
+        status = STATUS_ERROR;
+    }
+
+    DepIndexHeader header = {0};
+    if (status == STATUS_SUCCESS) {
+        for (size_t i = 0; i < set.count; i++) {
+            order[i].pom = &set.poms[i];
+        }
+        qsort(order, set.count, sizeof(SortEntry), compare_poms);
+
+        // Artifacts and versions, dropping duplicate coordinates
+        size_t edge_total = 0;
+        SortEntry previous = {NULL};
+        for (size_t i = 0; i < set.count && status == STATUS_SUCCESS; i++) {
+            SortEntry current = order[i];
+            const Pom *pom = current.pom;
+            int same_artifact = previous.pom && strcmp(previous.pom->key, pom->key) == 0;
+            if (same_artifact && compare_poms(&previous, &current) == 0) {
+                continue;
+            }
+            previous = current;
+            DepArtifact *last = header.artifact_count ? &artifacts[header.artifact_count - 1] : NULL;
+            if (!same_artifact) {
+                long key = string_append(&strings, pom->key, strlen(pom->key));
+                if (key < 0) status = STATUS_ERROR;
+                artifacts[header.artifact_count++] = (DepArtifact){
+                    .key = (uint32_t)key, .key_length = (uint32_t)strlen(pom->key),
+                    .first_version = header.version_count};
+                last = &artifacts[header.artifact_count - 1];
+            }
+            long version = string_append(&strings, pom->version, strlen(pom->version));
+            if (version < 0) status = STATUS_ERROR;
+            order[header.version_count].pom = pom;  // order now maps version index -> pom
+            versions[header.version_count++] = (DepVersion){
+                .artifact = header.artifact_count - 1, .version = (uint32_t)version,
+                .version_length = (uint32_t)strlen(pom->version)};
+            last->version_count++;
+            edge_total += pom->dep_count;
+        }
+        edges = malloc((edge_total ? edge_total : 1) * sizeof(DepEdge));
+        if (!edges || status != STATUS_SUCCESS) {
+            fprintf(stderr, "Failed to allocate dependency index\n");
+            status = STATUS_ERROR;
+        }
+    }
+
+    // CSR rows: each version's dependencies resolved to version indices
+    for (uint32_t v = 0; status == STATUS_SUCCESS && v < header.version_count; v++) {
+        const Pom *pom = order[v].pom;
+        versions[v].first_edge = header.edge_count;
+        for (size_t d = 0; d < pom->dep_count; d++) {
+            const PomDep *dep = &pom->deps[d];
+            char key[KEY_MAX];
+            int length = snprintf(key, sizeof(key), "%s:%s", dep->group, dep->artifact);
+            long artifact = length > 0 && (size_t)length < sizeof(key)
+                                ? find_artifact(artifacts, header.artifact_count, strings.data, key, (size_t)length)
+                                : -1;
+            if (artifact < 0) {
+                stats->unresolved++;
+                continue;
+            }
+            uint32_t target = find_version(&artifacts[artifact], versions, strings.data, dep->version);
+            edges[header.edge_count++] = (DepEdge){.target = target, .flags = dep->flags};
+        }
+    }
+    if (status == STATUS_SUCCESS) {
+        versions[header.version_count] = (DepVersion){.artifact = UINT32_MAX, .first_edge = header.edge_count};
+        memcpy(header.magic, DEP_INDEX_MAGIC, sizeof(header.magic));
+        status = write_index(index_path, &header, artifacts, versions, edges, &strings);
+        stats->artifacts = header.artifact_count;
+        stats->versions = header.version_count;
+        stats->edges = header.edge_count;
+    }
+
+    for (size_t i = 0; i < set.count; i++) {
+        free(set.poms[i].deps);
+    }
+    free(set.poms);
+    free(set.parser.deps);
+    free(set.parser.properties);
+    arena_free(&set.arena);
+    free(order);
+    free(artifacts);
+    free(versions);
+    free(edges);
+    free(strings.data);
+    return status;
+}
+
+// Mapped index
+
+static int index_is_valid(const DepIndex *index) {
+    const DepIndexHeader *h = index->header;
+    size_t size = index->map_size;
+    if (memcmp(h->magic, DEP_INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+        h->artifacts_offset % 8 || h->versions_offset % 8 || h->edges_offset % 8 ||
+        h->artifacts_offset > size || (size - h->artifacts_offset) / sizeof(DepArtifact) < h->artifact_count ||
+        h->versions_offset > size ||
+        (size - h->versions_offset) / sizeof(DepVersion) < (uint64_t)h->version_count + 1 ||
+        h->edges_offset > size || (size - h->edges_offset) / sizeof(DepEdge) < h->edge_count ||
+        h->strings_offset > size || size - h->strings_offset < h->strings_length) {
+        return 0;
+    }
+    const DepArtifact *artifacts = index->artifacts;
+    const DepVersion *versions = index->versions;
+    for (uint32_t a = 0; a < h->artifact_count; a++) {
+        if ((uint64_t)artifacts[a].key + artifacts[a].key_length > h->strings_length ||
+            artifacts[a].version_count == 0 ||
+            (uint64_t)artifacts[a].first_version + artifacts[a].version_count > h->version_count) {
+            return 0;
+        }
+    }
+    for (uint32_t v = 0; v < h->version_count; v++) {
+        if (versions[v].artifact >= h->artifact_count ||
+            (uint64_t)versions[v].version + versions[v].version_length > h->strings_length ||
+            versions[v].first_edge > versions[v + 1].first_edge) {
+            return 0;
+        }
+    }
+    if (versions[h->version_count].first_edge != h->edge_count) return 0;
+    for (uint32_t e = 0; e < h->edge_count; e++) {
+        if (index->edges[e].target >= h->version_count) return 0;
+    }
+    return 1;
+}
+
+DepIndex* dep_index_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(DepIndexHeader)) {
+        fprintf(stderr, "Not a dependency index: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    DepIndex *index = calloc(1, sizeof(DepIndex));
+    void *map = index ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s\n", path);
+        free(index);
+        return NULL;
+    }
+    index->map = map;
+    index->map_size = (size_t)st.st_size;
+    index->header = map;
+    index->artifacts = (const DepArtifact *)(index->map + index->header->artifacts_offset);
+    index->versions = (const DepVersion *)(index->map + index->header->versions_offset);
+    index->edges = (const DepEdge *)(index->map + index->header->edges_offset);
+    index->strings = (const char *)(index->map + index->header->strings_offset);
+    // Offsets are checked before any table is read through them
+    if (!index_is_valid(index)) {
+        fprintf(stderr, "Corrupt dependency index: %s\n", path);
+        dep_index_close(index);
+        return NULL;
+    }
+    return index;
+}
+
+void dep_index_close(DepIndex *index) {
+    if (!index) return;
+    munmap(index->map, index->map_size);
+    free(index);
+}
+
+long dep_index_find(const DepIndex *index, const char *key, size_t length) {
+    return find_artifact(index->artifacts, index->header->artifact_count, index->strings, key, length);
+}
+
+uint32_t dep_index_version(const DepIndex *index, uint32_t artifact, const char *version) {
+    return find_version(&index->artifacts[artifact], index->versions, index->strings, version);
+}
+
+const char* dep_index_coordinates(const DepIndex *index, uint32_t version, char *buffer, size_t size) {
+    const DepVersion *v = &index->versions[version];
+    const DepArtifact *a = &index->artifacts[v->artifact];
+    snprintf(buffer, size, "%.*s:%.*s", (int)a->key_length, index->strings + a->key, (int)v->version_length,
+             index->strings + v->version);
+    return buffer;
+}
+
+// Resolution
+
+int dep_resolver_init(DepResolver *resolver, const DepIndex *index) {
+    memset(resolver, 0, sizeof(DepResolver));
+    size_t count = index->header->artifact_count ? index->header->artifact_count : 1;
+    resolver->index = index;
+    resolver->seen = calloc(count, sizeof(uint32_t));
+    resolver->versions = malloc(count * sizeof(uint32_t));
+    if (!resolver->seen || !resolver->versions) {
+        fprintf(stderr, "Failed to allocate dependency resolver\n");
+        dep_resolver_free(resolver);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+void dep_resolver_free(DepResolver *resolver) {
+    free(resolver->seen);
+    free(resolver->versions);
+    memset(resolver, 0, sizeof(DepResolver));
+}
+
+static int follows(uint32_t flags) {
+    uint32_t scope = flags & 0xff;
+    return !(flags & DEP_EDGE_OPTIONAL) && (scope == DEP_SCOPE_COMPILE || scope == DEP_SCOPE_RUNTIME);
+}
+
+int dep_resolver_resolve(DepResolver *resolver, const uint32_t *roots, size_t root_count) {
+    const DepIndex *index = resolver->index;
+    // Bumping the generation clears seen without touching it
+    if (++resolver->generation == 0) {
+        memset(resolver->seen, 0, index->header->artifact_count * sizeof(uint32_t));
+        resolver->generation = 1;
+    }
+    uint32_t generation = resolver->generation;
+    uint32_t *seen = resolver->seen;
+    uint32_t *queue = resolver->versions;
+    size_t count = 0;
+    for (size_t i = 0; i < root_count; i++) {
+        if (roots[i] >= index->header->version_count) {
+            fprintf(stderr, "Invalid dependency version %u\n", roots[i]);
+            return STATUS_ERROR;
+        }
+        uint32_t artifact = index->versions[roots[i]].artifact;
+        if (seen[artifact] != generation) {
+            seen[artifact] = generation;
+            queue[count++] = roots[i];
+        }
+    }
+    // The result doubles as the BFS queue: each artifact enters it once
+    for (size_t head = 0; head < count; head++) {
+        const DepVersion *v = &index->versions[queue[head]];
+        for (uint32_t e = v->first_edge; e < v[1].first_edge; e++) {
+            const DepEdge *edge = &index->edges[e];
+            if (!follows(edge->flags)) continue;
+            uint32_t artifact = index->versions[edge->target].artifact;
+            if (seen[artifact] != generation) {
+                seen[artifact] = generation;
+                queue[count++] = edge->target;
+            }
+        }
+    }
+    resolver->count = count;
+    return STATUS_SUCCESS;
+}
+
+typedef struct DepJsonState {
+    const DepIndex *index;
+    char group[KEY_MAX / 2];
+    char artifact[KEY_MAX / 2];
+    char version[128];
+    uint32_t *roots;
+    size_t count;
+    size_t capacity;
+    size_t missing;
+    int failed;
+} DepJsonState;
+
+static void copy_value(char *dst, size_t size, const JsonToken *token) {
+    size_t n = token->length < size - 1 ? token->length : size - 1;
+    memcpy(dst, token->value, n);
+    dst[n] = '\0';
+}
+
+static void add_root(DepJsonState *state, const char *key, size_t key_length, const char *version) {
+    long artifact = dep_index_find(state->index, key, key_length);
+    if (artifact < 0) {
+        state->missing++;
+        return;
+    }
+    if (state->count == state->capacity) {
+        size_t capacity = state->capacity ? state->capacity * 2 : 32;
+        uint32_t *roots = realloc(state->roots, capacity * sizeof(uint32_t));
+        if (!roots) {
+            state->failed = 1;
+            return;
+        }
+        state->roots = roots;
+        state->capacity = capacity;
+    }
+    state->roots[state->count++] = dep_index_version(state->index, (uint32_t)artifact, version);
+}
+
+static void on_dependency_token(const JsonToken *token, void *user_data) {
+    static const char element[] = "$.dependencies[*]";
+    DepJsonState *state = user_data;
+    size_t prefix = sizeof(element) - 1;
+    if (token->path_length < prefix || memcmp(token->path, element, prefix) != 0) return;
+    const char *field = token->path + prefix;
+    size_t field_length = token->path_length - prefix;
+
+    if (field_length == 0) {
+        if (token->type == JSON_TOKEN_OBJECT_START) {
+            state->group[0] = state->artifact[0] = state->version[0] = '\0';
+        } else if (token->type == JSON_TOKEN_OBJECT_END) {
+            char key[KEY_MAX];
+            int length = snprintf(key, sizeof(key), "%s:%s", state->group, state->artifact);
+            if (length > 0 && (size_t)length < sizeof(key)) {
+                add_root(state, key, (size_t)length, state->version);
+            }
+        } else if (token->type == JSON_TOKEN_STRING) {
+            // "groupId:artifactId[:version]"
+            const char *first = memchr(token->value, ':', token->length);
+            const char *second = first ? memchr(first + 1, ':', token->length - (size_t)(first + 1 - token->value))
+                                       : NULL;
+            size_t key_length = second ? (size_t)(second - token->value) : token->length;
+            add_root(state, token->value, key_length, second ? second + 1 : NULL);
+        }
+    } else if (token->type == JSON_TOKEN_STRING) {
+        if (path_is(field, field_length, ".groupId")) copy_value(state->group, sizeof(state->group), token);
+        else if (path_is(field, field_length, ".artifactId")) {
+            copy_value(state->artifact, sizeof(state->artifact), token);
+        } else if (path_is(field, field_length, ".version")) {
+            copy_value(state->version, sizeof(state->version), token);
+        }
+    }
+}
+
+int dep_resolver_resolve_json(DepResolver *resolver, const char *json, size_t length) {
+    DepJsonState state = {.index = resolver->index};
+    JsonTokenizer tokenizer;
+    json_tokenizer_init(&tokenizer);
+    int status = json_tokenizer_subscribe(&tokenizer, NULL, on_dependency_token, &state);
+    if (status == STATUS_SUCCESS) {
+        status = json_tokenizer_feed(&tokenizer, json, length);
+    }
+    if (status == STATUS_SUCCESS && !json_tokenizer_at_boundary(&tokenizer)) {
+        fprintf(stderr, "Truncated dependencies.json\n");
+        status = STATUS_ERROR;
+    }
+    json_tokenizer_free(&tokenizer);
+    if (state.failed) {
+        fprintf(stderr, "Failed to allocate dependency roots\n");
+        status = STATUS_ERROR;
+    }
+    if (status == STATUS_SUCCESS) {
+        status = dep_resolver_resolve(resolver, state.roots, state.count);
+    }
+    resolver->missing = state.missing;
+    free(state.roots);
+    return status;
+}
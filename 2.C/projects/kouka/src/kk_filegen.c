@@ -0,0 +1,514 @@
+#include "common.h"
+#include "kk_filegen.h"
+#include "kk_hash.h"
+#include "kk_thread_pool.h"
+#include "kk_uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_QUEUE_DEPTH 64
+#define JOBS_PER_THREAD     4
+#define FILE_MODE           0644
+#define DIR_MODE            0755
+#define OPEN_FLAGS          (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+// io_uring writes take a 32-bit length; bigger files go through pwrite
+#define URING_MAX_WRITE     (1u << 30)
+
+// Plan
+
+void project_plan_init(ProjectPlan *plan) {
+    memset(plan, 0, sizeof(ProjectPlan));
+}
+
+void project_plan_free(ProjectPlan *plan) {
+    for (size_t i = 0; i < plan->count; i++) {
+        free(plan->entries[i].path);
+    }
+    free(plan->entries);
+    free(plan->dir_hashes);
+    free(plan->dir_slots);
+    memset(plan, 0, sizeof(ProjectPlan));
+}
+
+static int path_is_safe(const char *path, size_t length) {
+    if (length == 0 || path[0] == '/') {
+        return 0;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i <= length; i++) {
+        if (i == length || path[i] == '/') {
+            size_t n = i - start;
+            if (n == 0 || (n == 1 && path[start] == '.') ||
+                (n == 2 && path[start] == '.' && path[start + 1] == '.')) {
+                return 0;
+            }
+            start = i + 1;
+        }
+    }
+    return 1;
+}
+
+// Returns the slot holding path, or the empty slot where it would go.
+static size_t path_slot(const ProjectPlan *plan, const char *path, size_t length, uint64_t hash) {
+    size_t mask = plan->dir_slot_count - 1;
+    size_t i = (size_t)hash & mask;
+    while (plan->dir_slots[i]) {
+        const PlanEntry *entry = &plan->entries[plan->dir_slots[i] - 1];
+        if (plan->dir_hashes[i] == hash && strncmp(entry->path, path, length) == 0 &&
+            entry->path[length] == '\0') {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int path_set_grow(ProjectPlan *plan) {
+    size_t old_count = plan->dir_slot_count;
+    uint64_t *old_hashes = plan->dir_hashes;
+    size_t *old_slots = plan->dir_slots;
+    size_t count = old_count ? old_count * 2 : 64;
+    plan->dir_hashes = calloc(count, sizeof(uint64_t));
+    plan->dir_slots = calloc(count, sizeof(size_t));
+    if (!plan->dir_hashes || !plan->dir_slots) {
+        fprintf(stderr, "Failed to allocate project plan\n");
+        free(plan->dir_hashes);
+        free(plan->dir_slots);
+        plan->dir_hashes = old_hashes;
+        plan->dir_slots = old_slots;
+        return STATUS_ERROR;
+    }
+    plan->dir_slot_count = count;
+    for (size_t i = 0; i < old_count; i++) {
+        if (old_slots[i]) {
+            size_t slot = (size_t)old_hashes[i] & (count - 1);
+            while (plan->dir_slots[slot]) {
+                slot = (slot + 1) & (count - 1);
+            }
+            plan->dir_hashes[slot] = old_hashes[i];
+            plan->dir_slots[slot] = old_slots[i];
+        }
+    }
+    free(old_hashes);
+    free(old_slots);
+    return STATUS_SUCCESS;
+}
+
+// Finds or appends the entry for path[0 .. length). Every path, file or
+// directory, is in the set, so a file and a directory can't share a name.
+static PlanEntry* plan_entry(ProjectPlan *plan, const char *path, size_t length, int is_dir) {
+    if ((plan->count + 1) * 2 > plan->dir_slot_count && path_set_grow(plan) != STATUS_SUCCESS) {
+        return NULL;
+    }
+    uint64_t hash = xxh64(path, length, 0);
+    size_t slot = path_slot(plan, path, length, hash);
+    if (plan->dir_slots[slot]) {
+        PlanEntry *existing = &plan->entries[plan->dir_slots[slot] - 1];
+        if (existing->is_dir != is_dir) {
+            fprintf(stderr, "Project plan: %.*s is both a file and a directory\n", (int)length, path);
+            return NULL;
+        }
+        return existing;
+    }
+    if (plan->count == plan->capacity) {
+        size_t capacity = plan->capacity ? plan->capacity * 2 : 64;
+        PlanEntry *entries = realloc(plan->entries, capacity * sizeof(PlanEntry));
+        if (!entries) {
+            fprintf(stderr, "Failed to allocate project plan\n");
+            return NULL;
+        }
+        plan->entries = entries;
+        plan->capacity = capacity;
+    }
+    PlanEntry *entry = &plan->entries[plan->count];
+    memset(entry, 0, sizeof(PlanEntry));
+    entry->path = strndup(path, length);
+    if (!entry->path) {
+        fprintf(stderr, "Failed to allocate project plan\n");
+        return NULL;
+    }
+    entry->is_dir = is_dir;
+    plan->count++;
+    plan->dir_hashes[slot] = hash;
+    plan->dir_slots[slot] = plan->count;
+    if (is_dir) {
+        plan->dir_count++;
+    } else {
+        plan->file_count++;
+    }
+    return entry;
+}
+
+// Parents are added before the path itself, so entries stay in creation order.
+static int plan_add_parents(ProjectPlan *plan, const char *path, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (path[i] == '/' && !plan_entry(plan, path, i, 1)) {
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int project_plan_add_dir(ProjectPlan *plan, const char *path) {
+    size_t length = strlen(path);
+    while (length > 0 && path[length - 1] == '/') {
+        length--;
+    }
+    if (!path_is_safe(path, length)) {
+        fprintf(stderr, "Project plan: unsafe directory path \"%s\"\n", path);
+        return STATUS_ERROR;
+    }
+    if (plan_add_parents(plan, path, length) != STATUS_SUCCESS || !plan_entry(plan, path, length, 1)) {
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int project_plan_add_file(ProjectPlan *plan, const char *path, const char *content, size_t length) {
+    size_t path_length = strlen(path);
+    if (!path_is_safe(path, path_length) || (length > 0 && !content)) {
+        fprintf(stderr, "Project plan: unsafe file path \"%s\"\n", path);
+        return STATUS_ERROR;
+    }
+    if (plan_add_parents(plan, path, path_length) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    PlanEntry *entry = plan_entry(plan, path, path_length, 0);
+    if (!entry) {
+        return STATUS_ERROR;
+    }
+    // Adding a file again replaces its content
+    entry->content = content;
+    entry->length = length;
+    return STATUS_SUCCESS;
+}
+
+const char* file_generator_backend_name(FileGenBackend backend) {
+    switch (backend) {
+        case FILEGEN_BACKEND_IO_URING: return "io_uring";
+        case FILEGEN_BACKEND_PWRITE:   return "pwrite";
+        default:                       return "auto";
+    }
+}
+
+// Writer
+
+typedef struct FileGenJob {
+    const ProjectPlan *plan;
+    int root_fd;
+    const size_t *files;  // entry indices
+    size_t count;
+    FileGenBackend backend;
+    unsigned queue_depth;
+    size_t bytes;
+    int used_uring;
+    int failed;
+} FileGenJob;
+
+static int write_all_at(int fd, const char *data, size_t length, size_t offset) {
+    while (offset < length) {
+        ssize_t n = pwrite(fd, data + offset, length - offset, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return STATUS_ERROR;
+        }
+        offset += (size_t)n;
+    }
+    return STATUS_SUCCESS;
+}
+
+static void write_file_sync(FileGenJob *job, const PlanEntry *entry) {
+    int fd = openat(job->root_fd, entry->path, OPEN_FLAGS, FILE_MODE);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create %s: %s\n", entry->path, strerror(errno));
+        job->failed = 1;
+        return;
+    }
+    if (write_all_at(fd, entry->content, entry->length, 0) != STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to write %s: %s\n", entry->path, strerror(errno));
+        job->failed = 1;
+    }
+    if (close(fd) < 0) {
+        fprintf(stderr, "Failed to close %s: %s\n", entry->path, strerror(errno));
+        job->failed = 1;
+    }
+    job->bytes += entry->length;
+}
+
+static void run_pwrite(FileGenJob *job, size_t first) {
+    for (size_t i = first; i < job->count; i++) {
+        write_file_sync(job, &job->plan->entries[job->files[i]]);
+    }
+}
+
+#ifdef KK_HAVE_IO_URING
+static struct io_uring_cqe* wait_cqe(Uring *ring) {
+    struct io_uring_cqe *cqe = uring_peek_cqe(ring);
+    while (!cqe) {
+        if (uring_submit_and_wait(ring, 1) < 0) {
+            return NULL;
+        }
+        cqe = uring_peek_cqe(ring);
+    }
+    return cqe;
+}
+
+typedef struct UringFile {
+    int fd;
+    int write_result;
+    int closed;
+} UringFile;
+
+// Opens stay synchronous: the kernel always hands an O_CREAT|O_TRUNC
+// IORING_OP_OPENAT to an io-wq worker, which costs more than the syscall it
+// saves. Each opened file then gets a linked write+close, and the whole batch
+// goes in with one io_uring_enter. A short or failed write breaks its link
+// (the close completes with -ECANCELED) and is finished here with pwrite.
+static int run_uring_batch(FileGenJob *job, Uring *ring, size_t first, size_t n, UringFile *files) {
+    const ProjectPlan *plan = job->plan;
+    unsigned queued = 0;
+    for (size_t j = 0; j < n; j++) {
+        const PlanEntry *entry = &plan->entries[job->files[first + j]];
+        files[j] = (UringFile){.fd = openat(job->root_fd, entry->path, OPEN_FLAGS, FILE_MODE)};
+        if (files[j].fd < 0) {
+            fprintf(stderr, "Failed to create %s: %s\n", entry->path, strerror(errno));
+            job->failed = 1;
+            continue;
+        }
+        if (entry->length > URING_MAX_WRITE) {
+            if (write_all_at(files[j].fd, entry->content, entry->length, 0) != STATUS_SUCCESS) {
+                files[j].write_result = -errno;
+            }
+        } else if (entry->length > 0) {
+            struct io_uring_sqe *sqe = uring_get_sqe(ring);
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->fd = files[j].fd;
+            sqe->addr = (uint64_t)(uintptr_t)entry->content;
+            sqe->len = (unsigned)entry->length;
+            sqe->off = 0;
+            sqe->user_data = j << 1;
+            queued++;
+        }
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = files[j].fd;
+        sqe->user_data = (j << 1) | 1;
+        queued++;
+    }
+
+    int supported = 1;
+    int submitted = queued > 0 ? uring_submit_and_wait(ring, queued) : 0;
+    for (int done = 0; done < submitted; done++) {
+        struct io_uring_cqe *cqe = wait_cqe(ring);
+        if (!cqe) {
+            submitted = -1;
+            break;
+        }
+        size_t j = (size_t)(cqe->user_data >> 1);
+        int res = cqe->res;
+        uring_cqe_seen(ring);
+        if (res == -EINVAL || res == -EOPNOTSUPP) {
+            supported = 0;  // kernel predates the opcode
+        }
+        if (cqe->user_data & 1) {
+            // Only a close that never ran is retried; the fd is gone otherwise
+            files[j].closed = res != -ECANCELED && supported;
+            if (res < 0 && files[j].closed) {
+                fprintf(stderr, "Failed to close %s: %s\n", plan->entries[job->files[first + j]].path,
+                        strerror(-res));
+                job->failed = 1;
+            }
+        } else {
+            files[j].write_result = res;
+        }
+    }
+
+    for (size_t j = 0; j < n; j++) {
+        const PlanEntry *entry = &plan->entries[job->files[first + j]];
+        if (files[j].fd < 0) continue;
+        int res = files[j].write_result;
+        size_t written = res > 0 ? (size_t)res : 0;
+        if (submitted < 0 || res == -EINVAL || res == -EOPNOTSUPP) {
+            res = 0;
+            written = 0;
+        }
+        if (res >= 0 && entry->length <= URING_MAX_WRITE && written < entry->length &&
+            write_all_at(files[j].fd, entry->content, entry->length, written) != STATUS_SUCCESS) {
+            res = -errno;
+        }
+        if (res < 0) {
+            fprintf(stderr, "Failed to write %s: %s\n", entry->path, strerror(-res));
+            job->failed = 1;
+        }
+        if (!files[j].closed && close(files[j].fd) < 0) {
+            fprintf(stderr, "Failed to close %s: %s\n", entry->path, strerror(errno));
+            job->failed = 1;
+        }
+        job->bytes += entry->length;
+    }
+    return submitted >= 0 && supported ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+// Falls back to pwrite for whatever is left if the ring can't be set up or
+// the kernel rejects an opcode.
+static void run_uring(FileGenJob *job) {
+    Uring ring;
+    if (uring_init(&ring, job->queue_depth) != STATUS_SUCCESS) {
+        run_pwrite(job, 0);
+        return;
+    }
+    size_t batch = ring.sq_entries / 2;
+    UringFile *files = malloc(batch * sizeof(UringFile));
+    size_t first = 0;
+    job->used_uring = files != NULL;
+    while (files && first < job->count) {
+        size_t n = job->count - first < batch ? job->count - first : batch;
+        if (run_uring_batch(job, &ring, first, n, files) != STATUS_SUCCESS) {
+            job->used_uring = 0;
+            break;
+        }
+        first += n;
+    }
+    free(files);
+    uring_free(&ring);
+    run_pwrite(job, first);
+}
+#endif
+
+static void file_gen_task(void *arg) {
+    FileGenJob *job = (FileGenJob *)arg;
+#ifdef KK_HAVE_IO_URING
+    if (job->backend != FILEGEN_BACKEND_PWRITE) {
+        run_uring(job);
+        return;
+    }
+#endif
+    run_pwrite(job, 0);
+}
+
+// mkdir -p root. An empty root has no first byte to step past.
+static int make_root(const char *root) {
+    size_t len = strlen(root);
+    if (len == 0) {
+        fprintf(stderr, "Empty output directory\n");
+        return STATUS_ERROR;
+    }
+    char *path = strdup(root);
+    if (!path) {
+        fprintf(stderr, "Failed to allocate path\n");
+        return STATUS_ERROR;
+    }
+    // A trailing slash would only repeat the last mkdir
+    while (len > 1 && path[len - 1] == '/') {
+        path[--len] = '\0';
+    }
+    for (char *p = path + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            char saved = *p;
+            *p = '\0';
+            if (mkdir(path, DIR_MODE) < 0 && errno != EEXIST) {
+                fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+                free(path);
+                return STATUS_ERROR;
+            }
+            *p = saved;
+            if (saved == '\0') break;
+        }
+    }
+    free(path);
+    return STATUS_SUCCESS;
+}
+
+int file_generator_write(const ProjectPlan *plan, const char *root, const FileGenOptions *options,
+                         FileGenStats *stats) {
+    FileGenOptions opts = {0};
+    if (options) {
+        opts = *options;
+    }
+    if (!opts.queue_depth) {
+        opts.queue_depth = DEFAULT_QUEUE_DEPTH;
+    }
+    FileGenStats local = {0};
+    if (!stats) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(FileGenStats));
+    if (make_root(root) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", root, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // Entries list parents first, so a single in-order pass creates every level
+    int status = STATUS_SUCCESS;
+    size_t *files = malloc((plan->file_count ? plan->file_count : 1) * sizeof(size_t));
+    size_t file_count = 0;
+    for (size_t i = 0; files && i < plan->count; i++) {
+        const PlanEntry *entry = &plan->entries[i];
+        if (!entry->is_dir) {
+            files[file_count++] = i;
+        } else if (mkdirat(root_fd, entry->path, DIR_MODE) < 0 && errno != EEXIST) {
+            fprintf(stderr, "Failed to create %s: %s\n", entry->path, strerror(errno));
+            status = STATUS_ERROR;
+        } else {
+            stats->dirs++;
+        }
+    }
+    if (!files || status != STATUS_SUCCESS) {
+        free(files);
+        close(root_fd);
+        return STATUS_ERROR;
+    }
+
+    ThreadPool *pool = file_count ? thread_pool_create(opts.threads) : NULL;
+    size_t job_count = pool ? pool->thread_count * JOBS_PER_THREAD : 0;
+    if (job_count > file_count) {
+        job_count = file_count;
+    }
+    FileGenJob *jobs = calloc(job_count ? job_count : 1, sizeof(FileGenJob));
+    if (file_count && (!pool || !jobs)) {
+        fprintf(stderr, "Failed to start file generator\n");
+        status = STATUS_ERROR;
+        job_count = 0;
+    }
+    for (size_t j = 0; j < job_count; j++) {
+        size_t begin = file_count * j / job_count, end = file_count * (j + 1) / job_count;
+        jobs[j] = (FileGenJob){.plan = plan, .root_fd = root_fd, .files = files + begin, .count = end - begin,
+                               .backend = opts.backend, .queue_depth = opts.queue_depth};
+        if (thread_pool_submit(pool, file_gen_task, &jobs[j]) != STATUS_SUCCESS) {
+            file_gen_task(&jobs[j]);
+        }
+    }
+    if (pool) {
+        thread_pool_wait(pool);
+        thread_pool_destroy(pool);
+    }
+
+    stats->backend = FILEGEN_BACKEND_IO_URING;
+    for (size_t j = 0; j < job_count; j++) {
+        stats->bytes += jobs[j].bytes;
+        stats->files += jobs[j].count;
+        if (!jobs[j].used_uring) {
+            stats->backend = FILEGEN_BACKEND_PWRITE;
+        }
+        if (jobs[j].failed) {
+            status = STATUS_ERROR;
+        }
+    }
+    if (job_count == 0) {
+        stats->backend = opts.backend == FILEGEN_BACKEND_PWRITE ? FILEGEN_BACKEND_PWRITE : FILEGEN_BACKEND_AUTO;
+    }
+    free(jobs);
+    free(files);
+    close(root_fd);
+    return status;
+}
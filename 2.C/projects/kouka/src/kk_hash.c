@@ -0,0 +1,148 @@
+#include "kk_hash.h"
+#include <string.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads; memcpy compiles to a plain mov
+static inline uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t v) {
+    acc ^= round64(0, v);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static uint64_t finalize(uint64_t h, const unsigned char *p, size_t length) {
+    while (length >= 8) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+        length -= 8;
+    }
+    if (length >= 4) {
+        h ^= (uint64_t)read32(p) * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        length -= 4;
+    }
+    while (length > 0) {
+        h ^= (*p++) * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+        length--;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t merge_lanes(const uint64_t v[4]) {
+    uint64_t h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+    for (int i = 0; i < 4; i++) {
+        h = merge_round(h, v[i]);
+    }
+    return h;
+}
+
+uint64_t xxh64(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + length;
+    uint64_t h;
+    if (length >= 32) {
+        uint64_t v[4] = {seed + XXH_PRIME64_1 + XXH_PRIME64_2, seed + XXH_PRIME64_2, seed,
+                         seed - XXH_PRIME64_1};
+        const unsigned char *limit = end - 32;
+        do {
+            v[0] = round64(v[0], read64(p));
+            v[1] = round64(v[1], read64(p + 8));
+            v[2] = round64(v[2], read64(p + 16));
+            v[3] = round64(v[3], read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = merge_lanes(v);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)length;
+    return finalize(h, p, (size_t)(end - p));
+}
+
+void xxh64_init(Xxh64State *state, uint64_t seed) {
+    memset(state, 0, sizeof(Xxh64State));
+    state->seed = seed;
+    state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    state->v[1] = seed + XXH_PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - XXH_PRIME64_1;
+}
+
+void xxh64_update(Xxh64State *state, const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+    state->total_length += length;
+    if (state->buffered + length < 32) {
+        memcpy(state->buffer + state->buffered, p, length);
+        state->buffered += length;
+        return;
+    }
+    if (state->buffered) {
+        size_t fill = 32 - state->buffered;
+        memcpy(state->buffer + state->buffered, p, fill);
+        for (int i = 0; i < 4; i++) {
+            state->v[i] = round64(state->v[i], read64(state->buffer + i * 8));
+        }
+        p += fill;
+        length -= fill;
+        state->buffered = 0;
+    }
+    while (length >= 32) {
+        for (int i = 0; i < 4; i++) {
+            state->v[i] = round64(state->v[i], read64(p + i * 8));
+        }
+        p += 32;
+        length -= 32;
+    }
+    memcpy(state->buffer, p, length);
+    state->buffered = length;
+}
+
+uint64_t xxh64_digest(const Xxh64State *state) {
+    uint64_t h;
+    if (state->total_length >= 32) {
+        h = merge_lanes(state->v);
+    } else {
+        h = state->seed + XXH_PRIME64_5;
+    }
+    h += state->total_length;
+    return finalize(h, state->buffer, state->buffered);
+}
@@ -1,4 +1,6 @@
 #include "kk_json.h"
+#include "kk_scan.h"
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -8,76 +10,245 @@ void json_parser_init(JsonParser *parser, json_value_callback callback, void *ag
     parser->agent_response = agent_response;
 }
 
-static void handle_json_value(JsonParser *parser) {
+void json_parser_set_zero_copy(JsonParser *parser, int enabled) {
+    parser->zero_copy = enabled;
+}
+
+void json_parser_free(JsonParser *parser) {
+    free(parser->value_buffer);
+    parser->value_buffer = NULL;
+    parser->value_capacity = 0;
+    parser->value_pos = 0;
+}
+
+// Appends to value_buffer, doubling it when full. One byte is always kept
+// free for the terminating NUL.
+static void value_append(JsonParser *parser, const char *data, size_t length) {
+    if (parser->value_pos + length + 1 > parser->value_capacity) {
+        size_t new_capacity = parser->value_capacity ? parser->value_capacity * 2 : 256;
+        while (parser->value_pos + length + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *ptr = realloc(parser->value_buffer, new_capacity);
+        if (!ptr) {
+            fprintf(stderr, "Failed to grow JSON value buffer\n");
+            return;
+        }
+        parser->value_buffer = ptr;
+        parser->value_capacity = new_capacity;
+    }
+    memcpy(parser->value_buffer + parser->value_pos, data, length);
+    parser->value_pos += length;
+}
+
+// Moves a pending zero-copy slice into value_buffer, e.g. because an escape
+// needs decoding or the chunk ends before the closing quote.
+static void value_detach(JsonParser *parser, const char *slice_end) {
+    if (parser->value_start) {
+        value_append(parser, parser->value_start, (size_t)(slice_end - parser->value_start));
+        parser->value_start = NULL;
+    }
+}
+
+size_t json_utf8_encode(unsigned int codepoint, char out[4]) {
+    if (codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        codepoint = 0xFFFD;
+    }
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+static void emit_escaped(JsonParser *parser, char c);
+
+static void emit_codepoint(JsonParser *parser, unsigned int codepoint) {
+    char utf8[4];
+    size_t n = json_utf8_encode(codepoint, utf8);
+    for (size_t i = 0; i < n; i++) {
+        emit_escaped(parser, utf8[i]);
+    }
+}
+
+// A \u high surrogate only counts if a \u low surrogate follows right away.
+static void flush_high_surrogate(JsonParser *parser) {
+    if (parser->pending_high_surrogate) {
+        parser->pending_high_surrogate = 0;
+        emit_codepoint(parser, 0xFFFD);
+    }
+}
+
+static void finish_unicode_escape(JsonParser *parser) {
+    unsigned int cp = parser->unicode_value;
+    if (cp >= 0xDC00 && cp <= 0xDFFF && parser->pending_high_surrogate) {
+        cp = 0x10000 + ((parser->pending_high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        parser->pending_high_surrogate = 0;
+    } else {
+        flush_high_surrogate(parser);
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            parser->pending_high_surrogate = cp;
+            return;
+        }
+    }
+    emit_codepoint(parser, cp);
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void emit_escaped(JsonParser *parser, char c) {
+    if (parser->is_parsing_key) {
+        if (parser->key_pos < sizeof(parser->current_key) - 1) {
+            parser->current_key[parser->key_pos++] = c;
+        }
+    } else if (parser->parsing_response_value) {
+        value_append(parser, &c, 1);
+    }
+}
+
+static void handle_json_value(JsonParser *parser, const char *slice_end) {
     if (parser->found_response && parser->depth == 1) {
-        // Null-terminate the value_buffer.
-        if (parser->value_pos < sizeof(parser->value_buffer)) {
-            parser->value_buffer[parser->value_pos] = '\0';
+        if (parser->value_start) {
+            parser->callback(parser->value_start, (size_t)(slice_end - parser->value_start), parser->agent_response);
+        } else {
+            value_append(parser, "", 0);
+            if (parser->value_buffer) {
+                parser->value_buffer[parser->value_pos] = '\0';
+            }
+            parser->callback(parser->value_buffer ? parser->value_buffer : "", parser->value_pos,
+                             parser->agent_response);
         }
-        parser->callback(parser->value_buffer, parser->value_pos, parser->agent_response);
     }
+    parser->value_start = NULL;
     parser->value_pos = 0;
 }
 
+// Copies a run of plain string bytes (no quote, no backslash) in one go.
+// Zero-copy values need no copy at all: the bytes are already in the chunk.
+static void copy_string_run(JsonParser *parser, const char *run, size_t length) {
+    flush_high_surrogate(parser);
+    if (parser->is_parsing_key) {
+        size_t room = sizeof(parser->current_key) - 1 - parser->key_pos;
+        if (length > room) {
+            length = room;
+        }
+        memcpy(parser->current_key + parser->key_pos, run, length);
+        parser->key_pos += length;
+    } else if (parser->parsing_response_value && !parser->value_start) {
+        value_append(parser, run, length);
+    }
+}
+
 void json_parse(JsonParser *parser, const char *chunk, size_t length) {
+    ScanMasks masks = {0};
+    size_t block_start = 0;
+    size_t block_end = 0;
     for (size_t i = 0; i < length; ++i) {
-        char curr_chunk = chunk[i];
-        if (parser->escape_next) {
-            if (parser->value_pos < sizeof(parser->value_buffer)-1) {
-                switch (curr_chunk) {
-                    case '"':  parser->value_buffer[parser->value_pos++] = '"'; break;
-                        case '\\': parser->value_buffer[parser->value_pos++] = '\\'; break;
-                        case '/':  parser->value_buffer[parser->value_pos++] = '/'; break;
-                        case 'b':  parser->value_buffer[parser->value_pos++] = '\b'; break;
-                        case 'f':  parser->value_buffer[parser->value_pos++] = '\f'; break;
-                        case 'n':  parser->value_buffer[parser->value_pos++] = '\n'; break;
-                        case 'r':  parser->value_buffer[parser->value_pos++] = '\r'; break;
-                        case 't':  parser->value_buffer[parser->value_pos++] = '\t'; break;
-                        case 'u':  /* Simple unicode handling (basic) */
-                            if (i + 4 < length) {
-                                // Skip unicode bytes for simplicity
-                                i += 4;
-                                parser->value_buffer[parser->value_pos++] = '?';
-                            }
-                            break;
-                        default: parser->value_buffer[parser->value_pos++] = curr_chunk; break;
+        if (!parser->escape_next && !parser->unicode_remaining) {
+            // Jump straight to the next byte the state machine cares about,
+            // classifying the input one 64-byte block at a time.
+            uint64_t pending;
+            do {
+                if (i >= block_end) {
+                    block_start = i;
+                    block_end = i + (length - i < SCAN_BLOCK_SIZE ? length - i : SCAN_BLOCK_SIZE);
+                    scan_block(chunk + i, block_end - block_start, &masks);
+                }
+                pending = (parser->in_string ? masks.string : masks.structural) >> (i - block_start);
+                size_t run = pending ? (size_t)__builtin_ctzll(pending) : block_end - i;
+                if (parser->in_string && run > 0) {
+                    copy_string_run(parser, chunk + i, run);
                 }
+                i += run;
+            } while (!pending && i < length);
+            if (i == length) {
+                break;
+            }
+        }
+        char curr_chunk = chunk[i];
+        if (parser->unicode_remaining) {
+            int digit = hex_digit(curr_chunk);
+            if (digit < 0) {
+                // Malformed escape: substitute U+FFFD and reread this byte
+                parser->unicode_remaining = 0;
+                flush_high_surrogate(parser);
+                emit_codepoint(parser, 0xFFFD);
+                --i;
+                continue;
             }
+            parser->unicode_value = (parser->unicode_value << 4) | (unsigned int)digit;
+            if (--parser->unicode_remaining == 0) {
+                finish_unicode_escape(parser);
+            }
+            continue;
+        }
+        if (parser->escape_next) {
             parser->escape_next = 0;
+            if (curr_chunk == 'u') {
+                // Digits may arrive in later chunks; collect them one by one
+                parser->unicode_remaining = 4;
+                parser->unicode_value = 0;
+                continue;
+            }
+            flush_high_surrogate(parser);
+            switch (curr_chunk) {
+                case 'b':  emit_escaped(parser, '\b'); break;
+                case 'f':  emit_escaped(parser, '\f'); break;
+                case 'n':  emit_escaped(parser, '\n'); break;
+                case 'r':  emit_escaped(parser, '\r'); break;
+                case 't':  emit_escaped(parser, '\t'); break;
+                default:   emit_escaped(parser, curr_chunk); break;  // '"' '\\' '/'
+            }
             continue;
         }
         if (parser->in_string) {
             if (curr_chunk == '\\') {
                 parser->escape_next = 1;
+                value_detach(parser, chunk + i);
             } else if (curr_chunk == '"') {
+                flush_high_surrogate(parser);
                 parser->in_string = 0;
                 if (parser->is_parsing_key) {
                     parser->current_key[parser->key_pos] = '\0';
-                    if (strcmp(parser->current_key, "response") == 0) {
+                    if (parser->depth == 1 && !parser->array_depth &&
+                        strcmp(parser->current_key, "response") == 0) {
                         parser->found_response = 1;
                     }
                     parser->key_pos = 0;
                     parser->is_parsing_key = 0;
                 } else if (parser->parsing_response_value) {
-                    handle_json_value(parser);
+                    handle_json_value(parser, chunk + i);
                     parser->parsing_response_value = 0;
                     parser->found_response = 0;
                 }
-            } else {
-                if (parser->is_parsing_key) {  // Building key
-                    if (parser->key_pos < sizeof(parser->current_key)-1) {
-                        parser->current_key[parser->key_pos++] = curr_chunk;
-                    }
-                } else if (parser->parsing_response_value) {
-                    if (parser->value_pos < sizeof(parser->value_buffer) - 1) {
-                        parser->value_buffer[parser->value_pos++] = curr_chunk;
-                    }
-                }
             }
         } else {
             switch(curr_chunk) {
                 case '"':
                     if (parser->is_parsing_key) parser->key_pos = 0;
+                    if (parser->parsing_response_value && parser->zero_copy) {
+                        parser->value_start = chunk + i + 1;
+                    }
                     parser->in_string = 1;    
                     break;
                 case '{':
@@ -111,4 +282,8 @@ void json_parse(JsonParser *parser, const char *chunk, size_t length) {
             }
         }
     }
-}
\ No newline at end of file
+    // The slice can't outlive this chunk; keep what we have so far.
+    if (parser->value_start) {
+        value_detach(parser, chunk + length);
+    }
+}
@@ -0,0 +1,520 @@
+#include "common.h"
+#include "kk_json.h"
+#include "kk_json_tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+enum {
+    LEX_NONE,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_NUMBER,
+    LEX_LITERAL,
+};
+
+enum {
+    // object frames
+    EXPECT_KEY_OR_END,
+    EXPECT_KEY,
+    EXPECT_COLON,
+    EXPECT_MEMBER_VALUE,
+    EXPECT_MEMBER_COMMA_OR_END,
+    // array frames
+    EXPECT_ELEMENT_OR_END,
+    EXPECT_ELEMENT,
+    EXPECT_ELEMENT_COMMA_OR_END,
+};
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+void json_tokenizer_init(JsonTokenizer *tokenizer) {
+    memset(tokenizer, 0, sizeof(JsonTokenizer));
+    tokenizer->path[0] = '$';
+    tokenizer->path_length = 1;
+}
+
+void json_tokenizer_free(JsonTokenizer *tokenizer) {
+    for (size_t i = 0; i < tokenizer->subscription_count; i++) {
+        free(tokenizer->subscriptions[i].path);
+    }
+    tokenizer->subscription_count = 0;
+    free(tokenizer->text);
+    tokenizer->text = NULL;
+    tokenizer->text_capacity = 0;
+}
+
+void json_tokenizer_reset(JsonTokenizer *tokenizer) {
+    tokenizer->depth = 0;
+    tokenizer->lex_state = LEX_NONE;
+    tokenizer->pending_high_surrogate = 0;
+    tokenizer->text_length = 0;
+    tokenizer->path_length = 1;
+    tokenizer->error = NULL;
+    tokenizer->error_offset = 0;
+}
+
+int json_tokenizer_at_boundary(const JsonTokenizer *tokenizer) {
+    return !tokenizer->error && tokenizer->depth == 0 && tokenizer->lex_state == LEX_NONE;
+}
+
+int json_tokenizer_subscribe(JsonTokenizer *tokenizer, const char *path, json_token_callback callback,
+                             void *user_data) {
+    if (!callback || tokenizer->subscription_count == JSON_MAX_SUBSCRIPTIONS) {
+        fprintf(stderr, "Cannot add JSON path subscription\n");
+        return STATUS_ERROR;
+    }
+    JsonSubscription *sub = &tokenizer->subscriptions[tokenizer->subscription_count];
+    sub->path = NULL;
+    sub->path_length = 0;
+    if (path) {
+        sub->path = strdup(path);
+        if (!sub->path) {
+            fprintf(stderr, "Failed to allocate JSON path subscription\n");
+            return STATUS_ERROR;
+        }
+        sub->path_length = strlen(path);
+    }
+    sub->callback = callback;
+    sub->user_data = user_data;
+    tokenizer->subscription_count++;
+    return STATUS_SUCCESS;
+}
+
+int json_token_to_int64(const JsonToken *token, long long *out) {
+    if (token->type != JSON_TOKEN_NUMBER) {
+        return STATUS_ERROR;
+    }
+    char *end;
+    errno = 0;
+    long long value = strtoll(token->value, &end, 10);
+    if (errno != 0 || *end != '\0') {
+        return STATUS_ERROR;
+    }
+    *out = value;
+    return STATUS_SUCCESS;
+}
+
+static int fail(JsonTokenizer *tokenizer, const char *message) {
+    if (!tokenizer->error) {
+        tokenizer->error = message;
+        tokenizer->error_offset = tokenizer->offset;
+    }
+    return STATUS_ERROR;
+}
+
+static int text_append(JsonTokenizer *tokenizer, const char *data, size_t length) {
+    if (tokenizer->text_length + length + 1 > tokenizer->text_capacity) {
+        size_t new_capacity = tokenizer->text_capacity ? tokenizer->text_capacity * 2 : 256;
+        while (tokenizer->text_length + length + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *ptr = realloc(tokenizer->text, new_capacity);
+        if (!ptr) {
+            return fail(tokenizer, "out of memory");
+        }
+        tokenizer->text = ptr;
+        tokenizer->text_capacity = new_capacity;
+    }
+    memcpy(tokenizer->text + tokenizer->text_length, data, length);
+    tokenizer->text_length += length;
+    tokenizer->text[tokenizer->text_length] = '\0';
+    return STATUS_SUCCESS;
+}
+
+static int text_append_codepoint(JsonTokenizer *tokenizer, uint32_t codepoint) {
+    char utf8[4];
+    return text_append(tokenizer, utf8, json_utf8_encode(codepoint, utf8));
+}
+
+// A high surrogate must be followed directly by a \u low surrogate;
+// anything else turns it into U+FFFD.
+static int flush_high_surrogate(JsonTokenizer *tokenizer) {
+    if (!tokenizer->pending_high_surrogate) {
+        return STATUS_SUCCESS;
+    }
+    tokenizer->pending_high_surrogate = 0;
+    return text_append_codepoint(tokenizer, REPLACEMENT_CHARACTER);
+}
+
+static int finish_unicode_escape(JsonTokenizer *tokenizer) {
+    uint32_t cp = tokenizer->unicode_value;
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!tokenizer->pending_high_surrogate) {
+            return text_append_codepoint(tokenizer, REPLACEMENT_CHARACTER);
+        }
+        uint32_t high = tokenizer->pending_high_surrogate;
+        tokenizer->pending_high_surrogate = 0;
+        return text_append_codepoint(tokenizer, 0x10000 + ((high - 0xD800) << 10) + (cp - 0xDC00));
+    }
+    if (flush_high_surrogate(tokenizer) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        tokenizer->pending_high_surrogate = cp;
+        return STATUS_SUCCESS;
+    }
+    return text_append_codepoint(tokenizer, cp);
+}
+
+static void emit(JsonTokenizer *tokenizer, JsonTokenType type, const char *value, size_t length) {
+    if (tokenizer->subscription_count == 0) {
+        return;
+    }
+    JsonToken token = {
+        .type = type,
+        .value = value,
+        .length = length,
+        .path = tokenizer->path,
+        .path_length = tokenizer->path_length,
+        .depth = tokenizer->depth,
+    };
+    tokenizer->path[tokenizer->path_length] = '\0';
+    for (size_t i = 0; i < tokenizer->subscription_count; i++) {
+        JsonSubscription *sub = &tokenizer->subscriptions[i];
+        if (!sub->path || (sub->path_length == tokenizer->path_length &&
+                           memcmp(sub->path, tokenizer->path, tokenizer->path_length) == 0)) {
+            sub->callback(&token, sub->user_data);
+        }
+    }
+}
+
+static int path_append(JsonTokenizer *tokenizer, const char *prefix, size_t prefix_length, const char *name,
+                       size_t name_length) {
+    if (tokenizer->path_length + prefix_length + name_length >= JSON_PATH_MAX) {
+        return fail(tokenizer, "path too long");
+    }
+    memcpy(tokenizer->path + tokenizer->path_length, prefix, prefix_length);
+    tokenizer->path_length += prefix_length;
+    memcpy(tokenizer->path + tokenizer->path_length, name, name_length);
+    tokenizer->path_length += name_length;
+    return STATUS_SUCCESS;
+}
+
+// Called after any complete value: moves the enclosing container on.
+static void value_done(JsonTokenizer *tokenizer) {
+    if (tokenizer->depth == 0) {
+        return;
+    }
+    JsonFrame *frame = &tokenizer->frames[tokenizer->depth - 1];
+    if (frame->is_array) {
+        frame->state = EXPECT_ELEMENT_COMMA_OR_END;
+    } else {
+        frame->state = EXPECT_MEMBER_COMMA_OR_END;
+        tokenizer->path_length = frame->path_length;
+    }
+}
+
+static int push_container(JsonTokenizer *tokenizer, int is_array) {
+    if (tokenizer->depth == JSON_MAX_DEPTH) {
+        return fail(tokenizer, "nesting too deep");
+    }
+    emit(tokenizer, is_array ? JSON_TOKEN_ARRAY_START : JSON_TOKEN_OBJECT_START, NULL, 0);
+    JsonFrame *frame = &tokenizer->frames[tokenizer->depth++];
+    frame->is_array = (unsigned char)is_array;
+    frame->state = is_array ? EXPECT_ELEMENT_OR_END : EXPECT_KEY_OR_END;
+    frame->path_length = tokenizer->path_length;
+    if (is_array) {
+        return path_append(tokenizer, "[*]", 3, "", 0);
+    }
+    return STATUS_SUCCESS;
+}
+
+static void pop_container(JsonTokenizer *tokenizer) {
+    JsonFrame *frame = &tokenizer->frames[--tokenizer->depth];
+    tokenizer->path_length = frame->path_length;
+    emit(tokenizer, frame->is_array ? JSON_TOKEN_ARRAY_END : JSON_TOKEN_OBJECT_END, NULL, 0);
+    value_done(tokenizer);
+}
+
+static int begin_value(JsonTokenizer *tokenizer, char c) {
+    tokenizer->text_length = 0;
+    switch (c) {
+        case '{': return push_container(tokenizer, 0);
+        case '[': return push_container(tokenizer, 1);
+        case '"':
+            tokenizer->lex_state = LEX_STRING;
+            tokenizer->string_is_key = 0;
+            return text_append(tokenizer, "", 0);
+        case 't': tokenizer->literal = "true";  break;
+        case 'f': tokenizer->literal = "false"; break;
+        case 'n': tokenizer->literal = "null";  break;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                tokenizer->lex_state = LEX_NUMBER;
+                return text_append(tokenizer, &c, 1);
+            }
+            return fail(tokenizer, "unexpected character");
+    }
+    tokenizer->lex_state = LEX_LITERAL;
+    tokenizer->literal_pos = 1;
+    return STATUS_SUCCESS;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static int number_is_valid(const char *s) {
+    if (*s == '-') s++;
+    if (*s == '0') {
+        s++;
+    } else if (*s >= '1' && *s <= '9') {
+        while (*s >= '0' && *s <= '9') s++;
+    } else {
+        return 0;
+    }
+    if (*s == '.') {
+        s++;
+        if (!(*s >= '0' && *s <= '9')) return 0;
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    if (*s == 'e' || *s == 'E') {
+        s++;
+        if (*s == '+' || *s == '-') s++;
+        if (!(*s >= '0' && *s <= '9')) return 0;
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    return *s == '\0';
+}
+
+static int is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// A number has no closing character; it ends at the next delimiter or at
+// json_tokenizer_finish.
+static int finish_number(JsonTokenizer *tokenizer) {
+    tokenizer->lex_state = LEX_NONE;
+    if (!number_is_valid(tokenizer->text)) {
+        return fail(tokenizer, "invalid number");
+    }
+    emit(tokenizer, JSON_TOKEN_NUMBER, tokenizer->text, tokenizer->text_length);
+    value_done(tokenizer);
+    return STATUS_SUCCESS;
+}
+
+static int finish_string(JsonTokenizer *tokenizer) {
+    if (flush_high_surrogate(tokenizer) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    tokenizer->lex_state = LEX_NONE;
+    if (tokenizer->string_is_key) {
+        JsonFrame *frame = &tokenizer->frames[tokenizer->depth - 1];
+        frame->state = EXPECT_COLON;
+        return path_append(tokenizer, ".", 1, tokenizer->text, tokenizer->text_length);
+    }
+    emit(tokenizer, JSON_TOKEN_STRING, tokenizer->text, tokenizer->text_length);
+    value_done(tokenizer);
+    return STATUS_SUCCESS;
+}
+
+static int handle_escape(JsonTokenizer *tokenizer, char c) {
+    char decoded;
+    switch (c) {
+        case '"':  decoded = '"';  break;
+        case '\\': decoded = '\\'; break;
+        case '/':  decoded = '/';  break;
+        case 'b':  decoded = '\b'; break;
+        case 'f':  decoded = '\f'; break;
+        case 'n':  decoded = '\n'; break;
+        case 'r':  decoded = '\r'; break;
+        case 't':  decoded = '\t'; break;
+        case 'u':
+            tokenizer->lex_state = LEX_UNICODE;
+            tokenizer->unicode_value = 0;
+            tokenizer->unicode_digits = 0;
+            return STATUS_SUCCESS;
+        default:
+            return fail(tokenizer, "invalid escape");
+    }
+    tokenizer->lex_state = LEX_STRING;
+    if (flush_high_surrogate(tokenizer) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    return text_append(tokenizer, &decoded, 1);
+}
+
+static int handle_unicode_digit(JsonTokenizer *tokenizer, char c) {
+    int digit;
+    if (c >= '0' && c <= '9') digit = c - '0';
+    else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+    else return fail(tokenizer, "invalid \\u escape");
+    tokenizer->unicode_value = (tokenizer->unicode_value << 4) | (uint32_t)digit;
+    if (++tokenizer->unicode_digits == 4) {
+        tokenizer->lex_state = LEX_STRING;
+        return finish_unicode_escape(tokenizer);
+    }
+    return STATUS_SUCCESS;
+}
+
+// Structural character outside any string/number/literal.
+static int handle_structural(JsonTokenizer *tokenizer, char c) {
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return STATUS_SUCCESS;
+    }
+    if (tokenizer->depth == 0) {
+        return begin_value(tokenizer, c);
+    }
+    JsonFrame *frame = &tokenizer->frames[tokenizer->depth - 1];
+    switch (frame->state) {
+        case EXPECT_KEY_OR_END:
+            if (c == '}') {
+                pop_container(tokenizer);
+                return STATUS_SUCCESS;
+            }
+            /* fall through */
+        case EXPECT_KEY:
+            if (c != '"') {
+                return fail(tokenizer, "expected object key");
+            }
+            tokenizer->lex_state = LEX_STRING;
+            tokenizer->string_is_key = 1;
+            tokenizer->text_length = 0;
+            return text_append(tokenizer, "", 0);
+        case EXPECT_COLON:
+            if (c != ':') {
+                return fail(tokenizer, "expected ':'");
+            }
+            frame->state = EXPECT_MEMBER_VALUE;
+            return STATUS_SUCCESS;
+        case EXPECT_MEMBER_COMMA_OR_END:
+            if (c == ',') {
+                frame->state = EXPECT_KEY;
+                return STATUS_SUCCESS;
+            }
+            if (c == '}') {
+                pop_container(tokenizer);
+                return STATUS_SUCCESS;
+            }
+            return fail(tokenizer, "expected ',' or '}'");
+        case EXPECT_ELEMENT_OR_END:
+            if (c == ']') {
+                pop_container(tokenizer);
+                return STATUS_SUCCESS;
+            }
+            return begin_value(tokenizer, c);
+        case EXPECT_ELEMENT_COMMA_OR_END:
+            if (c == ',') {
+                frame->state = EXPECT_ELEMENT;
+                return STATUS_SUCCESS;
+            }
+            if (c == ']') {
+                pop_container(tokenizer);
+                return STATUS_SUCCESS;
+            }
+            return fail(tokenizer, "expected ',' or ']'");
+        default:  // EXPECT_MEMBER_VALUE, EXPECT_ELEMENT
+            return begin_value(tokenizer, c);
+    }
+}
+
+int json_tokenizer_feed(JsonTokenizer *tokenizer, const char *chunk, size_t length) {
+    if (tokenizer->error) {
+        return STATUS_ERROR;
+    }
+    size_t i = 0;
+    while (i < length) {
+        char c = chunk[i];
+        int status = STATUS_SUCCESS;
+        switch (tokenizer->lex_state) {
+            case LEX_STRING: {
+                // Copy the whole run of plain characters at once
+                size_t run = i;
+                while (run < length && chunk[run] != '"' && chunk[run] != '\\' &&
+                       (unsigned char)chunk[run] >= 0x20) {
+                    run++;
+                }
+                if (run > i) {
+                    if (flush_high_surrogate(tokenizer) != STATUS_SUCCESS ||
+                        text_append(tokenizer, chunk + i, run - i) != STATUS_SUCCESS) {
+                        return STATUS_ERROR;
+                    }
+                    tokenizer->offset += run - i;
+                    i = run;
+                    continue;
+                }
+                if (c == '"') {
+                    status = finish_string(tokenizer);
+                } else if (c == '\\') {
+                    tokenizer->lex_state = LEX_ESCAPE;
+                } else {
+                    status = fail(tokenizer, "control character in string");
+                }
+                break;
+            }
+            case LEX_ESCAPE:
+                status = handle_escape(tokenizer, c);
+                break;
+            case LEX_UNICODE:
+                status = handle_unicode_digit(tokenizer, c);
+                break;
+            case LEX_NUMBER: {
+                size_t run = i;
+                while (run < length && is_number_char(chunk[run])) {
+                    run++;
+                }
+                if (run > i) {
+                    if (text_append(tokenizer, chunk + i, run - i) != STATUS_SUCCESS) {
+                        return STATUS_ERROR;
+                    }
+                    tokenizer->offset += run - i;
+                    i = run;
+                    continue;
+                }
+                if (finish_number(tokenizer) != STATUS_SUCCESS) {
+                    return STATUS_ERROR;
+                }
+                continue;  // c still needs handling as a structural character
+            }
+            case LEX_LITERAL:
+                if (c != tokenizer->literal[tokenizer->literal_pos]) {
+                    return fail(tokenizer, "invalid literal");
+                }
+                if (tokenizer->literal[++tokenizer->literal_pos] == '\0') {
+                    tokenizer->lex_state = LEX_NONE;
+                    JsonTokenType type = tokenizer->literal[0] == 't'   ? JSON_TOKEN_TRUE
+                                         : tokenizer->literal[0] == 'f' ? JSON_TOKEN_FALSE
+                                                                        : JSON_TOKEN_NULL;
+                    emit(tokenizer, type, NULL, 0);
+                    value_done(tokenizer);
+                }
+                break;
+            default:
+                status = handle_structural(tokenizer, c);
+                break;
+        }
+        if (status != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        tokenizer->offset++;
+        i++;
+    }
+    return STATUS_SUCCESS;
+}
+
+int json_tokenizer_finish(JsonTokenizer *tokenizer) {
+    if (tokenizer->error) {
+        return STATUS_ERROR;
+    }
+    switch (tokenizer->lex_state) {
+        case LEX_NUMBER:
+            if (finish_number(tokenizer) != STATUS_SUCCESS) {
+                return STATUS_ERROR;
+            }
+            break;
+        case LEX_STRING:
+        case LEX_ESCAPE:
+        case LEX_UNICODE:
+            return fail(tokenizer, "unterminated string");
+        case LEX_LITERAL:
+            return fail(tokenizer, "unterminated literal");
+        default:
+            break;
+    }
+    if (tokenizer->depth > 0) {
+        return fail(tokenizer, tokenizer->frames[tokenizer->depth - 1].is_array ? "unterminated array"
+                                                                                : "unterminated object");
+    }
+    return STATUS_SUCCESS;
+}
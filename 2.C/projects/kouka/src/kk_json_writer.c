@@ -0,0 +1,210 @@
+#include "common.h"
+#include "kk_json_writer.h"
+#include "kk_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_writer_init(JsonWriter *writer, char *storage, size_t capacity) {
+    memset(writer, 0, sizeof(JsonWriter));
+    if (storage && capacity > 0) {
+        writer->data = storage;
+        writer->capacity = capacity;
+        writer->data[0] = '\0';
+    }
+}
+
+void json_writer_reset(JsonWriter *writer) {
+    writer->length = 0;
+    writer->depth = 0;
+    writer->has_members = 0;
+    writer->after_key = 0;
+    writer->failed = 0;
+    if (writer->data) {
+        writer->data[0] = '\0';
+    }
+}
+
+void json_writer_free(JsonWriter *writer) {
+    if (writer->owns_data) {
+        free(writer->data);
+    }
+    memset(writer, 0, sizeof(JsonWriter));
+}
+
+int json_writer_reserve(JsonWriter *writer, size_t additional) {
+    if (writer->length + additional + 1 <= writer->capacity) {
+        return STATUS_SUCCESS;
+    }
+    if (writer->failed) {
+        return STATUS_ERROR;
+    }
+    size_t new_capacity = writer->capacity ? writer->capacity * 2 : 256;
+    while (writer->length + additional + 1 > new_capacity) {
+        new_capacity *= 2;
+    }
+    char *data = writer->owns_data ? realloc(writer->data, new_capacity) : malloc(new_capacity);
+    if (!data) {
+        fprintf(stderr, "Failed to grow JSON writer buffer\n");
+        writer->failed = 1;
+        return STATUS_ERROR;
+    }
+    if (!writer->owns_data && writer->data) {
+        memcpy(data, writer->data, writer->length + 1);
+    }
+    writer->data = data;
+    writer->capacity = new_capacity;
+    writer->owns_data = 1;
+    return STATUS_SUCCESS;
+}
+
+static void append(JsonWriter *writer, const char *bytes, size_t length) {
+    if (json_writer_reserve(writer, length) != STATUS_SUCCESS) {
+        return;
+    }
+    memcpy(writer->data + writer->length, bytes, length);
+    writer->length += length;
+    writer->data[writer->length] = '\0';
+}
+
+// Emits the comma that separates this value from the previous member.
+static void begin_value(JsonWriter *writer) {
+    if (writer->after_key) {
+        writer->after_key = 0;
+        return;
+    }
+    uint64_t bit = 1ULL << writer->depth;
+    if (writer->has_members & bit) {
+        append(writer, ",", 1);
+    }
+    writer->has_members |= bit;
+}
+
+static void begin_container(JsonWriter *writer, char open) {
+    begin_value(writer);
+    if (writer->depth >= JSON_WRITER_MAX_DEPTH) {
+        writer->failed = 1;
+        return;
+    }
+    append(writer, &open, 1);
+    writer->depth++;
+    writer->has_members &= ~(1ULL << writer->depth);
+}
+
+static void end_container(JsonWriter *writer, char close) {
+    if (writer->depth == 0) {
+        writer->failed = 1;
+        return;
+    }
+    writer->depth--;
+    append(writer, &close, 1);
+}
+
+void json_writer_begin_object(JsonWriter *writer) {
+    begin_container(writer, '{');
+}
+
+void json_writer_end_object(JsonWriter *writer) {
+    end_container(writer, '}');
+}
+
+void json_writer_begin_array(JsonWriter *writer) {
+    begin_container(writer, '[');
+}
+
+void json_writer_end_array(JsonWriter *writer) {
+    end_container(writer, ']');
+}
+
+// Writes one escape sequence for c; out has room for 6 bytes.
+static size_t escape_byte(unsigned char c, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    out[0] = '\\';
+    switch (c) {
+        case '"':  out[1] = '"';  return 2;
+        case '\\': out[1] = '\\'; return 2;
+        case '\b': out[1] = 'b';  return 2;
+        case '\f': out[1] = 'f';  return 2;
+        case '\n': out[1] = 'n';  return 2;
+        case '\r': out[1] = 'r';  return 2;
+        case '\t': out[1] = 't';  return 2;
+        default:
+            memcpy(out + 1, "u00", 3);
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 0xf];
+            return 6;
+    }
+}
+
+// Copies the runs between escapable bytes with memcpy, jumping from one
+// escapable byte to the next through the block's bitmask. Each block
+// reserves its worst case once, so the inner loop never checks capacity.
+static void append_escaped(JsonWriter *writer, const char *value, size_t length) {
+    if (json_writer_reserve(writer, length + 2) != STATUS_SUCCESS) {
+        return;
+    }
+    writer->data[writer->length++] = '"';
+    size_t pos = 0;
+    while (pos < length) {
+        size_t block = length - pos < SCAN_BLOCK_SIZE ? length - pos : SCAN_BLOCK_SIZE;
+        uint64_t escape = scan_escape_block(value + pos, block);
+        // The rest of the input, up to 5 extra bytes per escape, the closing quote
+        size_t worst = (length - pos) + 5 * (size_t)__builtin_popcountll(escape) + 1;
+        if (json_writer_reserve(writer, worst) != STATUS_SUCCESS) {
+            return;
+        }
+        char *out = writer->data + writer->length;
+        size_t run_start = 0;
+        while (escape) {
+            size_t i = (size_t)__builtin_ctzll(escape);
+            escape &= escape - 1;
+            memcpy(out, value + pos + run_start, i - run_start);
+            out += i - run_start;
+            out += escape_byte((unsigned char)value[pos + i], out);
+            run_start = i + 1;
+        }
+        memcpy(out, value + pos + run_start, block - run_start);
+        out += block - run_start;
+        writer->length = (size_t)(out - writer->data);
+        pos += block;
+    }
+    writer->data[writer->length++] = '"';
+    writer->data[writer->length] = '\0';
+}
+
+void json_writer_key(JsonWriter *writer, const char *key) {
+    begin_value(writer);
+    append_escaped(writer, key, strlen(key));
+    append(writer, ":", 1);
+    writer->after_key = 1;
+}
+
+void json_writer_string(JsonWriter *writer, const char *value, size_t length) {
+    begin_value(writer);
+    append_escaped(writer, value, length);
+}
+
+void json_writer_int(JsonWriter *writer, long long value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%lld", value);
+    begin_value(writer);
+    append(writer, digits, (size_t)n);
+}
+
+void json_writer_bool(JsonWriter *writer, int value) {
+    begin_value(writer);
+    if (value) {
+        append(writer, "true", 4);
+    } else {
+        append(writer, "false", 5);
+    }
+}
+
+void json_writer_raw(JsonWriter *writer, const char *json, size_t length) {
+    begin_value(writer);
+    append(writer, json, length);
+}
+
+int json_writer_status(const JsonWriter *writer) {
+    return writer->failed ? STATUS_ERROR : STATUS_SUCCESS;
+}
@@ -0,0 +1,340 @@
+#include "common.h"
+#include "kk_metrics.h"
+#include "kk_json_writer.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *metric_names[METRIC_COUNT] = {
+    "dns", "connect", "ttfb", "ttft", "inter_token", "total",
+};
+
+static const double reported_percentiles[] = {50, 90, 99};
+
+// Histograms
+
+static size_t bucket_index(uint64_t value) {
+    if (value < 2 * HISTOGRAM_SUB_COUNT) {
+        return (size_t)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    if (shift > HISTOGRAM_MAX_SHIFT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    return 2 * HISTOGRAM_SUB_COUNT + (size_t)(shift - 1) * HISTOGRAM_SUB_COUNT +
+           (size_t)((value >> shift) - HISTOGRAM_SUB_COUNT);
+}
+
+static uint64_t bucket_upper_bound(size_t index) {
+    if (index < 2 * HISTOGRAM_SUB_COUNT) {
+        return index;
+    }
+    size_t offset = index - 2 * HISTOGRAM_SUB_COUNT;
+    int shift = (int)(offset / HISTOGRAM_SUB_COUNT) + 1;
+    uint64_t mantissa = offset % HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_COUNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void histogram_reset(LatencyHistogram *histogram) {
+    memset(histogram, 0, sizeof(LatencyHistogram));
+}
+
+void histogram_record(LatencyHistogram *histogram, uint64_t value) {
+    histogram->counts[bucket_index(value)]++;
+    if (histogram->count == 0 || value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+    histogram->count++;
+    histogram->sum += value;
+}
+
+void histogram_merge(LatencyHistogram *into, const LatencyHistogram *from) {
+    if (from->count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    if (into->count == 0 || from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+    into->count += from->count;
+    into->sum += from->sum;
+}
+
+uint64_t histogram_percentile(const LatencyHistogram *histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->count + 0.999999);
+    if (rank == 0) {
+        return histogram->min;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            // The last bucket also holds everything past the range
+            uint64_t upper = i == HISTOGRAM_BUCKETS - 1 ? histogram->max : bucket_upper_bound(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Registry
+
+KkMetrics* metrics_create(void) {
+    KkMetrics *metrics = calloc(1, sizeof(KkMetrics));
+    if (!metrics) {
+        fprintf(stderr, "Failed to allocate metrics\n");
+        return NULL;
+    }
+    pthread_mutex_init(&metrics->lock, NULL);
+    return metrics;
+}
+
+void metrics_destroy(KkMetrics *metrics) {
+    if (!metrics) return;
+    pthread_mutex_destroy(&metrics->lock);
+    free(metrics->models);
+    free(metrics);
+}
+
+// A handful of models per run at most, so a linear scan is fine.
+static ModelMetrics* find_model(KkMetrics *metrics, const char *model, int create) {
+    for (size_t i = 0; i < metrics->model_count; i++) {
+        if (strncmp(metrics->models[i].model, model, METRICS_MODEL_NAME - 1) == 0) {
+            return &metrics->models[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (metrics->model_count == metrics->model_capacity) {
+        size_t capacity = metrics->model_capacity ? metrics->model_capacity * 2 : 4;
+        ModelMetrics *models = realloc(metrics->models, capacity * sizeof(ModelMetrics));
+        if (!models) {
+            fprintf(stderr, "Failed to allocate model metrics\n");
+            return NULL;
+        }
+        metrics->models = models;
+        metrics->model_capacity = capacity;
+    }
+    ModelMetrics *entry = &metrics->models[metrics->model_count++];
+    memset(entry, 0, sizeof(ModelMetrics));
+    snprintf(entry->model, sizeof(entry->model), "%s", model);
+    return entry;
+}
+
+void metrics_record(KkMetrics *metrics, const char *model, const RequestTrace *trace,
+                    const RequestTimings *timings, int succeeded) {
+    pthread_mutex_lock(&metrics->lock);
+    ModelMetrics *entry = find_model(metrics, model, 1);
+    if (!entry) {
+        pthread_mutex_unlock(&metrics->lock);
+        return;
+    }
+    entry->requests++;
+    if (!succeeded) {
+        entry->failures++;
+    }
+    if (timings) {
+        histogram_record(&entry->latency[METRIC_DNS], timings->dns_us);
+        histogram_record(&entry->latency[METRIC_CONNECT], timings->connect_us);
+        histogram_record(&entry->latency[METRIC_TTFB], timings->ttfb_us);
+        histogram_record(&entry->latency[METRIC_TOTAL], timings->total_us);
+    }
+    if (trace) {
+        entry->tokens += trace->tokens;
+        if (trace->tokens > 0) {
+            histogram_record(&entry->latency[METRIC_TTFT], (trace->first_token_ns - trace->start_ns) / 1000);
+        }
+        histogram_merge(&entry->latency[METRIC_INTER_TOKEN], &trace->inter_token);
+        if (trace->eval_count > 0 && trace->eval_duration > 0) {
+            entry->eval_count += (unsigned long long)trace->eval_count;
+            histogram_record(&entry->eval_rate,
+                             (uint64_t)((double)trace->eval_count * 1e9 / (double)trace->eval_duration));
+        }
+    }
+    pthread_mutex_unlock(&metrics->lock);
+}
+
+int metrics_snapshot(KkMetrics *metrics, const char *model, ModelMetrics *out) {
+    pthread_mutex_lock(&metrics->lock);
+    ModelMetrics *entry = find_model(metrics, model, 0);
+    if (entry) {
+        *out = *entry;
+    }
+    pthread_mutex_unlock(&metrics->lock);
+    return entry ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+// Output
+
+static void write_histogram_json(JsonWriter *writer, const char *name, const LatencyHistogram *histogram) {
+    char key[16];
+    json_writer_key(writer, name);
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "count");
+    json_writer_int(writer, (long long)histogram->count);
+    json_writer_key(writer, "min");
+    json_writer_int(writer, (long long)histogram->min);
+    json_writer_key(writer, "mean");
+    json_writer_int(writer, histogram->count ? (long long)(histogram->sum / histogram->count) : 0);
+    for (size_t i = 0; i < sizeof(reported_percentiles) / sizeof(reported_percentiles[0]); i++) {
+        snprintf(key, sizeof(key), "p%g", reported_percentiles[i]);
+        json_writer_key(writer, key);
+        json_writer_int(writer, (long long)histogram_percentile(histogram, reported_percentiles[i]));
+    }
+    json_writer_key(writer, "max");
+    json_writer_int(writer, (long long)histogram->max);
+    json_writer_end_object(writer);
+}
+
+int metrics_write_json(KkMetrics *metrics, FILE *out) {
+    JsonWriter writer;
+    json_writer_init(&writer, NULL, 0);
+    pthread_mutex_lock(&metrics->lock);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "models");
+    json_writer_begin_array(&writer);
+    for (size_t m = 0; m < metrics->model_count; m++) {
+        const ModelMetrics *entry = &metrics->models[m];
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, "model");
+        json_writer_string(&writer, entry->model, strlen(entry->model));
+        json_writer_key(&writer, "requests");
+        json_writer_int(&writer, (long long)entry->requests);
+        json_writer_key(&writer, "failures");
+        json_writer_int(&writer, (long long)entry->failures);
+        json_writer_key(&writer, "tokens");
+        json_writer_int(&writer, (long long)entry->tokens);
+        json_writer_key(&writer, "eval_count");
+        json_writer_int(&writer, (long long)entry->eval_count);
+        json_writer_key(&writer, "latency_us");
+        json_writer_begin_object(&writer);
+        for (int k = 0; k < METRIC_COUNT; k++) {
+            write_histogram_json(&writer, metric_names[k], &entry->latency[k]);
+        }
+        json_writer_end_object(&writer);
+        write_histogram_json(&writer, "eval_tokens_per_second", &entry->eval_rate);
+        json_writer_end_object(&writer);
+    }
+    json_writer_end_array(&writer);
+    json_writer_end_object(&writer);
+    pthread_mutex_unlock(&metrics->lock);
+
+    int status = json_writer_status(&writer);
+    if (status == STATUS_SUCCESS && (fwrite(writer.data, 1, writer.length, out) != writer.length ||
+                                     fputc('\n', out) == EOF)) {
+        status = STATUS_ERROR;
+    }
+    json_writer_free(&writer);
+    return status;
+}
+
+// Model names go inside a quoted label value; escape what the format requires.
+static void write_label(FILE *out, const char *model) {
+    for (const char *p = model; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p == '\n') {
+            fputs("\\n", out);
+        } else {
+            fputc(*p, out);
+        }
+    }
+}
+
+static void write_summary(FILE *out, const char *name, const char *model, const LatencyHistogram *histogram,
+                          double scale) {
+    for (size_t i = 0; i < sizeof(reported_percentiles) / sizeof(reported_percentiles[0]); i++) {
+        fprintf(out, "%s{model=\"", name);
+        write_label(out, model);
+        fprintf(out, "\",quantile=\"%g\"} %.9g\n", reported_percentiles[i] / 100,
+                (double)histogram_percentile(histogram, reported_percentiles[i]) * scale);
+    }
+    fprintf(out, "%s_sum{model=\"", name);
+    write_label(out, model);
+    fprintf(out, "\"} %.9g\n", (double)histogram->sum * scale);
+    fprintf(out, "%s_count{model=\"", name);
+    write_label(out, model);
+    fprintf(out, "\"} %llu\n", (unsigned long long)histogram->count);
+}
+
+static void write_counter(FILE *out, KkMetrics *metrics, const char *name, const char *help, size_t field) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (size_t m = 0; m < metrics->model_count; m++) {
+        const ModelMetrics *entry = &metrics->models[m];
+        fprintf(out, "%s{model=\"", name);
+        write_label(out, entry->model);
+        fprintf(out, "\"} %lu\n", *(const unsigned long *)((const char *)entry + field));
+    }
+}
+
+int metrics_write_prometheus(KkMetrics *metrics, FILE *out) {
+    char name[64];
+    pthread_mutex_lock(&metrics->lock);
+    write_counter(out, metrics, "kouka_requests_total", "Model requests sent.",
+                  offsetof(ModelMetrics, requests));
+    write_counter(out, metrics, "kouka_request_failures_total", "Model requests that failed.",
+                  offsetof(ModelMetrics, failures));
+    write_counter(out, metrics, "kouka_tokens_total", "Response tokens received.",
+                  offsetof(ModelMetrics, tokens));
+    for (int k = 0; k < METRIC_COUNT; k++) {
+        snprintf(name, sizeof(name), "kouka_%s_seconds", metric_names[k]);
+        fprintf(out, "# TYPE %s summary\n", name);
+        for (size_t m = 0; m < metrics->model_count; m++) {
+            write_summary(out, name, metrics->models[m].model, &metrics->models[m].latency[k], 1e-6);
+        }
+    }
+    fprintf(out, "# TYPE kouka_eval_tokens_per_second summary\n");
+    for (size_t m = 0; m < metrics->model_count; m++) {
+        write_summary(out, "kouka_eval_tokens_per_second", metrics->models[m].model,
+                      &metrics->models[m].eval_rate, 1.0);
+    }
+    pthread_mutex_unlock(&metrics->lock);
+    return ferror(out) ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+// Request traces
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_eval_field(const JsonToken *token, void *user_data) {
+    long long *field = (long long *)user_data;
+    json_token_to_int64(token, field);
+}
+
+void request_trace_begin(RequestTrace *trace) {
+    memset(trace, 0, sizeof(RequestTrace));
+    trace->start_ns = metrics_now_ns();
+    json_tokenizer_init(&trace->tokenizer);
+    json_tokenizer_subscribe(&trace->tokenizer, "$.eval_count", trace_eval_field, &trace->eval_count);
+    json_tokenizer_subscribe(&trace->tokenizer, "$.eval_duration", trace_eval_field, &trace->eval_duration);
+}
+
+void request_trace_token(RequestTrace *trace) {
+    uint64_t now = metrics_now_ns();
+    if (trace->tokens == 0) {
+        trace->first_token_ns = now;
+    } else {
+        histogram_record(&trace->inter_token, (now - trace->last_token_ns) / 1000);
+    }
+    trace->last_token_ns = now;
+    trace->tokens++;
+}
+
+// Malformed input only stops the eval fields from being picked up.
+void request_trace_feed(RequestTrace *trace, const char *chunk, size_t length) {
+    json_tokenizer_feed(&trace->tokenizer, chunk, length);
+}
+
+void request_trace_free(RequestTrace *trace) {
+    json_tokenizer_free(&trace->tokenizer);
+}
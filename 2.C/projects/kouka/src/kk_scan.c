@@ -0,0 +1,210 @@
+#include "kk_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KK_SCAN_X86 1
+#endif
+
+typedef void (*scan_block_fn)(const char *data, ScanMasks *masks);
+typedef uint64_t (*scan_escape_fn)(const char *data);
+
+// Bit 0: ends a string run, bit 1: structural
+static const unsigned char byte_class[256] = {
+    ['"'] = 3, ['\\'] = 1,
+    ['{'] = 2, ['}'] = 2, ['['] = 2, [']'] = 2, [':'] = 2, [','] = 2,
+};
+
+static void scan_block_scalar_n(const char *data, size_t length, ScanMasks *masks) {
+    uint64_t string = 0, structural = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char cls = byte_class[(unsigned char)data[i]];
+        string |= (uint64_t)(cls & 1) << i;
+        structural |= (uint64_t)(cls >> 1) << i;
+    }
+    masks->string = string;
+    masks->structural = structural;
+}
+
+static void scan_block_scalar(const char *data, ScanMasks *masks) {
+    scan_block_scalar_n(data, SCAN_BLOCK_SIZE, masks);
+}
+
+static uint64_t scan_escape_scalar_n(const char *data, size_t length) {
+    uint64_t escape = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)data[i];
+        escape |= (uint64_t)(c < 0x20 || c == '"' || c == '\\') << i;
+    }
+    return escape;
+}
+
+static uint64_t scan_escape_scalar(const char *data) {
+    return scan_escape_scalar_n(data, SCAN_BLOCK_SIZE);
+}
+
+#ifdef KK_SCAN_X86
+// SSE2 is part of the x86-64 baseline, so this needs no target attribute.
+// '[' and '{' (and ']' and '}') differ only in bit 0x20, so OR-ing each byte
+// with 0x20 folds the brackets onto the braces and saves two compares.
+static void scan_block_sse2(const char *data, ScanMasks *masks) {
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    uint64_t string = 0, structural = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + lane * 16));
+        __m128i folded = _mm_or_si128(block, fold);
+        __m128i quotes = _mm_cmpeq_epi8(block, quote);
+        __m128i str = _mm_or_si128(quotes, _mm_cmpeq_epi8(block, backslash));
+        __m128i st = _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close));
+        st = _mm_or_si128(st, quotes);
+        st = _mm_or_si128(st, _mm_cmpeq_epi8(block, colon));
+        st = _mm_or_si128(st, _mm_cmpeq_epi8(block, comma));
+        string |= (uint64_t)(unsigned)_mm_movemask_epi8(str) << (lane * 16);
+        structural |= (uint64_t)(unsigned)_mm_movemask_epi8(st) << (lane * 16);
+    }
+    masks->string = string;
+    masks->structural = structural;
+}
+
+// There is no unsigned byte compare, but max(c, 0x1f) == 0x1f iff c < 0x20.
+static uint64_t scan_escape_sse2(const char *data) {
+    const __m128i control_max = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    uint64_t escape = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + lane * 16));
+        __m128i esc = _mm_cmpeq_epi8(_mm_max_epu8(block, control_max), control_max);
+        esc = _mm_or_si128(esc, _mm_cmpeq_epi8(block, quote));
+        esc = _mm_or_si128(esc, _mm_cmpeq_epi8(block, backslash));
+        escape |= (uint64_t)(unsigned)_mm_movemask_epi8(esc) << (lane * 16);
+    }
+    return escape;
+}
+
+__attribute__((target("avx2")))
+static void scan_block_avx2(const char *data, ScanMasks *masks) {
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    uint64_t string = 0, structural = 0;
+    for (int lane = 0; lane < 2; lane++) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + lane * 32));
+        __m256i folded = _mm256_or_si256(block, fold);
+        __m256i quotes = _mm256_cmpeq_epi8(block, quote);
+        __m256i str = _mm256_or_si256(quotes, _mm256_cmpeq_epi8(block, backslash));
+        __m256i st = _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close));
+        st = _mm256_or_si256(st, quotes);
+        st = _mm256_or_si256(st, _mm256_cmpeq_epi8(block, colon));
+        st = _mm256_or_si256(st, _mm256_cmpeq_epi8(block, comma));
+        string |= (uint64_t)(uint32_t)_mm256_movemask_epi8(str) << (lane * 32);
+        structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(st) << (lane * 32);
+    }
+    masks->string = string;
+    masks->structural = structural;
+}
+
+__attribute__((target("avx2")))
+static uint64_t scan_escape_avx2(const char *data) {
+    const __m256i control_max = _mm256_set1_epi8(0x1f);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    uint64_t escape = 0;
+    for (int lane = 0; lane < 2; lane++) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + lane * 32));
+        __m256i esc = _mm256_cmpeq_epi8(_mm256_max_epu8(block, control_max), control_max);
+        esc = _mm256_or_si256(esc, _mm256_cmpeq_epi8(block, quote));
+        esc = _mm256_or_si256(esc, _mm256_cmpeq_epi8(block, backslash));
+        escape |= (uint64_t)(uint32_t)_mm256_movemask_epi8(esc) << (lane * 32);
+    }
+    return escape;
+}
+#endif
+
+static ScanIsa active_isa = SCAN_ISA_SCALAR;
+static scan_block_fn block_impl = NULL;
+static scan_escape_fn escape_impl = NULL;
+
+static ScanIsa scan_best_isa(void) {
+#ifdef KK_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SCAN_ISA_AVX2;
+    }
+    return SCAN_ISA_SSE2;
+#else
+    return SCAN_ISA_SCALAR;
+#endif
+}
+
+ScanIsa scan_select_isa(ScanIsa isa) {
+    ScanIsa best = scan_best_isa();
+    if (isa > best) {
+        isa = best;
+    }
+    scan_block_fn impl = scan_block_scalar;
+    scan_escape_fn escape = scan_escape_scalar;
+#ifdef KK_SCAN_X86
+    if (isa == SCAN_ISA_AVX2) {
+        impl = scan_block_avx2;
+        escape = scan_escape_avx2;
+    } else if (isa == SCAN_ISA_SSE2) {
+        impl = scan_block_sse2;
+        escape = scan_escape_sse2;
+    }
+#endif
+    // Threads racing through the first-use path all store the same values.
+    __atomic_store_n(&active_isa, isa, __ATOMIC_RELAXED);
+    __atomic_store_n(&escape_impl, escape, __ATOMIC_RELEASE);
+    __atomic_store_n(&block_impl, impl, __ATOMIC_RELEASE);
+    return isa;
+}
+
+ScanIsa scan_active_isa(void) {
+    if (!__atomic_load_n(&block_impl, __ATOMIC_ACQUIRE)) {
+        scan_select_isa(SCAN_ISA_AVX2);
+    }
+    return __atomic_load_n(&active_isa, __ATOMIC_RELAXED);
+}
+
+const char* scan_isa_name(ScanIsa isa) {
+    switch (isa) {
+        case SCAN_ISA_AVX2: return "avx2";
+        case SCAN_ISA_SSE2: return "sse2";
+        default:            return "scalar";
+    }
+}
+
+void scan_block(const char *data, size_t length, ScanMasks *masks) {
+    if (length < SCAN_BLOCK_SIZE) {
+        scan_block_scalar_n(data, length, masks);
+        return;
+    }
+    scan_block_fn impl = __atomic_load_n(&block_impl, __ATOMIC_ACQUIRE);
+    if (!impl) {
+        scan_active_isa();
+        impl = __atomic_load_n(&block_impl, __ATOMIC_ACQUIRE);
+    }
+    impl(data, masks);
+}
+
+uint64_t scan_escape_block(const char *data, size_t length) {
+    if (length < SCAN_BLOCK_SIZE) {
+        return scan_escape_scalar_n(data, length);
+    }
+    scan_escape_fn impl = __atomic_load_n(&escape_impl, __ATOMIC_ACQUIRE);
+    if (!impl) {
+        scan_active_isa();
+        impl = __atomic_load_n(&escape_impl, __ATOMIC_ACQUIRE);
+    }
+    return impl(data);
+}
@@ -0,0 +1,451 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_template.h"
+#include "kk_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define TEMPLATE_MAX_DEPTH 32
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Compiler
+
+typedef struct TemplateCompiler {
+    Template *tpl;
+    size_t op_capacity;
+    size_t name_capacity;
+    uint32_t open[TEMPLATE_MAX_DEPTH];  // op index of each open section
+    size_t depth;
+} TemplateCompiler;
+
+static int template_error(const Template *tpl, size_t offset, const char *message) {
+    int line = 1;
+    for (size_t i = 0; i < offset; i++) {
+        if (tpl->source[i] == '\n') line++;
+    }
+    fprintf(stderr, "Template error at line %d: %s\n", line, message);
+    return STATUS_ERROR;
+}
+
+static int emit(TemplateCompiler *c, uint32_t opcode, uint32_t a, uint32_t b) {
+    Template *tpl = c->tpl;
+    if (opcode == TEMPLATE_OP_TEXT) {
+        if (b == 0) return STATUS_SUCCESS;
+        TemplateOp *last = tpl->op_count ? &tpl->ops[tpl->op_count - 1] : NULL;
+        if (last && last->opcode == TEMPLATE_OP_TEXT && last->a + last->b == a) {
+            last->b += b;
+            return STATUS_SUCCESS;
+        }
+    }
+    if (tpl->op_count == c->op_capacity) {
+        size_t capacity = c->op_capacity ? c->op_capacity * 2 : 16;
+        TemplateOp *ops = realloc(tpl->ops, capacity * sizeof(TemplateOp));
+        if (!ops) {
+            fprintf(stderr, "Failed to allocate template\n");
+            return STATUS_ERROR;
+        }
+        tpl->ops = ops;
+        c->op_capacity = capacity;
+    }
+    tpl->ops[tpl->op_count++] = (TemplateOp){.opcode = opcode, .a = a, .b = b};
+    return STATUS_SUCCESS;
+}
+
+static int slot_for(TemplateCompiler *c, const char *name, size_t length) {
+    Template *tpl = c->tpl;
+    for (size_t i = 0; i < tpl->var_count; i++) {
+        if (strncmp(tpl->names[i], name, length) == 0 && tpl->names[i][length] == '\0') {
+            return (int)i;
+        }
+    }
+    if (tpl->var_count == c->name_capacity) {
+        size_t capacity = c->name_capacity ? c->name_capacity * 2 : 8;
+        char **names = realloc(tpl->names, capacity * sizeof(char *));
+        if (!names) {
+            fprintf(stderr, "Failed to allocate template\n");
+            return -1;
+        }
+        tpl->names = names;
+        c->name_capacity = capacity;
+    }
+    char *copy = strndup(name, length);
+    if (!copy) {
+        fprintf(stderr, "Failed to allocate template\n");
+        return -1;
+    }
+    tpl->names[tpl->var_count] = copy;
+    return (int)tpl->var_count++;
+}
+
+static int is_blank(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+// For a tag spanning [tag_start, tag_end) with text pending from text_start:
+// if nothing but blanks shares its line, widens the span to the whole line
+// including its newline.
+static void trim_standalone(const Template *tpl, size_t text_start, size_t *tag_start, size_t *tag_end) {
+    const char *s = tpl->source;
+    size_t begin = *tag_start;
+    while (begin > text_start && is_blank(s[begin - 1])) {
+        begin--;
+    }
+    if (begin > 0 && s[begin - 1] != '\n') {
+        return;
+    }
+    size_t end = *tag_end;
+    while (end < tpl->length && is_blank(s[end])) {
+        end++;
+    }
+    if (end < tpl->length && s[end] == '\r' && end + 1 < tpl->length && s[end + 1] == '\n') {
+        end++;
+    }
+    if (end < tpl->length && s[end] != '\n') {
+        return;
+    }
+    *tag_start = begin;
+    *tag_end = end < tpl->length ? end + 1 : end;
+}
+
+static int compile(TemplateCompiler *c) {
+    Template *tpl = c->tpl;
+    const char *s = tpl->source;
+    size_t pos = 0;
+    while (pos < tpl->length) {
+        const char *open = memmem(s + pos, tpl->length - pos, "{{", 2);
+        if (!open) break;
+        size_t tag_start = (size_t)(open - s);
+        const char *close = memmem(open + 2, tpl->length - tag_start - 2, "}}", 2);
+        if (!close) {
+            return template_error(tpl, tag_start, "unterminated tag");
+        }
+        size_t tag_end = (size_t)(close - s) + 2;
+
+        const char *name = open + 2;
+        const char *name_end = close;
+        char sigil = *name;
+        if (sigil == '#' || sigil == '^' || sigil == '/' || sigil == '!') {
+            name++;
+        } else {
+            sigil = 0;
+        }
+        while (name < name_end && is_blank(*name)) name++;
+        while (name_end > name && is_blank(name_end[-1])) name_end--;
+        if (sigil != '!' && name == name_end) {
+            return template_error(tpl, tag_start, "empty tag");
+        }
+
+        if (sigil) {
+            trim_standalone(tpl, pos, &tag_start, &tag_end);
+        }
+        if (emit(c, TEMPLATE_OP_TEXT, (uint32_t)pos, (uint32_t)(tag_start - pos)) != STATUS_SUCCESS) {
+            return STATUS_ERROR;
+        }
+        pos = tag_end;
+        if (sigil == '!') continue;
+
+        int slot = slot_for(c, name, (size_t)(name_end - name));
+        if (slot < 0) return STATUS_ERROR;
+        if (sigil == 0) {
+            if (emit(c, TEMPLATE_OP_VAR, (uint32_t)slot, 0) != STATUS_SUCCESS) return STATUS_ERROR;
+        } else if (sigil == '#' || sigil == '^') {
+            if (c->depth == TEMPLATE_MAX_DEPTH) {
+                return template_error(tpl, tag_start, "sections nested too deeply");
+            }
+            c->open[c->depth++] = (uint32_t)tpl->op_count;
+            if (c->depth > tpl->max_depth) tpl->max_depth = c->depth;
+            uint32_t opcode = sigil == '#' ? TEMPLATE_OP_SECTION : TEMPLATE_OP_INVERTED;
+            if (emit(c, opcode, (uint32_t)slot, 0) != STATUS_SUCCESS) return STATUS_ERROR;
+        } else {
+            if (c->depth == 0 || tpl->ops[c->open[c->depth - 1]].a != (uint32_t)slot) {
+                return template_error(tpl, tag_start, "closing tag does not match an open section");
+            }
+            uint32_t start = c->open[--c->depth];
+            tpl->ops[start].b = (uint32_t)tpl->op_count;
+            if (emit(c, TEMPLATE_OP_END, (uint32_t)slot, start) != STATUS_SUCCESS) return STATUS_ERROR;
+        }
+    }
+    if (c->depth > 0) {
+        return template_error(tpl, tpl->length, "unclosed section");
+    }
+    return emit(c, TEMPLATE_OP_TEXT, (uint32_t)pos, (uint32_t)(tpl->length - pos));
+}
+
+Template* template_compile(const char *source, size_t length) {
+    if (length > UINT32_MAX) {
+        fprintf(stderr, "Template too large\n");
+        return NULL;
+    }
+    Template *tpl = calloc(1, sizeof(Template));
+    if (!tpl) {
+        fprintf(stderr, "Failed to allocate template\n");
+        return NULL;
+    }
+    tpl->source = malloc(length + 1);
+    if (!tpl->source) {
+        fprintf(stderr, "Failed to allocate template\n");
+        free(tpl);
+        return NULL;
+    }
+    memcpy(tpl->source, source, length);
+    tpl->source[length] = '\0';
+    tpl->length = length;
+
+    TemplateCompiler compiler = {.tpl = tpl};
+    if (compile(&compiler) != STATUS_SUCCESS) {
+        template_free(tpl);
+        return NULL;
+    }
+    return tpl;
+}
+
+void template_free(Template *tpl) {
+    if (!tpl) return;
+    for (size_t i = 0; i < tpl->var_count; i++) {
+        free(tpl->names[i]);
+    }
+    free(tpl->names);
+    free(tpl->ops);
+    free(tpl->source);
+    free(tpl);
+}
+
+int template_var_index(const Template *tpl, const char *name) {
+    for (size_t i = 0; i < tpl->var_count; i++) {
+        if (strcmp(tpl->names[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Renderer
+
+static int output_push(TemplateOutput *out, const char *data, size_t length) {
+    if (out->count == out->capacity) {
+        size_t capacity = out->capacity ? out->capacity * 2 : 64;
+        struct iovec *iov = realloc(out->iov, capacity * sizeof(struct iovec));
+        if (!iov) {
+            fprintf(stderr, "Failed to allocate template output\n");
+            return STATUS_ERROR;
+        }
+        out->iov = iov;
+        out->capacity = capacity;
+    }
+    out->iov[out->count].iov_base = (void *)data;
+    out->iov[out->count].iov_len = length;
+    out->count++;
+    out->bytes += length;
+    return STATUS_SUCCESS;
+}
+
+// scopes[0] is the caller's values, scopes[1..depth] the rows of the
+// sections being repeated. Unset names fall through to outer scopes.
+static const TemplateValue* lookup(const TemplateValue **scopes, size_t depth, uint32_t slot) {
+    for (;;) {
+        const TemplateValue *value = &scopes[depth][slot];
+        if (value->data || value->rows || depth == 0) {
+            return value;
+        }
+        depth--;
+    }
+}
+
+static int truthy(const TemplateValue *value) {
+    return value->rows ? value->row_count > 0 : value->length > 0;
+}
+
+static int render_range(const Template *tpl, size_t pc, size_t end, const TemplateValue **scopes, size_t depth,
+                        TemplateOutput *out) {
+    while (pc < end) {
+        const TemplateOp *op = &tpl->ops[pc];
+        switch (op->opcode) {
+            case TEMPLATE_OP_TEXT:
+                if (output_push(out, tpl->source + op->a, op->b) != STATUS_SUCCESS) return STATUS_ERROR;
+                pc++;
+                break;
+            case TEMPLATE_OP_VAR: {
+                const TemplateValue *value = lookup(scopes, depth, op->a);
+                if (value->length > 0 && output_push(out, value->data, value->length) != STATUS_SUCCESS) {
+                    return STATUS_ERROR;
+                }
+                pc++;
+                break;
+            }
+            case TEMPLATE_OP_SECTION: {
+                const TemplateValue *value = lookup(scopes, depth, op->a);
+                if (value->rows) {
+                    for (size_t r = 0; r < value->row_count; r++) {
+                        scopes[depth + 1] = value->rows + r * tpl->var_count;
+                        if (render_range(tpl, pc + 1, op->b, scopes, depth + 1, out) != STATUS_SUCCESS) {
+                            return STATUS_ERROR;
+                        }
+                    }
+                    pc = op->b + 1;
+                } else {
+                    // A plain value renders the body once, in place
+                    pc = value->length > 0 ? pc + 1 : op->b + 1;
+                }
+                break;
+            }
+            case TEMPLATE_OP_INVERTED:
+                pc = truthy(lookup(scopes, depth, op->a)) ? op->b + 1 : pc + 1;
+                break;
+            default:
+                pc++;
+                break;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int template_render(const Template *tpl, const TemplateValue *values, TemplateOutput *out) {
+    const TemplateValue *scopes[TEMPLATE_MAX_DEPTH + 1];
+    static const TemplateValue empty = {0};
+    // A template without names may be rendered with values == NULL
+    scopes[0] = values ? values : &empty;
+    if (!values && tpl->var_count > 0) {
+        fprintf(stderr, "Template needs %zu values\n", tpl->var_count);
+        return STATUS_ERROR;
+    }
+    return render_range(tpl, 0, tpl->op_count, scopes, 0, out);
+}
+
+void template_output_init(TemplateOutput *out) {
+    memset(out, 0, sizeof(TemplateOutput));
+}
+
+void template_output_reset(TemplateOutput *out) {
+    out->count = 0;
+    out->bytes = 0;
+}
+
+void template_output_free(TemplateOutput *out) {
+    free(out->iov);
+    memset(out, 0, sizeof(TemplateOutput));
+}
+
+int template_output_write(TemplateOutput *out, int fd) {
+    struct iovec *iov = out->iov;
+    size_t remaining = out->count;
+    while (remaining > 0) {
+        int batch = remaining < IOV_MAX ? (int)remaining : IOV_MAX;
+        ssize_t n = writev(fd, iov, batch);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Failed to write template output: %s\n", strerror(errno));
+            return STATUS_ERROR;
+        }
+        // Skip what was written, trimming a partially written entry
+        while (remaining > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            remaining--;
+        }
+        if (remaining > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    template_output_reset(out);
+    return STATUS_SUCCESS;
+}
+
+char* template_output_join(const TemplateOutput *out) {
+    char *text = malloc(out->bytes + 1);
+    if (!text) {
+        fprintf(stderr, "Failed to allocate template output\n");
+        return NULL;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < out->count; i++) {
+        memcpy(text + offset, out->iov[i].iov_base, out->iov[i].iov_len);
+        offset += out->iov[i].iov_len;
+    }
+    text[offset] = '\0';
+    return text;
+}
+
+// Cache
+
+TemplateCache* template_cache_create(void) {
+    TemplateCache *cache = calloc(1, sizeof(TemplateCache));
+    if (!cache) {
+        fprintf(stderr, "Failed to allocate template cache\n");
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void template_cache_destroy(TemplateCache *cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        template_free(cache->templates[i]);
+    }
+    free(cache->keys);
+    free(cache->templates);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+static int cache_grow(TemplateCache *cache) {
+    size_t count = cache->slot_count ? cache->slot_count * 2 : 32;
+    uint64_t *keys = calloc(count, sizeof(uint64_t));
+    Template **templates = calloc(count, sizeof(Template *));
+    if (!keys || !templates) {
+        fprintf(stderr, "Failed to allocate template cache\n");
+        free(keys);
+        free(templates);
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        if (!cache->templates[i]) continue;
+        size_t slot = (size_t)cache->keys[i] & (count - 1);
+        while (templates[slot]) {
+            slot = (slot + 1) & (count - 1);
+        }
+        keys[slot] = cache->keys[i];
+        templates[slot] = cache->templates[i];
+    }
+    free(cache->keys);
+    free(cache->templates);
+    cache->keys = keys;
+    cache->templates = templates;
+    cache->slot_count = count;
+    return STATUS_SUCCESS;
+}
+
+const Template* template_cache_get(TemplateCache *cache, const char *source, size_t length) {
+    uint64_t key = xxh64(source, length, 0);
+    pthread_mutex_lock(&cache->lock);
+    if ((cache->count + 1) * 2 > cache->slot_count && cache_grow(cache) != STATUS_SUCCESS) {
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    size_t mask = cache->slot_count - 1;
+    size_t slot = (size_t)key & mask;
+    while (cache->templates[slot]) {
+        const Template *tpl = cache->templates[slot];
+        if (cache->keys[slot] == key && tpl->length == length && memcmp(tpl->source, source, length) == 0) {
+            pthread_mutex_unlock(&cache->lock);
+            return tpl;
+        }
+        slot = (slot + 1) & mask;
+    }
+    Template *tpl = template_compile(source, length);
+    if (tpl) {
+        cache->keys[slot] = key;
+        cache->templates[slot] = tpl;
+        cache->count++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return tpl;
+}
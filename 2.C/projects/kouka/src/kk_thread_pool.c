@@ -0,0 +1,113 @@
+#include "common.h"
+#include "kk_thread_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void *thread_pool_worker(void *arg) {
+    ThreadPool *pool = (ThreadPool *)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->head && !pool->shutting_down) {
+            pthread_cond_wait(&pool->job_available, &pool->lock);
+        }
+        if (!pool->head) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        ThreadPoolJob *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        job->task(job->arg);
+        free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->all_done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+ThreadPool* thread_pool_create(size_t thread_count) {
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        fprintf(stderr, "Failed to allocate thread pool\n");
+        return NULL;
+    }
+    pool->threads = calloc(thread_count, sizeof(pthread_t));
+    if (!pool->threads) {
+        fprintf(stderr, "Failed to allocate thread pool\n");
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_available, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) != 0) {
+            fprintf(stderr, "Failed to start worker thread\n");
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+    return pool;
+}
+
+int thread_pool_submit(ThreadPool *pool, thread_pool_task task, void *arg) {
+    ThreadPoolJob *job = malloc(sizeof(ThreadPoolJob));
+    if (!job) {
+        fprintf(stderr, "Failed to allocate thread pool job\n");
+        return STATUS_ERROR;
+    }
+    job->task = task;
+    job->arg = arg;
+    job->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pool->pending++;
+    pthread_cond_signal(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+    return STATUS_SUCCESS;
+}
+
+void thread_pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Queued jobs still run before the workers exit.
+void thread_pool_destroy(ThreadPool *pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->all_done);
+    pthread_cond_destroy(&pool->job_available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
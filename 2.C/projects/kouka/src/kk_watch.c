@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                      IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK)
+#define EVENT_BUFFER  (64 * 1024)
+// A steady stream of events (a long checkout) still gets built eventually
+#define MAX_DEBOUNCE_ROUNDS 10
+
+static int add_watch_tree(BuildWatcher *watcher, const char *relative) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s%s", watcher->root, *relative ? "/" : "", relative);
+    int wd = inotify_add_watch(watcher->fd, path, WATCH_EVENTS);
+    if (wd < 0) {
+        // Gone already, or not a directory: its parent's events cover it
+        if (errno == ENOENT || errno == ENOTDIR) return STATUS_SUCCESS;
+        fprintf(stderr, "Failed to watch %s: %s%s\n", path, strerror(errno),
+                errno == ENOSPC ? " (raise fs.inotify.max_user_watches)" : "");
+        return STATUS_ERROR;
+    }
+    if ((size_t)wd >= watcher->dir_capacity) {
+        size_t capacity = watcher->dir_capacity ? watcher->dir_capacity : 64;
+        while (capacity <= (size_t)wd) capacity *= 2;
+        char **dirs = realloc(watcher->dirs, capacity * sizeof(char *));
+        if (!dirs) {
+            fprintf(stderr, "Failed to allocate watch table\n");
+            return STATUS_ERROR;
+        }
+        memset(dirs + watcher->dir_capacity, 0, (capacity - watcher->dir_capacity) * sizeof(char *));
+        watcher->dirs = dirs;
+        watcher->dir_capacity = capacity;
+    }
+    if (watcher->dirs[wd]) {
+        // Same directory reached again (moved back, or a bind mount)
+        free(watcher->dirs[wd]);
+    } else {
+        watcher->watch_count++;
+    }
+    watcher->dirs[wd] = strdup(relative);
+    if (!watcher->dirs[wd]) return STATUS_ERROR;
+
+    DIR *dir = opendir(path);
+    if (!dir) return STATUS_SUCCESS;
+    struct dirent *entry;
+    char child[PATH_MAX];
+    int status = STATUS_SUCCESS;
+    while (status == STATUS_SUCCESS && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) continue;
+        snprintf(child, sizeof(child), "%s%s%s", relative, *relative ? "/" : "", entry->d_name);
+        status = add_watch_tree(watcher, child);
+    }
+    closedir(dir);
+    return status;
+}
+
+static int add_change(BuildWatcher *watcher, const char *dir, const char *name) {
+    if (watcher->change_count == watcher->change_capacity) {
+        size_t capacity = watcher->change_capacity ? watcher->change_capacity * 2 : 64;
+        char **changes = realloc(watcher->changes, capacity * sizeof(char *));
+        if (!changes) return STATUS_ERROR;
+        watcher->changes = changes;
+        watcher->change_capacity = capacity;
+    }
+    char *path = NULL;
+    if (asprintf(&path, "%s%s%s", dir, *dir ? "/" : "", name) < 0) return STATUS_ERROR;
+    watcher->changes[watcher->change_count++] = path;
+    return STATUS_SUCCESS;
+}
+
+static void clear_changes(BuildWatcher *watcher) {
+    for (size_t i = 0; i < watcher->change_count; i++) {
+        free(watcher->changes[i]);
+    }
+    watcher->change_count = 0;
+    watcher->overflowed = 0;
+    watcher->reload = 0;
+}
+
+static int read_events(BuildWatcher *watcher) {
+    char buffer[EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(watcher->fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return STATUS_SUCCESS;
+            fprintf(stderr, "Failed to read inotify events: %s\n", strerror(errno));
+            return STATUS_ERROR;
+        }
+        for (char *p = buffer; p < buffer + n;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                watcher->overflowed = 1;
+                continue;
+            }
+            if (event->wd < 0 || (size_t)event->wd >= watcher->dir_capacity || !watcher->dirs[event->wd]) continue;
+            if (event->mask & IN_IGNORED) {
+                free(watcher->dirs[event->wd]);
+                watcher->dirs[event->wd] = NULL;
+                watcher->watch_count--;
+                continue;
+            }
+            if (event->len == 0 || event->name[0] == '.') continue;
+            const char *dir = watcher->dirs[event->wd];
+            if (add_change(watcher, dir, event->name) != STATUS_SUCCESS) {
+                watcher->overflowed = 1;
+                continue;
+            }
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                // Anything written into it before the watch lands is covered
+                // by the directory itself being in the change list
+                if (add_watch_tree(watcher, watcher->changes[watcher->change_count - 1]) != STATUS_SUCCESS) {
+                    watcher->overflowed = 1;
+                }
+            }
+        }
+    }
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void coalesce_changes(BuildWatcher *watcher) {
+    if (watcher->change_count == 0) return;
+    qsort(watcher->changes, watcher->change_count, sizeof(char *), compare_paths);
+    size_t kept = 1;
+    for (size_t i = 1; i < watcher->change_count; i++) {
+        if (strcmp(watcher->changes[i], watcher->changes[kept - 1]) == 0) {
+            free(watcher->changes[i]);
+        } else {
+            watcher->changes[kept++] = watcher->changes[i];
+        }
+    }
+    watcher->change_count = kept;
+    if (watcher->commands_name) {
+        for (size_t i = 0; i < watcher->change_count; i++) {
+            if (strcmp(watcher->changes[i], watcher->commands_name) == 0) watcher->reload = 1;
+        }
+    }
+}
+
+int build_watcher_init(BuildWatcher *watcher, const char *commands_path, const BuildOptions *options,
+                       int debounce_ms) {
+    memset(watcher, 0, sizeof(BuildWatcher));
+    watcher->fd = -1;
+    build_graph_init(&watcher->graph);
+    watcher->debounce_ms = debounce_ms > 0 ? debounce_ms : WATCH_DEFAULT_DEBOUNCE_MS;
+    if (options) watcher->options = *options;
+    watcher->root = realpath(watcher->options.root ? watcher->options.root : ".", NULL);
+    watcher->commands_path = strdup(commands_path);
+    if (!watcher->root || !watcher->commands_path) {
+        fprintf(stderr, "Failed to open %s: %s\n", watcher->options.root ? watcher->options.root : ".",
+                strerror(errno));
+        build_watcher_free(watcher);
+        return STATUS_ERROR;
+    }
+    watcher->options.root = watcher->root;
+    char *commands = realpath(commands_path, NULL);
+    size_t root_length = strlen(watcher->root);
+    if (commands && strncmp(commands, watcher->root, root_length) == 0 && commands[root_length] == '/') {
+        watcher->commands_name = strdup(commands + root_length + 1);
+    }
+    free(commands);
+
+    if (build_graph_load(&watcher->graph, commands_path) != STATUS_SUCCESS) {
+        build_watcher_free(watcher);
+        return STATUS_ERROR;
+    }
+    watcher->db = build_db_open(watcher->root);
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        fprintf(stderr, "Failed to start inotify: %s\n", strerror(errno));
+    }
+    if (!watcher->db || watcher->fd < 0 || add_watch_tree(watcher, "") != STATUS_SUCCESS) {
+        build_watcher_free(watcher);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int build_watcher_wait(BuildWatcher *watcher, int timeout_ms) {
+    struct pollfd pfd = {.fd = watcher->fd, .events = POLLIN};
+    int ready;
+    while ((ready = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {
+    }
+    if (ready < 0) {
+        fprintf(stderr, "Failed to wait for file changes: %s\n", strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (ready == 0) return 0;
+    // Editors save in bursts (write, rename, chmod); wait for a quiet gap
+    // so one save is one rebuild
+    for (int round = 0; ready > 0 && round < MAX_DEBOUNCE_ROUNDS; round++) {
+        if (read_events(watcher) != STATUS_SUCCESS) return STATUS_ERROR;
+        while ((ready = poll(&pfd, 1, watcher->debounce_ms)) < 0 && errno == EINTR) {
+        }
+    }
+    coalesce_changes(watcher);
+    if (watcher->change_count == 0 && watcher->overflowed) return 1;
+    return (int)watcher->change_count;
+}
+
+static size_t path_components(const char *path) {
+    size_t count = 1;
+    for (; *path; path++) {
+        if (*path == '/') count++;
+    }
+    return count;
+}
+
+// Copies the first `count` components of path into out
+static const char* leading_components(const char *path, size_t count, char *out, size_t out_size) {
+    size_t i = 0;
+    for (; path[i] && i + 1 < out_size; i++) {
+        if (path[i] == '/' && --count == 0) break;
+        out[i] = path[i];
+    }
+    out[i] = '\0';
+    return out;
+}
+
+// True if a change to `changed` can affect what `pattern` names: either is
+// a directory containing the other, or they match outright.
+static int path_affects(const char *pattern, const char *changed) {
+    char trimmed[PATH_MAX];
+    if (strncmp(pattern, "./", 2) == 0) pattern += 2;
+    size_t length = strlen(pattern);
+    while (length > 0 && pattern[length - 1] == '/') length--;
+    if (length == 0 || length >= sizeof(trimmed)) return 1;
+    memcpy(trimmed, pattern, length);
+    trimmed[length] = '\0';
+
+    char prefix[PATH_MAX];
+    size_t pattern_depth = path_components(trimmed), changed_depth = path_components(changed);
+    if (changed_depth <= pattern_depth) {
+        return fnmatch(leading_components(trimmed, changed_depth, prefix, sizeof(prefix)), changed,
+                       FNM_PATHNAME) == 0;
+    }
+    return fnmatch(trimmed, leading_components(changed, pattern_depth, prefix, sizeof(prefix)), FNM_PATHNAME) == 0;
+}
+
+static int step_touched(const BuildStep *step, char **changes, size_t change_count) {
+    for (size_t c = 0; c < change_count; c++) {
+        for (size_t i = 0; i < step->input_count; i++) {
+            if (path_affects(step->inputs[i], changes[c])) return 1;
+        }
+        for (size_t i = 0; i < step->output_count; i++) {
+            if (path_affects(step->outputs[i], changes[c])) return 1;
+        }
+    }
+    return 0;
+}
+
+int build_watcher_rebuild(BuildWatcher *watcher, BuildStats *stats) {
+    if (watcher->reload) {
+        BuildGraph graph;
+        build_graph_init(&graph);
+        if (build_graph_load(&graph, watcher->commands_path) == STATUS_SUCCESS) {
+            build_graph_free(&watcher->graph);
+            watcher->graph = graph;
+        } else {
+            fprintf(stderr, "Keeping the previous build graph\n");
+            build_graph_free(&graph);
+        }
+    } else if (watcher->built && !watcher->overflowed) {
+        for (size_t i = 0; i < watcher->graph.count; i++) {
+            BuildStep *step = &watcher->graph.steps[i];
+            step->unchanged = !step_touched(step, watcher->changes, watcher->change_count);
+        }
+    }
+    clear_changes(watcher);
+    watcher->built = 1;
+    return build_run_with_db(&watcher->graph, &watcher->options, &watcher->db, stats);
+}
+
+void build_watcher_free(BuildWatcher *watcher) {
+    if (watcher->fd >= 0) close(watcher->fd);
+    clear_changes(watcher);
+    free(watcher->changes);
+    for (size_t i = 0; i < watcher->dir_capacity; i++) {
+        free(watcher->dirs[i]);
+    }
+    free(watcher->dirs);
+    build_graph_free(&watcher->graph);
+    build_db_close(watcher->db);
+    free(watcher->root);
+    free(watcher->commands_path);
+    free(watcher->commands_name);
+    memset(watcher, 0, sizeof(BuildWatcher));
+    watcher->fd = -1;
+}
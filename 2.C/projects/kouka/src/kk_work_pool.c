@@ -0,0 +1,201 @@
+#include "common.h"
+#include "kk_work_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Which pool and deque the calling thread works on, if any
+static __thread WorkPool *current_pool;
+static __thread size_t current_worker;
+
+typedef struct WorkerStart {
+    WorkPool *pool;
+    size_t index;
+} WorkerStart;
+
+static int deque_push(WorkDeque *deque, WorkItem item) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+        WorkItem *items = malloc(capacity * sizeof(WorkItem));
+        if (!items) {
+            pthread_mutex_unlock(&deque->lock);
+            fprintf(stderr, "Failed to allocate work pool deque\n");
+            return STATUS_ERROR;
+        }
+        for (size_t i = 0; i < deque->count; i++) {
+            items[i] = deque->items[(deque->head + i) % deque->capacity];
+        }
+        free(deque->items);
+        deque->items = items;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->items[(deque->head + deque->count) % deque->capacity] = item;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return STATUS_SUCCESS;
+}
+
+static int deque_take(WorkDeque *deque, int from_head, WorkItem *item) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == 0) {
+        pthread_mutex_unlock(&deque->lock);
+        return 0;
+    }
+    if (from_head) {
+        *item = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+    } else {
+        *item = deque->items[(deque->head + deque->count - 1) % deque->capacity];
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->lock);
+    return 1;
+}
+
+// Own deque first, then every other worker's, starting with the neighbour.
+static int find_work(WorkPool *pool, size_t self, WorkItem *item) {
+    if (deque_take(&pool->deques[self], 0, item)) {
+        return 1;
+    }
+    for (size_t i = 1; i < pool->thread_count; i++) {
+        if (deque_take(&pool->deques[(self + i) % pool->thread_count], 1, item)) {
+            __atomic_fetch_add(&pool->steals, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *work_pool_worker(void *arg) {
+    WorkerStart *start = (WorkerStart *)arg;
+    WorkPool *pool = start->pool;
+    size_t self = start->index;
+    free(start);
+    current_pool = pool;
+    current_worker = self;
+    for (;;) {
+        WorkItem item;
+        if (find_work(pool, self, &item)) {
+            __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+            item.task(item.arg);
+            if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->all_done);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+        // Submitters raise queued before signalling under the lock, so
+        // checking it here can't miss a wakeup
+        pthread_mutex_lock(&pool->lock);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 && !pool->shutting_down) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        int done = pool->shutting_down && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (done) {
+            return NULL;
+        }
+    }
+}
+
+WorkPool* work_pool_create(size_t thread_count) {
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if (!pool) {
+        fprintf(stderr, "Failed to allocate work pool\n");
+        return NULL;
+    }
+    pool->threads = calloc(thread_count, sizeof(pthread_t));
+    pool->deques = calloc(thread_count, sizeof(WorkDeque));
+    if (!pool->threads || !pool->deques) {
+        fprintf(stderr, "Failed to allocate work pool\n");
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    for (size_t i = 0; i < thread_count; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+    // Workers steal across every deque, so all of them exist before any runs
+    pool->thread_count = thread_count;
+    size_t started = 0;
+    for (; started < thread_count; started++) {
+        WorkerStart *start = malloc(sizeof(WorkerStart));
+        if (!start) break;
+        start->pool = pool;
+        start->index = started;
+        if (pthread_create(&pool->threads[started], NULL, work_pool_worker, start) != 0) {
+            free(start);
+            break;
+        }
+    }
+    if (started < thread_count) {
+        fprintf(stderr, "Failed to start worker thread\n");
+        pool->thread_count = started;
+        work_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int work_pool_submit(WorkPool *pool, work_pool_task task, void *arg) {
+    size_t target;
+    if (current_pool == pool) {
+        target = current_worker;
+    } else {
+        target = __atomic_fetch_add(&pool->next_deque, 1, __ATOMIC_RELAXED) % pool->thread_count;
+    }
+    // Counted before the push so a worker that takes the item early never
+    // drives the counters below zero
+    __atomic_fetch_add(&pool->pending, 1, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    if (deque_push(&pool->deques[target], (WorkItem){.task = task, .arg = arg}) != STATUS_SUCCESS) {
+        __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+        __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_ACQ_REL);
+        return STATUS_ERROR;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    return STATUS_SUCCESS;
+}
+
+void work_pool_wait(WorkPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void work_pool_destroy(WorkPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        free(pool->deques[i].items);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
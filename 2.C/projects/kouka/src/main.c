@@ -0,0 +1,183 @@
+#include "common.h"
+#include "ollama_client.h"
+#include "kk_build.h"
+#include "kk_watch.h"
+#include <sys/stat.h>
+
+#define RESPONSE_CACHE_TTL (7 * 24 * 60 * 60)
+
+// Answers are cached under $XDG_CACHE_HOME/kouka (or ~/.cache/kouka) so
+// scaffolding the same project again doesn't wait on the model.
+static ResponseCache* open_response_cache(void) {
+    char dir[4096], path[4200];
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (base && *base) {
+        snprintf(dir, sizeof(dir), "%s/kouka", base);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "%s/.cache/kouka", home);
+    } else {
+        return NULL;
+    }
+    mkdir(dir, 0755);
+    snprintf(path, sizeof(path), "%s/responses.cache", dir);
+    ResponseCacheConfig config = {.ttl_seconds = RESPONSE_CACHE_TTL, .disk_path = path};
+    return response_cache_create(&config);
+}
+
+// KK_METRICS=json|prometheus dumps latency metrics at exit, to
+// KK_METRICS_FILE if set, otherwise stderr.
+static void dump_metrics(KkMetrics *metrics) {
+    const char *format = getenv("KK_METRICS");
+    if (!metrics || !format) {
+        return;
+    }
+    const char *path = getenv("KK_METRICS_FILE");
+    FILE *out = path ? fopen(path, "w") : stderr;
+    if (!out) {
+        perror(path);
+        return;
+    }
+    int status = strcmp(format, "prometheus") == 0 ? metrics_write_prometheus(metrics, out)
+                                                   : metrics_write_json(metrics, out);
+    if (status != STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to write metrics\n");
+    }
+    if (out != stderr) {
+        fclose(out);
+    }
+}
+
+// kk build|watch [-j jobs] [-C root] [commands.json]
+static int parse_build_args(int argc, char *argv[], BuildOptions *options, char *file, size_t file_size) {
+    memset(options, 0, sizeof(BuildOptions));
+    const char *commands = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options->jobs = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+            options->root = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: kk %s [-j jobs] [-C root] [commands.json]\n", argv[1]);
+            return STATUS_ERROR;
+        } else {
+            commands = argv[i];
+        }
+    }
+    if (commands) {
+        snprintf(file, file_size, "%s", commands);
+    } else {
+        snprintf(file, file_size, "%s/commands.json", options->root ? options->root : ".");
+    }
+    return STATUS_SUCCESS;
+}
+
+static void print_build_stats(const BuildStats *stats) {
+    printf("%zu steps: %zu executed, %zu up to date, %zu failed, %zu skipped (%zu inputs, %zu hashed)\n",
+           stats->steps, stats->executed, stats->up_to_date, stats->failed, stats->skipped, stats->files,
+           stats->files_hashed);
+}
+
+static int run_build(int argc, char *argv[]) {
+    BuildOptions options;
+    char file[4096];
+    if (parse_build_args(argc, argv, &options, file, sizeof(file)) != STATUS_SUCCESS) {
+        return 2;
+    }
+    BuildGraph graph;
+    build_graph_init(&graph);
+    if (build_graph_load(&graph, file) != STATUS_SUCCESS) {
+        build_graph_free(&graph);
+        return 1;
+    }
+    BuildStats stats;
+    int status = build_run(&graph, &options, &stats);
+    print_build_stats(&stats);
+    build_graph_free(&graph);
+    return status == STATUS_SUCCESS ? 0 : 1;
+}
+
+// Builds once, then again after every batch of changes until killed
+static int run_watch(int argc, char *argv[]) {
+    BuildOptions options;
+    char file[4096];
+    if (parse_build_args(argc, argv, &options, file, sizeof(file)) != STATUS_SUCCESS) {
+        return 2;
+    }
+    BuildWatcher watcher;
+    if (build_watcher_init(&watcher, file, &options, 0) != STATUS_SUCCESS) {
+        return 1;
+    }
+    printf("Watching %s (%zu directories)\n", watcher.root, watcher.watch_count);
+    BuildStats stats;
+    int changed = 1;
+    while (changed >= 0) {
+        if (changed > 0) {
+            build_watcher_rebuild(&watcher, &stats);
+            print_build_stats(&stats);
+        }
+        changed = build_watcher_wait(&watcher, -1);
+    }
+    build_watcher_free(&watcher);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "build") == 0) {
+        return run_build(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "watch") == 0) {
+        return run_watch(argc, argv);
+    }
+
+    // Initialize CURL globally FIRST
+    CURLcode curl_init_result = curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (curl_init_result != CURLE_OK) {
+        fprintf(stderr, "Failed to initialize CURL globally: %s\n", 
+                curl_easy_strerror(curl_init_result));
+        return 1;
+    }
+
+    setbuf(stdout, NULL);  // Unbuffer stdout
+    OllamaClient *client = ollama_client_create(OLLAMA_DEFAULT_URL, OLLAMA_DEFAULT_POOL_SIZE);
+    if (!client) {
+        curl_global_cleanup();
+        return 1;
+    }
+    // Running without a cache is fine, just slower
+    ResponseCache *cache = open_response_cache();
+    ollama_client_set_cache(client, cache);
+    KkMetrics *metrics = getenv("KK_METRICS") ? metrics_create() : NULL;
+    ollama_client_set_metrics(client, metrics);
+    // One pool for the whole run, so every prompt reuses its connections
+    call_ollama_set_client(client);
+    ResponseBuffer *response = call_ollama("qwen2.5-coder:32b", "Please give me the structure of a Java Spring Web application in JSON format");
+
+    if (!response) {
+        fprintf(stderr, "No response buffer created\n");
+        ollama_client_destroy(client);
+        response_cache_destroy(cache);
+        dump_metrics(metrics);
+        metrics_destroy(metrics);
+        curl_global_cleanup();
+        return 1;
+    }
+
+    if (response->parsed_response) {
+        printf("Parsed response: %s\n", response->parsed_response);
+    } else {
+        printf("No parsed response available\n");
+    }
+    
+    // Clean up
+    response_buffer_free(response);
+    ollama_client_destroy(client);
+    response_cache_destroy(cache);
+    dump_metrics(metrics);
+    metrics_destroy(metrics);
+    curl_global_cleanup();
+
+    return 0;
+}
@@ -1,6 +1,42 @@
+#define _GNU_SOURCE  // memrchr
 #include "common.h"
 #include "kk_json.h"
+#include "kk_json_writer.h"
 #include "ollama_client.h"
+#ifdef __linux__
+#include <errno.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Streaming mode: keep only the bytes after the last newline, in a ring
+// that overwrites its oldest bytes once a record outgrows tail_limit.
+static void keep_partial_record(ResponseBuffer *buffer, const char *chunk, size_t length) {
+    const char *newline = memrchr(chunk, '\n', length);
+    if (newline) {
+        buffer->size = 0;
+        buffer->tail_start = 0;
+        length -= (size_t)(newline + 1 - chunk);
+        chunk = newline + 1;
+    }
+    size_t capacity = buffer->tail_limit;
+    if (length >= capacity) {
+        memcpy(buffer->data, chunk + length - capacity, capacity);
+        buffer->tail_start = 0;
+        buffer->size = capacity;
+        return;
+    }
+    size_t write_pos = (buffer->tail_start + buffer->size) % capacity;
+    size_t first = capacity - write_pos < length ? capacity - write_pos : length;
+    memcpy(buffer->data + write_pos, chunk, first);
+    memcpy(buffer->data, chunk + first, length - first);
+    buffer->size += length;
+    if (buffer->size > capacity) {
+        buffer->tail_start = (buffer->tail_start + buffer->size - capacity) % capacity;
+        buffer->size = capacity;
+    }
+}
 
 size_t write_callback(void *contents, size_t size, size_t no_memb, void *ai_response) {
     if (!contents || !ai_response) { 
@@ -9,6 +45,17 @@ size_t write_callback(void *contents, size_t size, size_t no_memb, void *ai_resp
     }
     size_t real_size = size * no_memb;
     ResponseBuffer *buffer = (ResponseBuffer *)ai_response;
+    buffer->bytes_received += real_size;
+    if (buffer->trace) {
+        request_trace_feed(buffer->trace, (const char *)contents, real_size);
+    }
+    // Parse curl's receive buffer directly so zero-copy values are slices of it
+    json_parse(&buffer->parser, (const char *)contents, real_size);
+    if (buffer->tail_limit) {
+        keep_partial_record(buffer, (const char *)contents, real_size);
+        return real_size;
+    }
+
     if (buffer->size + real_size + 1> buffer->allocated_size) {
         size_t new_alloc = (buffer->allocated_size >0) ? buffer->allocated_size * 2 : 4096;
         while (buffer->size + real_size + 1> new_alloc) {
@@ -25,10 +72,7 @@ size_t write_callback(void *contents, size_t size, size_t no_memb, void *ai_resp
     memcpy(&(buffer->data[buffer->size]), contents, real_size);
     buffer->size += real_size;
     buffer->data[buffer->size] = '\0';
-
-    if (parse_ollama_response(buffer) != STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to parse response\n");
-    }
+    buffer->parsed_offset = buffer->size;
     return real_size;
 }
 
@@ -38,135 +82,671 @@ static void response_callback_store(const char *value, size_t length, void *agen
         return;
     }
     ResponseBuffer *buffer = (ResponseBuffer *)agent_response;
-    // If parsed response is not yet set, allocate it
-    if (buffer->parsed_response == NULL) {
-        buffer->parsed_response = (char *)malloc(length + 1);
-        if (!buffer->parsed_response) {
-            fprintf(stderr, "Failed to allocate memory for parsed response\n");
+    // The final record's empty "response" is not a token
+    if (buffer->trace && length > 0) {
+        request_trace_token(buffer->trace);
+    }
+    if (buffer->on_token) {
+        buffer->on_token(value, length, buffer->token_user_data);
+        if (!buffer->keep_response) {
             return;
         }
-        memcpy(buffer->parsed_response, value, length);
-        buffer->parsed_response[length] = '\0';
-    } else {
-        // Otherwise, append the new data
-        size_t old_len = strlen(buffer->parsed_response);
-        char *new_ptr = realloc(buffer->parsed_response, old_len + length + 1);
+    }
+    // Grow geometrically and track the length, so appending n tokens is O(n)
+    if (buffer->parsed_length + length + 1 > buffer->parsed_capacity) {
+        size_t new_capacity = buffer->parsed_capacity ? buffer->parsed_capacity * 2 : 256;
+        while (buffer->parsed_length + length + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *new_ptr = realloc(buffer->parsed_response, new_capacity);
         if (!new_ptr) {
             fprintf(stderr, "Failed to reallocate memory for parsed response\n");
             return;
         }
         buffer->parsed_response = new_ptr;
-        memcpy(buffer->parsed_response + old_len, value, length);
-        buffer->parsed_response[old_len + length] = '\0';
+        buffer->parsed_capacity = new_capacity;
     }
+    memcpy(buffer->parsed_response + buffer->parsed_length, value, length);
+    buffer->parsed_length += length;
+    buffer->parsed_response[buffer->parsed_length] = '\0';
 }
 
+// Retained mode only: parses bytes appended to data by hand since the last call.
 int parse_ollama_response(ResponseBuffer *buffer) {
-    static JsonParser parser;
-    static int parser_initialized = 0;
-    if (!parser_initialized) {
-        json_parser_init(&parser, response_callback_store, buffer);
-        parser_initialized = 1;
+    if (buffer->tail_limit) {
+        return STATUS_SUCCESS;  // streaming buffers are parsed as chunks arrive
     }
     // Process only new data since last parse
     char *new_data_start = buffer->data + buffer->parsed_offset;
     size_t new_data_length = buffer->size - buffer->parsed_offset;
-    json_parse(&parser, new_data_start, new_data_length);
+    json_parse(&buffer->parser, new_data_start, new_data_length);
     // Update parsed offset to mark this data as processed
     buffer->parsed_offset = buffer->size;
     return STATUS_SUCCESS;
 }
 
-ResponseBuffer* call_ollama(const char *model, const char *prompt) {
-    // First allocate the response buffer
-    ResponseBuffer *buffer = malloc(sizeof(ResponseBuffer));
+static ResponseBuffer* response_buffer_alloc(size_t initial_size) {
+    ResponseBuffer *buffer = calloc(1, sizeof(ResponseBuffer));
     if (!buffer) {
         fprintf(stderr, "Failed to allocate response buffer\n");
         return NULL;
     }
-
-    // Initialize buffer fields
-    buffer->data = malloc(4096);  // Initial 4KB allocation
+    buffer->data = malloc(initial_size);
     if (!buffer->data) {
         fprintf(stderr, "Failed to allocate buffer data\n");
         free(buffer);
         return NULL;
     }
-    buffer->allocated_size = 4096;
-    buffer->size = 0;
-    buffer->parsed_offset = 0;
-    buffer->parsed_response = NULL;
+    buffer->allocated_size = initial_size;
     buffer->data[0] = '\0';
+    json_parser_init(&buffer->parser, response_callback_store, buffer);
+    json_parser_set_zero_copy(&buffer->parser, 1);
+    return buffer;
+}
+
+ResponseBuffer* response_buffer_create(void) {
+    return response_buffer_alloc(4096);  // Initial 4KB allocation
+}
 
+ResponseBuffer* response_buffer_create_streaming(size_t tail_limit, ollama_token_callback on_token,
+                                                 void *user_data) {
+    if (tail_limit == 0) {
+        tail_limit = RESPONSE_TAIL_LIMIT;
+    }
+    ResponseBuffer *buffer = response_buffer_alloc(tail_limit);
+    if (buffer) {
+        buffer->tail_limit = tail_limit;
+        buffer->on_token = on_token;
+        buffer->token_user_data = user_data;
+    }
+    return buffer;
+}
+
+size_t response_buffer_tail(const ResponseBuffer *buffer, char *out, size_t out_size) {
+    if (out_size == 0) {
+        return buffer->size;
+    }
+    size_t n = buffer->size < out_size - 1 ? buffer->size : out_size - 1;
+    if (!buffer->tail_limit) {
+        memcpy(out, buffer->data + buffer->size - n, n);  // newest bytes of the body
+    } else {
+        // Skip the oldest bytes that don't fit, then unwrap the ring
+        size_t start = (buffer->tail_start + buffer->size - n) % buffer->tail_limit;
+        size_t first = buffer->tail_limit - start < n ? buffer->tail_limit - start : n;
+        memcpy(out, buffer->data + start, first);
+        memcpy(out + first, buffer->data, n - first);
+    }
+    out[n] = '\0';
+    return buffer->size;
+}
+
+void response_buffer_free(ResponseBuffer *buffer) {
+    if (!buffer) {
+        return;
+    }
+    json_parser_free(&buffer->parser);
+    free(buffer->data);
+    free(buffer->parsed_response);
+    free(buffer);
+}
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *user_data) {
+    (void)handle;
+    (void)access;
+    OllamaClient *client = (OllamaClient *)user_data;
+    pthread_mutex_lock(&client->share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *user_data) {
+    (void)handle;
+    OllamaClient *client = (OllamaClient *)user_data;
+    pthread_mutex_unlock(&client->share_locks[data]);
+}
+
+// Options that never change between requests are set once per handle;
+// only the body and the destination buffer are set per call.
+static CURL* client_handle_create(OllamaClient *client) {
     CURL *curl = curl_easy_init();
     if (!curl) {
         fprintf(stderr, "Failed to initialize curl: ensure curl_global_init() was called\n");
-        free(buffer->data);
-        free(buffer);
         return NULL;
     }
-   
-    char json_data[1024];
-    snprintf(json_data, sizeof(json_data), "{\"model\":\"%s\",\"prompt\":\"%s\"}", model, prompt);
-    // initialize Ollama request headers
-    struct curl_slist *headers = NULL;
-    // add headers
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    // curl set options
-    curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:11434/api/generate");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data);
+    curl_easy_setopt(curl, CURLOPT_URL, client->generate_url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(curl, CURLOPT_SHARE, client->share);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    return curl;
+}
+
+OllamaClient* ollama_client_create(const char *base_url, size_t pool_size) {
+    if (!base_url) {
+        base_url = OLLAMA_DEFAULT_URL;
+    }
+    if (pool_size == 0) {
+        pool_size = OLLAMA_DEFAULT_POOL_SIZE;
+    }
+    OllamaClient *client = calloc(1, sizeof(OllamaClient));
+    if (!client) {
+        fprintf(stderr, "Failed to allocate ollama client\n");
+        return NULL;
+    }
+    size_t url_len = strlen(base_url) + sizeof("/api/generate");
+    client->generate_url = malloc(url_len);
+    client->idle_handles = calloc(pool_size, sizeof(CURL *));
+    if (!client->generate_url || !client->idle_handles) {
+        fprintf(stderr, "Failed to allocate ollama client\n");
+        free(client->generate_url);
+        free(client->idle_handles);
+        free(client);
+        return NULL;
+    }
+    snprintf(client->generate_url, url_len, "%s/api/generate", base_url);
+    client->pool_size = pool_size;
+    pthread_mutex_init(&client->pool_lock, NULL);
+    pthread_cond_init(&client->pool_available, NULL);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&client->share_locks[i], NULL);
+    }
+
+    client->share = curl_share_init();
+    if (!client->share) {
+        fprintf(stderr, "Failed to initialize curl share\n");
+        ollama_client_destroy(client);
+        return NULL;
+    }
+    curl_share_setopt(client->share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(client->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(client->share, CURLSHOPT_USERDATA, client);
+    curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    client->headers = curl_slist_append(NULL, "Content-Type: application/json");
+    // Disable "Expect: 100-continue" so large prompts don't cost an extra round trip
+    struct curl_slist *headers = curl_slist_append(client->headers, "Expect:");
+    if (!client->headers || !headers) {
+        fprintf(stderr, "Failed to build request headers\n");
+        ollama_client_destroy(client);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < pool_size; i++) {
+        CURL *curl = client_handle_create(client);
+        if (!curl) {
+            ollama_client_destroy(client);
+            return NULL;
+        }
+        client->idle_handles[client->idle_count++] = curl;
+    }
+    return client;
+}
+
+// Every handle must be back in the pool (no request in flight) before destroying.
+void ollama_client_destroy(OllamaClient *client) {
+    if (!client) {
+        return;
+    }
+    for (size_t i = 0; i < client->idle_count; i++) {
+        curl_easy_cleanup(client->idle_handles[i]);
+    }
+    if (client->share) {
+        curl_share_cleanup(client->share);
+    }
+    curl_slist_free_all(client->headers);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&client->share_locks[i]);
+    }
+    pthread_cond_destroy(&client->pool_available);
+    pthread_mutex_destroy(&client->pool_lock);
+    free(client->idle_handles);
+    free(client->generate_url);
+    free(client);
+}
+
+void ollama_client_set_cache(OllamaClient *client, ResponseCache *cache) {
+    client->cache = cache;
+}
+
+void ollama_client_set_metrics(OllamaClient *client, KkMetrics *metrics) {
+    client->metrics = metrics;
+}
+
+// curl reports each phase as time since the transfer started
+static void read_timings(CURL *curl, RequestTimings *timings) {
+    curl_off_t dns = 0, connect = 0, ttfb = 0, total = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    timings->dns_us = (uint64_t)dns;
+    timings->connect_us = connect > dns ? (uint64_t)(connect - dns) : 0;
+    timings->ttfb_us = (uint64_t)ttfb;
+    timings->total_us = (uint64_t)total;
+}
+
+static CURL* client_acquire_handle(OllamaClient *client) {
+    pthread_mutex_lock(&client->pool_lock);
+    while (client->idle_count == 0) {
+        pthread_cond_wait(&client->pool_available, &client->pool_lock);
+    }
+    CURL *curl = client->idle_handles[--client->idle_count];
+    pthread_mutex_unlock(&client->pool_lock);
+    return curl;
+}
+
+static void client_release_handle(OllamaClient *client, CURL *curl) {
+    pthread_mutex_lock(&client->pool_lock);
+    client->idle_handles[client->idle_count++] = curl;
+    pthread_cond_signal(&client->pool_available);
+    pthread_mutex_unlock(&client->pool_lock);
+}
+
+// Prompts may embed whole source files, so they are escaped, never truncated.
+static int build_generate_body(JsonWriter *body, const char *model, const char *prompt) {
+    size_t prompt_length = strlen(prompt);
+    json_writer_reserve(body, prompt_length + strlen(model) + 32);
+    json_writer_begin_object(body);
+    json_writer_key(body, "model");
+    json_writer_string(body, model, strlen(model));
+    json_writer_key(body, "prompt");
+    json_writer_string(body, prompt, prompt_length);
+    json_writer_end_object(body);
+    if (json_writer_status(body) != STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to build request body\n");
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Both must be set on every request: a pooled handle keeps the last size.
+static void set_post_body(CURL *curl, const JsonWriter *body) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body->length);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data);
+}
+
+static int client_perform(OllamaClient *client, const char *model, const char *prompt, ResponseBuffer *buffer,
+                          long *http_status) {
+    // Typical bodies fit the stack storage; large prompts spill to the heap once
+    char storage[1024];
+    JsonWriter body;
+    json_writer_init(&body, storage, sizeof(storage));
+    if (build_generate_body(&body, model, prompt) != STATUS_SUCCESS) {
+        json_writer_free(&body);
+        return STATUS_ERROR;
+    }
+
+    RequestTrace *trace = NULL;
+    if (client->metrics && (trace = malloc(sizeof(RequestTrace)))) {
+        request_trace_begin(trace);
+        buffer->trace = trace;
+    }
+
+    CURL *curl = client_acquire_handle(client);
+    set_post_body(curl, &body);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
-    // perform request
     CURLcode res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_status);
+    if (trace) {
+        RequestTimings timings;
+        read_timings(curl, &timings);
+        metrics_record(client->metrics, model, trace, &timings, res == CURLE_OK && *http_status == 200);
+        buffer->trace = NULL;
+        request_trace_free(trace);
+        free(trace);
+    }
+    // Drop the pointer to the body before the handle goes back to the pool
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+    client_release_handle(client, curl);
+    json_writer_free(&body);
     if (res != CURLE_OK) {
         fprintf(stderr, "Request failed: %s\n", curl_easy_strerror(res));
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        free(buffer->data);
-        free(buffer);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Serves the request from the cache or the server. A cached answer is
+// delivered through the same path as parsed tokens, in one piece.
+static int client_generate_into(OllamaClient *client, const char *model, const char *prompt,
+                                ResponseBuffer *buffer) {
+    uint64_t key = 0;
+    if (client->cache) {
+        key = response_cache_key(model, prompt, NULL);
+        size_t length;
+        char *cached = response_cache_get(client->cache, key, &length);
+        if (cached) {
+            response_callback_store(cached, length, buffer);
+            free(cached);
+            return STATUS_SUCCESS;
+        }
+        buffer->keep_response = 1;
+    }
+    long http_status = 0;
+    if (client_perform(client, model, prompt, buffer, &http_status) != STATUS_SUCCESS) {
+        return STATUS_ERROR;
+    }
+    if (client->cache && http_status == 200 && buffer->parsed_length > 0) {
+        response_cache_put(client->cache, key, buffer->parsed_response, buffer->parsed_length);
+    }
+    return STATUS_SUCCESS;
+}
+
+ResponseBuffer* ollama_client_generate(OllamaClient *client, const char *model, const char *prompt) {
+    if (!client || !model || !prompt) {
+        fprintf(stderr, "NULL argument to ollama_client_generate\n");
+        return NULL;
+    }
+    ResponseBuffer *buffer = response_buffer_create_streaming(RESPONSE_TAIL_LIMIT, NULL, NULL);
+    if (!buffer) {
+        return NULL;
+    }
+    if (client_generate_into(client, model, prompt, buffer) != STATUS_SUCCESS) {
+        response_buffer_free(buffer);
         return NULL;
     }
-    // cleanup
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
     return buffer;
 }
 
-int main() {
-    // Initialize CURL globally FIRST
-    CURLcode curl_init_result = curl_global_init(CURL_GLOBAL_DEFAULT);
-    if (curl_init_result != CURLE_OK) {
-        fprintf(stderr, "Failed to initialize CURL globally: %s\n", 
-                curl_easy_strerror(curl_init_result));
-        return 1;
+// With a cache attached the answer is also accumulated so it can be stored.
+int ollama_client_generate_stream(OllamaClient *client, const char *model, const char *prompt,
+                                  ollama_token_callback on_token, void *user_data) {
+    if (!client || !model || !prompt || !on_token) {
+        fprintf(stderr, "NULL argument to ollama_client_generate_stream\n");
+        return STATUS_ERROR;
+    }
+    ResponseBuffer *buffer = response_buffer_create_streaming(RESPONSE_TAIL_LIMIT, on_token, user_data);
+    if (!buffer) {
+        return STATUS_ERROR;
+    }
+    int status = client_generate_into(client, model, prompt, buffer);
+    response_buffer_free(buffer);
+    return status;
+}
+
+// Per-stream state of a batch. Each stream owns its parser, so tokens from
+// interleaved responses never mix.
+typedef struct OllamaStream {
+    CURL *curl;
+    int pooled;
+    JsonParser parser;
+    OllamaRequest *request;
+    RequestTrace *trace;
+    JsonWriter body;
+    char body_storage[1024];
+} OllamaStream;
+
+typedef struct BatchLoop {
+    CURLM *multi;
+    KkMetrics *metrics;
+    int epoll_fd;
+    long long deadline_ms;  // CLOCK_MONOTONIC; -1 when curl has no timer set
+} BatchLoop;
+
+static void stream_token_callback(const char *value, size_t length, void *agent_response) {
+    OllamaStream *stream = (OllamaStream *)agent_response;
+    if (stream->trace && length > 0) {
+        request_trace_token(stream->trace);
+    }
+    if (stream->request->on_token) {
+        stream->request->on_token(value, length, stream->request->user_data);
     }
+}
 
-    setbuf(stdout, NULL);  // Unbuffer stdout
-    ResponseBuffer *response = call_ollama("qwen2.5-coder:32b", "Please give me the structure of a Java Spring Web application in JSON format");
+static size_t stream_write_callback(void *contents, size_t size, size_t no_memb, void *user_data) {
+    size_t real_size = size * no_memb;
+    OllamaStream *stream = (OllamaStream *)user_data;
+    if (stream->trace) {
+        request_trace_feed(stream->trace, (const char *)contents, real_size);
+    }
+    json_parse(&stream->parser, (const char *)contents, real_size);
+    return real_size;
+}
 
-    if (!response) {
-        fprintf(stderr, "No response buffer created\n");
-        curl_global_cleanup();
-        return 1;
+// Batches may be larger than the pool: borrow idle handles when there are
+// some and create short-lived ones for the rest. Both share connections.
+static CURL* client_try_acquire_handle(OllamaClient *client, int *pooled) {
+    CURL *curl = NULL;
+    pthread_mutex_lock(&client->pool_lock);
+    if (client->idle_count > 0) {
+        curl = client->idle_handles[--client->idle_count];
     }
+    pthread_mutex_unlock(&client->pool_lock);
+    *pooled = curl != NULL;
+    return curl ? curl : client_handle_create(client);
+}
 
-    if (response->parsed_response) {
-        printf("Parsed response: %s\n", response->parsed_response);
+static void batch_finish_stream(OllamaClient *client, OllamaStream *stream) {
+    curl_easy_setopt(stream->curl, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(stream->curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(stream->curl, CURLOPT_WRITEDATA, NULL);
+    curl_easy_setopt(stream->curl, CURLOPT_PRIVATE, NULL);
+    json_parser_free(&stream->parser);
+    json_writer_free(&stream->body);
+    if (stream->trace) {
+        request_trace_free(stream->trace);
+        free(stream->trace);
+        stream->trace = NULL;
+    }
+    if (stream->pooled) {
+        client_release_handle(client, stream->curl);
     } else {
-        printf("No parsed response available\n");
+        curl_easy_cleanup(stream->curl);
     }
-    
-    // Clean up
-    if (response->data) {
-        free(response->data);
+    stream->curl = NULL;
+}
+
+static void batch_collect_results(BatchLoop *loop) {
+    CURLMsg *msg;
+    int pending;
+    while ((msg = curl_multi_info_read(loop->multi, &pending))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        OllamaStream *stream = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&stream);
+        OllamaRequest *request = stream->request;
+        request->curl_code = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &request->http_status);
+        if (request->curl_code != CURLE_OK) {
+            fprintf(stderr, "Request failed: %s\n", curl_easy_strerror(request->curl_code));
+        } else if (request->http_status == 200) {
+            request->status = STATUS_SUCCESS;
+        }
+        if (stream->trace) {
+            RequestTimings timings;
+            read_timings(msg->easy_handle, &timings);
+            metrics_record(loop->metrics, request->model, stream->trace, &timings,
+                           request->status == STATUS_SUCCESS);
+        }
+        curl_multi_remove_handle(loop->multi, msg->easy_handle);
+    }
+}
+
+#ifdef __linux__
+static int batch_socket_callback(CURL *easy, curl_socket_t s, int what, void *user_data, void *socket_data) {
+    (void)easy;
+    BatchLoop *loop = (BatchLoop *)user_data;
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
     }
-    if (response->parsed_response) {
-        free(response->parsed_response);
+    struct epoll_event ev = {0};
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+    if (socket_data) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, s, &ev);
+    } else {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, s, &ev);
+        curl_multi_assign(loop->multi, s, loop);
     }
-    free(response);
-    curl_global_cleanup();
+    return 0;
+}
 
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// curl hands over a relative timeout; keep it as a deadline so busy
+// sockets can't postpone it
+static int batch_timer_callback(CURLM *multi, long timeout_ms, void *user_data) {
+    (void)multi;
+    ((BatchLoop *)user_data)->deadline_ms = timeout_ms < 0 ? -1 : monotonic_ms() + timeout_ms;
     return 0;
-}
\ No newline at end of file
+}
+
+// curl tells us which sockets to watch and when its next timeout is due;
+// epoll wakes us only for sockets that are actually ready. The timer is
+// checked after every wakeup, not just when epoll times out, or a stream
+// that keeps its socket busy would starve the others' connect and
+// transfer timeouts.
+static int batch_run(BatchLoop *loop) {
+    struct epoll_event events[64];
+    int running = 0;
+    int status = STATUS_SUCCESS;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        perror("epoll_create1");
+        return STATUS_ERROR;
+    }
+    loop->deadline_ms = -1;
+    curl_multi_setopt(loop->multi, CURLMOPT_SOCKETFUNCTION, batch_socket_callback);
+    curl_multi_setopt(loop->multi, CURLMOPT_SOCKETDATA, loop);
+    curl_multi_setopt(loop->multi, CURLMOPT_TIMERFUNCTION, batch_timer_callback);
+    curl_multi_setopt(loop->multi, CURLMOPT_TIMERDATA, loop);
+    curl_multi_socket_action(loop->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    batch_collect_results(loop);
+    while (running) {
+        int wait_ms = -1;
+        if (loop->deadline_ms >= 0) {
+            long long left = loop->deadline_ms - monotonic_ms();
+            wait_ms = left < 0 ? 0 : left > 1000000 ? 1000000 : (int)left;
+        }
+        int n = epoll_wait(loop->epoll_fd, events, 64, wait_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            status = STATUS_ERROR;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int flags = 0;
+            if (events[i].events & EPOLLIN) flags |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+            curl_multi_socket_action(loop->multi, events[i].data.fd, flags, &running);
+        }
+        if (loop->deadline_ms >= 0 && monotonic_ms() >= loop->deadline_ms) {
+            // curl sets a new timer, if it wants one, from inside the call
+            loop->deadline_ms = -1;
+            curl_multi_socket_action(loop->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+        batch_collect_results(loop);
+    }
+    close(loop->epoll_fd);
+    return status;
+}
+#else
+static int batch_run(BatchLoop *loop) {
+    int running = 1;
+    while (running) {
+        if (curl_multi_perform(loop->multi, &running) != CURLM_OK) {
+            return STATUS_ERROR;
+        }
+        batch_collect_results(loop);
+        if (running) {
+            curl_multi_poll(loop->multi, NULL, 0, 1000, NULL);
+        }
+    }
+    return STATUS_SUCCESS;
+}
+#endif
+
+int ollama_client_generate_batch(OllamaClient *client, OllamaRequest *requests, size_t count) {
+    if (!client || (!requests && count > 0)) {
+        fprintf(stderr, "NULL argument to ollama_client_generate_batch\n");
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < count; i++) {
+        requests[i].status = STATUS_ERROR;
+        requests[i].curl_code = CURLE_OK;
+        requests[i].http_status = 0;
+    }
+    OllamaStream *streams = calloc(count, sizeof(OllamaStream));
+    BatchLoop loop = {0};
+    loop.multi = curl_multi_init();
+    loop.metrics = client->metrics;
+    if ((count > 0 && !streams) || !loop.multi) {
+        fprintf(stderr, "Failed to allocate batch\n");
+        free(streams);
+        curl_multi_cleanup(loop.multi);
+        return STATUS_ERROR;
+    }
+
+    int status = STATUS_SUCCESS;
+    for (size_t i = 0; i < count; i++) {
+        OllamaStream *stream = &streams[i];
+        stream->request = &requests[i];
+        if (!requests[i].model || !requests[i].prompt) {
+            fprintf(stderr, "Batch request %zu has no model or prompt\n", i);
+            continue;
+        }
+        stream->curl = client_try_acquire_handle(client, &stream->pooled);
+        if (!stream->curl) {
+            continue;
+        }
+        json_parser_init(&stream->parser, stream_token_callback, stream);
+        json_parser_set_zero_copy(&stream->parser, 1);
+        json_writer_init(&stream->body, stream->body_storage, sizeof(stream->body_storage));
+        if (client->metrics && (stream->trace = malloc(sizeof(RequestTrace)))) {
+            request_trace_begin(stream->trace);
+        }
+        if (build_generate_body(&stream->body, requests[i].model, requests[i].prompt) != STATUS_SUCCESS) {
+            batch_finish_stream(client, stream);
+            continue;
+        }
+        set_post_body(stream->curl, &stream->body);
+        curl_easy_setopt(stream->curl, CURLOPT_WRITEFUNCTION, stream_write_callback);
+        curl_easy_setopt(stream->curl, CURLOPT_WRITEDATA, stream);
+        curl_easy_setopt(stream->curl, CURLOPT_PRIVATE, stream);
+        if (curl_multi_add_handle(loop.multi, stream->curl) != CURLM_OK) {
+            batch_finish_stream(client, stream);
+        }
+    }
+
+    if (batch_run(&loop) != STATUS_SUCCESS) {
+        status = STATUS_ERROR;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (streams[i].curl) {
+            curl_multi_remove_handle(loop.multi, streams[i].curl);
+            batch_finish_stream(client, &streams[i]);
+        }
+        if (requests[i].status != STATUS_SUCCESS) {
+            status = STATUS_ERROR;
+        }
+    }
+    curl_multi_cleanup(loop.multi);
+    free(streams);
+    return status;
+}
+
+static OllamaClient *default_client = NULL;
+
+void call_ollama_set_client(OllamaClient *client) {
+    default_client = client;
+}
+
+ResponseBuffer* call_ollama(const char *model, const char *prompt) {
+    if (!default_client) {
+        fprintf(stderr, "call_ollama: no client set\n");
+        return NULL;
+    }
+    return ollama_client_generate(default_client, model, prompt);
+}
@@ -0,0 +1,136 @@
+#include "common.h"
+#include "ollama_client.h"
+#include "mock_ollama.h"
+#include "check.h"
+#include <time.h>
+
+#define STREAMS 8
+#define TOKENS  20
+
+typedef struct StreamTokens {
+    char prompt[32];
+    size_t own;
+    size_t foreign;
+} StreamTokens;
+
+// The mock echoes each prompt as every token, so a token from any other
+// stream shows up as foreign. The closing record's empty token is skipped.
+static void collect_token(const char *token, size_t length, void *user_data) {
+    StreamTokens *tokens = (StreamTokens *)user_data;
+    if (length == 0) {
+        return;
+    }
+    if (length == strlen(tokens->prompt) && memcmp(token, tokens->prompt, length) == 0) {
+        tokens->own++;
+    } else {
+        tokens->foreign++;
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void run_batch(OllamaClient *client, OllamaRequest *requests, StreamTokens *tokens, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        tokens[i].own = 0;
+        tokens[i].foreign = 0;
+        requests[i] = (OllamaRequest){.model = "mock", .prompt = tokens[i].prompt,
+                                      .on_token = collect_token, .user_data = &tokens[i]};
+    }
+    ollama_client_generate_batch(client, requests, count);
+}
+
+// More streams than pooled handles, interleaved by the token delay, twice
+// so the second round runs on reused connections.
+static void test_concurrent_streams(const char *url, MockOllama *mock) {
+    OllamaClient *client = ollama_client_create(url, STREAMS / 2);
+    CHECK(client != NULL);
+    if (!client) return;
+    OllamaRequest requests[STREAMS];
+    StreamTokens tokens[STREAMS];
+    for (size_t i = 0; i < STREAMS; i++) {
+        snprintf(tokens[i].prompt, sizeof(tokens[i].prompt), "prompt %zu", i);
+    }
+    for (int round = 0; round < 2; round++) {
+        run_batch(client, requests, tokens, STREAMS);
+        for (size_t i = 0; i < STREAMS; i++) {
+            CHECK(requests[i].status == STATUS_SUCCESS);
+            CHECK(requests[i].curl_code == CURLE_OK);
+            CHECK(requests[i].http_status == 200);
+            CHECK(tokens[i].own == TOKENS);
+            CHECK(tokens[i].foreign == 0);
+        }
+    }
+    CHECK(mock->requests == 2 * STREAMS);
+    ollama_client_destroy(client);
+}
+
+// A request without a prompt fails on its own; the rest of the batch runs.
+static void test_invalid_request(const char *url) {
+    OllamaClient *client = ollama_client_create(url, 2);
+    CHECK(client != NULL);
+    if (!client) return;
+    OllamaRequest requests[3];
+    StreamTokens tokens[3] = {{.prompt = "first"}, {.prompt = "second"}, {.prompt = "third"}};
+    for (size_t i = 0; i < 3; i++) {
+        requests[i] = (OllamaRequest){.model = "mock", .prompt = tokens[i].prompt,
+                                      .on_token = collect_token, .user_data = &tokens[i]};
+    }
+    requests[1].prompt = NULL;
+    CHECK(ollama_client_generate_batch(client, requests, 3) == STATUS_ERROR);
+    CHECK(requests[0].status == STATUS_SUCCESS && tokens[0].own == TOKENS);
+    CHECK(requests[1].status == STATUS_ERROR && tokens[1].own == 0);
+    CHECK(requests[2].status == STATUS_SUCCESS && tokens[2].own == TOKENS);
+    ollama_client_destroy(client);
+}
+
+// Nothing listens on the port any more: every request reports the refused
+// connection and the loop returns instead of waiting on the sockets.
+static void test_connection_refused(void) {
+    MockOllama closed;
+    if (mock_ollama_start(&closed, TOKENS, 0) != 0) {
+        CHECK(0);
+        return;
+    }
+    mock_ollama_stop(&closed);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", closed.port);
+    OllamaClient *client = ollama_client_create(url, 2);
+    CHECK(client != NULL);
+    if (!client) return;
+    OllamaRequest requests[4];
+    StreamTokens tokens[4];
+    for (size_t i = 0; i < 4; i++) {
+        snprintf(tokens[i].prompt, sizeof(tokens[i].prompt), "refused %zu", i);
+    }
+    double start = now_seconds();
+    run_batch(client, requests, tokens, 4);
+    CHECK(now_seconds() - start < 5.0);
+    for (size_t i = 0; i < 4; i++) {
+        CHECK(requests[i].status == STATUS_ERROR);
+        CHECK(requests[i].curl_code == CURLE_COULDNT_CONNECT);
+        CHECK(tokens[i].own == 0 && tokens[i].foreign == 0);
+    }
+    ollama_client_destroy(client);
+}
+
+int main(void) {
+    MockOllama mock;
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return 1;
+    if (mock_ollama_start(&mock, TOKENS, 500) != 0) return 1;
+    __atomic_store_n(&mock.echo_prompt, 1, __ATOMIC_RELAXED);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", mock.port);
+
+    test_concurrent_streams(url, &mock);
+    test_invalid_request(url);
+    test_connection_refused();
+
+    mock_ollama_stop(&mock);
+    curl_global_cleanup();
+    printf("test_batch: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
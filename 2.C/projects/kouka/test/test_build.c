@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_build.h"
+#include "kk_work_pool.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void write_file(const char *root, const char *path, const char *content) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE *file = fopen(full, "w");
+    if (!file) {
+        failures++;
+        return;
+    }
+    fputs(content, file);
+    fclose(file);
+}
+
+static int count_lines(const char *root, const char *path) {
+    char full[512], line[256];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE *file = fopen(full, "r");
+    if (!file) return 0;
+    int lines = 0;
+    while (fgets(line, sizeof(line), file)) lines++;
+    fclose(file);
+    return lines;
+}
+
+// Each step appends to log/<name> so the test can count how often it ran
+static const char commands[] =
+    "{\"steps\": ["
+    " {\"name\": \"gen\", \"command\": \"echo x >> log/gen; cat src/schema.txt > gen.out\","
+    "  \"inputs\": [\"src/schema.txt\"], \"outputs\": [\"gen.out\"]},"
+    " {\"name\": \"compile\", \"command\": \"echo x >> log/compile; touch classes.out\","
+    "  \"inputs\": [\"src/java\", \"gen.out\"], \"outputs\": [\"classes.out\"], \"deps\": [\"gen\"]},"
+    " {\"name\": \"docs\", \"command\": \"echo x >> log/docs\", \"inputs\": [\"doc/*.md\"]},"
+    " {\"name\": \"package\", \"command\": \"echo x >> log/package\","
+    "  \"inputs\": [], \"deps\": [\"compile\", \"docs\"]}"
+    "]}";
+
+static void test_parse_errors(void) {
+    static const char *bad[] = {
+        "{\"steps\": [{\"name\": \"a\", \"command\": \"true\", \"deps\": [\"b\"]}]}",
+        "{\"steps\": [{\"name\": \"a\", \"command\": \"true\", \"deps\": [\"b\"]},"
+        " {\"name\": \"b\", \"command\": \"true\", \"deps\": [\"a\"]}]}",
+        "{\"steps\": [{\"name\": \"a\", \"command\": \"true\"}, {\"name\": \"a\", \"command\": \"true\"}]}",
+        "{\"steps\": [{\"name\": \"a\"}]}",
+        "{\"steps\": [{\"name\": \"a\", \"command\": \"tr",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        BuildGraph graph;
+        build_graph_init(&graph);
+        CHECK(build_graph_parse(&graph, bad[i], strlen(bad[i])) == STATUS_ERROR);
+        build_graph_free(&graph);
+    }
+
+    BuildGraph graph;
+    build_graph_init(&graph);
+    CHECK(build_graph_parse(&graph, commands, sizeof(commands) - 1) == STATUS_SUCCESS);
+    CHECK(graph.count == 4);
+    if (graph.count == 4) {
+        CHECK(strcmp(graph.steps[1].name, "compile") == 0);
+        CHECK(graph.steps[1].input_count == 2 && graph.steps[1].dep_count == 1 && graph.steps[1].deps[0] == 0);
+        CHECK(graph.steps[3].dep_count == 2 && graph.steps[3].deps[1] == 2);
+        CHECK(graph.steps[0].dependent_count == 1 && graph.steps[0].dependents[0] == 1);
+    }
+    build_graph_free(&graph);
+}
+
+static void test_incremental(void) {
+    char root[] = "/tmp/kk_test_build_XXXXXX";
+    if (!mkdtemp(root)) {
+        failures++;
+        return;
+    }
+    char path[512];
+    const char *dirs[] = {"src", "src/java", "src/java/app", "doc", "log"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        mkdir(path, 0755);
+    }
+    write_file(root, "src/schema.txt", "table a\n");
+    write_file(root, "src/java/app/App.java", "class App {}\n");
+    write_file(root, "src/java/app/.App.java.swp", "editor noise\n");
+    write_file(root, "doc/guide.md", "# Guide\n");
+
+    BuildGraph graph;
+    build_graph_init(&graph);
+    CHECK(build_graph_parse(&graph, commands, sizeof(commands) - 1) == STATUS_SUCCESS);
+    BuildOptions options = {.root = root, .jobs = 3, .quiet = 1};
+    BuildStats stats;
+
+    // Cold build runs everything
+    CHECK(build_run(&graph, &options, &stats) == STATUS_SUCCESS);
+    CHECK(stats.steps == 4 && stats.executed == 4 && stats.up_to_date == 0);
+    CHECK(stats.files == 4);
+    CHECK(count_lines(root, "log/gen") == 1 && count_lines(root, "log/package") == 1);
+
+    // Nothing changed: nothing runs
+    CHECK(build_run(&graph, &options, &stats) == STATUS_SUCCESS);
+    CHECK(stats.executed == 0 && stats.up_to_date == 4);
+    CHECK(count_lines(root, "log/compile") == 1);
+
+    // A source change reruns compile and what depends on it, not gen or docs
+    write_file(root, "src/java/app/App.java", "class App { int x; }\n");
+    CHECK(build_run(&graph, &options, &stats) == STATUS_SUCCESS);
+    CHECK(stats.executed == 2 && stats.up_to_date == 2);
+    CHECK(count_lines(root, "log/gen") == 1 && count_lines(root, "log/docs") == 1);
+    CHECK(count_lines(root, "log/compile") == 2 && count_lines(root, "log/package") == 2);
+
+    // Dotfiles are not inputs; new files matching a glob are
+    write_file(root, "src/java/app/.App.java.swp", "more editor noise\n");
+    write_file(root, "doc/api.md", "# API\n");
+    CHECK(build_run(&graph, &options, &stats) == STATUS_SUCCESS);
+    CHECK(count_lines(root, "log/compile") == 2);
+    CHECK(count_lines(root, "log/docs") == 2 && count_lines(root, "log/package") == 3);
+
+    // A missing output forces its step to run again
+    snprintf(path, sizeof(path), "%s/classes.out", root);
+    unlink(path);
+    CHECK(build_run(&graph, &options, &stats) == STATUS_SUCCESS);
+    CHECK(stats.executed == 1 && count_lines(root, "log/compile") == 3);
+    build_graph_free(&graph);
+
+    // A failing step skips its dependents and they stay out of date
+    static const char failing[] =
+        "{\"steps\": ["
+        " {\"name\": \"gen\", \"command\": \"test -f ok\"},"
+        " {\"name\": \"compile\", \"command\": \"echo x >> log/late\", \"deps\": [\"gen\"]},"
+        " {\"name\": \"docs\", \"command\": \"true\"}"
+        "]}";
+    build_graph_init(&graph);
+    CHECK(build_graph_parse(&graph, failing, sizeof(failing) - 1) == STATUS_SUCCESS);
+    CHECK(build_run(&graph, &options, &stats) == STATUS_ERROR);
+    CHECK(stats.failed == 1 && stats.skipped == 1 && stats.executed == 1);
+    CHECK(count_lines(root, "log/late") == 0);
+    write_file(root, "ok", "");
+    CHECK(build_run(&graph, &options, &stats) == STATUS_SUCCESS);
+    CHECK(stats.executed == 2 && stats.up_to_date == 1);
+    CHECK(count_lines(root, "log/late") == 1);
+    build_graph_free(&graph);
+
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+typedef struct FanOut {
+    WorkPool *pool;
+    int depth;
+    int *count;
+} FanOut;
+
+static FanOut nodes[1 + 4 + 16 + 64];
+
+// Every node submits four children, three levels deep; node k's children
+// are 4k+1..4k+4
+static void fan_out(void *arg) {
+    FanOut *node = arg;
+    __atomic_fetch_add(node->count, 1, __ATOMIC_RELAXED);
+    if (node->depth == 3) return;
+    size_t self = (size_t)(node - nodes);
+    for (int i = 0; i < 4; i++) {
+        FanOut *child = &nodes[(self * 4) + 1 + (size_t)i];
+        child->pool = node->pool;
+        child->depth = node->depth + 1;
+        child->count = node->count;
+        work_pool_submit(node->pool, fan_out, child);
+    }
+}
+
+static void test_work_pool(void) {
+    WorkPool *pool = work_pool_create(4);
+    CHECK(pool != NULL);
+    if (!pool) return;
+    for (int round = 0; round < 20; round++) {
+        int count = 0;
+        nodes[0] = (FanOut){.pool = pool, .depth = 0, .count = &count};
+        CHECK(work_pool_submit(pool, fan_out, &nodes[0]) == STATUS_SUCCESS);
+        work_pool_wait(pool);
+        CHECK(count == 85);
+    }
+    work_pool_destroy(pool);
+}
+
+int main(void) {
+    test_parse_errors();
+    test_incremental();
+    test_work_pool();
+    printf("test_build: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_depindex.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void write_pom(const char *dir, const char *name, const char *body) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        CHECK(0);
+        return;
+    }
+    fprintf(file, "<?xml version=\"1.0\"?>\n<project xmlns=\"http://maven.apache.org/POM/4.0.0\">\n%s</project>\n",
+            body);
+    fclose(file);
+}
+
+static void test_version_order(void) {
+    static const char *ordered[] = {"1.0-alpha1", "1.0-beta", "1.0-rc1", "1.0-SNAPSHOT", "1.0", "1.0.1",
+                                    "1.2", "1.9", "1.10", "2.0.0.RELEASE", "10"};
+    size_t n = sizeof(ordered) / sizeof(ordered[0]);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            int cmp = dep_version_compare(ordered[i], strlen(ordered[i]), ordered[j], strlen(ordered[j]));
+            CHECK(i < j ? cmp < 0 : i > j ? cmp > 0 : cmp == 0);
+        }
+    }
+    CHECK(dep_version_compare("1.0", 3, "1.0.RELEASE", 11) == 0);
+    CHECK(dep_version_compare("1.01", 4, "1.1", 3) == 0);
+}
+
+// app -> web (test scope: not followed below the root), core, json
+// web -> core 1.0 (nearest wins: app already picked core 2.0), logging
+// core -> logging, optional-dep (optional: not followed)
+// logging <-> core cycle through logging -> core
+static void test_build_and_resolve(void) {
+    char root[] = "/tmp/kk_depindex_XXXXXX";
+    if (!mkdtemp(root)) {
+        CHECK(0);
+        return;
+    }
+    char repo[600], index_path[600];
+    snprintf(repo, sizeof(repo), "%s/repo", root);
+    snprintf(index_path, sizeof(index_path), "%s/deps.idx", root);
+    mkdir(repo, 0755);
+    char sub[700];
+    snprintf(sub, sizeof(sub), "%s/org", repo);
+    mkdir(sub, 0755);
+    snprintf(sub, sizeof(sub), "%s/org/example", repo);
+    mkdir(sub, 0755);
+
+    write_pom(repo, "app-1.0.pom",
+              "<groupId>org.example</groupId><artifactId>app</artifactId><version>1.0</version>\n"
+              "<properties><core.version>2.0</core.version></properties>\n"
+              "<dependencyManagement><dependencies><dependency>\n"
+              "  <groupId>org.example</groupId><artifactId>managed</artifactId><version>9</version>\n"
+              "</dependency></dependencies></dependencyManagement>\n"
+              "<dependencies>\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>web</artifactId>\n"
+              "    <version>1.0</version></dependency>\n"
+              "  <dependency><groupId>${project.groupId}</groupId><artifactId>core</artifactId>\n"
+              "    <version>${core.version}</version></dependency>\n"
+              "  <!-- <dependency><groupId>org.example</groupId><artifactId>ghost</artifactId></dependency> -->\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>json</artifactId>\n"
+              "    <scope>test</scope></dependency>\n"
+              "  <dependency><groupId>com.elsewhere</groupId><artifactId>missing</artifactId>\n"
+              "    <version>1</version></dependency>\n"
+              "</dependencies>\n");
+    write_pom(sub, "web-1.0.pom",
+              "<parent><groupId>org.example</groupId><artifactId>parent</artifactId><version>1.0</version></parent>\n"
+              "<artifactId>web</artifactId>\n"
+              "<dependencies>\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>core</artifactId>\n"
+              "    <version>1.0</version></dependency>\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>logging</artifactId>\n"
+              "    <version>[1.0,)</version></dependency>\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>junit</artifactId>\n"
+              "    <version>4</version><scope>test</scope></dependency>\n"
+              "</dependencies>\n");
+    write_pom(sub, "core-1.0.pom",
+              "<groupId>org.example</groupId><artifactId>core</artifactId><version>1.0</version>\n");
+    write_pom(sub, "core-2.0.pom",
+              "<groupId>org.example</groupId><artifactId>core</artifactId><version>2.0</version>\n"
+              "<dependencies>\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>logging</artifactId>\n"
+              "    <version>1.2</version></dependency>\n"
+              "  <dependency><groupId>org.example</groupId><artifactId>optional-dep</artifactId>\n"
+              "    <version>1</version><optional>true</optional></dependency>\n"
+              "</dependencies>\n");
+    write_pom(sub, "logging-1.2.pom",
+              "<groupId>org.example</groupId><artifactId>logging</artifactId><version>1.2</version>\n"
+              "<dependencies><dependency><groupId>org.example</groupId><artifactId>core</artifactId>\n"
+              "  <version>2.0</version></dependency></dependencies>\n");
+    write_pom(sub, "logging-1.10.pom",
+              "<groupId>org.example</groupId><artifactId>logging</artifactId><version>1.10</version>\n");
+    write_pom(sub, "json-3.pom", "<groupId>org.example</groupId><artifactId>json</artifactId><version>3</version>\n");
+    write_pom(sub, "junit-4.pom", "<groupId>org.example</groupId><artifactId>junit</artifactId><version>4</version>\n");
+    write_pom(sub, "optional-dep-1.pom",
+              "<groupId>org.example</groupId><artifactId>optional-dep</artifactId><version>1</version>\n");
+    write_pom(sub, "broken.pom", "<artifactId>nogroup</artifactId>\n");
+    write_pom(sub, "notes.txt", "<groupId>x</groupId><artifactId>y</artifactId><version>1</version>\n");
+
+    DepIndexBuildStats stats;
+    CHECK(dep_index_build(repo, index_path, &stats) == STATUS_SUCCESS);
+    CHECK(stats.poms == 10 && stats.skipped == 1);
+    CHECK(stats.artifacts == 7 && stats.versions == 9);
+    CHECK(stats.unresolved == 1);
+
+    DepIndex *index = dep_index_open(index_path);
+    CHECK(index != NULL);
+    if (!index) return;
+    CHECK(dep_index_find(index, "org.example:ghost", 17) == -1);
+    long logging = dep_index_find(index, "org.example:logging", 19);
+    CHECK(logging >= 0);
+    char coords[128];
+    if (logging >= 0) {
+        CHECK(strcmp(dep_index_coordinates(index, dep_index_version(index, (uint32_t)logging, NULL), coords,
+                                           sizeof(coords)), "org.example:logging:1.10") == 0);
+        CHECK(strcmp(dep_index_coordinates(index, dep_index_version(index, (uint32_t)logging, "1.2"), coords,
+                                           sizeof(coords)), "org.example:logging:1.2") == 0);
+    }
+
+    DepResolver resolver;
+    CHECK(dep_resolver_init(&resolver, index) == STATUS_SUCCESS);
+    static const char json[] =
+        "{\"name\": \"demo\", \"dependencies\": [\n"
+        "  {\"groupId\": \"org.example\", \"artifactId\": \"app\", \"version\": \"1.0\"},\n"
+        "  \"org.example:json:3\",\n"
+        "  {\"groupId\": \"com.nowhere\", \"artifactId\": \"gone\"}\n"
+        "]}";
+    for (int round = 0; round < 2; round++) {
+        CHECK(dep_resolver_resolve_json(&resolver, json, sizeof(json) - 1) == STATUS_SUCCESS);
+        CHECK(resolver.missing == 1);
+        CHECK(resolver.count == 5);
+        static const char *expected[] = {"org.example:app:1.0", "org.example:json:3", "org.example:web:1.0",
+                                         "org.example:core:2.0", "org.example:logging:1.10"};
+        for (size_t i = 0; i < resolver.count && i < 5; i++) {
+            CHECK(strcmp(dep_index_coordinates(index, resolver.versions[i], coords, sizeof(coords)),
+                         expected[i]) == 0);
+        }
+    }
+
+    // From core alone the cycle back through logging ends at core
+    long core = dep_index_find(index, "org.example:core", 16);
+    uint32_t root_version = dep_index_version(index, (uint32_t)core, "2.0");
+    CHECK(dep_resolver_resolve(&resolver, &root_version, 1) == STATUS_SUCCESS);
+    CHECK(resolver.count == 2);
+    CHECK(dep_resolver_resolve_json(&resolver, "{\"dependencies\": [", 18) == STATUS_ERROR);
+    dep_resolver_free(&resolver);
+    dep_index_close(index);
+
+    // Truncated and corrupt files are refused
+    FILE *file = fopen(index_path, "r+b");
+    if (file) {
+        CHECK(fseek(file, 16, SEEK_SET) == 0);
+        fputc(0x7f, file);
+        fclose(file);
+    }
+    CHECK(dep_index_open(index_path) == NULL);
+    CHECK(truncate(index_path, 20) == 0);
+    CHECK(dep_index_open(index_path) == NULL);
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int main(void) {
+    test_version_order();
+    test_build_and_resolve();
+    printf("test_depindex: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_filegen.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void remove_tree(const char *root) {
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int file_equals(const char *root, const char *path, const char *expected, size_t length) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE *file = fopen(full, "rb");
+    if (!file) return 0;
+    char *data = malloc(length + 1);
+    size_t n = fread(data, 1, length + 1, file);
+    fclose(file);
+    int equal = n == length && memcmp(data, expected, length) == 0;
+    free(data);
+    return equal;
+}
+
+static int is_dir(const char *root, const char *path) {
+    char full[512];
+    struct stat st;
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    return stat(full, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void test_plan(void) {
+    ProjectPlan plan;
+    project_plan_init(&plan);
+    CHECK(project_plan_add_file(&plan, "src/main/java/App.java", "x", 1) == STATUS_SUCCESS);
+    CHECK(project_plan_add_dir(&plan, "src/main/") == STATUS_SUCCESS);
+    CHECK(project_plan_add_file(&plan, "src/main/resources/app.yml", "y", 1) == STATUS_SUCCESS);
+    CHECK(plan.dir_count == 4 && plan.file_count == 2);
+
+    // Every directory comes before what it contains
+    for (size_t i = 0; i < plan.count; i++) {
+        const char *slash = strrchr(plan.entries[i].path, '/');
+        if (!slash) continue;
+        size_t parent = plan.count;
+        for (size_t j = 0; j < plan.count; j++) {
+            if (plan.entries[j].is_dir && strlen(plan.entries[j].path) == (size_t)(slash - plan.entries[i].path) &&
+                strncmp(plan.entries[j].path, plan.entries[i].path, (size_t)(slash - plan.entries[i].path)) == 0) {
+                parent = j;
+            }
+        }
+        CHECK(parent < i);
+    }
+
+    CHECK(project_plan_add_file(&plan, "src/main/java/App.java", "zz", 2) == STATUS_SUCCESS);
+    CHECK(plan.file_count == 2);
+    CHECK(project_plan_add_dir(&plan, "src/main/java/App.java") == STATUS_ERROR);
+    CHECK(project_plan_add_file(&plan, "src/main", "x", 1) == STATUS_ERROR);
+
+    CHECK(project_plan_add_file(&plan, "../escape", "x", 1) == STATUS_ERROR);
+    CHECK(project_plan_add_file(&plan, "/etc/passwd", "x", 1) == STATUS_ERROR);
+    CHECK(project_plan_add_file(&plan, "a//b", "x", 1) == STATUS_ERROR);
+    CHECK(project_plan_add_file(&plan, "a/./b", "x", 1) == STATUS_ERROR);
+    CHECK(project_plan_add_dir(&plan, "a/..") == STATUS_ERROR);
+    CHECK(project_plan_add_file(&plan, "", "x", 1) == STATUS_ERROR);
+    CHECK(plan.count == 6);
+    project_plan_free(&plan);
+}
+
+static void test_write(FileGenBackend backend) {
+    char root[] = "/tmp/kk_filegen_XXXXXX";
+    if (!mkdtemp(root)) {
+        CHECK(0);
+        return;
+    }
+    char target[64];
+    snprintf(target, sizeof(target), "%s/out/project", root);
+
+    // Enough files to fill several io_uring batches per worker
+    ProjectPlan plan;
+    project_plan_init(&plan);
+    char *contents[300];
+    for (int i = 0; i < 300; i++) {
+        char path[64];
+        contents[i] = malloc(64 + (size_t)i * 50);
+        size_t length = (size_t)snprintf(contents[i], 64, "file %d\n", i);
+        memset(contents[i] + length, 'a' + i % 26, (size_t)i * 50);
+        snprintf(path, sizeof(path), "pkg%d/sub%d/File%d.java", i % 7, i % 3, i);
+        CHECK(project_plan_add_file(&plan, path, contents[i], length + (size_t)i * 50) == STATUS_SUCCESS);
+    }
+    CHECK(project_plan_add_file(&plan, "empty.txt", "", 0) == STATUS_SUCCESS);
+    CHECK(project_plan_add_dir(&plan, "docs/empty") == STATUS_SUCCESS);
+
+    FileGenOptions options = {.threads = 3, .backend = backend, .queue_depth = 8};
+    FileGenStats stats;
+    CHECK(file_generator_write(&plan, target, &options, &stats) == STATUS_SUCCESS);
+    CHECK(stats.files == 301);
+    CHECK(stats.dirs == plan.dir_count);
+    if (backend == FILEGEN_BACKEND_PWRITE) {
+        CHECK(stats.backend == FILEGEN_BACKEND_PWRITE);
+    }
+    for (size_t i = 0; i < plan.count; i++) {
+        const PlanEntry *entry = &plan.entries[i];
+        if (entry->is_dir) {
+            CHECK(is_dir(target, entry->path));
+        } else {
+            CHECK(file_equals(target, entry->path, entry->content, entry->length));
+        }
+    }
+    CHECK(is_dir(target, "docs/empty"));
+
+    // Writing again truncates what is there
+    CHECK(project_plan_add_file(&plan, "pkg0/sub0/File0.java", "short", 5) == STATUS_SUCCESS);
+    CHECK(file_generator_write(&plan, target, &options, NULL) == STATUS_SUCCESS);
+    CHECK(file_equals(target, "pkg0/sub0/File0.java", "short", 5));
+
+    // A trailing slash names the same root; an empty one is refused
+    char slashed[80];
+    snprintf(slashed, sizeof(slashed), "%s//", target);
+    CHECK(file_generator_write(&plan, slashed, &options, NULL) == STATUS_SUCCESS);
+    CHECK(file_generator_write(&plan, "", &options, NULL) == STATUS_ERROR);
+
+    project_plan_free(&plan);
+    for (int i = 0; i < 300; i++) {
+        free(contents[i]);
+    }
+    remove_tree(root);
+}
+
+int main(void) {
+    test_plan();
+    test_write(FILEGEN_BACKEND_PWRITE);
+    test_write(FILEGEN_BACKEND_IO_URING);
+    test_write(FILEGEN_BACKEND_AUTO);
+    printf("test_filegen: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
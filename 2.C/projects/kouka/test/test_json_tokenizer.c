@@ -0,0 +1,160 @@
+#include "common.h"
+#include "kk_json_tokenizer.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Collected {
+    int count;
+    char text[1024];
+    size_t length;
+    JsonTokenType last_type;
+} Collected;
+
+static void collect(const JsonToken *token, void *user_data) {
+    Collected *c = (Collected *)user_data;
+    c->count++;
+    c->last_type = token->type;
+    if (token->value && c->length + token->length + 1 < sizeof(c->text)) {
+        memcpy(c->text + c->length, token->value, token->length);
+        c->length += token->length;
+        c->text[c->length] = '\0';
+    }
+}
+
+static void test_ollama_generate_fields(void) {
+    const char *stream =
+        "{\"model\":\"qwen\",\"response\":\"Hel\",\"done\":false}\n"
+        "{\"model\":\"qwen\",\"response\":\"lo\",\"done\":false}\n"
+        "{\"model\":\"qwen\",\"response\":\"\",\"done\":true,\"context\":[1,2,3],"
+        "\"eval_count\":290,\"eval_duration\":4709213000}\n";
+    Collected response = {0}, done = {0}, context = {0}, context_items = {0}, eval_count = {0};
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    json_tokenizer_subscribe(&tok, "$.response", collect, &response);
+    json_tokenizer_subscribe(&tok, "$.done", collect, &done);
+    json_tokenizer_subscribe(&tok, "$.context", collect, &context);
+    json_tokenizer_subscribe(&tok, "$.context[*]", collect, &context_items);
+    json_tokenizer_subscribe(&tok, "$.eval_count", collect, &eval_count);
+    // Odd-sized pieces so tokens straddle chunk boundaries
+    for (size_t off = 0; off < strlen(stream); off += 7) {
+        size_t n = strlen(stream) - off < 7 ? strlen(stream) - off : 7;
+        CHECK(json_tokenizer_feed(&tok, stream + off, n) == STATUS_SUCCESS);
+    }
+    CHECK(json_tokenizer_at_boundary(&tok));
+    CHECK(response.count == 3);
+    CHECK(strcmp(response.text, "Hello") == 0);
+    CHECK(done.count == 3 && done.last_type == JSON_TOKEN_TRUE);
+    CHECK(context.count == 2 && context.last_type == JSON_TOKEN_ARRAY_END);
+    CHECK(context_items.count == 3 && strcmp(context_items.text, "123") == 0);
+    CHECK(eval_count.count == 1 && strcmp(eval_count.text, "290") == 0);
+    json_tokenizer_free(&tok);
+}
+
+static void capture_int(const JsonToken *token, void *user_data) {
+    json_token_to_int64(token, (long long *)user_data);
+}
+
+static void test_chat_tool_calls(void) {
+    const char *chunk =
+        "{\"message\":{\"role\":\"assistant\",\"content\":\"\",\"tool_calls\":["
+        "{\"function\":{\"name\":\"read_file\",\"arguments\":{\"path\":\"pom.xml\"}}},"
+        "{\"function\":{\"name\":\"list_dir\",\"arguments\":{}}}]},"
+        "\"done\":true,\"eval_duration\":4709213000}\n";
+    Collected names = {0}, content = {0}, args = {0};
+    long long eval_duration = 0;
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    json_tokenizer_subscribe(&tok, "$.message.content", collect, &content);
+    json_tokenizer_subscribe(&tok, "$.message.tool_calls[*].function.name", collect, &names);
+    json_tokenizer_subscribe(&tok, "$.message.tool_calls[*].function.arguments.path", collect, &args);
+    json_tokenizer_subscribe(&tok, "$.eval_duration", capture_int, &eval_duration);
+    CHECK(json_tokenizer_feed(&tok, chunk, strlen(chunk)) == STATUS_SUCCESS);
+    CHECK(content.count == 1 && content.length == 0);
+    CHECK(names.count == 2 && strcmp(names.text, "read_filelist_dir") == 0);
+    CHECK(args.count == 1 && strcmp(args.text, "pom.xml") == 0);
+    CHECK(eval_duration == 4709213000LL);
+    json_tokenizer_free(&tok);
+}
+
+// Every split point of a \u escape and a surrogate pair must decode the same.
+static void test_unicode_across_chunks(void) {
+    const char *doc = "{\"response\":\"\\u00e9\\uD83D\\uDE00\\u0041\"}";
+    const char *expected = "\xc3\xa9\xf0\x9f\x98\x80" "A";
+    for (size_t cut = 1; cut < strlen(doc); cut++) {
+        Collected response = {0};
+        JsonTokenizer tok;
+        json_tokenizer_init(&tok);
+        json_tokenizer_subscribe(&tok, "$.response", collect, &response);
+        CHECK(json_tokenizer_feed(&tok, doc, cut) == STATUS_SUCCESS);
+        CHECK(json_tokenizer_feed(&tok, doc + cut, strlen(doc) - cut) == STATUS_SUCCESS);
+        CHECK(response.count == 1 && strcmp(response.text, expected) == 0);
+        json_tokenizer_free(&tok);
+    }
+}
+
+static void test_errors_and_reset(void) {
+    static const char *bad[] = {
+        "{\"a\":}", "[1,]", "{\"a\" 1}", "tru", "{\"a\":01}", "\"\\x\"", "\"\\u12G4\"", "]",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        JsonTokenizer tok;
+        json_tokenizer_init(&tok);
+        int status = json_tokenizer_feed(&tok, bad[i], strlen(bad[i]));
+        if (status == STATUS_SUCCESS) {
+            // Truncated input is only an error once the next value starts
+            status = json_tokenizer_feed(&tok, " {}", 3);
+        }
+        CHECK(status == STATUS_ERROR);
+        CHECK(tok.error != NULL);
+        json_tokenizer_reset(&tok);
+        CHECK(json_tokenizer_feed(&tok, "{\"ok\":[true,null,-1.5e3]}\n", 26) == STATUS_SUCCESS);
+        CHECK(json_tokenizer_at_boundary(&tok));
+        json_tokenizer_free(&tok);
+    }
+}
+
+static void test_finish(void) {
+    Collected all = {0};
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    json_tokenizer_subscribe(&tok, NULL, collect, &all);
+    // A top-level number has no delimiter until end of input
+    CHECK(json_tokenizer_feed(&tok, "42", 2) == STATUS_SUCCESS);
+    CHECK(all.count == 0);
+    CHECK(json_tokenizer_finish(&tok) == STATUS_SUCCESS);
+    CHECK(all.count == 1 && all.last_type == JSON_TOKEN_NUMBER && strcmp(all.text, "42") == 0);
+    CHECK(json_tokenizer_at_boundary(&tok));
+
+    // The last NDJSON line without its newline
+    all = (Collected){0};
+    json_tokenizer_reset(&tok);
+    const char *stream = "{\"a\":1}\n7";
+    CHECK(json_tokenizer_feed(&tok, stream, strlen(stream)) == STATUS_SUCCESS);
+    CHECK(all.count == 3 && strcmp(all.text, "1") == 0);
+    CHECK(json_tokenizer_finish(&tok) == STATUS_SUCCESS);
+    CHECK(all.count == 4 && all.last_type == JSON_TOKEN_NUMBER && strcmp(all.text, "17") == 0);
+    CHECK(json_tokenizer_finish(&tok) == STATUS_SUCCESS);
+    CHECK(all.count == 4);
+    json_tokenizer_free(&tok);
+
+    static const char *open[] = {"\"abc", "\"a\\", "\"\\u12", "tru", "{\"a\":1", "[1,2", "-"};
+    for (size_t i = 0; i < sizeof(open) / sizeof(open[0]); i++) {
+        json_tokenizer_init(&tok);
+        CHECK(json_tokenizer_feed(&tok, open[i], strlen(open[i])) == STATUS_SUCCESS);
+        CHECK(json_tokenizer_finish(&tok) == STATUS_ERROR);
+        CHECK(tok.error != NULL);
+        json_tokenizer_free(&tok);
+    }
+}
+
+int main(void) {
+    test_ollama_generate_fields();
+    test_chat_tool_calls();
+    test_unicode_across_chunks();
+    test_errors_and_reset();
+    test_finish();
+    printf("test_json_tokenizer: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
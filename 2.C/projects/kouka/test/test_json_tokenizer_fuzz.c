@@ -0,0 +1,120 @@
+#include "common.h"
+#include "kk_json_tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+// Differential fuzz harness: the token stream (type, path, value) and the
+// error position must not depend on how the input is split into chunks.
+// Built normally it replays test/fuzz_corpus; built with -DKK_LIBFUZZER and
+// clang's -fsanitize=fuzzer it becomes a libFuzzer target (make fuzz).
+
+#define CORPUS_DIR "test/fuzz_corpus"
+
+typedef struct Digest {
+    unsigned long long hash;
+    size_t tokens;
+} Digest;
+
+static void mix(Digest *d, const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < length; i++) {
+        d->hash = (d->hash ^ p[i]) * 1099511628211ull;
+    }
+}
+
+static void digest_token(const JsonToken *token, void *user_data) {
+    Digest *d = (Digest *)user_data;
+    int type = (int)token->type;
+    mix(d, &type, sizeof(type));
+    mix(d, token->path, token->path_length);
+    if (token->value) {
+        mix(d, token->value, token->length);
+    }
+    d->tokens++;
+}
+
+typedef struct RunResult {
+    Digest digest;
+    int failed;
+    size_t error_offset;
+} RunResult;
+
+// split == 0 feeds everything at once; otherwise pieces of pseudo-random
+// length up to split bytes.
+static RunResult run(const unsigned char *data, size_t size, size_t split, unsigned seed) {
+    RunResult result = {{1469598103934665603ull, 0}, 0, 0};
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    json_tokenizer_subscribe(&tok, NULL, digest_token, &result.digest);
+    size_t off = 0;
+    while (off < size && !result.failed) {
+        size_t n = size - off;
+        if (split) {
+            seed = seed * 1103515245u + 12345u;
+            size_t piece = 1 + (seed >> 16) % split;
+            if (piece < n) n = piece;
+        }
+        result.failed = json_tokenizer_feed(&tok, (const char *)data + off, n) != STATUS_SUCCESS;
+        off += n;
+    }
+    result.error_offset = tok.error_offset;
+    json_tokenizer_free(&tok);
+    return result;
+}
+
+static int check_input(const unsigned char *data, size_t size) {
+    RunResult whole = run(data, size, 0, 0);
+    static const size_t splits[] = {1, 3, 17, 64};
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+        RunResult pieces = run(data, size, splits[i], (unsigned)(size + i));
+        if (pieces.failed != whole.failed || pieces.error_offset != whole.error_offset ||
+            pieces.digest.hash != whole.digest.hash || pieces.digest.tokens != whole.digest.tokens) {
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+#ifdef KK_LIBFUZZER
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size) {
+    if (check_input(data, size) != STATUS_SUCCESS) {
+        abort();
+    }
+    return 0;
+}
+#else
+int main(int argc, char *argv[]) {
+    const char *dir_path = argc > 1 ? argv[1] : CORPUS_DIR;
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        perror(dir_path);
+        return 1;
+    }
+    int inputs = 0, failures = 0;
+    struct dirent *entry;
+    char path[1024];
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        FILE *f = fopen(path, "rb");
+        if (!f) continue;
+        unsigned char buf[1 << 16];
+        size_t size = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+        inputs++;
+        // Every prefix too, so truncated documents get exercised
+        for (size_t len = 0; len <= size; len += (len < 256 ? 1 : 97)) {
+            if (check_input(buf, len) != STATUS_SUCCESS) {
+                fprintf(stderr, "%s: chunking changed the result (prefix %zu)\n", entry->d_name, len);
+                failures++;
+                break;
+            }
+        }
+    }
+    closedir(dir);
+    printf("test_json_tokenizer_fuzz: %d inputs, %d failures\n", inputs, failures);
+    return failures == 0 && inputs > 0 ? 0 : 1;
+}
+#endif
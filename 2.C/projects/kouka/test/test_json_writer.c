@@ -0,0 +1,139 @@
+#include "common.h"
+#include "kk_json_writer.h"
+#include "kk_json_tokenizer.h"
+#include "kk_scan.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Decoded {
+    char *text;
+    size_t length;
+    int strings;
+} Decoded;
+
+static void decode_string(const JsonToken *token, void *user_data) {
+    Decoded *decoded = (Decoded *)user_data;
+    if (token->type != JSON_TOKEN_STRING) return;
+    decoded->strings++;
+    decoded->text = realloc(decoded->text, token->length + 1);
+    memcpy(decoded->text, token->value, token->length + 1);
+    decoded->length = token->length;
+}
+
+// Writes value as {"prompt": value} and parses it back.
+static int round_trips(const char *value, size_t length) {
+    JsonWriter writer;
+    json_writer_init(&writer, NULL, 0);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "prompt");
+    json_writer_string(&writer, value, length);
+    json_writer_end_object(&writer);
+
+    Decoded decoded = {0};
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    json_tokenizer_subscribe(&tok, "$.prompt", decode_string, &decoded);
+    int ok = json_writer_status(&writer) == STATUS_SUCCESS &&
+             json_tokenizer_feed(&tok, writer.data, writer.length) == STATUS_SUCCESS &&
+             json_tokenizer_at_boundary(&tok) && decoded.strings == 1 && decoded.length == length &&
+             memcmp(decoded.text, value, length) == 0;
+    json_tokenizer_free(&tok);
+    json_writer_free(&writer);
+    free(decoded.text);
+    return ok;
+}
+
+static void test_escapes(void) {
+    char storage[256];
+    JsonWriter writer;
+    json_writer_init(&writer, storage, sizeof(storage));
+    static const char raw[] = "q\" b\\ n\n r\r t\t b\b f\f \x01\x1f \x7f \xc3\xa9";
+    json_writer_string(&writer, raw, sizeof(raw) - 1);
+    CHECK(strcmp(writer.data, "\"q\\\" b\\\\ n\\n r\\r t\\t b\\b f\\f \\u0001\\u001f \x7f \xc3\xa9\"") == 0);
+    CHECK(!writer.owns_data);
+    json_writer_free(&writer);
+
+    char all[256];
+    for (int i = 0; i < 256; i++) all[i] = (char)i;
+    CHECK(round_trips(all, sizeof(all)));
+    CHECK(round_trips("", 0));
+}
+
+static void test_structure_and_commas(void) {
+    JsonWriter writer;
+    json_writer_init(&writer, NULL, 0);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "model");
+    json_writer_string(&writer, "qwen", 4);
+    json_writer_key(&writer, "stream");
+    json_writer_bool(&writer, 0);
+    json_writer_key(&writer, "context");
+    json_writer_begin_array(&writer);
+    json_writer_int(&writer, 1);
+    json_writer_int(&writer, -2);
+    json_writer_begin_object(&writer);
+    json_writer_end_object(&writer);
+    json_writer_end_array(&writer);
+    json_writer_key(&writer, "options");
+    json_writer_raw(&writer, "{\"temperature\":0}", 17);
+    json_writer_end_object(&writer);
+    CHECK(json_writer_status(&writer) == STATUS_SUCCESS);
+    CHECK(strcmp(writer.data, "{\"model\":\"qwen\",\"stream\":false,\"context\":[1,-2,{}],"
+                              "\"options\":{\"temperature\":0}}") == 0);
+
+    // Reset keeps the buffer for the next body
+    char *data = writer.data;
+    json_writer_reset(&writer);
+    json_writer_begin_array(&writer);
+    json_writer_end_array(&writer);
+    CHECK(writer.data == data && strcmp(writer.data, "[]") == 0);
+
+    json_writer_end_array(&writer);
+    CHECK(json_writer_status(&writer) == STATUS_ERROR);
+    json_writer_free(&writer);
+}
+
+// Escapes on both sides of 64-byte block edges, under every scan ISA, and
+// a large prompt that has to move from the stack storage to the heap.
+static void test_long_strings(void) {
+    size_t length = 200 * 1024;
+    char *value = malloc(length);
+    unsigned seed = 12345;
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = (seed >> 16) % 100;
+        value[i] = r < 3 ? '"' : r < 6 ? '\n' : r < 8 ? '\\' : r < 9 ? '\x02' : (char)('a' + r % 26);
+    }
+    for (size_t i = 60; i < 70; i++) value[i] = '"';
+
+    ScanIsa best = scan_active_isa();
+    for (int isa = SCAN_ISA_SCALAR; isa <= (int)best; isa++) {
+        scan_select_isa((ScanIsa)isa);
+        CHECK(round_trips(value, length));
+        for (size_t n = 0; n < 200; n++) {
+            CHECK(round_trips(value + 7, n));
+        }
+    }
+    scan_select_isa(best);
+
+    char storage[64];
+    JsonWriter writer;
+    json_writer_init(&writer, storage, sizeof(storage));
+    json_writer_string(&writer, "short", 5);
+    json_writer_string(&writer, value, length);
+    CHECK(writer.owns_data);
+    CHECK(strncmp(writer.data, "\"short\",\"", 9) == 0);
+    CHECK(writer.length > length);
+    json_writer_free(&writer);
+    free(value);
+}
+
+int main(void) {
+    test_escapes();
+    test_structure_and_commas();
+    test_long_strings();
+    printf("test_json_writer: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include "kk_json.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Capture {
+    const char *chunk;      // chunk currently being parsed
+    size_t chunk_length;
+    int calls;
+    int slices;             // values that pointed into the chunk
+    char text[16384];
+    size_t length;
+} Capture;
+
+static void capture_value(const char *value, size_t length, void *agent_response) {
+    Capture *cap = (Capture *)agent_response;
+    cap->calls++;
+    if (cap->chunk && value >= cap->chunk && value + length <= cap->chunk + cap->chunk_length) {
+        cap->slices++;
+    }
+    if (cap->length + length < sizeof(cap->text)) {
+        memcpy(cap->text + cap->length, value, length);
+        cap->length += length;
+        cap->text[cap->length] = '\0';
+    }
+}
+
+static void feed(JsonParser *parser, Capture *cap, const char *data, size_t length) {
+    cap->chunk = data;
+    cap->chunk_length = length;
+    json_parse(parser, data, length);
+}
+
+static void test_zero_copy_slices(void) {
+    Capture cap = {0};
+    JsonParser parser;
+    json_parser_init(&parser, capture_value, &cap);
+    json_parser_set_zero_copy(&parser, 1);
+    const char *line = "{\"model\":\"m\",\"response\":\"hello\",\"done\":false}\n";
+    feed(&parser, &cap, line, strlen(line));
+    CHECK(cap.calls == 1);
+    CHECK(cap.slices == 1);
+    CHECK(strcmp(cap.text, "hello") == 0);
+    json_parser_free(&parser);
+}
+
+static void test_escapes_force_copy(void) {
+    Capture cap = {0};
+    JsonParser parser;
+    json_parser_init(&parser, capture_value, &cap);
+    json_parser_set_zero_copy(&parser, 1);
+    const char *line = "{\"response\":\"say \\\"hi\\\"\\n\",\"done\":false}\n";
+    feed(&parser, &cap, line, strlen(line));
+    CHECK(cap.calls == 1);
+    CHECK(cap.slices == 0);
+    CHECK(strcmp(cap.text, "say \"hi\"\n") == 0);
+    json_parser_free(&parser);
+}
+
+static void test_value_split_across_chunks(void) {
+    Capture cap = {0};
+    JsonParser parser;
+    json_parser_init(&parser, capture_value, &cap);
+    json_parser_set_zero_copy(&parser, 1);
+    const char *line = "{\"response\":\"split value\",\"done\":false}\n";
+    size_t cut = strlen("{\"response\":\"spl");
+    feed(&parser, &cap, line, cut);
+    feed(&parser, &cap, line + cut, strlen(line) - cut);
+    CHECK(cap.calls == 1);
+    CHECK(strcmp(cap.text, "split value") == 0);
+    json_parser_free(&parser);
+}
+
+// The old parser silently cut values at 4 KB.
+static void test_long_value_not_truncated(void) {
+    Capture cap = {0};
+    JsonParser parser;
+    size_t value_length = 10000;
+    char *line = malloc(value_length + 64);
+    int prefix = sprintf(line, "{\"response\":\"");
+    memset(line + prefix, 'x', value_length);
+    strcpy(line + prefix + value_length, "\\t\"}\n");
+    for (int zero_copy = 0; zero_copy <= 1; zero_copy++) {
+        memset(&cap, 0, sizeof(cap));
+        json_parser_init(&parser, capture_value, &cap);
+        json_parser_set_zero_copy(&parser, zero_copy);
+        // Small chunks make the value span many calls
+        for (size_t off = 0; off < strlen(line); off += 100) {
+            size_t n = strlen(line) - off < 100 ? strlen(line) - off : 100;
+            feed(&parser, &cap, line + off, n);
+        }
+        CHECK(cap.calls == 1);
+        CHECK(cap.length == value_length + 1);
+        CHECK(cap.text[value_length] == '\t');
+        json_parser_free(&parser);
+    }
+    free(line);
+}
+
+static void test_other_keys_ignored(void) {
+    Capture cap = {0};
+    JsonParser parser;
+    json_parser_init(&parser, capture_value, &cap);
+    const char *lines =
+        "{\"model\":\"res\\\"ponse\",\"response\":\"a\",\"context\":[1,{\"response\":\"no\"}],\"done\":false}\n"
+        "{\"model\":\"m\",\"response\":\"b\",\"done\":true}\n";
+    feed(&parser, &cap, lines, strlen(lines));
+    CHECK(cap.calls == 2);
+    CHECK(strcmp(cap.text, "ab") == 0);
+    json_parser_free(&parser);
+}
+
+static void test_unicode_escapes(void) {
+    Capture cap = {0};
+    JsonParser parser;
+    json_parser_init(&parser, capture_value, &cap);
+    json_parser_set_zero_copy(&parser, 1);
+    // "é", then U+1F600 as a surrogate pair, fed one byte at a time
+    const char *line = "{\"response\":\"caf\\u00e9 \\uD83D\\ude00!\"}\n";
+    for (size_t i = 0; i < strlen(line); i++) {
+        feed(&parser, &cap, line + i, 1);
+    }
+    CHECK(cap.calls == 1);
+    CHECK(strcmp(cap.text, "caf\xc3\xa9 \xf0\x9f\x98\x80!") == 0);
+    json_parser_free(&parser);
+
+    // A lone surrogate becomes U+FFFD
+    memset(&cap, 0, sizeof(cap));
+    json_parser_init(&parser, capture_value, &cap);
+    line = "{\"response\":\"\\ud83dx\"}\n";
+    feed(&parser, &cap, line, strlen(line));
+    CHECK(strcmp(cap.text, "\xef\xbf\xbdx") == 0);
+    json_parser_free(&parser);
+}
+
+int main(void) {
+    test_zero_copy_slices();
+    test_escapes_force_copy();
+    test_value_split_across_chunks();
+    test_long_value_not_truncated();
+    test_other_keys_ignored();
+    test_unicode_escapes();
+    printf("test_kk_json: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
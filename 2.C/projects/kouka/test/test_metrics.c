@@ -0,0 +1,123 @@
+#include "common.h"
+#include "kk_metrics.h"
+#include "kk_json_tokenizer.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int within(uint64_t value, uint64_t expected, double tolerance) {
+    double diff = (double)value - (double)expected;
+    if (diff < 0) diff = -diff;
+    return diff <= (double)expected * tolerance + 1;
+}
+
+static void test_histogram_precision(void) {
+    LatencyHistogram *histogram = malloc(sizeof(LatencyHistogram));
+    histogram_reset(histogram);
+    for (uint64_t v = 1; v <= 1000000; v++) {
+        histogram_record(histogram, v);
+    }
+    CHECK(histogram->count == 1000000);
+    CHECK(histogram->min == 1 && histogram->max == 1000000);
+    CHECK(within(histogram_percentile(histogram, 50), 500000, 0.035));
+    CHECK(within(histogram_percentile(histogram, 90), 900000, 0.035));
+    CHECK(within(histogram_percentile(histogram, 99), 990000, 0.035));
+    CHECK(histogram_percentile(histogram, 100) == 1000000);
+    CHECK(histogram_percentile(histogram, 0) == 1);
+
+    // Small values are exact, huge ones clamp into the last bucket
+    histogram_reset(histogram);
+    histogram_record(histogram, 3);
+    histogram_record(histogram, 5);
+    CHECK(histogram_percentile(histogram, 50) == 3);
+    histogram_record(histogram, 1ull << 62);
+    CHECK(histogram_percentile(histogram, 100) == 1ull << 62);
+
+    LatencyHistogram *other = malloc(sizeof(LatencyHistogram));
+    histogram_reset(other);
+    histogram_record(other, 1);
+    histogram_merge(histogram, other);
+    CHECK(histogram->count == 4 && histogram->min == 1);
+    free(other);
+    free(histogram);
+}
+
+// Drives a trace the way the client does: tokens arrive as the NDJSON is
+// fed, and the final record carries Ollama's own counters.
+static void test_trace_and_record(void) {
+    static const char body[] =
+        "{\"response\":\"a\",\"done\":false}\n"
+        "{\"response\":\"b\",\"done\":false}\n"
+        "{\"response\":\"\",\"done\":true,\"eval_count\":100,\"eval_duration\":2000000000}\n";
+    KkMetrics *metrics = metrics_create();
+    RequestTrace *trace = malloc(sizeof(RequestTrace));
+    request_trace_begin(trace);
+    request_trace_token(trace);
+    request_trace_token(trace);
+    request_trace_token(trace);
+    for (size_t off = 0; off < sizeof(body) - 1; off += 5) {
+        size_t n = sizeof(body) - 1 - off < 5 ? sizeof(body) - 1 - off : 5;
+        request_trace_feed(trace, body + off, n);
+    }
+    CHECK(trace->tokens == 3);
+    CHECK(trace->inter_token.count == 2);
+    CHECK(trace->eval_count == 100 && trace->eval_duration == 2000000000);
+
+    RequestTimings timings = {.dns_us = 10, .connect_us = 20, .ttfb_us = 300, .total_us = 5000};
+    metrics_record(metrics, "qwen", trace, &timings, 1);
+    metrics_record(metrics, "qwen", NULL, &timings, 0);
+    metrics_record(metrics, "llama \"3\"", NULL, NULL, 1);
+    request_trace_free(trace);
+    free(trace);
+
+    ModelMetrics *snapshot = malloc(sizeof(ModelMetrics));
+    CHECK(metrics_snapshot(metrics, "qwen", snapshot) == STATUS_SUCCESS);
+    CHECK(snapshot->requests == 2 && snapshot->failures == 1 && snapshot->tokens == 3);
+    CHECK(snapshot->eval_count == 100);
+    CHECK(histogram_percentile(&snapshot->eval_rate, 50) == 50);
+    CHECK(snapshot->latency[METRIC_TTFB].count == 2 && snapshot->latency[METRIC_TTFB].max == 300);
+    CHECK(snapshot->latency[METRIC_TTFT].count == 1);
+    CHECK(metrics_snapshot(metrics, "missing", snapshot) == STATUS_ERROR);
+    free(snapshot);
+
+    // JSON output must parse
+    FILE *out = tmpfile();
+    CHECK(metrics_write_json(metrics, out) == STATUS_SUCCESS);
+    long length = ftell(out);
+    char *json = malloc((size_t)length + 1);
+    rewind(out);
+    CHECK(fread(json, 1, (size_t)length, out) == (size_t)length);
+    json[length] = '\0';
+    fclose(out);
+    JsonTokenizer tok;
+    json_tokenizer_init(&tok);
+    CHECK(json_tokenizer_feed(&tok, json, (size_t)length) == STATUS_SUCCESS);
+    CHECK(json_tokenizer_at_boundary(&tok));
+    json_tokenizer_free(&tok);
+    CHECK(strstr(json, "\"model\":\"llama \\\"3\\\"\"") != NULL);
+    CHECK(strstr(json, "\"ttfb\":{\"count\":2,\"min\":300,\"mean\":300,\"p50\":300") != NULL);
+    free(json);
+
+    out = tmpfile();
+    CHECK(metrics_write_prometheus(metrics, out) == STATUS_SUCCESS);
+    length = ftell(out);
+    char *text = malloc((size_t)length + 1);
+    rewind(out);
+    CHECK(fread(text, 1, (size_t)length, out) == (size_t)length);
+    text[length] = '\0';
+    fclose(out);
+    CHECK(strstr(text, "kouka_requests_total{model=\"qwen\"} 2\n") != NULL);
+    CHECK(strstr(text, "kouka_requests_total{model=\"llama \\\"3\\\"\"} 1\n") != NULL);
+    CHECK(strstr(text, "kouka_ttfb_seconds{model=\"qwen\",quantile=\"0.5\"} 0.0003\n") != NULL);
+    CHECK(strstr(text, "kouka_eval_tokens_per_second_count{model=\"qwen\"} 1\n") != NULL);
+    free(text);
+    metrics_destroy(metrics);
+}
+
+int main(void) {
+    test_histogram_precision();
+    test_trace_and_record();
+    printf("test_metrics: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
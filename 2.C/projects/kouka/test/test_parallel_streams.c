@@ -0,0 +1,107 @@
+#include "common.h"
+#include "ollama_client.h"
+#include "kk_thread_pool.h"
+
+#define STREAM_COUNT      4000
+#define TOKENS_PER_STREAM 64
+#define WORKER_COUNT      8
+
+typedef struct StreamCase {
+    unsigned seed;
+    char *ndjson;
+    size_t ndjson_length;
+    char *expected;
+    int passed;
+} StreamCase;
+
+// Appends to a heap string, growing as needed.
+static void append(char **out, size_t *length, size_t *capacity, const char *text) {
+    size_t n = strlen(text);
+    while (*length + n + 1 > *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        *out = realloc(*out, *capacity);
+    }
+    memcpy(*out + *length, text, n + 1);
+    *length += n;
+}
+
+// Each stream has unique tokens, and some contain escapes, so any state
+// leaking between parsers shows up as a wrong answer.
+static void build_stream(StreamCase *sc, int index) {
+    size_t nd_len = 0, nd_cap = 0, ex_len = 0, ex_cap = 0;
+    char token[64], line[160];
+    sc->seed = (unsigned)index * 2654435761u + 1;
+    for (int t = 0; t < TOKENS_PER_STREAM; t++) {
+        if (t % 7 == 3) {
+            snprintf(line, sizeof(line), "{\"model\":\"m\",\"response\":\"\\\"s%d\\\"\\n\",\"done\":false}\n", index);
+            snprintf(token, sizeof(token), "\"s%d\"\n", index);
+        } else {
+            snprintf(line, sizeof(line), "{\"model\":\"m\",\"response\":\"t%d_%d \",\"done\":false}\n", index, t);
+            snprintf(token, sizeof(token), "t%d_%d ", index, t);
+        }
+        append(&sc->ndjson, &nd_len, &nd_cap, line);
+        append(&sc->expected, &ex_len, &ex_cap, token);
+    }
+    append(&sc->ndjson, &nd_len, &nd_cap, "{\"model\":\"m\",\"response\":\"\",\"done\":true,\"context\":[1,2,3]}\n");
+    sc->ndjson_length = nd_len;
+}
+
+// Feeds a stream through write_callback in small random-sized pieces, the
+// way curl would deliver it.
+static void parse_stream(void *arg) {
+    StreamCase *sc = (StreamCase *)arg;
+    ResponseBuffer *buffer = response_buffer_create();
+    if (!buffer) {
+        return;
+    }
+    size_t offset = 0;
+    unsigned seed = sc->seed;
+    while (offset < sc->ndjson_length) {
+        seed = seed * 1103515245u + 12345u;
+        size_t piece = 1 + (seed >> 16) % 48;
+        if (piece > sc->ndjson_length - offset) {
+            piece = sc->ndjson_length - offset;
+        }
+        write_callback(sc->ndjson + offset, 1, piece, buffer);
+        offset += piece;
+    }
+    sc->passed = buffer->parsed_response && strcmp(buffer->parsed_response, sc->expected) == 0;
+    response_buffer_free(buffer);
+}
+
+int main(void) {
+    StreamCase *cases = calloc(STREAM_COUNT, sizeof(StreamCase));
+    if (!cases) {
+        return 1;
+    }
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        build_stream(&cases[i], i);
+    }
+
+    ThreadPool *pool = thread_pool_create(WORKER_COUNT);
+    if (!pool) {
+        return 1;
+    }
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (thread_pool_submit(pool, parse_stream, &cases[i]) != STATUS_SUCCESS) {
+            return 1;
+        }
+    }
+    thread_pool_wait(pool);
+    thread_pool_destroy(pool);
+
+    int failures = 0;
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (!cases[i].passed) {
+            if (failures < 5) {
+                fprintf(stderr, "stream %d parsed incorrectly\n", i);
+            }
+            failures++;
+        }
+        free(cases[i].ndjson);
+        free(cases[i].expected);
+    }
+    free(cases);
+    printf("%d streams on %d workers: %d failures\n", STREAM_COUNT, WORKER_COUNT, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+#include "common.h"
+#include "kk_cache.h"
+#include "kk_hash.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static time_t fake_time = 1000;
+
+static time_t fake_now(void) {
+    return fake_time;
+}
+
+static int cached_equals(ResponseCache *cache, uint64_t key, const char *expected) {
+    size_t length = 0;
+    char *value = response_cache_get(cache, key, &length);
+    int equal = value && length == strlen(expected) && strcmp(value, expected) == 0;
+    free(value);
+    return equal;
+}
+
+static void test_xxh64_reference_vectors(void) {
+    CHECK(xxh64("", 0, 0) == 0xEF46DB3751D8E999ULL);
+    CHECK(xxh64("abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+    // Streaming in odd-sized pieces must match the one-shot digest
+    char data[200];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (char)(i * 31);
+    Xxh64State state;
+    xxh64_init(&state, 7);
+    for (size_t i = 0; i < sizeof(data); i += 13) {
+        xxh64_update(&state, data + i, i + 13 <= sizeof(data) ? 13 : sizeof(data) - i);
+    }
+    CHECK(xxh64_digest(&state) == xxh64(data, sizeof(data), 7));
+}
+
+static void test_key_separates_fields(void) {
+    CHECK(response_cache_key("ab", "c", NULL) != response_cache_key("a", "bc", NULL));
+    CHECK(response_cache_key("m", "p", NULL) != response_cache_key("m", "p", "{\"temperature\":0}"));
+    CHECK(response_cache_key("m", "p", NULL) == response_cache_key("m", "p", NULL));
+}
+
+static void test_lru_eviction(void) {
+    ResponseCacheConfig config = {.max_entries = 2};
+    ResponseCache *cache = response_cache_create(&config);
+    response_cache_put(cache, 1, "one", 3);
+    response_cache_put(cache, 2, "two", 3);
+    CHECK(cached_equals(cache, 1, "one"));  // 1 is now most recent
+    response_cache_put(cache, 3, "three", 5);
+    CHECK(cached_equals(cache, 1, "one"));
+    CHECK(!cached_equals(cache, 2, "two"));
+    CHECK(cached_equals(cache, 3, "three"));
+
+    ResponseCacheStats stats;
+    response_cache_stats(cache, &stats);
+    CHECK(stats.hits == 3);
+    CHECK(stats.misses == 1);
+    CHECK(stats.evictions == 1);
+    CHECK(stats.entries == 2);
+    CHECK(stats.bytes == 8);
+    response_cache_destroy(cache);
+}
+
+static void test_byte_limit(void) {
+    ResponseCacheConfig config = {.max_bytes = 10};
+    ResponseCache *cache = response_cache_create(&config);
+    response_cache_put(cache, 1, "aaaaaa", 6);
+    response_cache_put(cache, 2, "bbbbbb", 6);
+    CHECK(!cached_equals(cache, 1, "aaaaaa"));
+    CHECK(cached_equals(cache, 2, "bbbbbb"));
+    response_cache_put(cache, 3, "this value is too big", 21);
+    CHECK(cached_equals(cache, 2, "bbbbbb"));
+    response_cache_destroy(cache);
+}
+
+static void test_ttl(void) {
+    ResponseCacheConfig config = {.ttl_seconds = 60};
+    ResponseCache *cache = response_cache_create(&config);
+    cache->now = fake_now;
+    fake_time = 1000;
+    response_cache_put(cache, 1, "fresh", 5);
+    fake_time = 1059;
+    CHECK(cached_equals(cache, 1, "fresh"));
+    fake_time = 1060;
+    CHECK(!cached_equals(cache, 1, "fresh"));
+    ResponseCacheStats stats;
+    response_cache_stats(cache, &stats);
+    CHECK(stats.expirations == 1);
+    CHECK(stats.entries == 0);
+    response_cache_destroy(cache);
+}
+
+static void test_disk_persistence(const char *path) {
+    ResponseCacheConfig config = {.disk_path = path};
+    ResponseCache *cache = response_cache_create(&config);
+    CHECK(cache != NULL);
+    if (!cache) return;
+    response_cache_put(cache, 10, "first answer", 12);
+    response_cache_put(cache, 11, "second answer", 13);
+    response_cache_put(cache, 10, "replaced answer", 15);
+    response_cache_destroy(cache);
+
+    cache = response_cache_create(&config);
+    CHECK(cached_equals(cache, 10, "replaced answer"));
+    CHECK(cached_equals(cache, 11, "second answer"));
+    CHECK(cached_equals(cache, 10, "replaced answer"));
+    ResponseCacheStats stats;
+    response_cache_stats(cache, &stats);
+    CHECK(stats.disk_hits == 2);
+    CHECK(stats.hits == 1);
+    CHECK(stats.misses == 0);
+    response_cache_destroy(cache);
+    unlink(path);
+}
+
+// Filling past max_disk_bytes compacts away dead records, then the oldest.
+static void test_disk_size_limit(const char *path) {
+    ResponseCacheConfig config = {.max_entries = 1, .disk_path = path, .max_disk_bytes = 4096};
+    ResponseCache *cache = response_cache_create(&config);
+    char value[200];
+    memset(value, 'x', sizeof(value));
+    for (uint64_t key = 1; key <= 100; key++) {
+        value[0] = (char)('a' + key % 26);
+        response_cache_put(cache, key, value, sizeof(value));
+    }
+    ResponseCacheStats stats;
+    response_cache_stats(cache, &stats);
+    CHECK(stats.disk_bytes <= 4096);
+    size_t length;
+    char *newest = response_cache_get(cache, 99, &length);
+    CHECK(newest && length == sizeof(value) && newest[0] == 'a' + 99 % 26);
+    free(newest);
+    CHECK(response_cache_get(cache, 1, &length) == NULL);
+    response_cache_destroy(cache);
+    unlink(path);
+}
+
+// Two caches on one store, as two kk processes would open it: each sees the
+// other's appends and compactions, and never returns an answer stored under
+// another key.
+static void test_shared_store(const char *path) {
+    ResponseCacheConfig config = {.max_entries = 1, .disk_path = path, .max_disk_bytes = 4096};
+    ResponseCache *first = response_cache_create(&config);
+    ResponseCache *second = response_cache_create(&config);
+    CHECK(first != NULL && second != NULL);
+    if (!first || !second) return;
+    response_cache_put(first, 1, "from first", 10);
+    response_cache_put(second, 2, "from second", 11);
+    CHECK(cached_equals(second, 1, "from first"));
+    CHECK(cached_equals(first, 2, "from second"));
+
+    // Enough from first to compact the store under second's index
+    char value[200];
+    memset(value, 'x', sizeof(value));
+    for (uint64_t key = 10; key < 60; key++) {
+        value[0] = (char)('a' + key % 26);
+        response_cache_put(first, key, value, sizeof(value));
+    }
+    size_t length;
+    char *newest = response_cache_get(second, 59, &length);
+    CHECK(newest && length == sizeof(value) && newest[0] == 'a' + 59 % 26);
+    free(newest);
+    for (uint64_t key = 10; key < 59; key++) {
+        char *older = response_cache_get(second, key, &length);
+        CHECK(!older || (length == sizeof(value) && older[0] == (char)('a' + key % 26)));
+        free(older);
+    }
+    response_cache_put(second, 3, "after compaction", 16);
+    CHECK(cached_equals(first, 3, "after compaction"));
+
+    // Closing one shrinks the file under the other's mapping
+    response_cache_destroy(first);
+    CHECK(cached_equals(second, 3, "after compaction"));
+    response_cache_put(second, 4, "after shrink", 12);
+    CHECK(cached_equals(second, 4, "after shrink"));
+    response_cache_destroy(second);
+    unlink(path);
+}
+
+static void test_corrupt_store_is_reset(const char *path) {
+    FILE *file = fopen(path, "w");
+    fputs("definitely not a cache file", file);
+    fclose(file);
+    ResponseCacheConfig config = {.disk_path = path};
+    ResponseCache *cache = response_cache_create(&config);
+    CHECK(cache != NULL);
+    if (!cache) return;
+    size_t length;
+    CHECK(response_cache_get(cache, 1, &length) == NULL);
+    response_cache_put(cache, 1, "ok", 2);
+    CHECK(cached_equals(cache, 1, "ok"));
+    response_cache_destroy(cache);
+    unlink(path);
+}
+
+int main(void) {
+    char path[] = "/tmp/kk_cache_testXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    unlink(path);
+
+    test_xxh64_reference_vectors();
+    test_key_separates_fields();
+    test_lru_eviction();
+    test_byte_limit();
+    test_ttl();
+    test_disk_persistence(path);
+    test_disk_size_limit(path);
+    test_shared_store(path);
+    test_corrupt_store_is_reset(path);
+    printf("test_response_cache: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
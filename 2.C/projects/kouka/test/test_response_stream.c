@@ -0,0 +1,110 @@
+#include "common.h"
+#include "ollama_client.h"
+#include "check.h"
+
+#define STREAM_BYTES (64UL * 1024 * 1024)
+#define CHUNK_SIZE   (16 * 1024)
+
+typedef struct TokenCount {
+    size_t tokens;
+    size_t bytes;
+} TokenCount;
+
+static void count_token(const char *token, size_t length, void *user_data) {
+    (void)token;
+    TokenCount *count = (TokenCount *)user_data;
+    count->tokens++;
+    count->bytes += length;
+}
+
+// Feeds a 64 MB NDJSON body in curl-sized chunks that split records at
+// arbitrary points; the buffer must stay at its fixed size throughout and
+// never hold more than the partial record at the end of a chunk.
+static void test_constant_memory(void) {
+    static const char line[] = "{\"model\":\"m\",\"response\":\"token \",\"done\":false}\n";
+    size_t line_length = sizeof(line) - 1;
+    char *chunk = malloc(CHUNK_SIZE);
+    TokenCount count = {0};
+    ResponseBuffer *buffer = response_buffer_create_streaming(RESPONSE_TAIL_LIMIT, count_token, &count);
+    CHECK(buffer != NULL);
+
+    size_t sent = 0, line_pos = 0;
+    while (sent < STREAM_BYTES) {
+        for (size_t i = 0; i < CHUNK_SIZE; i++) {
+            chunk[i] = line[line_pos];
+            line_pos = (line_pos + 1) % line_length;
+        }
+        CHECK(write_callback(chunk, 1, CHUNK_SIZE, buffer) == CHUNK_SIZE);
+        CHECK(buffer->allocated_size == RESPONSE_TAIL_LIMIT);
+        CHECK(buffer->size < line_length);
+        sent += CHUNK_SIZE;
+    }
+
+    CHECK(buffer->bytes_received == STREAM_BYTES);
+    CHECK(count.tokens == STREAM_BYTES / line_length);
+    CHECK(count.bytes == count.tokens * 6);
+    CHECK(buffer->parsed_length == 0);
+
+    char tail[128];
+    size_t tail_length = response_buffer_tail(buffer, tail, sizeof(tail));
+    CHECK(tail_length == line_pos);
+    CHECK(strncmp(tail, line, line_pos) == 0);
+    response_buffer_free(buffer);
+    free(chunk);
+}
+
+static void test_accumulates_without_callback(void) {
+    const char *body = "{\"response\":\"Hel\"}\n{\"response\":\"lo\"}\n{\"resp";
+    ResponseBuffer *buffer = response_buffer_create_streaming(64, NULL, NULL);
+    write_callback((void *)body, 1, strlen(body), buffer);
+    CHECK(buffer->parsed_length == 5);
+    CHECK(strcmp(buffer->parsed_response, "Hello") == 0);
+    char tail[16];
+    CHECK(response_buffer_tail(buffer, tail, sizeof(tail)) == 6);
+    CHECK(strcmp(tail, "{\"resp") == 0);
+    // parse_ollama_response is a no-op once chunks are parsed on arrival
+    CHECK(parse_ollama_response(buffer) == STATUS_SUCCESS);
+    CHECK(buffer->parsed_length == 5);
+    response_buffer_free(buffer);
+}
+
+// A record longer than the tail keeps only its newest bytes.
+static void test_ring_overwrites_oldest(void) {
+    ResponseBuffer *buffer = response_buffer_create_streaming(8, NULL, NULL);
+    write_callback("abcde", 1, 5, buffer);
+    write_callback("fghij", 1, 5, buffer);
+    char tail[16];
+    CHECK(response_buffer_tail(buffer, tail, sizeof(tail)) == 8);
+    CHECK(strcmp(tail, "cdefghij") == 0);
+    write_callback("klm", 1, 3, buffer);
+    response_buffer_tail(buffer, tail, sizeof(tail));
+    CHECK(strcmp(tail, "fghijklm") == 0);
+    write_callback("0123456789xyz", 1, 13, buffer);
+    response_buffer_tail(buffer, tail, sizeof(tail));
+    CHECK(strcmp(tail, "56789xyz") == 0);
+    response_buffer_tail(buffer, tail, 4);
+    CHECK(strcmp(tail, "xyz") == 0);
+    write_callback("xx\nnew", 1, 6, buffer);
+    response_buffer_tail(buffer, tail, sizeof(tail));
+    CHECK(strcmp(tail, "new") == 0);
+    response_buffer_free(buffer);
+}
+
+static void test_retained_mode_unchanged(void) {
+    const char *body = "{\"response\":\"a\"}\n{\"response\":\"b\"}\n";
+    ResponseBuffer *buffer = response_buffer_create();
+    write_callback((void *)body, 1, strlen(body), buffer);
+    CHECK(buffer->size == strlen(body));
+    CHECK(strcmp(buffer->data, body) == 0);
+    CHECK(strcmp(buffer->parsed_response, "ab") == 0);
+    response_buffer_free(buffer);
+}
+
+int main(void) {
+    test_constant_memory();
+    test_accumulates_without_callback();
+    test_ring_overwrites_oldest();
+    test_retained_mode_unchanged();
+    printf("test_response_stream: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
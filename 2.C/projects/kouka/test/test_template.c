@@ -0,0 +1,159 @@
+#include "common.h"
+#include "kk_template.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static TemplateValue str(const char *s) {
+    return (TemplateValue){.data = s, .length = strlen(s)};
+}
+
+static int renders(const Template *tpl, const TemplateValue *values, const char *expected) {
+    TemplateOutput out;
+    template_output_init(&out);
+    int ok = template_render(tpl, values, &out) == STATUS_SUCCESS;
+    char *text = ok ? template_output_join(&out) : NULL;
+    ok = text && strcmp(text, expected) == 0;
+    if (text && !ok) {
+        fprintf(stderr, "rendered:\n%s\nexpected:\n%s\n", text, expected);
+    }
+    free(text);
+    template_output_free(&out);
+    return ok;
+}
+
+static void test_variables(void) {
+    static const char src[] = "Hello {{ name }}, {{name}}! {{missing}}{{! ignored }}.";
+    Template *tpl = template_compile(src, sizeof(src) - 1);
+    CHECK(tpl != NULL);
+    CHECK(tpl->var_count == 2);
+    CHECK(template_var_index(tpl, "name") == 0);
+    CHECK(template_var_index(tpl, "nope") == -1);
+    TemplateValue values[2] = {0};
+    values[template_var_index(tpl, "name")] = str("kouka");
+    CHECK(renders(tpl, values, "Hello kouka, kouka! ."));
+    template_free(tpl);
+
+    tpl = template_compile("plain text", 10);
+    CHECK(tpl && tpl->op_count == 1);
+    CHECK(renders(tpl, NULL, "plain text"));
+    template_free(tpl);
+}
+
+// The pom.xml shape: a repeated dependency block and an optional one.
+static void test_sections(void) {
+    static const char src[] =
+        "<project>\n"
+        "  <artifactId>{{artifact}}</artifactId>\n"
+        "  <dependencies>\n"
+        "    {{#deps}}\n"
+        "    <dependency>{{group}}:{{artifact}}</dependency>\n"
+        "    {{/deps}}\n"
+        "    {{^deps}}\n"
+        "    <!-- none -->\n"
+        "    {{/deps}}\n"
+        "  </dependencies>\n"
+        "  {{#java}}<java>{{java}}</java>{{/java}}\n"
+        "</project>\n";
+    Template *tpl = template_compile(src, sizeof(src) - 1);
+    CHECK(tpl != NULL);
+    if (!tpl) return;
+    int artifact = template_var_index(tpl, "artifact");
+    int deps = template_var_index(tpl, "deps");
+    int group = template_var_index(tpl, "group");
+    int java = template_var_index(tpl, "java");
+    CHECK(artifact >= 0 && deps >= 0 && group >= 0 && java >= 0);
+
+    // Row 0 sets its own artifact, row 1 inherits the project's
+    TemplateValue *rows = calloc(2 * tpl->var_count, sizeof(TemplateValue));
+    TemplateValue *values = calloc(tpl->var_count, sizeof(TemplateValue));
+    rows[group] = str("org.springframework.boot");
+    rows[artifact] = str("spring-boot-starter-web");
+    rows[tpl->var_count + group] = str("com.example");
+    values[artifact] = str("demo");
+    values[java] = str("17");
+    values[deps] = (TemplateValue){.rows = rows, .row_count = 2};
+    CHECK(renders(tpl, values,
+                  "<project>\n"
+                  "  <artifactId>demo</artifactId>\n"
+                  "  <dependencies>\n"
+                  "    <dependency>org.springframework.boot:spring-boot-starter-web</dependency>\n"
+                  "    <dependency>com.example:demo</dependency>\n"
+                  "  </dependencies>\n"
+                  "  <java>17</java>\n"
+                  "</project>\n"));
+
+    values[deps].row_count = 0;
+    values[java] = str("");
+    CHECK(renders(tpl, values,
+                  "<project>\n"
+                  "  <artifactId>demo</artifactId>\n"
+                  "  <dependencies>\n"
+                  "    <!-- none -->\n"
+                  "  </dependencies>\n"
+                  "  \n"
+                  "</project>\n"));
+    free(rows);
+    free(values);
+    template_free(tpl);
+}
+
+static void test_errors(void) {
+    CHECK(template_compile("{{name", 6) == NULL);
+    CHECK(template_compile("{{}}", 4) == NULL);
+    CHECK(template_compile("{{#a}}x", 7) == NULL);
+    CHECK(template_compile("{{#a}}x{{/b}}", 13) == NULL);
+    CHECK(template_compile("x{{/a}}", 7) == NULL);
+}
+
+static void test_write_and_cache(void) {
+    TemplateCache *cache = template_cache_create();
+    static const char src[] = "{{a}}-{{b}}\n";
+    const Template *tpl = template_cache_get(cache, src, sizeof(src) - 1);
+    CHECK(tpl != NULL);
+    CHECK(template_cache_get(cache, src, sizeof(src) - 1) == tpl);
+    CHECK(template_cache_get(cache, "other", 5) != tpl);
+    CHECK(cache->count == 2);
+    for (int i = 0; i < 100; i++) {
+        char other[32];
+        int n = snprintf(other, sizeof(other), "t%d {{x}}", i);
+        CHECK(template_cache_get(cache, other, (size_t)n) != NULL);
+    }
+    CHECK(template_cache_get(cache, src, sizeof(src) - 1) == tpl);
+
+    // More iovecs than one writev takes, through a pipe
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    TemplateOutput out;
+    template_output_init(&out);
+    TemplateValue values[2] = {str("x"), str("yy")};
+    for (int i = 0; i < 1000; i++) {
+        CHECK(template_render(tpl, values, &out) == STATUS_SUCCESS);
+    }
+    CHECK(out.count == 4000 && out.bytes == 5000);
+    CHECK(template_output_write(&out, fds[1]) == STATUS_SUCCESS);
+    CHECK(out.count == 0);
+    close(fds[1]);
+    char buffer[6000];
+    size_t total = 0;
+    ssize_t n;
+    while ((n = read(fds[0], buffer + total, sizeof(buffer) - total)) > 0) {
+        total += (size_t)n;
+    }
+    close(fds[0]);
+    CHECK(total == 5000);
+    CHECK(memcmp(buffer, "x-yy\nx-yy\n", 10) == 0);
+    template_output_free(&out);
+    template_cache_destroy(cache);
+}
+
+int main(void) {
+    test_variables();
+    test_sections();
+    test_errors();
+    test_write_and_cache();
+    printf("test_template: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
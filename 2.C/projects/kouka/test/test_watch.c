@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "kk_watch.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void write_file(const char *root, const char *path, const char *content) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE *file = fopen(full, "w");
+    if (!file) {
+        failures++;
+        return;
+    }
+    fputs(content, file);
+    fclose(file);
+}
+
+static int count_lines(const char *root, const char *path) {
+    char full[512], line[256];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE *file = fopen(full, "r");
+    if (!file) return 0;
+    int lines = 0;
+    while (fgets(line, sizeof(line), file)) lines++;
+    fclose(file);
+    return lines;
+}
+
+static const char commands[] =
+    "{\"steps\": ["
+    " {\"name\": \"compile\", \"command\": \"echo x >> log/compile; touch out/classes\","
+    "  \"inputs\": [\"src/java\"], \"outputs\": [\"out/classes\"]},"
+    " {\"name\": \"docs\", \"command\": \"echo x >> log/docs\", \"inputs\": [\"doc/*.md\"]},"
+    " {\"name\": \"package\", \"command\": \"echo x >> log/package\","
+    "  \"inputs\": [\"out/classes\"], \"deps\": [\"compile\"]}"
+    "]}";
+
+// Rebuilds until the build's own writes stop producing events
+static void settle(BuildWatcher *watcher, BuildStats *stats) {
+    while (build_watcher_wait(watcher, 100) > 0) {
+        build_watcher_rebuild(watcher, stats);
+    }
+}
+
+static void test_watch(void) {
+    char root[] = "/tmp/kk_test_watch_XXXXXX";
+    if (!mkdtemp(root)) {
+        failures++;
+        return;
+    }
+    char path[512];
+    const char *dirs[] = {"src", "src/java", "src/java/app", "doc", "log", "out"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        mkdir(path, 0755);
+    }
+    write_file(root, "src/java/app/App.java", "class App {}\n");
+    write_file(root, "doc/guide.md", "# Guide\n");
+    write_file(root, "commands.json", commands);
+
+    BuildWatcher watcher;
+    BuildOptions options = {.root = root, .quiet = 1};
+    snprintf(path, sizeof(path), "%s/commands.json", root);
+    CHECK(build_watcher_init(&watcher, path, &options, 10) == STATUS_SUCCESS);
+    CHECK(watcher.commands_name && strcmp(watcher.commands_name, "commands.json") == 0);
+    CHECK(watcher.watch_count == 7);
+    BuildStats stats;
+    CHECK(build_watcher_rebuild(&watcher, &stats) == STATUS_SUCCESS);
+    CHECK(stats.executed == 3);
+    settle(&watcher, &stats);
+    CHECK(stats.executed == 0);
+
+    // Nothing happening is a timeout
+    CHECK(build_watcher_wait(&watcher, 20) == 0);
+
+    // Several writes to one file coalesce into one change; steps whose
+    // inputs weren't touched aren't rescanned
+    write_file(root, "src/java/app/App.java", "class App { int x; }\n");
+    write_file(root, "src/java/app/App.java", "class App { int y; }\n");
+    CHECK(build_watcher_wait(&watcher, 1000) == 1);
+    CHECK(watcher.change_count == 1 && strcmp(watcher.changes[0], "src/java/app/App.java") == 0);
+    CHECK(build_watcher_rebuild(&watcher, &stats) == STATUS_SUCCESS);
+    CHECK(stats.executed == 2 && stats.files_hashed == 2);
+    CHECK(count_lines(root, "log/compile") == 2 && count_lines(root, "log/package") == 2);
+    CHECK(count_lines(root, "log/docs") == 1);
+    settle(&watcher, &stats);
+
+    // New directories are picked up, including files written into them
+    snprintf(path, sizeof(path), "%s/src/java/util", root);
+    mkdir(path, 0755);
+    write_file(root, "src/java/util/Strings.java", "class Strings {}\n");
+    CHECK(build_watcher_wait(&watcher, 1000) > 0);
+    CHECK(build_watcher_rebuild(&watcher, &stats) == STATUS_SUCCESS);
+    CHECK(count_lines(root, "log/compile") == 3 && count_lines(root, "log/docs") == 1);
+    settle(&watcher, &stats);
+    write_file(root, "src/java/util/Strings.java", "class Strings { }\n");
+    CHECK(build_watcher_wait(&watcher, 1000) == 1);
+    CHECK(build_watcher_rebuild(&watcher, &stats) == STATUS_SUCCESS);
+    CHECK(count_lines(root, "log/compile") == 4);
+    settle(&watcher, &stats);
+
+    // Globs, and deleting an output
+    write_file(root, "doc/api.md", "# API\n");
+    snprintf(path, sizeof(path), "%s/out/classes", root);
+    unlink(path);
+    CHECK(build_watcher_wait(&watcher, 1000) == 2);
+    CHECK(build_watcher_rebuild(&watcher, &stats) == STATUS_SUCCESS);
+    CHECK(count_lines(root, "log/docs") == 2 && count_lines(root, "log/compile") == 5);
+    settle(&watcher, &stats);
+
+    // Editing commands.json reloads the graph
+    write_file(root, "commands.json",
+               "{\"steps\": [{\"name\": \"lint\", \"command\": \"echo x >> log/lint\", \"inputs\": [\"src\"]}]}");
+    CHECK(build_watcher_wait(&watcher, 1000) > 0);
+    CHECK(watcher.reload);
+    CHECK(build_watcher_rebuild(&watcher, &stats) == STATUS_SUCCESS);
+    CHECK(watcher.graph.count == 1 && stats.executed == 1 && count_lines(root, "log/lint") == 1);
+    settle(&watcher, &stats);
+
+    // A broken commands.json keeps the graph that was there
+    write_file(root, "commands.json", "{\"steps\": [");
+    CHECK(build_watcher_wait(&watcher, 1000) > 0);
+    build_watcher_rebuild(&watcher, &stats);
+    CHECK(watcher.graph.count == 1);
+
+    build_watcher_free(&watcher);
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int main(void) {
+    test_watch();
+    printf("test_watch: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}